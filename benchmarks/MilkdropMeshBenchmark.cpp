@@ -0,0 +1,104 @@
+// Measures how per-vertex equation evaluation scales with the number of row bands (threads).
+//
+// Usage: MilkdropMeshBenchmark [preset directory] [frames]
+//
+// Every preset with per_pixel code is evaluated over the warp mesh at three mesh sizes, with 1, 2,
+// 4, 8 and 16 bands. Reported times are the average milliseconds per frame summed over all presets.
+#include "MilkdropWarpMesh.h"
+#include "PresetFileParser.hpp"
+#include "WorkerPool.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+static std::mutex s_evalMemoryMutex;
+extern "C" void projectm_eval_memory_host_lock_mutex() { s_evalMemoryMutex.lock(); }
+extern "C" void projectm_eval_memory_host_unlock_mutex() { s_evalMemoryMutex.unlock(); }
+
+namespace {
+    struct Preset {
+        std::string perPixelCode;
+        MilkdropWarpMesh::FrameInputs frame;
+    };
+
+    std::vector<Preset> LoadPresets(const std::string& directory) {
+        std::vector<Preset> presets;
+        for (const auto& entry : std::filesystem::directory_iterator(directory)) {
+            if (entry.path().extension() != ".milk") continue;
+            libprojectM::PresetFileParser parser;
+            if (!parser.Read(entry.path().string())) continue;
+            Preset preset;
+            preset.perPixelCode = parser.GetCode("per_pixel_");
+            if (preset.perPixelCode.empty()) continue;
+            for (int i = 0; i < MilkdropVars::VarCount; ++i) {
+                const auto& info = MilkdropVars::GetInfo(i);
+                preset.frame.vars[i] = info.presetKey ? parser.GetFloat(info.presetKey, info.defaultValue) : 0.0f;
+            }
+            preset.frame.vars[MilkdropVars::AspectX] = 1.0f;
+            preset.frame.vars[MilkdropVars::AspectY] = 1.0f;
+            preset.frame.vars[MilkdropVars::Bass] = preset.frame.vars[MilkdropVars::BassAtt] = 1.0f;
+            preset.frame.vars[MilkdropVars::Mid] = preset.frame.vars[MilkdropVars::MidAtt] = 1.0f;
+            preset.frame.vars[MilkdropVars::Treb] = preset.frame.vars[MilkdropVars::TrebAtt] = 1.0f;
+            preset.frame.warpScale = parser.GetFloat("fWarpScale", 1.0f);
+            presets.push_back(std::move(preset));
+        }
+        return presets;
+    }
+}
+
+int main(int argc, char** argv) {
+    const std::string directory = argc > 1 ? argv[1] : "shaders/presets";
+    const int frames = argc > 2 ? std::max(1, std::atoi(argv[2])) : 20;
+
+    std::vector<Preset> presets = LoadPresets(directory);
+    if (presets.empty()) {
+        std::fprintf(stderr, "No presets with per_pixel code found in %s\n", directory.c_str());
+        return 1;
+    }
+    std::printf("%zu presets with per_pixel code, %d frames each, %u hardware threads\n\n",
+                presets.size(), frames, std::thread::hardware_concurrency());
+
+    const int meshSizes[][2] = {{48, 36}, {96, 72}, {192, 144}};
+    const int bandCounts[] = {1, 2, 4, 8, 16};
+
+    std::printf("%-10s", "mesh");
+    for (int bands : bandCounts) std::printf("  %8d thr", bands);
+    std::printf("\n");
+
+    for (const auto& size : meshSizes) {
+        std::printf("%4dx%-5d", size[0], size[1]);
+        double serialMs = 0.0;
+        for (int bands : bandCounts) {
+            // As in MilkdropPreset: one scope the bands all run in
+            projectm_eval_global_scope* scope = projectm_eval_global_scope_create(0);
+            MilkdropWarpMesh mesh;
+            mesh.SetSize(size[0], size[1]);
+            std::vector<MilkdropWarpMesh::Vertex> vertices((size_t)mesh.GetVertexCount());
+            double totalMs = 0.0;
+            for (Preset& preset : presets) {
+                std::string error;
+                if (!mesh.Compile(preset.perPixelCode, scope, bands, error)) continue;
+                const auto start = std::chrono::steady_clock::now();
+                for (int frame = 0; frame < frames; ++frame) {
+                    preset.frame.vars[MilkdropVars::Time] = frame / 60.0f;
+                    preset.frame.warpTime = frame / 60.0f;
+                    mesh.Evaluate(preset.frame, vertices.data());
+                }
+                totalMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            }
+            std::string ignored;
+            mesh.Compile(std::string(), nullptr, bands, ignored);  // Band contexts go before their scope
+            projectm_eval_global_scope_destroy(scope);
+            const double perFrameMs = totalMs / frames;
+            if (bands == 1) serialMs = perFrameMs;
+            std::printf("  %7.2fms %4.1fx", perFrameMs, serialMs / perFrameMs);
+        }
+        std::printf("\n");
+    }
+    return 0;
+}
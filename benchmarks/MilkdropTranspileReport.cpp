@@ -0,0 +1,58 @@
+// Reports which presets' per_pixel equations translate to GLSL and so warp per pixel on the GPU.
+//
+// Usage: MilkdropTranspileReport [preset directory]
+//
+// Run from the source directory, as the shader template is read from shaders/. Every preset with
+// per_pixel code is listed as GPU or CPU with the reason it stays on the warp mesh, followed by a
+// count per reason.
+#include "MilkdropWarpShader.h"
+#include "PresetFileParser.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <filesystem>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+static std::mutex s_evalMemoryMutex;
+extern "C" void projectm_eval_memory_host_lock_mutex() { s_evalMemoryMutex.lock(); }
+extern "C" void projectm_eval_memory_host_unlock_mutex() { s_evalMemoryMutex.unlock(); }
+
+int main(int argc, char** argv) {
+    const std::string directory = argc > 1 ? argv[1] : "shaders/presets";
+
+    std::vector<std::filesystem::path> paths;
+    for (const auto& entry : std::filesystem::directory_iterator(directory)) {
+        if (entry.path().extension() == ".milk") paths.push_back(entry.path());
+    }
+    std::sort(paths.begin(), paths.end());
+
+    int total = 0;
+    int translated = 0;
+    std::map<std::string, int> reasons;
+    for (const auto& path : paths) {
+        libprojectM::PresetFileParser parser;
+        if (!parser.Read(path.string())) continue;
+        const std::string perPixelCode = parser.GetCode("per_pixel_");
+        if (perPixelCode.empty()) continue;
+        ++total;
+
+        std::string reason;
+        if (!MilkdropWarpShader::Generate(perPixelCode, reason).empty()) {
+            ++translated;
+            std::printf("GPU  %s\n", path.filename().string().c_str());
+        } else {
+            ++reasons[reason];
+            std::printf("CPU  %s: %s\n", path.filename().string().c_str(), reason.c_str());
+        }
+    }
+    if (total == 0) {
+        std::fprintf(stderr, "No presets with per_pixel code found in %s\n", directory.c_str());
+        return 1;
+    }
+
+    std::printf("\n%d of %d presets with per_pixel code run on the GPU\n", translated, total);
+    for (const auto& [reason, count] : reasons) std::printf("%5d  %s\n", count, reason.c_str());
+    return 0;
+}
@@ -0,0 +1,95 @@
+// Measures how long projectm-eval takes to compile the equations of every bundled preset.
+//
+// Usage: PresetCompileBenchmark [preset directory] [rounds]
+//
+// Each round compiles every equation block of every preset (per_frame_init, per_frame, per_pixel
+// and the custom wave and shape blocks) into a fresh context with the Milkdrop variables
+// registered, as a preset load does. Files are parsed once up front, so only compilation is timed.
+#include "MilkdropWarpMesh.h"
+#include "PresetFileParser.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <vector>
+
+static std::mutex s_evalMemoryMutex;
+extern "C" void projectm_eval_memory_host_lock_mutex() { s_evalMemoryMutex.lock(); }
+extern "C" void projectm_eval_memory_host_unlock_mutex() { s_evalMemoryMutex.unlock(); }
+
+namespace {
+    std::vector<std::vector<std::string>> LoadBlocks(const std::string& directory) {
+        std::vector<std::string> prefixes = {"per_frame_init_", "per_frame_", "per_pixel_"};
+        for (int i = 0; i < 4; ++i) {
+            for (const char* block : {"init", "per_frame", "per_point"}) {
+                prefixes.push_back("wave_" + std::to_string(i) + "_" + block);
+                prefixes.push_back("shape_" + std::to_string(i) + "_" + block);
+            }
+        }
+
+        std::vector<std::string> paths;
+        for (const auto& entry : std::filesystem::directory_iterator(directory)) {
+            if (entry.path().extension() == ".milk") paths.push_back(entry.path().string());
+        }
+        std::sort(paths.begin(), paths.end());
+
+        std::vector<std::vector<std::string>> presets;
+        for (const auto& path : paths) {
+            libprojectM::PresetFileParser parser;
+            if (!parser.Read(path)) continue;
+            std::vector<std::string> blocks;
+            for (const auto& prefix : prefixes) {
+                std::string code = parser.GetCode(prefix);
+                if (!code.empty()) blocks.push_back(std::move(code));
+            }
+            presets.push_back(std::move(blocks));
+        }
+        return presets;
+    }
+
+    // Returns the milliseconds one round took; compiled counts the blocks that compiled.
+    double CompileAll(const std::vector<std::vector<std::string>>& presets, size_t& compiled) {
+        compiled = 0;
+        const auto start = std::chrono::steady_clock::now();
+        for (const auto& blocks : presets) {
+            for (const auto& code : blocks) {
+                projectm_eval_context* context = projectm_eval_context_create(nullptr, nullptr);
+                MilkdropVars::Storage vars;
+                MilkdropVars::RegisterAll(context, vars);
+                if (projectm_eval_code* program = projectm_eval_code_compile(context, code.c_str())) {
+                    ++compiled;
+                    projectm_eval_code_destroy(program);
+                }
+                projectm_eval_context_destroy(context);
+            }
+        }
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+}
+
+int main(int argc, char** argv) {
+    const std::string directory = argc > 1 ? argv[1] : "shaders/presets";
+    const int rounds = argc > 2 ? std::max(1, std::atoi(argv[2])) : 10;
+
+    const auto presets = LoadBlocks(directory);
+    size_t blockCount = 0;
+    for (const auto& blocks : presets) blockCount += blocks.size();
+    if (blockCount == 0) {
+        std::fprintf(stderr, "No equations found in %s\n", directory.c_str());
+        return 1;
+    }
+
+    size_t compiled = 0;
+    CompileAll(presets, compiled);  // Warm-up
+    std::vector<double> times;
+    for (int round = 0; round < rounds; ++round) times.push_back(CompileAll(presets, compiled));
+    std::sort(times.begin(), times.end());
+    const double median = times[times.size() / 2];
+
+    std::printf("%zu presets, %zu equation blocks (%zu compile), median of %d rounds\n", presets.size(), blockCount, compiled, rounds);
+    std::printf("  %.2f ms per round, %.1f us per block\n", median, median * 1000.0 / blockCount);
+    return 0;
+}
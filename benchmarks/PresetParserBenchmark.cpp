@@ -0,0 +1,174 @@
+// Compares PresetFileParser, which indexes string views into the file, with the previous stream-and-map implementation.
+//
+// Usage: PresetParserBenchmark [preset directory] [rounds]
+//
+// Every preset is parsed the way a preset load does it: read the file, look up the numeric
+// settings and assemble every equation and shader block. Both parsers must produce identical
+// code blocks and values; the benchmark then reports the median time per round over all presets.
+#include "PresetFileParser.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+    // The previous parser: the file is copied into a buffer, every line into a string and every
+    // key, lower-cased, into a std::map; code blocks are assembled through a stringstream.
+    class LegacyParser {
+    public:
+        bool Read(const std::string& path) {
+            std::ifstream stream(path, std::ios_base::in | std::ios_base::binary);
+            if (!stream.good()) return false;
+            stream.seekg(0, stream.end);
+            auto fileSize = stream.tellg();
+            stream.seekg(0, stream.beg);
+            if (static_cast<size_t>(fileSize) > libprojectM::PresetFileParser::maxFileSize) return false;
+            std::vector<char> contents(fileSize);
+            stream.read(contents.data(), fileSize);
+            if (stream.fail()) return false;
+
+            size_t startPos = 0;
+            for (size_t pos = 0; pos <= contents.size(); ++pos) {
+                if (pos < contents.size() && contents[pos] == '\0') return false;
+                if (pos == contents.size() || contents[pos] == '\r' || contents[pos] == '\n') {
+                    if (pos > startPos) ParseLine(std::string(contents.begin() + startPos, contents.begin() + pos));
+                    startPos = pos + 1;
+                }
+            }
+            return !m_values.empty();
+        }
+
+        std::string GetCode(const std::string& prefix) const {
+            std::stringstream code;
+            for (int index = 1; index <= 99999; ++index) {
+                auto it = m_values.find(ToLower(prefix) + std::to_string(index));
+                if (it == m_values.end()) break;
+                std::string line = it->second;
+                if (!line.empty() && line[0] == '`') line.erase(0, 1);
+                code << line << std::endl;
+            }
+            return code.str();
+        }
+
+        float GetFloat(const std::string& key, float defaultValue) const {
+            auto it = m_values.find(ToLower(key));
+            if (it == m_values.end()) return defaultValue;
+            try {
+                return std::stof(it->second);
+            } catch (std::logic_error&) {
+                return defaultValue;
+            }
+        }
+
+    private:
+        void ParseLine(const std::string& line) {
+            auto delimiter = line.find_first_of(" =");
+            if (delimiter == std::string::npos || delimiter == 0) return;
+            m_values.emplace(ToLower(line.substr(0, delimiter)), line.substr(delimiter + 1));
+        }
+
+        static std::string ToLower(std::string text) {
+            std::transform(text.begin(), text.end(), text.begin(), [](unsigned char c) { return (char)std::tolower(c); });
+            return text;
+        }
+
+        std::map<std::string, std::string> m_values;
+    };
+
+    // Settings every preset load reads, and the blocks it assembles.
+    const char* const kSettings[] = {
+        "fDecay", "fGammaAdj", "fVideoEchoZoom", "fVideoEchoAlpha", "nVideoEchoOrientation", "fWaveAlpha",
+        "fWaveScale", "fWaveSmoothing", "fWaveParam", "fModWaveAlphaStart", "fModWaveAlphaEnd", "fWarpAnimSpeed",
+        "fWarpScale", "fZoomExponent", "fShader", "zoom", "rot", "cx", "cy", "dx", "dy", "warp", "sx", "sy",
+        "wave_r", "wave_g", "wave_b", "wave_x", "wave_y", "ob_size", "ob_r", "ob_g", "ob_b", "ob_a", "ib_size",
+        "ib_r", "ib_g", "ib_b", "ib_a", "nMotionVectorsX", "nMotionVectorsY", "mv_dx", "mv_dy", "mv_l", "mv_r",
+        "mv_g", "mv_b", "mv_a", "bTexWrap", "bDarkenCenter", "bRedBlueStereo", "bBrighten", "bDarken", "bSolarize",
+        "bInvert", "MILKDROP_PRESET_VERSION", "PSVERSION", "PSVERSION_WARP", "PSVERSION_COMP",
+    };
+    const char* const kBlocks[] = {
+        "per_frame_init_", "per_frame_", "per_pixel_", "warp_", "comp_",
+        "wave_0_init", "wave_0_per_frame", "wave_0_per_point", "shape_0_init", "shape_0_per_frame",
+    };
+
+    template <typename Parser>
+    size_t Load(Parser& parser, const std::string& path, std::vector<std::string>* blocks, std::vector<float>* settings) {
+        if (!parser.Read(path)) return 0;
+        size_t bytes = 0;
+        for (const char* setting : kSettings) {
+            const float value = parser.GetFloat(setting, -1.0f);
+            if (settings) settings->push_back(value);
+        }
+        for (const char* prefix : kBlocks) {
+            std::string code = parser.GetCode(prefix);
+            bytes += code.size();
+            if (blocks) blocks->push_back(std::move(code));
+        }
+        return bytes;
+    }
+
+    template <typename Parser>
+    double TimeRound(const std::vector<std::string>& paths, size_t& bytes) {
+        const auto start = std::chrono::steady_clock::now();
+        bytes = 0;
+        for (const auto& path : paths) {
+            Parser parser;
+            bytes += Load(parser, path, nullptr, nullptr);
+        }
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+}
+
+int main(int argc, char** argv) {
+    const std::string directory = argc > 1 ? argv[1] : "shaders/presets";
+    const int rounds = argc > 2 ? std::max(1, std::atoi(argv[2])) : 20;
+
+    std::vector<std::string> paths;
+    for (const auto& entry : std::filesystem::directory_iterator(directory)) {
+        if (entry.path().extension() == ".milk") paths.push_back(entry.path().string());
+    }
+    std::sort(paths.begin(), paths.end());
+    if (paths.empty()) {
+        std::fprintf(stderr, "No presets found in %s\n", directory.c_str());
+        return 1;
+    }
+
+    for (const auto& path : paths) {
+        LegacyParser legacy;
+        libprojectM::PresetFileParser parser;
+        std::vector<std::string> legacyBlocks, blocks;
+        std::vector<float> legacySettings, settings;
+        Load(legacy, path, &legacyBlocks, &legacySettings);
+        Load(parser, path, &blocks, &settings);
+        if (blocks != legacyBlocks || settings != legacySettings) {
+            std::fprintf(stderr, "Parsers disagree on %s\n", path.c_str());
+            return 1;
+        }
+    }
+
+    // One untimed round each, so both start with the files in the page cache.
+    size_t bytes = 0;
+    TimeRound<LegacyParser>(paths, bytes);
+    TimeRound<libprojectM::PresetFileParser>(paths, bytes);
+
+    std::vector<double> legacyTimes, times;
+    for (int round = 0; round < rounds; ++round) {
+        legacyTimes.push_back(TimeRound<LegacyParser>(paths, bytes));
+        times.push_back(TimeRound<libprojectM::PresetFileParser>(paths, bytes));
+    }
+    std::sort(legacyTimes.begin(), legacyTimes.end());
+    std::sort(times.begin(), times.end());
+    const double legacyMedian = legacyTimes[legacyTimes.size() / 2];
+    const double median = times[times.size() / 2];
+
+    std::printf("%zu presets, %.1f KB of code per round, median of %d rounds\n", paths.size(), bytes / 1024.0, rounds);
+    std::printf("  stream + std::map:       %8.2f ms  (%.1f us per preset)\n", legacyMedian, legacyMedian * 1000.0 / paths.size());
+    std::printf("  string_view + hash table:%8.2f ms  (%.1f us per preset)\n", median, median * 1000.0 / paths.size());
+    std::printf("  speedup:                  %8.2fx\n", legacyMedian / median);
+    return 0;
+}
@@ -7,6 +7,10 @@ public:
     bool Init();
     void RenderFullscreenTexture(GLuint textureID);
     static void RenderQuad();
+    // Compiles and links a program from shader files. Returns 0 (and logs) on failure.
+    static GLuint CompileProgram(const char* vertexPath, const char* fragmentPath);
+    // Same, from shader source text, e.g. a shader assembled at run time.
+    static GLuint CompileProgramSource(const char* vertexSource, const char* fragmentSource);
 
 private:
     bool setupCompositingShader();
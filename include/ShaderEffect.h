@@ -19,7 +19,7 @@ public:
     void Render() override;
     void RenderUI() override;
     GLuint GetOutputTexture() const override;
-    void ResizeFrameBuffer(int width, int height);
+    virtual void ResizeFrameBuffer(int width, int height);
 
     int GetInputPinCount() const override;
     void SetInputEffect(int pinIndex, Effect* inputEffect) override;
@@ -27,7 +27,7 @@ public:
 
     bool LoadShaderFromFile(const std::string& filePath);
     bool LoadShaderFromSource(const std::string& sourceCode);
-    void ApplyShaderCode(const std::string& newShaderCode);
+    virtual void ApplyShaderCode(const std::string& newShaderCode);
     void SetShadertoyMode(bool mode);
     bool IsShadertoyMode() const; // Added getter
 
@@ -37,6 +37,7 @@ public:
     void IncrementFrameCount() { m_frameCount++; }
     void SetAudioAmplitude(float amp);
     void SetAudioBands(const std::array<float, 4>& bands);
+    void SetBeatState(float beat, float beatPhase, float bpm);
     void SetCameraState(const glm::vec3& pos, const glm::mat4& viewMatrix);
     void SetLightPosition(const glm::vec3& pos);
 
@@ -62,6 +63,11 @@ public:
 
     static void InitializeDummyTexture();
 
+    // Internal format of every effect framebuffer, used from the next ResizeFrameBuffer. GL_RGBA16F
+    // keeps more than 8 bits per channel through the chain, for high-precision image sequences.
+    static void SetFramebufferFormat(GLenum internalFormat) { s_framebufferFormat = internalFormat; }
+    static GLenum GetFramebufferFormat() { return s_framebufferFormat; }
+
 private:
     void CompileAndLinkShader();
     void FetchUniformLocations();
@@ -77,6 +83,9 @@ private:
     void RenderEnhancedColorControl(ShaderToyUniformControl& control, const std::string& label, int components);
     void updatePaletteSync(); // REAL-TIME PALETTE SYNCHRONIZATION
 
+protected:
+    static inline GLenum s_framebufferFormat = GL_RGBA8;
+
     GLuint m_shaderProgram;
     bool m_isShadertoyMode;
     bool m_shaderLoaded;
@@ -129,6 +138,13 @@ private:
     GLint m_iCameraPositionLocation = -1;
     GLint m_iCameraMatrixLocation = -1;
     GLint m_iLightPositionLocation = -1;
+    GLint m_iBeatLocation = -1;
+    GLint m_iBeatPhaseLocation = -1;
+    GLint m_iBPMLocation = -1;
+
+    float m_beat = 0.0f;
+    float m_beatPhase = 0.0f;
+    float m_bpm = 0.0f;
 
     glm::vec3 m_cameraPosition;
     glm::mat4 m_cameraMatrix;
@@ -0,0 +1,60 @@
+#version 330 core
+// Milkdrop composite: video echo, gamma and the preset's colour filters, applied to the feedback
+// texture on its way to the effect output. The feedback itself is left untouched. While presets
+// switch, the incoming one is drawn over the outgoing one with alpha set by the blend pattern.
+out vec4 FragColor;
+
+in vec2 TexCoords;
+
+uniform sampler2D feedbackTexture;
+uniform float gamma;       // Brightness multiplier (fGammaAdj)
+uniform float echoZoom;
+uniform float echoAlpha;
+uniform int echoOrient;    // 0 normal, 1 flip x, 2 flip y, 3 both
+uniform bool brighten;
+uniform bool darken;
+uniform bool solarize;
+uniform bool invert;
+uniform float blendProgress;  // 0..1 through a preset switch, 1 otherwise
+uniform int blendPattern;     // 0 uniform, 1 radial from the centre, 2 noise
+uniform float blendSeed;      // Varies the noise pattern from one switch to the next
+
+float Hash(vec2 p)
+{
+    return fract(sin(dot(p, vec2(127.1, 311.7)) + blendSeed) * 43758.5453);
+}
+
+// Milkdrop-style blend: every pixel switches over a short window of its own, starting at the
+// pattern's value, so the incoming preset grows in rather than fading uniformly.
+float BlendAlpha(vec2 uv)
+{
+    if (blendPattern == 0) return clamp(blendProgress, 0.0, 1.0);
+    float start;
+    if (blendPattern == 1) {
+        start = clamp(length(uv - 0.5) * 1.41421, 0.0, 1.0);
+    } else {
+        vec2 cell = floor(uv * 12.0);
+        vec2 f = smoothstep(0.0, 1.0, fract(uv * 12.0));
+        start = mix(mix(Hash(cell), Hash(cell + vec2(1.0, 0.0)), f.x),
+                    mix(Hash(cell + vec2(0.0, 1.0)), Hash(cell + vec2(1.0, 1.0)), f.x), f.y);
+    }
+    const float window = 0.3;
+    return clamp((blendProgress * (1.0 + window) - start) / window, 0.0, 1.0);
+}
+
+void main()
+{
+    vec3 color = texture(feedbackTexture, TexCoords).rgb;
+    if (echoAlpha > 0.0) {
+        vec2 echoUV = (TexCoords - 0.5) / max(echoZoom, 0.001) + 0.5;
+        if (echoOrient == 1 || echoOrient == 3) echoUV.x = 1.0 - echoUV.x;
+        if (echoOrient == 2 || echoOrient == 3) echoUV.y = 1.0 - echoUV.y;
+        color = mix(color, texture(feedbackTexture, echoUV).rgb, clamp(echoAlpha, 0.0, 1.0));
+    }
+    color = clamp(color * gamma, 0.0, 1.0);
+    if (brighten) color = sqrt(color);
+    if (darken) color = color * color;
+    if (solarize) color = color * (1.0 - color) * 4.0;
+    if (invert) color = 1.0 - color;
+    FragColor = vec4(color, BlendAlpha(TexCoords));
+}
@@ -0,0 +1,18 @@
+#version 330 core
+// Feedback pass: the previous frame through the warp mesh, faded by decay.
+out vec4 FragColor;
+
+in vec2 WarpUV;
+in vec2 ScreenPos;
+
+uniform sampler2D previousFrame;
+uniform float decay;
+uniform float darkenCenter;  // 1.0 dims a small spot in the middle so feedback cannot saturate there
+
+void main()
+{
+    vec3 color = texture(previousFrame, WarpUV).rgb * decay;
+    float centerFade = 1.0 - smoothstep(0.0, 0.12, length(ScreenPos));
+    color *= 1.0 - darkenCenter * 0.1 * centerFade;
+    FragColor = vec4(color, 1.0);
+}
@@ -0,0 +1,15 @@
+#version 330 core
+// Milkdrop warp mesh: each vertex carries its clip-space position and the point of the previous
+// frame it samples, computed on the CPU by the preset's per-vertex equations.
+layout (location = 0) in vec2 aPos;
+layout (location = 1) in vec2 aWarpUV;
+
+out vec2 WarpUV;
+out vec2 ScreenPos;
+
+void main()
+{
+    gl_Position = vec4(aPos, 0.0, 1.0);
+    WarpUV = aWarpUV;
+    ScreenPos = aPos;
+}
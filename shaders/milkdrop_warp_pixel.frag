@@ -0,0 +1,65 @@
+#version 330 core
+// Feedback pass with the warp computed per pixel: the preset's per_pixel equations, translated to
+// GLSL, run here instead of at the vertices of the CPU warp mesh. MilkdropWarpShader replaces the
+// "// @" lines with the uniform arrays, the helper functions and the equations.
+out vec4 FragColor;
+
+in vec2 TexCoords;
+
+uniform sampler2D previousFrame;
+uniform float decay;
+uniform float darkenCenter;  // 1.0 dims a small spot in the middle so feedback cannot saturate there
+uniform vec2 aspect;         // aspectx, aspecty
+uniform float warpTime;      // time * fWarpAnimSpeed
+uniform float warpScaleInv;  // 1 / fWarpScale
+uniform vec4 warpFactors;    // The four warp wobble frequencies, see MilkdropWarpMesh::WarpFactors
+// @uniforms
+
+// @functions
+
+void main()
+{
+    float fx = TexCoords.x * 2.0 - 1.0;
+    float fy = TexCoords.y * 2.0 - 1.0;
+    float rad = sqrt(fx * fx * aspect.x * aspect.x + fy * fy * aspect.y * aspect.y) * 0.70710678;
+    float angle = prjm_atan2(fy * aspect.y, fx * aspect.x);
+
+    float md_x = fx * 0.5 + 0.5;
+    float md_y = -fy * 0.5 + 0.5;
+    float md_rad = rad;
+    float md_ang = angle < 0.0 ? angle + 6.28318531 : angle;
+    // @equations
+
+    // The warp, as MilkdropWarpMesh::EvaluateRows computes it at each vertex.
+    float zoom = prjm_pow(md_zoom, prjm_pow(md_zoomexp, rad * 2.0 - 1.0));
+    float zoomInv = zoom != 0.0 ? 1.0 / zoom : 1.0;
+    float u = fx * aspect.x * 0.5 * zoomInv + 0.5;
+    float v = -fy * aspect.y * 0.5 * zoomInv + 0.5;
+
+    if (md_sx != 0.0) u = (u - md_cx) / md_sx + md_cx;
+    if (md_sy != 0.0) v = (v - md_cy) / md_sy + md_cy;
+
+    if (md_warp != 0.0) {
+        u += md_warp * 0.0035 * sin(warpTime * 0.333 + warpScaleInv * (fx * warpFactors.x - fy * warpFactors.w));
+        v += md_warp * 0.0035 * cos(warpTime * 0.375 - warpScaleInv * (fx * warpFactors.z + fy * warpFactors.y));
+        u += md_warp * 0.0035 * cos(warpTime * 0.753 - warpScaleInv * (fx * warpFactors.y - fy * warpFactors.z));
+        v += md_warp * 0.0035 * sin(warpTime * 0.825 + warpScaleInv * (fx * warpFactors.x + fy * warpFactors.w));
+    }
+
+    float u2 = u - md_cx;
+    float v2 = v - md_cy;
+    float cosRot = cos(md_rot);
+    float sinRot = sin(md_rot);
+    u = u2 * cosRot - v2 * sinRot + md_cx;
+    v = u2 * sinRot + v2 * cosRot + md_cy;
+
+    u -= md_dx;
+    v -= md_dy;
+    u = (u - 0.5) / aspect.x + 0.5;
+    v = (v - 0.5) / aspect.y + 0.5;
+
+    vec3 color = texture(previousFrame, vec2(u, 1.0 - v)).rgb * decay;
+    float centerFade = 1.0 - smoothstep(0.0, 0.12, length(vec2(fx, fy)));
+    color *= 1.0 - darkenCenter * 0.1 * centerFade;
+    FragColor = vec4(color, 1.0);
+}
@@ -0,0 +1,9 @@
+#version 330 core
+out vec4 FragColor;
+
+uniform vec4 waveColor;
+
+void main()
+{
+    FragColor = waveColor;
+}
@@ -0,0 +1,56 @@
+#version 330 core
+// Packs the recorder's source texture into I420 (BT.709, limited range) in a single R8 target.
+// The target is (2 * chromaWidth) x (height + chromaHeight): rows [0, height) hold Y, and each row
+// below that holds one U row in its left half and the matching V row in its right half.
+// Row 0 is the top of the image, so a glReadPixels of the target gives top-down planes.
+out vec4 FragColor;
+
+in vec2 TexCoords;
+
+uniform sampler2D sourceTexture;
+uniform ivec2 frameSize;
+uniform ivec2 sourceSize;
+
+const vec3 kLumaWeights = vec3(0.2126, 0.7152, 0.0722);
+
+// pixel is in top-down image coordinates; clamped so odd sizes reuse the last row/column.
+// When the source is larger than the frame, the texels under the pixel are box-filtered: each
+// bilinear tap averages a 2x2 block, so taps two texels apart cover downscales up to 8x.
+vec3 sourcePixel(ivec2 pixel)
+{
+    pixel = min(pixel, frameSize - 1);
+    vec2 footprint = vec2(sourceSize) / vec2(frameSize);
+    ivec2 taps = clamp(ivec2(ceil(footprint * 0.5)), ivec2(1), ivec2(4));
+    vec2 tapStep = footprint / vec2(taps);
+    vec2 origin = vec2(pixel) * footprint;
+    vec3 sum = vec3(0.0);
+    for (int y = 0; y < taps.y; ++y) {
+        for (int x = 0; x < taps.x; ++x) {
+            vec2 texel = origin + (vec2(x, y) + 0.5) * tapStep;
+            vec2 uv = vec2(texel.x / float(sourceSize.x), 1.0 - texel.y / float(sourceSize.y));
+            sum += clamp(texture(sourceTexture, uv).rgb, 0.0, 1.0);
+        }
+    }
+    return sum / float(taps.x * taps.y);
+}
+
+void main()
+{
+    ivec2 fragPixel = ivec2(gl_FragCoord.xy);
+    ivec2 chromaSize = (frameSize + 1) / 2;
+
+    if (fragPixel.y < frameSize.y) {
+        float luma = dot(sourcePixel(fragPixel), kLumaWeights);
+        FragColor = vec4((16.0 + 219.0 * luma) / 255.0);
+        return;
+    }
+
+    // Chroma is the average of the 2x2 block it covers.
+    bool isV = fragPixel.x >= chromaSize.x;
+    ivec2 block = 2 * ivec2(isV ? fragPixel.x - chromaSize.x : fragPixel.x, fragPixel.y - frameSize.y);
+    vec3 rgb = 0.25 * (sourcePixel(block) + sourcePixel(block + ivec2(1, 0)) +
+                       sourcePixel(block + ivec2(0, 1)) + sourcePixel(block + ivec2(1, 1)));
+    float luma = dot(rgb, kLumaWeights);
+    float chroma = isV ? (rgb.r - luma) / 1.5748 : (rgb.b - luma) / 1.8556;
+    FragColor = vec4((128.0 + 224.0 * chroma) / 255.0);
+}
@@ -0,0 +1,310 @@
+#include "AudioAnalysisTrack.h"
+#include "AudioSystem.h"
+#include "BeatTracker.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <complex>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+namespace {
+    const char kCacheMagic[4] = { 'R', 'M', 'V', 'A' };
+    const uint32_t kCacheVersion = 1;
+    const int kSpectrumBins = AudioSystem::FFT_SIZE / 2;
+    const size_t kHopSize = AudioSystem::FFT_SIZE / 2; // Same hop as live analysis
+
+    // Spectrum bytes cover 100 dB of magnitude; 0 is reserved for silence.
+    const float kSpectrumMinDb = -40.0f;
+    const float kSpectrumRangeDb = 100.0f;
+
+    struct CacheHeader {
+        char magic[4];
+        uint32_t version;
+        uint32_t fpsNum;
+        uint32_t fpsDen;
+        uint32_t sampleRate;
+        uint32_t channels;
+        uint32_t fftSize;
+        uint32_t spectrumBins;
+        float beatSensitivity;
+        uint32_t reserved;
+        uint64_t sourceSize;
+        int64_t sourceMtime;
+        uint64_t frameCount;
+    };
+
+    uint8_t QuantizeMagnitude(float magnitude) {
+        if (magnitude <= 0.0f) return 0;
+        float db = 20.0f * std::log10(magnitude);
+        float q = (db - kSpectrumMinDb) / kSpectrumRangeDb * 255.0f;
+        return (uint8_t)std::clamp((int)std::lround(q), 0, 255);
+    }
+
+    float DequantizeMagnitude(uint8_t q) {
+        if (q == 0) return 0.0f;
+        return std::pow(10.0f, ((float)q / 255.0f * kSpectrumRangeDb + kSpectrumMinDb) / 20.0f);
+    }
+
+    bool GetSourceStamp(const std::string& path, uint64_t& size, int64_t& mtime) {
+        std::error_code ec;
+        size = std::filesystem::file_size(path, ec);
+        if (ec) return false;
+        auto time = std::filesystem::last_write_time(path, ec);
+        if (ec) return false;
+        mtime = (int64_t)time.time_since_epoch().count();
+        return true;
+    }
+}
+
+uint64_t AudioAnalysisTrack::FrameStartSample(uint64_t frameIndex, uint32_t sampleRate, uint32_t fpsNum, uint32_t fpsDen) {
+    if (fpsNum == 0) return 0;
+    return frameIndex * sampleRate * fpsDen / fpsNum;
+}
+
+void AudioAnalysisTrack::Clear() {
+    m_audioPath.clear();
+    m_frames.clear();
+    m_spectrum.clear();
+    m_sampleRate = 0;
+    m_channels = 0;
+}
+
+bool AudioAnalysisTrack::Matches(const std::string& audioPath, uint32_t fpsNum, uint32_t fpsDen, float beatSensitivity) const {
+    if (!IsValid() || audioPath != m_audioPath || fpsNum != m_fpsNum || fpsDen != m_fpsDen || beatSensitivity != m_beatSensitivity) {
+        return false;
+    }
+    uint64_t size = 0;
+    int64_t mtime = 0;
+    return GetSourceStamp(audioPath, size, mtime) && size == m_sourceSize && mtime == m_sourceMtime;
+}
+
+const AudioAnalysisTrack::Frame& AudioAnalysisTrack::GetFrame(uint64_t frameIndex) const {
+    static const Frame silence;
+    return frameIndex < m_frames.size() ? m_frames[frameIndex] : silence;
+}
+
+void AudioAnalysisTrack::GetSpectrum(uint64_t frameIndex, std::vector<float>& magnitudes) const {
+    magnitudes.resize(kSpectrumBins);
+    if (frameIndex >= m_frames.size()) {
+        std::fill(magnitudes.begin(), magnitudes.end(), 0.0f);
+        return;
+    }
+    const uint8_t* bytes = m_spectrum.data() + frameIndex * kSpectrumBins;
+    for (int i = 0; i < kSpectrumBins; ++i) magnitudes[i] = DequantizeMagnitude(bytes[i]);
+}
+
+bool AudioAnalysisTrack::LoadOrBuild(const std::string& audioPath, uint32_t fpsNum, uint32_t fpsDen, float beatSensitivity, std::string& error,
+                                     std::atomic<float>* progress, const std::atomic<bool>* cancel) {
+    if (Matches(audioPath, fpsNum, fpsDen, beatSensitivity)) return true;
+
+    Clear();
+    if (fpsNum == 0 || fpsDen == 0) {
+        error = "Invalid frame rate for audio analysis.";
+        return false;
+    }
+    if (!GetSourceStamp(audioPath, m_sourceSize, m_sourceMtime)) {
+        error = "Cannot stat audio file: " + audioPath;
+        return false;
+    }
+    m_audioPath = audioPath;
+    m_fpsNum = fpsNum;
+    m_fpsDen = fpsDen;
+    m_beatSensitivity = beatSensitivity;
+
+    const std::string cachePath = audioPath + ".rmvanalysis";
+    if (LoadCache(cachePath)) {
+        std::cout << "Audio analysis: loaded " << m_frames.size() << " frames from " << cachePath << std::endl;
+        return true;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    if (!Build(audioPath, error, progress, cancel)) {
+        Clear();
+        return false;
+    }
+    float seconds = std::chrono::duration<float>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "Audio analysis: analysed " << m_frames.size() << " frames at " << fpsNum << "/" << fpsDen
+              << " fps in " << seconds << " s" << std::endl;
+
+    if (!SaveCache(cachePath)) {
+        std::cerr << "Audio analysis: could not write cache " << cachePath << " (kept in memory)" << std::endl;
+    }
+    return true;
+}
+
+bool AudioAnalysisTrack::Build(const std::string& audioPath, std::string& error, std::atomic<float>* progress, const std::atomic<bool>* cancel) {
+    // A private decoder, so the pre-pass never disturbs the playback cursor.
+    ma_decoder decoder;
+    ma_decoder_config decoderConfig = ma_decoder_config_init(ma_format_f32, 0, 0);
+    if (ma_decoder_init_file(audioPath.c_str(), &decoderConfig, &decoder) != MA_SUCCESS) {
+        error = "Failed to open audio file for analysis: " + audioPath;
+        return false;
+    }
+    m_sampleRate = decoder.outputSampleRate;
+    m_channels = decoder.outputChannels;
+    if (m_sampleRate == 0 || m_channels == 0) {
+        ma_decoder_uninit(&decoder);
+        error = "Audio file has no usable format: " + audioPath;
+        return false;
+    }
+
+    BeatTracker tracker;
+    tracker.Configure((float)m_sampleRate, AudioSystem::FFT_SIZE, (float)kHopSize / (float)m_sampleRate);
+
+    ma_uint64 lengthInFrames = 0;
+    ma_decoder_get_length_in_pcm_frames(&decoder, &lengthInFrames);
+    if (lengthInFrames > 0) {
+        uint64_t expectedFrames = lengthInFrames * m_fpsNum / ((uint64_t)m_sampleRate * m_fpsDen) + 1;
+        m_frames.reserve(expectedFrames);
+        m_spectrum.reserve(expectedFrames * kSpectrumBins);
+    }
+
+    // The most recent FFT_SIZE mono samples. Tracker hops and frame boundaries both take their
+    // spectrum from it, the hops at a fixed stride and the frames wherever a frame's audio ends.
+    std::vector<float> window(AudioSystem::FFT_SIZE, 0.0f);
+    std::vector<std::complex<float>> fftScratch(AudioSystem::FFT_SIZE);
+    std::vector<float> magnitudes(kSpectrumBins, 0.0f);
+    std::array<float, 4> bands{};
+    size_t samplesSinceHop = 0;
+
+    auto pushWindow = [&window](const float* samples, size_t count) {
+        if (count >= window.size()) {
+            std::copy(samples + count - window.size(), samples + count, window.begin());
+            return;
+        }
+        std::copy(window.begin() + count, window.end(), window.begin());
+        std::copy(samples, samples + count, window.end() - count);
+    };
+
+    std::vector<float> pcm;
+    std::vector<float> mono;
+    for (uint64_t frameIndex = 0;; ++frameIndex) {
+        uint64_t begin = FrameStartSample(frameIndex, m_sampleRate, m_fpsNum, m_fpsDen);
+        if (frameIndex % 64 == 0) {
+            if (cancel && cancel->load(std::memory_order_relaxed)) {
+                ma_decoder_uninit(&decoder);
+                error = "Audio analysis cancelled.";
+                return false;
+            }
+            if (progress && lengthInFrames > 0) {
+                progress->store(std::min(1.0f, (float)begin / (float)lengthInFrames), std::memory_order_relaxed);
+            }
+        }
+        uint64_t end = FrameStartSample(frameIndex + 1, m_sampleRate, m_fpsNum, m_fpsDen);
+        ma_uint64 wanted = end - begin;
+        pcm.resize((size_t)wanted * m_channels);
+        ma_uint64 framesRead = 0;
+        ma_decoder_read_pcm_frames(&decoder, pcm.data(), wanted, &framesRead);
+        if (framesRead == 0) break;
+
+        Frame frame;
+        const size_t totalSamples = (size_t)framesRead * m_channels;
+        float sumOfAbsoluteSamples = 0.0f;
+        for (size_t i = 0; i < totalSamples; ++i) sumOfAbsoluteSamples += std::fabs(pcm[i]);
+        frame.amplitude = sumOfAbsoluteSamples / (float)totalSamples;
+
+        mono.resize((size_t)framesRead);
+        for (size_t i = 0; i < (size_t)framesRead; ++i) {
+            float sum = 0.0f;
+            for (uint32_t c = 0; c < m_channels; ++c) sum += pcm[i * m_channels + c];
+            mono[i] = sum / (float)m_channels;
+        }
+
+        // Run the beat tracker on the same hop grid as live analysis, splitting the frame's audio
+        // wherever a hop completes.
+        size_t pos = 0;
+        while (pos < mono.size()) {
+            size_t piece = std::min(mono.size() - pos, kHopSize - samplesSinceHop);
+            pushWindow(mono.data() + pos, piece);
+            pos += piece;
+            samplesSinceHop += piece;
+            if (samplesSinceHop == kHopSize) {
+                samplesSinceHop = 0;
+                AudioSystem::ComputeSpectrum(window, fftScratch, magnitudes, bands);
+                tracker.ProcessSpectrum(magnitudes);
+            }
+        }
+
+        AudioSystem::ComputeSpectrum(window, fftScratch, magnitudes, bands);
+        frame.bands = bands;
+        frame.beat = tracker.GetBeatImpulse();
+        frame.beatPhase = tracker.GetBeatPhase();
+        frame.bpm = tracker.GetBPM();
+        frame.tempoLocked = tracker.IsTempoLocked() ? 1 : 0;
+        m_frames.push_back(frame);
+        for (int i = 0; i < kSpectrumBins; ++i) m_spectrum.push_back(QuantizeMagnitude(magnitudes[i]));
+
+        if (framesRead < wanted) break;
+    }
+    ma_decoder_uninit(&decoder);
+
+    if (m_frames.empty()) {
+        error = "Audio file contains no samples: " + audioPath;
+        return false;
+    }
+    return true;
+}
+
+bool AudioAnalysisTrack::LoadCache(const std::string& cachePath) {
+    std::ifstream in(cachePath, std::ios::binary);
+    if (!in) return false;
+
+    CacheHeader header;
+    if (!in.read(reinterpret_cast<char*>(&header), sizeof(header))) return false;
+    if (std::memcmp(header.magic, kCacheMagic, sizeof(kCacheMagic)) != 0 || header.version != kCacheVersion ||
+        header.fpsNum != m_fpsNum || header.fpsDen != m_fpsDen || header.beatSensitivity != m_beatSensitivity ||
+        header.fftSize != (uint32_t)AudioSystem::FFT_SIZE || header.spectrumBins != (uint32_t)kSpectrumBins ||
+        header.sourceSize != m_sourceSize || header.sourceMtime != m_sourceMtime ||
+        header.sampleRate == 0 || header.channels == 0 || header.frameCount == 0) {
+        return false;
+    }
+
+    m_frames.resize((size_t)header.frameCount);
+    m_spectrum.resize((size_t)header.frameCount * kSpectrumBins);
+    if (!in.read(reinterpret_cast<char*>(m_frames.data()), m_frames.size() * sizeof(Frame)) ||
+        !in.read(reinterpret_cast<char*>(m_spectrum.data()), m_spectrum.size())) {
+        m_frames.clear();
+        m_spectrum.clear();
+        return false;
+    }
+    m_sampleRate = header.sampleRate;
+    m_channels = header.channels;
+    return true;
+}
+
+bool AudioAnalysisTrack::SaveCache(const std::string& cachePath) const {
+    CacheHeader header{};
+    std::memcpy(header.magic, kCacheMagic, sizeof(kCacheMagic));
+    header.version = kCacheVersion;
+    header.fpsNum = m_fpsNum;
+    header.fpsDen = m_fpsDen;
+    header.sampleRate = m_sampleRate;
+    header.channels = m_channels;
+    header.fftSize = AudioSystem::FFT_SIZE;
+    header.spectrumBins = kSpectrumBins;
+    header.beatSensitivity = m_beatSensitivity;
+    header.sourceSize = m_sourceSize;
+    header.sourceMtime = m_sourceMtime;
+    header.frameCount = m_frames.size();
+
+    // Write to a temporary name first so an interrupted write never leaves a truncated cache behind.
+    const std::string tempPath = cachePath + ".tmp";
+    {
+        std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+        if (!out) return false;
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        out.write(reinterpret_cast<const char*>(m_frames.data()), m_frames.size() * sizeof(Frame));
+        out.write(reinterpret_cast<const char*>(m_spectrum.data()), m_spectrum.size());
+        if (!out) return false;
+    }
+    std::error_code ec;
+    std::filesystem::rename(tempPath, cachePath, ec);
+    if (ec) {
+        std::filesystem::remove(tempPath, ec);
+        return false;
+    }
+    return true;
+}
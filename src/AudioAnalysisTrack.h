@@ -0,0 +1,68 @@
+#ifndef AUDIOANALYSISTRACK_H
+#define AUDIOANALYSISTRACK_H
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Audio analysis for every video frame of an offline render, computed ahead of time.
+// The file is decoded once, front to back, and analysed at the exact sample position where each
+// output frame starts, so the render looks frame N up instead of seeking the decoder and re-running
+// the FFT. Results are cached next to the audio file (<audio>.rmvanalysis) and reused as long as the
+// file, frame rate and analysis settings are unchanged, which also makes re-renders deterministic.
+class AudioAnalysisTrack {
+public:
+    // Analysis state at the end of one video frame's audio. Plain data, stored verbatim in the cache.
+    struct Frame {
+        float amplitude = 0.0f;           // Mean absolute sample value, before amplitude scaling
+        std::array<float, 4> bands{};     // Same layout as AudioSystem::GetAudioBands()
+        float beat = 0.0f;
+        float beatPhase = 0.0f;
+        float bpm = 0.0f;
+        uint32_t tempoLocked = 0;
+    };
+
+    // Loads the cache for this file and frame rate, or decodes the file and writes a new one.
+    // Returns false (with a message in error) only if the file itself couldn't be analysed or cancel
+    // was set; a cache that can't be written is reported on the console and the track is kept in
+    // memory. progress, if given, goes from 0 to 1 while the file is decoded.
+    bool LoadOrBuild(const std::string& audioPath, uint32_t fpsNum, uint32_t fpsDen, float beatSensitivity, std::string& error,
+                     std::atomic<float>* progress = nullptr, const std::atomic<bool>* cancel = nullptr);
+    void Clear();
+
+    bool IsValid() const { return !m_frames.empty(); }
+    bool Matches(const std::string& audioPath, uint32_t fpsNum, uint32_t fpsDen, float beatSensitivity) const;
+    uint64_t GetFrameCount() const { return m_frames.size(); }
+    uint32_t GetSampleRate() const { return m_sampleRate; }
+    uint32_t GetChannels() const { return m_channels; }
+
+    // Frames past the end of the audio read as silence.
+    const Frame& GetFrame(uint64_t frameIndex) const;
+    // Expands the stored 8-bit spectrum of a frame back to FFT magnitudes.
+    void GetSpectrum(uint64_t frameIndex, std::vector<float>& magnitudes) const;
+
+    // First PCM frame of video frame n at the given rate: floor(n * sampleRate * fpsDen / fpsNum).
+    // Integer maths, so consecutive frames tile the audio with no gaps or overlaps.
+    static uint64_t FrameStartSample(uint64_t frameIndex, uint32_t sampleRate, uint32_t fpsNum, uint32_t fpsDen);
+
+private:
+    bool Build(const std::string& audioPath, std::string& error, std::atomic<float>* progress, const std::atomic<bool>* cancel);
+    bool LoadCache(const std::string& cachePath);
+    bool SaveCache(const std::string& cachePath) const;
+
+    std::string m_audioPath;
+    uint32_t m_fpsNum = 0;
+    uint32_t m_fpsDen = 1;
+    float m_beatSensitivity = 0.0f;
+    uint64_t m_sourceSize = 0;
+    int64_t m_sourceMtime = 0;
+    uint32_t m_sampleRate = 0;
+    uint32_t m_channels = 0;
+
+    std::vector<Frame> m_frames;
+    std::vector<uint8_t> m_spectrum; // SPECTRUM_BINS log-magnitude bytes per frame
+};
+
+#endif // AUDIOANALYSISTRACK_H
@@ -0,0 +1,231 @@
+#include "AudioFileStreamer.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+namespace {
+    const ma_uint32 kChunkFrames = 1024;
+    const size_t kRingSamples = 1 << 18;   // ~2.7 s of 48 kHz stereo
+    // The worker only prefetches half the ring, so after a seek there is always room to decode
+    // the new position while the reader is still discarding what was queued before it.
+    const size_t kPrefetchSamples = kRingSamples / 2;
+    const size_t kRingSegments = 1024;     // Enough headers for a full ring of mono chunks
+}
+
+AudioFileStreamer::AudioFileStreamer()
+    : m_open(false), m_channels(0), m_sampleRate(0), m_lengthInFrames(0),
+      m_decodedFrames(nullptr), m_decodedFrameCount(0),
+      m_currentSegment{0, 0, 0, false}, m_segmentRemaining(0),
+      m_atEnd(false), m_cursor(0), m_underruns(0),
+      m_seekTarget(0), m_seekEpoch(0), m_seekCount(0), m_running(false) {}
+
+AudioFileStreamer::~AudioFileStreamer() {
+    Close();
+}
+
+bool AudioFileStreamer::Open(const std::string& filePath) {
+    Close();
+
+    ma_decoder_config decoderConfig = ma_decoder_config_init(ma_format_f32, 0, 0);
+    if (ma_decoder_init_file(filePath.c_str(), &decoderConfig, &m_decoder) != MA_SUCCESS) return false;
+
+    m_channels = m_decoder.outputChannels;
+    m_sampleRate = m_decoder.outputSampleRate;
+    m_lengthInFrames = 0;
+    ma_decoder_get_length_in_pcm_frames(&m_decoder, &m_lengthInFrames);
+    if (m_channels == 0 || m_lengthInFrames == 0) {
+        ma_decoder_uninit(&m_decoder);
+        return false;
+    }
+
+    m_samples.Reset(kRingSamples);
+    m_segments.Reset(kRingSegments);
+    m_decodedFrames.store(nullptr);
+    m_decodedFrameCount = 0;
+    m_segmentRemaining = 0;
+    m_atEnd.store(false);
+    m_cursor.store(0);
+    m_underruns.store(0);
+    m_seekTarget.store(0);
+    m_seekEpoch.store(0);
+    m_seekCount.store(0);
+
+    m_open = true;
+    m_running.store(true);
+    m_worker = std::thread(&AudioFileStreamer::WorkerLoop, this);
+    return true;
+}
+
+void AudioFileStreamer::Close() {
+    if (!m_open) return;
+    {
+        std::lock_guard<std::mutex> lock(m_wakeMutex);
+        m_running.store(false);
+    }
+    m_workerWake.notify_all();
+    if (m_worker.joinable()) m_worker.join();
+    ma_decoder_uninit(&m_decoder);
+    m_decodedFrames.store(nullptr);
+    m_open = false;
+}
+
+void AudioFileStreamer::AttachDecodedFrames(const float* frames, ma_uint64 frameCount) {
+    if (!m_open || !frames || HasDecodedFrames()) return;
+    m_decodedFrameCount = frameCount;
+    m_decodedFrames.store(frames, std::memory_order_release);
+}
+
+void AudioFileStreamer::Seek(ma_uint64 frameIndex) {
+    if (!m_open) return;
+    frameIndex = std::min(frameIndex, m_lengthInFrames);
+    m_seekTarget.store(frameIndex, std::memory_order_relaxed);
+    m_seekEpoch.fetch_add(1, std::memory_order_release);
+    m_seekCount.fetch_add(1, std::memory_order_relaxed);
+    m_cursor.store(frameIndex, std::memory_order_release);
+    m_atEnd.store(false, std::memory_order_release);
+    m_workerWake.notify_one();
+}
+
+ma_uint64 AudioFileStreamer::Read(float* output, ma_uint64 frameCount) {
+    if (!m_open) return 0;
+    ma_uint64 copied = ReadAvailable(output, frameCount);
+    if (copied < frameCount && !IsAtEnd()) m_underruns.fetch_add(1, std::memory_order_relaxed);
+    return copied;
+}
+
+ma_uint64 AudioFileStreamer::ReadAvailable(float* output, ma_uint64 frameCount) {
+    if (const float* decoded = m_decodedFrames.load(std::memory_order_acquire)) {
+        ma_uint64 position = m_cursor.load(std::memory_order_acquire);
+        if (position >= m_decodedFrameCount) {
+            m_atEnd.store(true, std::memory_order_release);
+            return 0;
+        }
+        ma_uint64 count = std::min(frameCount, m_decodedFrameCount - position);
+        std::memcpy(output, decoded + position * m_channels, (size_t)(count * m_channels) * sizeof(float));
+        // A Seek that landed during the copy wins over advancing the cursor.
+        if (m_cursor.compare_exchange_strong(position, position + count, std::memory_order_acq_rel) &&
+            position + count >= m_decodedFrameCount) {
+            m_atEnd.store(true, std::memory_order_release);
+        }
+        return count;
+    }
+
+    // Loaded before the epoch, so a Seek from here on fails the cursor update below.
+    ma_uint64 cursor = m_cursor.load(std::memory_order_acquire);
+    const uint32_t epoch = m_seekEpoch.load(std::memory_order_acquire);
+    ma_uint64 copied = 0;
+
+    while (copied < frameCount) {
+        if (m_segmentRemaining == 0) {
+            if (m_segments.Read(&m_currentSegment, 1) == 0) break; // Worker hasn't caught up
+            m_segmentRemaining = m_currentSegment.frames;
+            if (m_currentSegment.epoch != epoch) {
+                // Decoded before the latest seek.
+                m_samples.Discard((size_t)m_segmentRemaining * m_channels);
+                m_segmentRemaining = 0;
+                continue;
+            }
+            if (m_currentSegment.endOfStream) {
+                if (m_seekEpoch.load(std::memory_order_acquire) == epoch) m_atEnd.store(true, std::memory_order_release);
+                break;
+            }
+        }
+        if (m_currentSegment.epoch != epoch) {
+            // A seek landed while this segment was being read out.
+            m_samples.Discard((size_t)m_segmentRemaining * m_channels);
+            m_segmentRemaining = 0;
+            continue;
+        }
+
+        ma_uint64 count = std::min<ma_uint64>(frameCount - copied, m_segmentRemaining);
+        m_samples.Read(output + copied * m_channels, (size_t)count * m_channels);
+        copied += count;
+        m_segmentRemaining -= (uint32_t)count;
+        // As with the decoded copy, a Seek that landed during the read wins over advancing the cursor.
+        const ma_uint64 next = m_currentSegment.startFrame + (m_currentSegment.frames - m_segmentRemaining);
+        if (!m_cursor.compare_exchange_strong(cursor, next, std::memory_order_acq_rel)) break;
+        cursor = next;
+    }
+
+    // No wake-up for the worker: this may run in the audio callback, and the worker polls the ring.
+    return copied;
+}
+
+ma_uint64 AudioFileStreamer::ReadBlocking(float* output, ma_uint64 frameCount) {
+    if (!m_open) return 0;
+    ma_uint64 copied = 0;
+    while (copied < frameCount && !IsAtEnd()) {
+        ma_uint64 count = ReadAvailable(output + copied * m_channels, frameCount - copied);
+        copied += count;
+        if (count == 0 && !IsAtEnd()) {
+            std::unique_lock<std::mutex> lock(m_wakeMutex);
+            m_dataReady.wait_for(lock, std::chrono::milliseconds(2));
+        }
+    }
+    return copied;
+}
+
+AudioFileStreamer::Stats AudioFileStreamer::GetStats() const {
+    Stats stats;
+    stats.underruns = m_underruns.load(std::memory_order_relaxed);
+    stats.seeks = m_seekCount.load(std::memory_order_relaxed);
+    stats.decodedFramesAttached = HasDecodedFrames();
+    if (m_channels > 0) {
+        stats.bufferedFrames = m_samples.AvailableToRead() / m_channels;
+        stats.capacityFrames = m_samples.Capacity() / m_channels;
+    }
+    return stats;
+}
+
+void AudioFileStreamer::WorkerLoop() {
+    std::vector<float> chunk((size_t)kChunkFrames * m_channels);
+    uint32_t epoch = m_seekEpoch.load(std::memory_order_acquire);
+    ma_uint64 position = 0;
+    size_t samplesSinceSeek = 0;
+    bool endQueued = false;
+
+    while (m_running.load(std::memory_order_acquire)) {
+        if (HasDecodedFrames()) {
+            // Reads are served from the decoded copy; nothing left to prefetch.
+            std::unique_lock<std::mutex> lock(m_wakeMutex);
+            if (!m_running.load(std::memory_order_acquire)) break;
+            m_workerWake.wait_for(lock, std::chrono::milliseconds(100));
+            continue;
+        }
+
+        uint32_t requestedEpoch = m_seekEpoch.load(std::memory_order_acquire);
+        if (requestedEpoch != epoch) {
+            epoch = requestedEpoch;
+            position = m_seekTarget.load(std::memory_order_relaxed);
+            ma_decoder_seek_to_pcm_frame(&m_decoder, position);
+            samplesSinceSeek = 0;
+            endQueued = false;
+        }
+
+        const bool belowTarget = m_samples.AvailableToRead() < kPrefetchSamples || samplesSinceSeek < kPrefetchSamples;
+        const bool roomForChunk = belowTarget && m_samples.AvailableToWrite() >= chunk.size() && m_segments.AvailableToWrite() >= 2;
+        if (endQueued || !roomForChunk) {
+            // Seeks and Close wake this early; room made by the reader is picked up on the timeout.
+            std::unique_lock<std::mutex> lock(m_wakeMutex);
+            if (!m_running.load(std::memory_order_acquire)) break;
+            m_workerWake.wait_for(lock, std::chrono::milliseconds(5));
+            continue;
+        }
+
+        ma_uint64 framesRead = 0;
+        ma_decoder_read_pcm_frames(&m_decoder, chunk.data(), kChunkFrames, &framesRead);
+        if (framesRead > 0) {
+            m_samples.Write(chunk.data(), (size_t)framesRead * m_channels);
+            Segment segment{epoch, (uint32_t)framesRead, position, false};
+            m_segments.Write(&segment, 1);
+            position += framesRead;
+            samplesSinceSeek += (size_t)framesRead * m_channels;
+        }
+        if (framesRead < kChunkFrames) {
+            Segment end{epoch, 0, position, true};
+            m_segments.Write(&end, 1);
+            endQueued = true;
+        }
+        m_dataReady.notify_all();
+    }
+}
@@ -0,0 +1,112 @@
+#ifndef AUDIOFILESTREAMER_H
+#define AUDIOFILESTREAMER_H
+
+#include "miniaudio.h"
+#include "SpscRingBuffer.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Decodes an audio file on a worker thread into a lock-free PCM ring ahead of the playhead.
+// The decoder is only ever touched by the worker: the reader (the playback callback, or the render
+// loop during offline recording) just copies interleaved f32 frames out of the ring, and seeks are
+// posted to the worker as commands. Every decoded chunk is tagged with the seek epoch it was
+// decoded for, so audio queued before a seek is dropped by the reader instead of being played.
+class AudioFileStreamer {
+public:
+    struct Stats {
+        uint64_t underruns = 0;     // Reads that came up short before the end of the file
+        uint64_t seeks = 0;
+        size_t bufferedFrames = 0;  // Current ring fill
+        size_t capacityFrames = 0;
+        bool decodedFramesAttached = false;
+    };
+
+    AudioFileStreamer();
+    ~AudioFileStreamer();
+
+    AudioFileStreamer(const AudioFileStreamer&) = delete;
+    AudioFileStreamer& operator=(const AudioFileStreamer&) = delete;
+
+    // Opens the file (native channel count and sample rate, f32) and starts prefetching from the start.
+    bool Open(const std::string& filePath);
+    void Close();
+    bool IsOpen() const { return m_open; }
+
+    ma_uint32 GetChannels() const { return m_channels; }
+    ma_uint32 GetSampleRate() const { return m_sampleRate; }
+    ma_uint64 GetLengthInFrames() const { return m_lengthInFrames; }
+
+    // Reader side. Copies up to frameCount frames and returns how many were copied. Never blocks,
+    // allocates or makes a system call, so it is safe in the audio callback.
+    ma_uint64 Read(float* output, ma_uint64 frameCount);
+    // Reader side. Waits for the worker until frameCount frames were copied or the file ended.
+    // For offline rendering, where correctness matters more than latency.
+    ma_uint64 ReadBlocking(float* output, ma_uint64 frameCount);
+    // True once the reader has consumed the last frame of the file for the current seek.
+    bool IsAtEnd() const { return m_atEnd.load(std::memory_order_acquire); }
+
+    // Any thread. Moves the playhead; takes effect on the next Read.
+    void Seek(ma_uint64 frameIndex);
+    // Position of the next frame Read will return.
+    ma_uint64 GetCursor() const { return m_cursor.load(std::memory_order_acquire); }
+
+    // Switches reads to a fully decoded copy of the file (see DecodedAudioCache), continuing from
+    // the current cursor. Read becomes a copy out of that memory, seeks take effect immediately and
+    // the worker goes idle. The frames must stay valid until Close().
+    void AttachDecodedFrames(const float* frames, ma_uint64 frameCount);
+    bool HasDecodedFrames() const { return m_decodedFrames.load(std::memory_order_acquire) != nullptr; }
+
+    Stats GetStats() const;
+
+private:
+    struct Segment {
+        uint32_t epoch;
+        uint32_t frames;
+        ma_uint64 startFrame;
+        bool endOfStream;
+    };
+
+    // Copies whatever is queued for the current seek, without counting a short read as an underrun.
+    ma_uint64 ReadAvailable(float* output, ma_uint64 frameCount);
+    void WorkerLoop();
+
+    ma_decoder m_decoder;
+    bool m_open;
+    ma_uint32 m_channels;
+    ma_uint32 m_sampleRate;
+    ma_uint64 m_lengthInFrames;
+
+    // Worker -> reader. Samples for a segment are written before its header, so a header the
+    // reader can see always has all of its samples available.
+    SpscRingBuffer<float> m_samples;
+    SpscRingBuffer<Segment> m_segments;
+
+    // Decoded copy of the whole file, once attached. The count is published before the pointer.
+    std::atomic<const float*> m_decodedFrames;
+    ma_uint64 m_decodedFrameCount;
+
+    // Reader state
+    Segment m_currentSegment;
+    uint32_t m_segmentRemaining;
+    std::atomic<bool> m_atEnd;
+    std::atomic<ma_uint64> m_cursor;
+    std::atomic<uint64_t> m_underruns;
+
+    // Seek commands: the target is written first, then the epoch is bumped.
+    std::atomic<ma_uint64> m_seekTarget;
+    std::atomic<uint32_t> m_seekEpoch;
+    std::atomic<uint64_t> m_seekCount;
+
+    std::thread m_worker;
+    std::atomic<bool> m_running;
+    std::mutex m_wakeMutex;
+    std::condition_variable m_workerWake; // Seek or close; the reader never signals it
+    std::condition_variable m_dataReady;  // Worker queued a segment (for ReadBlocking)
+};
+
+#endif // AUDIOFILESTREAMER_H
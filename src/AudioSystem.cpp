@@ -27,6 +27,24 @@ AudioSystem::AudioSystem() {
     m_fft_input.resize(FFT_SIZE);
     m_fftData.resize(FFT_SIZE / 2, 0.0f);
     m_audioBands.fill(0.0f);
+
+    // About a second of mono audio at 48 kHz; ProcessAudio drains it every frame.
+    m_micFeed.ring.Reset(65536);
+    m_fileFeed.ring.Reset(65536);
+    m_analysisWindow.assign(FFT_SIZE, 0.0f);
+    m_analysisWindowFill = 0;
+    m_lastHopTime = std::chrono::steady_clock::now();
+    m_analysisSampleRate = 0.0f;
+
+    m_offlineAnalysisActive = false;
+    m_offlineAnalysisPending = false;
+    m_offlineAnalysisCancel = false;
+    m_offlineAnalysisProgress = 0.0f;
+    m_offlineAnalysisBuilt = false;
+    m_offlineFpsNum = 60;
+    m_offlineFpsDen = 1;
+    m_offlineNextFrame = 0;
+    m_decodedAudioCacheEnabled = true;
 }
 
 // --- Destructor ---
@@ -47,7 +65,10 @@ bool AudioSystem::Initialize() {
 }
 
 void AudioSystem::Shutdown() {
+    CancelOfflineAnalysis();
     StopActiveDevice();
+    m_fileStreamer.Close();
+    m_decodedAudioCache.Close();
     if (contextInitialized) {
         ma_context_uninit(&miniaudioContext);
         contextInitialized = false;
@@ -126,22 +147,29 @@ void AudioSystem::StopActiveDevice() {
 }
 
 void AudioSystem::LoadWavFile(const char* filePath) {
-    if (audioFileLoaded) ma_decoder_uninit(&m_decoder);
+    if (audioFileLoaded) {
+        // The playback callback reads from the streamer, so the device has to go first.
+        if (m_playbackDeviceInitialized) StopActiveDevice();
+        m_fileStreamer.Close();
+    }
+    CancelOfflineAnalysis();
+    m_decodedAudioCache.Close();
     audioFileLoaded = false;
+    m_loadedAudioFilePath.clear();
+    m_analysisTrack.Clear();
     if (!filePath || filePath[0] == '\0') return;
 
-    ma_decoder_config decoderConfig = ma_decoder_config_init(ma_format_f32, 0, 0);
-    if (ma_decoder_init_file(filePath, &decoderConfig, &m_decoder) != MA_SUCCESS) return;
+    // Decoding happens on the streamer's worker thread from here on.
+    if (!m_fileStreamer.Open(filePath)) return;
 
-    audioFileChannels = m_decoder.outputChannels;
-    audioFileSampleRate = m_decoder.outputSampleRate;
-    ma_decoder_get_length_in_pcm_frames(&m_decoder, &audioFileTotalFrameCount);
-    if (audioFileTotalFrameCount == 0) {
-        ma_decoder_uninit(&m_decoder);
-        return;
-    }
+    audioFileChannels = m_fileStreamer.GetChannels();
+    audioFileSampleRate = m_fileStreamer.GetSampleRate();
+    audioFileTotalFrameCount = m_fileStreamer.GetLengthInFrames();
+    // Playback starts from the streamer straight away and switches to the mapped copy once it's ready.
+    if (m_decodedAudioCacheEnabled) m_decodedAudioCache.Open(filePath);
 
     audioFileLoaded = true;
+    m_loadedAudioFilePath = filePath;
     m_isPlaying = true;
     if (m_isPlaying && currentAudioSource == AudioSource::AudioFile) {
         InitializeAndStartPlaybackDevice();
@@ -151,23 +179,15 @@ void AudioSystem::LoadWavFile(const char* filePath) {
 ma_uint64 AudioSystem::ReadOfflineAudio(float* pOutput, ma_uint32 frameCount) {
     if (!audioFileLoaded) return 0;
 
-    ma_uint64 framesRead;
-    ma_decoder_read_pcm_frames(&m_decoder, pOutput, frameCount, &framesRead);
+    ma_uint64 framesRead = m_fileStreamer.ReadBlocking(pOutput, frameCount);
 
-    // Process for visualization (FFT)
+    // Process for visualization (FFT). The playback device is stopped in offline mode, so this
+    // thread stands in as the analysis feed's producer.
     float* pSamples = static_cast<float*>(pOutput);
-    
-    // Feed the FFT buffer (mix to mono if stereo)
-    if (m_decoder.outputChannels == 1) {
-        m_file_fft_buffer.insert(m_file_fft_buffer.end(), pSamples, pSamples + framesRead);
-    } else if (m_decoder.outputChannels >= 2) {
-        for (ma_uint64 i = 0; i < framesRead; ++i) {
-            m_file_fft_buffer.push_back((pSamples[i * 2] + pSamples[i * 2 + 1]) * 0.5f);
-        }
-    }
+    PushAnalysisSamples(m_fileFeed, pSamples, framesRead, audioFileChannels);
 
     // Calculate amplitude
-    ma_uint32 totalSamples = (ma_uint32)framesRead * m_decoder.outputChannels;
+    ma_uint32 totalSamples = (ma_uint32)framesRead * audioFileChannels;
     float sumOfAbsoluteSamples = 0.0f;
     for (ma_uint32 i = 0; i < totalSamples; ++i) sumOfAbsoluteSamples += fabsf(pSamples[i]);
     currentAudioAmplitude = totalSamples > 0 ? (sumOfAbsoluteSamples / totalSamples) * m_amplitudeScale : 0.0f;
@@ -175,6 +195,100 @@ ma_uint64 AudioSystem::ReadOfflineAudio(float* pOutput, ma_uint32 frameCount) {
     return framesRead;
 }
 
+void AudioSystem::PrepareOfflineAnalysis(ma_uint32 fpsNum, ma_uint32 fpsDen) {
+    CancelOfflineAnalysis();
+    // Offline mode drives the decoder from the render loop, so the device must not pull from it.
+    m_isPlaying = false;
+    StopActiveDevice();
+    ResetAnalysis();
+    m_offlineAnalysisActive = false; // The job owns the track until FinishOfflineAnalysis
+    m_offlineFpsNum = fpsNum;
+    m_offlineFpsDen = fpsDen;
+    m_offlineAnalysisBuilt = false;
+    m_offlineAnalysisError.clear();
+    if (!audioFileLoaded || fpsNum == 0 || fpsDen == 0) return;
+
+    m_offlineAnalysisProgress = 0.0f;
+    m_offlineAnalysisCancel = false;
+    m_offlineAnalysisPending = true;
+    const std::string path = m_loadedAudioFilePath;
+    const float sensitivity = m_beatTracker.GetSensitivity();
+    m_offlineAnalysisJob = std::thread([this, path, fpsNum, fpsDen, sensitivity] {
+        m_offlineAnalysisBuilt = m_analysisTrack.LoadOrBuild(path, fpsNum, fpsDen, sensitivity, m_offlineAnalysisError,
+                                                             &m_offlineAnalysisProgress, &m_offlineAnalysisCancel);
+        m_offlineAnalysisPending.store(false, std::memory_order_release);
+    });
+}
+
+void AudioSystem::CancelOfflineAnalysis() {
+    m_offlineAnalysisCancel = true;
+    if (m_offlineAnalysisJob.joinable()) m_offlineAnalysisJob.join();
+    m_offlineAnalysisPending = false;
+}
+
+bool AudioSystem::FinishOfflineAnalysis() {
+    if (m_offlineAnalysisJob.joinable()) m_offlineAnalysisJob.join();
+    if (!audioFileLoaded || m_offlineFpsNum == 0 || m_offlineFpsDen == 0) return false;
+    m_offlineAnalysisActive = true;
+    m_offlineNextFrame = UINT64_MAX; // Forces one seek to the first requested frame
+    m_offlineFrame = AudioAnalysisTrack::Frame();
+
+    if (!m_offlineAnalysisBuilt) {
+        AppendToErrorLog("AUDIO ERROR: " + m_offlineAnalysisError);
+        return false;
+    }
+    if (m_analysisTrack.GetSampleRate() != audioFileSampleRate || m_analysisTrack.GetChannels() != audioFileChannels) {
+        AppendToErrorLog("AUDIO ERROR: Analysis track format doesn't match the loaded file.");
+        m_analysisTrack.Clear();
+        return false;
+    }
+    return true;
+}
+
+ma_uint64 AudioSystem::ReadOfflineFrame(uint64_t frameIndex, std::vector<float>& interleavedOutput) {
+    interleavedOutput.clear();
+    if (!audioFileLoaded || !m_offlineAnalysisActive) return 0;
+
+    uint64_t begin = AudioAnalysisTrack::FrameStartSample(frameIndex, audioFileSampleRate, m_offlineFpsNum, m_offlineFpsDen);
+    uint64_t end = AudioAnalysisTrack::FrameStartSample(frameIndex + 1, audioFileSampleRate, m_offlineFpsNum, m_offlineFpsDen);
+    if (frameIndex != m_offlineNextFrame) {
+        m_fileStreamer.Seek(begin);
+    }
+    m_offlineNextFrame = frameIndex + 1;
+
+    interleavedOutput.resize((size_t)(end - begin) * audioFileChannels);
+    ma_uint64 framesRead = m_fileStreamer.ReadBlocking(interleavedOutput.data(), end - begin);
+    interleavedOutput.resize((size_t)framesRead * audioFileChannels);
+
+    if (!UsingAnalysisTrack()) {
+        // No track: fall back to analysing the samples live, as ReadOfflineAudio does.
+        PushAnalysisSamples(m_fileFeed, interleavedOutput.data(), framesRead, audioFileChannels);
+        float sumOfAbsoluteSamples = 0.0f;
+        for (float sample : interleavedOutput) sumOfAbsoluteSamples += fabsf(sample);
+        currentAudioAmplitude = !interleavedOutput.empty() ? (sumOfAbsoluteSamples / interleavedOutput.size()) * m_amplitudeScale : 0.0f;
+        return framesRead;
+    }
+
+    m_offlineFrame = m_analysisTrack.GetFrame(frameIndex);
+    currentAudioAmplitude = m_offlineFrame.amplitude * m_amplitudeScale;
+    m_audioBands = m_offlineFrame.bands;
+    m_analysisTrack.GetSpectrum(frameIndex, m_fftData);
+    return framesRead;
+}
+
+void AudioSystem::EndOfflineAnalysis() {
+    if (!m_offlineAnalysisActive) return;
+    m_offlineAnalysisActive = false;
+    ResetAnalysis();
+    m_lastHopTime = std::chrono::steady_clock::now();
+}
+
+bool AudioSystem::IsOfflineAnalysisActive() const { return m_offlineAnalysisActive; }
+
+bool AudioSystem::UsingAnalysisTrack() const {
+    return m_offlineAnalysisActive && m_analysisTrack.IsValid() && currentAudioSource == AudioSource::AudioFile;
+}
+
 void AudioSystem::RegisterListener(IAudioListener* listener) {
     if (listener) m_listeners.push_back(listener);
 }
@@ -197,9 +311,7 @@ const std::string& AudioSystem::GetLastError() const { return lastErrorLog; }
 
 float AudioSystem::GetPlaybackProgress() {
     if (!audioFileLoaded || audioFileTotalFrameCount == 0) return 0.0f;
-    ma_uint64 cursor;
-    ma_decoder_get_cursor_in_pcm_frames(&m_decoder, &cursor);
-    return (float)cursor / (float)audioFileTotalFrameCount;
+    return (float)m_fileStreamer.GetCursor() / (float)audioFileTotalFrameCount;
 }
 
 float AudioSystem::GetPlaybackDuration() const {
@@ -211,6 +323,16 @@ const std::vector<float>& AudioSystem::GetFFTData() const { return m_fftData; }
 
 const std::array<float, 4>& AudioSystem::GetAudioBands() const { return m_audioBands; }
 
+float AudioSystem::GetBeatImpulse() const { return UsingAnalysisTrack() ? m_offlineFrame.beat : m_beatTracker.GetBeatImpulse(); }
+float AudioSystem::GetBeatPhase() const { return UsingAnalysisTrack() ? m_offlineFrame.beatPhase : m_beatTracker.GetBeatPhase(); }
+float AudioSystem::GetBPM() const { return UsingAnalysisTrack() ? m_offlineFrame.bpm : m_beatTracker.GetBPM(); }
+bool AudioSystem::IsTempoLocked() const { return UsingAnalysisTrack() ? m_offlineFrame.tempoLocked != 0 : m_beatTracker.IsTempoLocked(); }
+float AudioSystem::GetBeatSensitivity() const { return m_beatTracker.GetSensitivity(); }
+const AudioSystem::OnsetLatencyStats& AudioSystem::GetOnsetLatencyStats() const { return m_onsetLatency; }
+AudioFileStreamer::Stats AudioSystem::GetFileStreamStats() const { return m_fileStreamer.GetStats(); }
+const DecodedAudioCache& AudioSystem::GetDecodedAudioCache() const { return m_decodedAudioCache; }
+bool AudioSystem::IsDecodedAudioCacheEnabled() const { return m_decodedAudioCacheEnabled; }
+
 ma_uint32 AudioSystem::GetCurrentInputSampleRate() const {
     if (currentAudioSource == AudioSource::Microphone) {
         // If the device is not yet initialized, it has no sample rate. Return a sensible default.
@@ -254,6 +376,7 @@ void AudioSystem::SetCurrentAudioSource(AudioSource source) {
     currentAudioSource = source;
     currentAudioAmplitude = 0.0f;
     StopActiveDevice();
+    ResetAnalysis();
     if (currentAudioSource == AudioSource::Microphone) {
         InitializeAndStartSelectedCaptureDevice();
     } else if (currentAudioSource == AudioSource::AudioFile) {
@@ -270,10 +393,14 @@ void AudioSystem::SetAudioFilePath(const char* filePath) {
 
 void AudioSystem::SetAmplitudeScale(float scale) { m_amplitudeScale = scale; }
 
+void AudioSystem::SetBeatSensitivity(float sensitivity) { m_beatTracker.SetSensitivity(sensitivity); }
+
+void AudioSystem::SetDecodedAudioCacheEnabled(bool enabled) { m_decodedAudioCacheEnabled = enabled; }
+
 void AudioSystem::SetPlaybackProgress(float progress) {
     if (audioFileLoaded) {
         ma_uint64 frameIndex = (ma_uint64)(progress * audioFileTotalFrameCount);
-        ma_decoder_seek_to_pcm_frame(&m_decoder, frameIndex);
+        m_fileStreamer.Seek(frameIndex);
     }
 }
 
@@ -288,7 +415,7 @@ void AudioSystem::Pause() { m_isPlaying = false; }
 
 void AudioSystem::Stop() {
     m_isPlaying = false;
-    if (audioFileLoaded) ma_decoder_seek_to_pcm_frame(&m_decoder, 0);
+    if (audioFileLoaded) m_fileStreamer.Seek(0);
     StopActiveDevice();
 }
 
@@ -305,34 +432,30 @@ void AudioSystem::data_callback_member(void* pOutput, const void* pInput, ma_uin
     // Playback Logic
     if (pOutput != nullptr && currentAudioSource == AudioSource::AudioFile) {
         if (audioFileLoaded && m_isPlaying) {
-            ma_uint64 framesRead;
-            ma_decoder_read_pcm_frames(&m_decoder, pOutput, frameCount, &framesRead);
-
+            // Only a copy out of the prefetch ring; decoding runs on the streamer's worker.
             float* pSamples = static_cast<float*>(pOutput);
-            for (IAudioListener* listener : m_listeners) {
-                listener->onAudioData(pSamples, framesRead, m_decoder.outputChannels, m_decoder.outputSampleRate);
+            ma_uint64 framesRead = m_fileStreamer.Read(pSamples, frameCount);
+            if (framesRead < frameCount) {
+                memset(pSamples + framesRead * audioFileChannels, 0, (size_t)(frameCount - framesRead) * audioFileChannels * sizeof(float));
             }
 
-            // Feed the FFT buffer (mix to mono if stereo)
-            if (m_decoder.outputChannels == 1) {
-                m_file_fft_buffer.insert(m_file_fft_buffer.end(), pSamples, pSamples + framesRead);
-            } else if (m_decoder.outputChannels >= 2) {
-                for (ma_uint64 i = 0; i < framesRead; ++i) {
-                    m_file_fft_buffer.push_back((pSamples[i * 2] + pSamples[i * 2 + 1]) * 0.5f);
-                }
+            for (IAudioListener* listener : m_listeners) {
+                listener->onAudioData(pSamples, framesRead, audioFileChannels, audioFileSampleRate);
             }
 
-            ma_uint32 totalSamples = (ma_uint32)framesRead * m_decoder.outputChannels;
+            PushAnalysisSamples(m_fileFeed, pSamples, framesRead, audioFileChannels);
+
+            ma_uint32 totalSamples = (ma_uint32)framesRead * audioFileChannels;
             float sumOfAbsoluteSamples = 0.0f;
             for (ma_uint32 i = 0; i < totalSamples; ++i) sumOfAbsoluteSamples += fabsf(pSamples[i]);
             currentAudioAmplitude = totalSamples > 0 ? (sumOfAbsoluteSamples / totalSamples) * m_amplitudeScale : 0.0f;
 
-            if (framesRead < frameCount) {
+            if (m_fileStreamer.IsAtEnd()) {
                 m_isPlaying = false;
-                ma_decoder_seek_to_pcm_frame(&m_decoder, 0);
+                m_fileStreamer.Seek(0);
             }
         } else {
-            memset(pOutput, 0, frameCount * ma_get_bytes_per_frame(m_decoder.outputFormat, m_decoder.outputChannels));
+            memset(pOutput, 0, frameCount * ma_get_bytes_per_frame(ma_format_f32, audioFileChannels));
             currentAudioAmplitude = 0.0f;
         }
     }
@@ -347,7 +470,7 @@ void AudioSystem::data_callback_member(void* pOutput, const void* pInput, ma_uin
 
         const float* inputFrames = static_cast<const float*>(pInput);
         ma_uint32 samplesToProcess = frameCount * device.capture.channels;
-        m_mic_fft_buffer.insert(m_mic_fft_buffer.end(), inputFrames, inputFrames + samplesToProcess);
+        PushAnalysisSamples(m_micFeed, inputFrames, frameCount, device.capture.channels);
 
         float sumOfAbsoluteSamples = 0.0f;
         for (ma_uint32 i = 0; i < samplesToProcess; ++i) sumOfAbsoluteSamples += fabsf(inputFrames[i]);
@@ -356,46 +479,138 @@ void AudioSystem::data_callback_member(void* pOutput, const void* pInput, ma_uin
 }
 
 void AudioSystem::ProcessAudio() {
+    if (audioFileLoaded && m_decodedAudioCache.IsReady() && !m_fileStreamer.HasDecodedFrames() &&
+        m_decodedAudioCache.GetChannels() == audioFileChannels && m_decodedAudioCache.GetSampleRate() == audioFileSampleRate) {
+        m_fileStreamer.AttachDecodedFrames(m_decodedAudioCache.GetFrames(), m_decodedAudioCache.GetFrameCount());
+    }
+
+    // ReadOfflineFrame has already applied this frame's pre-computed analysis.
+    if (UsingAnalysisTrack()) return;
+
     const size_t hopSize = FFT_SIZE / 2; // 50% overlap
-    std::vector<float>* buffer_to_process = nullptr;
+    AnalysisFeed* feed = nullptr;
 
     if (currentAudioSource == AudioSource::Microphone) {
-        buffer_to_process = &m_mic_fft_buffer;
+        feed = &m_micFeed;
     } else if (currentAudioSource == AudioSource::AudioFile) {
-        buffer_to_process = &m_file_fft_buffer;
+        feed = &m_fileFeed;
     } else {
         std::fill(m_fftData.begin(), m_fftData.end(), 0.0f);
         return;
     }
 
-    if (buffer_to_process && buffer_to_process->size() >= FFT_SIZE) {
-        // Copy the latest FFT_SIZE samples into the input buffer
-        std::copy(buffer_to_process->end() - FFT_SIZE, buffer_to_process->end(), m_fft_input.begin());
+    // The tracker's hop period follows the source's sample rate.
+    float sampleRate = (float)GetCurrentInputSampleRate();
+    if (sampleRate != m_analysisSampleRate) {
+        m_analysisSampleRate = sampleRate;
+        m_beatTracker.Configure(sampleRate, FFT_SIZE, (float)hopSize / sampleRate);
+        m_onsetLatency = OnsetLatencyStats();
+        m_onsetLatency.hopMs = 1000.0f * (float)hopSize / sampleRate;
+    }
+
+    // If the main loop stalled, skip ahead rather than analysing stale audio in a burst.
+    const size_t maxBacklog = hopSize * 8;
+    size_t available = feed->ring.AvailableToRead();
+    if (available > maxBacklog) {
+        size_t skipped = feed->ring.Discard((available - maxBacklog) / hopSize * hopSize);
+        feed->samplesConsumed += skipped;
+    }
 
-        // Perform FFT
-        auto fft_output = dj::fft1d(m_fft_input, dj::fft_dir::DIR_FWD);
-        for (int i = 0; i < FFT_SIZE / 2; ++i) {
-            m_fftData[i] = std::abs(fft_output[i]);
+    // Step through every complete hop so the onset detector sees a gap-free sequence of spectra.
+    while (feed->ring.AvailableToRead() >= hopSize) {
+        std::copy(m_analysisWindow.begin() + hopSize, m_analysisWindow.end(), m_analysisWindow.begin());
+        feed->ring.Read(m_analysisWindow.data() + (FFT_SIZE - hopSize), hopSize);
+        feed->samplesConsumed += hopSize;
+        m_analysisWindowFill = std::min<size_t>(FFT_SIZE, m_analysisWindowFill + hopSize);
+        if (m_analysisWindowFill < FFT_SIZE) continue;
+
+        AnalyzeWindow();
+        if (m_beatTracker.ProcessSpectrum(m_fftData)) {
+            RecordOnsetLatency(*feed);
         }
+        m_lastHopTime = std::chrono::steady_clock::now();
+    }
 
-        // Calculate frequency band averages
-        float bass = 0.0f, low_mids = 0.0f, high_mids = 0.0f, highs = 0.0f;
-        for (int i = 0; i < BASS_BINS_END; ++i) bass += m_fftData[i];
-        for (int i = BASS_BINS_END; i < LOW_MIDS_BINS_END; ++i) low_mids += m_fftData[i];
-        for (int i = LOW_MIDS_BINS_END; i < HIGH_MIDS_BINS_END; ++i) high_mids += m_fftData[i];
-        for (int i = HIGH_MIDS_BINS_END; i < HIGHS_BINS_END; ++i) highs += m_fftData[i];
+    // No audio arriving (paused, stopped or device gone): don't leave the last spectrum or beat
+    // frozen. The tracker relearns the tempo when audio resumes.
+    if (std::chrono::steady_clock::now() - m_lastHopTime > std::chrono::milliseconds(250)) {
+        std::fill(m_fftData.begin(), m_fftData.end(), 0.0f);
+        m_audioBands.fill(0.0f);
+        m_beatTracker.Reset();
+    }
+}
 
-        m_audioBands[0] = bass / (BASS_BINS_END);
-        m_audioBands[1] = low_mids / (LOW_MIDS_BINS_END - BASS_BINS_END);
-        m_audioBands[2] = high_mids / (HIGH_MIDS_BINS_END - LOW_MIDS_BINS_END);
-        m_audioBands[3] = highs / (HIGHS_BINS_END - HIGH_MIDS_BINS_END);
+void AudioSystem::AnalyzeWindow() {
+    ComputeSpectrum(m_analysisWindow, m_fft_input, m_fftData, m_audioBands);
+}
 
-        // Remove old samples from the front of the circular buffer
-        buffer_to_process->erase(buffer_to_process->begin(), buffer_to_process->begin() + hopSize);
-    } else {
-        // Not enough data, can optionally clear or just leave stale
-        m_audioBands.fill(0.0f);
+void AudioSystem::ComputeSpectrum(const std::vector<float>& window, std::vector<std::complex<float>>& fftInput,
+                                  std::vector<float>& magnitudes, std::array<float, 4>& bands) {
+    fftInput.resize(FFT_SIZE);
+    magnitudes.resize(FFT_SIZE / 2);
+    std::copy(window.begin(), window.begin() + FFT_SIZE, fftInput.begin());
+
+    // Perform FFT
+    auto fft_output = dj::fft1d(fftInput, dj::fft_dir::DIR_FWD);
+    for (int i = 0; i < FFT_SIZE / 2; ++i) {
+        magnitudes[i] = std::abs(fft_output[i]);
     }
+
+    // Calculate frequency band averages
+    float bass = 0.0f, low_mids = 0.0f, high_mids = 0.0f, highs = 0.0f;
+    for (int i = 0; i < BASS_BINS_END; ++i) bass += magnitudes[i];
+    for (int i = BASS_BINS_END; i < LOW_MIDS_BINS_END; ++i) low_mids += magnitudes[i];
+    for (int i = LOW_MIDS_BINS_END; i < HIGH_MIDS_BINS_END; ++i) high_mids += magnitudes[i];
+    for (int i = HIGH_MIDS_BINS_END; i < HIGHS_BINS_END; ++i) highs += magnitudes[i];
+
+    bands[0] = bass / (BASS_BINS_END);
+    bands[1] = low_mids / (LOW_MIDS_BINS_END - BASS_BINS_END);
+    bands[2] = high_mids / (HIGH_MIDS_BINS_END - LOW_MIDS_BINS_END);
+    bands[3] = highs / (HIGHS_BINS_END - HIGH_MIDS_BINS_END);
+}
+
+void AudioSystem::RecordOnsetLatency(const AnalysisFeed& feed) {
+    // Reconstruct when the middle of the newest hop reached the callback from the producer's
+    // latest write timestamp and how far the consumer is behind it.
+    const double hopSeconds = (double)(FFT_SIZE / 2) / m_analysisSampleRate;
+    uint64_t written = feed.samplesWritten.load(std::memory_order_acquire);
+    int64_t lastWriteNs = feed.lastWriteNs.load(std::memory_order_acquire);
+    double samplesBehind = written > feed.samplesConsumed ? (double)(written - feed.samplesConsumed) : 0.0;
+    double arrivalNs = (double)lastWriteNs - (samplesBehind / m_analysisSampleRate + 0.5 * hopSeconds) * 1e9;
+    int64_t nowNs = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    float latencyMs = (float)(((double)nowNs - arrivalNs) / 1e6);
+
+    m_onsetLatency.onsetCount++;
+    m_onsetLatency.averageMs = m_onsetLatency.onsetCount == 1 ? latencyMs : m_onsetLatency.averageMs + 0.1f * (latencyMs - m_onsetLatency.averageMs);
+    m_onsetLatency.maxMs = std::max(m_onsetLatency.maxMs, latencyMs);
+}
+
+void AudioSystem::PushAnalysisSamples(AnalysisFeed& feed, const float* frames, ma_uint64 frameCount, ma_uint32 channels) {
+    if (channels == 0) return;
+    // Mix down to mono through a small stack buffer so the audio thread never allocates.
+    float mono[256];
+    ma_uint64 written = 0;
+    for (ma_uint64 offset = 0; offset < frameCount; offset += 256) {
+        ma_uint64 count = std::min<ma_uint64>(256, frameCount - offset);
+        for (ma_uint64 i = 0; i < count; ++i) {
+            const float* frame = frames + (offset + i) * channels;
+            float sum = 0.0f;
+            for (ma_uint32 c = 0; c < channels; ++c) sum += frame[c];
+            mono[i] = sum / (float)channels;
+        }
+        written += feed.ring.Write(mono, (size_t)count);
+    }
+    int64_t nowNs = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    feed.lastWriteNs.store(nowNs, std::memory_order_release);
+    feed.samplesWritten.fetch_add(written, std::memory_order_release);
+}
+
+void AudioSystem::ResetAnalysis() {
+    m_micFeed.samplesConsumed += m_micFeed.ring.Discard(m_micFeed.ring.AvailableToRead());
+    m_fileFeed.samplesConsumed += m_fileFeed.ring.Discard(m_fileFeed.ring.AvailableToRead());
+    std::fill(m_analysisWindow.begin(), m_analysisWindow.end(), 0.0f);
+    m_analysisWindowFill = 0;
+    m_beatTracker.Reset();
 }
 
 bool AudioSystem::InitializeAndStartPlaybackDevice() {
@@ -403,9 +618,9 @@ bool AudioSystem::InitializeAndStartPlaybackDevice() {
     if (m_playbackDeviceInitialized) StopActiveDevice();
 
     ma_device_config playbackConfig = ma_device_config_init(ma_device_type_playback);
-    playbackConfig.playback.format   = m_decoder.outputFormat;
-    playbackConfig.playback.channels = m_decoder.outputChannels;
-    playbackConfig.sampleRate        = m_decoder.outputSampleRate;
+    playbackConfig.playback.format   = ma_format_f32;
+    playbackConfig.playback.channels = audioFileChannels;
+    playbackConfig.sampleRate        = audioFileSampleRate;
     playbackConfig.dataCallback      = data_callback_static;
     playbackConfig.pUserData         = this;
 
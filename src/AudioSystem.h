@@ -4,11 +4,20 @@
 #include "miniaudio.h"
 #include "dj_fft.h"
 #include "IAudioListener.h"
+#include "BeatTracker.h"
+#include "AudioAnalysisTrack.h"
+#include "AudioFileStreamer.h"
+#include "DecodedAudioCache.h"
+#include "SpscRingBuffer.h"
 #include <vector>
 #include <array>
 #include <string>
 #include <map>
 #include <complex>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <thread>
 
 #define AUDIO_FILE_PATH_BUFFER_SIZE 256
 
@@ -29,6 +38,15 @@ public:
     static const int HIGH_MIDS_BINS_END = 170; // ~7968 Hz
     static const int HIGHS_BINS_END = 426;   // ~19968 Hz
 
+    // End-to-end onset detection latency, measured from the moment the onset's hop reached the
+    // audio callback to the moment ProcessAudio flagged it.
+    struct OnsetLatencyStats {
+        float averageMs = 0.0f;
+        float maxMs = 0.0f;
+        float hopMs = 0.0f;      // Analysis granularity; an onset can land anywhere inside a hop
+        unsigned int onsetCount = 0;
+    };
+
     AudioSystem();
     ~AudioSystem();
 
@@ -43,6 +61,26 @@ public:
     void LoadWavFile(const char* filePath);
     ma_uint64 ReadOfflineAudio(float* pOutput, ma_uint32 frameCount);
 
+    // Offline rendering. PrepareOfflineAnalysis stops playback and loads (or builds) the
+    // per-frame analysis track for the loaded file on a worker thread, as decoding a long file takes
+    // a while. Once IsOfflineAnalysisPending() is false, FinishOfflineAnalysis starts offline mode
+    // with the track; it returns false if only live analysis is available. ReadOfflineFrame then
+    // returns exactly one video frame's worth of audio and applies that frame's analysis, reading
+    // the decoder sequentially and seeking only when frameIndex doesn't follow the previous call.
+    void PrepareOfflineAnalysis(ma_uint32 fpsNum, ma_uint32 fpsDen);
+    bool IsOfflineAnalysisPending() const { return m_offlineAnalysisPending.load(std::memory_order_acquire); }
+    float GetOfflineAnalysisProgress() const { return m_offlineAnalysisProgress.load(std::memory_order_relaxed); }
+    bool FinishOfflineAnalysis();
+    // Stops a pending analysis and waits for the worker.
+    void CancelOfflineAnalysis();
+    ma_uint64 ReadOfflineFrame(uint64_t frameIndex, std::vector<float>& interleavedOutput);
+    void EndOfflineAnalysis();
+    bool IsOfflineAnalysisActive() const;
+
+    // Magnitude spectrum and band averages of one FFT_SIZE window of mono samples.
+    static void ComputeSpectrum(const std::vector<float>& window, std::vector<std::complex<float>>& fftInput,
+                                std::vector<float>& magnitudes, std::array<float, 4>& bands);
+
     // Audio Processing (called from main thread)
     void ProcessAudio();
 
@@ -67,6 +105,15 @@ public:
     const std::array<float, 4>& GetAudioBands() const;
     ma_uint32 GetCurrentInputSampleRate() const;
     ma_uint32 GetCurrentInputChannels() const;
+    float GetBeatImpulse() const;
+    float GetBeatPhase() const;
+    float GetBPM() const;
+    bool IsTempoLocked() const;
+    float GetBeatSensitivity() const;
+    const OnsetLatencyStats& GetOnsetLatencyStats() const;
+    AudioFileStreamer::Stats GetFileStreamStats() const;
+    const DecodedAudioCache& GetDecodedAudioCache() const;
+    bool IsDecodedAudioCacheEnabled() const;
 
     // Setters
     void SetSelectedCaptureDeviceIndex(int index);
@@ -75,6 +122,9 @@ public:
     void SetAudioFilePath(const char* filePath);
     void SetAmplitudeScale(float scale);
     void SetPlaybackProgress(float progress);
+    void SetBeatSensitivity(float sensitivity);
+    // Decode loaded files once to a memory-mapped PCM cache for instant seeking. Applies from the next load.
+    void SetDecodedAudioCacheEnabled(bool enabled);
     void Play();
     void Pause();
     void Stop();
@@ -89,7 +139,9 @@ private:
     ma_device device;
     ma_device m_playbackDevice; // For audio file playback
     ma_device_config deviceConfig;
-    ma_decoder m_decoder;
+    AudioFileStreamer m_fileStreamer; // Owns the file decoder and its prefetch thread
+    DecodedAudioCache m_decodedAudioCache;
+    bool m_decodedAudioCacheEnabled;
 
     // State flags
     bool contextInitialized;
@@ -105,13 +157,46 @@ private:
     float m_amplitudeScale;
     char audioFilePathInputBuffer[AUDIO_FILE_PATH_BUFFER_SIZE];
 
+    // Mono samples handed from the audio callback to the analysis path. The callback is the
+    // only producer (ReadOfflineAudio takes its place while the device is stopped) and
+    // ProcessAudio the only consumer.
+    struct AnalysisFeed {
+        SpscRingBuffer<float> ring;
+        std::atomic<uint64_t> samplesWritten{0};
+        std::atomic<int64_t> lastWriteNs{0};
+        uint64_t samplesConsumed = 0; // Consumer side only
+    };
+
     // FFT related members
-    std::vector<float> m_mic_fft_buffer; // Circular buffer for microphone FFT analysis
-    std::vector<float> m_file_fft_buffer; // Circular buffer for audio file FFT analysis
+    AnalysisFeed m_micFeed;
+    AnalysisFeed m_fileFeed;
+    std::vector<float> m_analysisWindow; // Sliding FFT_SIZE window, advanced one hop at a time
+    size_t m_analysisWindowFill;
+    std::chrono::steady_clock::time_point m_lastHopTime;
     std::vector<std::complex<float>> m_fft_input;
     std::vector<float> m_fftData;
     std::array<float, 4> m_audioBands;
 
+    // Beat tracking (runs on the FFT output of every hop)
+    BeatTracker m_beatTracker;
+    float m_analysisSampleRate;
+    OnsetLatencyStats m_onsetLatency;
+
+    // Offline rendering from a pre-analysed track. While m_offlineAnalysisPending is set, the job
+    // owns m_analysisTrack and the result fields.
+    AudioAnalysisTrack m_analysisTrack;
+    std::thread m_offlineAnalysisJob;
+    std::atomic<bool> m_offlineAnalysisPending;
+    std::atomic<bool> m_offlineAnalysisCancel;
+    std::atomic<float> m_offlineAnalysisProgress;
+    bool m_offlineAnalysisBuilt;
+    std::string m_offlineAnalysisError;
+    AudioAnalysisTrack::Frame m_offlineFrame;
+    bool m_offlineAnalysisActive;
+    ma_uint32 m_offlineFpsNum;
+    ma_uint32 m_offlineFpsDen;
+    uint64_t m_offlineNextFrame;
+
     // Capture device information
     std::vector<ma_device_info> miniaudioAvailableCaptureDevicesInfo;
     std::vector<std::string>    miniaudioCaptureDevice_StdString_Names;
@@ -120,6 +205,7 @@ private:
     AudioSource currentAudioSource;
 
     // Audio file playback data
+    std::string m_loadedAudioFilePath;
     std::vector<float> audioFileSamples;
     ma_uint64 audioFileTotalFrameCount;
     ma_uint64 audioFileCurrentFrame;
@@ -138,6 +224,11 @@ private:
 
     // Private helpers
     bool InitializeAndStartPlaybackDevice();
+    void PushAnalysisSamples(AnalysisFeed& feed, const float* frames, ma_uint64 frameCount, ma_uint32 channels);
+    void AnalyzeWindow();
+    bool UsingAnalysisTrack() const;
+    void RecordOnsetLatency(const AnalysisFeed& feed);
+    void ResetAnalysis();
 };
 
 #endif // AUDIOSYSTEM_H
\ No newline at end of file
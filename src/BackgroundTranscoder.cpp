@@ -0,0 +1,218 @@
+#include "BackgroundTranscoder.h"
+#include <algorithm>
+#include <iostream>
+#include <vector>
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libavutil/opt.h>
+#include <libswscale/swscale.h>
+}
+
+namespace {
+    // Everything a transcode allocates, freed in one place whichever way it ends.
+    struct TranscodeContext {
+        AVFormatContext* input = nullptr;
+        AVFormatContext* output = nullptr;
+        AVCodecContext* decoder = nullptr;
+        AVCodecContext* encoder = nullptr;
+        SwsContext* sws = nullptr;
+        AVFrame* decoded = nullptr;
+        AVFrame* converted = nullptr;
+        AVPacket* packet = nullptr;
+
+        ~TranscodeContext() {
+            av_packet_free(&packet);
+            av_frame_free(&converted);
+            av_frame_free(&decoded);
+            sws_freeContext(sws);
+            avcodec_free_context(&encoder);
+            avcodec_free_context(&decoder);
+            if (output) {
+                if (!(output->oformat->flags & AVFMT_NOFILE) && output->pb) avio_closep(&output->pb);
+                avformat_free_context(output);
+            }
+            avformat_close_input(&input);
+        }
+    };
+
+    // Sends frame (nullptr flushes) and writes every packet the encoder returns.
+    bool EncodeAndWrite(TranscodeContext& tc, AVFrame* frame, AVStream* stream) {
+        AVPacket* pkt = av_packet_alloc();
+        int ret = avcodec_send_frame(tc.encoder, frame);
+        while (ret >= 0) {
+            ret = avcodec_receive_packet(tc.encoder, pkt);
+            if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) break;
+            if (ret < 0) break;
+            av_packet_rescale_ts(pkt, tc.encoder->time_base, stream->time_base);
+            pkt->stream_index = stream->index;
+            av_interleaved_write_frame(tc.output, pkt);
+        }
+        av_packet_free(&pkt);
+        return ret == AVERROR(EAGAIN) || ret == AVERROR_EOF;
+    }
+}
+
+BackgroundTranscoder::BackgroundTranscoder() : m_running(false), m_cancel(false), m_progress(0.0f) {}
+
+BackgroundTranscoder::~BackgroundTranscoder() {
+    Cancel();
+}
+
+bool BackgroundTranscoder::Start(const std::string& inputPath, const std::string& outputPath, const std::string& preset, const std::string& crf) {
+    if (IsRunning()) return false;
+    if (m_worker.joinable()) m_worker.join();
+    m_cancel.store(false);
+    m_progress.store(0.0f);
+    SetStatus("Transcoding " + inputPath);
+    m_running.store(true, std::memory_order_release);
+    m_worker = std::thread(&BackgroundTranscoder::Job, this, inputPath, outputPath, preset, crf);
+    return true;
+}
+
+void BackgroundTranscoder::Cancel() {
+    m_cancel.store(true);
+    if (m_worker.joinable()) m_worker.join();
+}
+
+std::string BackgroundTranscoder::GetStatus() const {
+    std::lock_guard<std::mutex> lock(m_statusMutex);
+    return m_status;
+}
+
+void BackgroundTranscoder::SetStatus(const std::string& status) {
+    std::lock_guard<std::mutex> lock(m_statusMutex);
+    m_status = status;
+}
+
+void BackgroundTranscoder::Job(std::string inputPath, std::string outputPath, std::string preset, std::string crf) {
+    const bool ok = Transcode(inputPath, outputPath, preset, crf);
+    if (ok) {
+        m_progress.store(1.0f);
+        SetStatus("Transcoded to " + outputPath);
+    } else if (m_cancel.load()) {
+        SetStatus("Transcode cancelled; " + outputPath + " is incomplete");
+    }
+    std::cout << "BackgroundTranscoder: " << GetStatus() << std::endl;
+    m_running.store(false, std::memory_order_release);
+}
+
+bool BackgroundTranscoder::Transcode(const std::string& inputPath, const std::string& outputPath, const std::string& preset, const std::string& crf) {
+    TranscodeContext tc;
+    auto fail = [this](const std::string& message) {
+        SetStatus("Transcode failed: " + message);
+        return false;
+    };
+
+    if (avformat_open_input(&tc.input, inputPath.c_str(), nullptr, nullptr) < 0) return fail("could not open " + inputPath);
+    if (avformat_find_stream_info(tc.input, nullptr) < 0) return fail("could not read stream info");
+    const AVCodec* decoderCodec = nullptr;
+    const int videoIndex = av_find_best_stream(tc.input, AVMEDIA_TYPE_VIDEO, -1, -1, &decoderCodec, 0);
+    if (videoIndex < 0 || !decoderCodec) return fail("no decodable video stream");
+    AVStream* inVideo = tc.input->streams[videoIndex];
+
+    tc.decoder = avcodec_alloc_context3(decoderCodec);
+    avcodec_parameters_to_context(tc.decoder, inVideo->codecpar);
+    tc.decoder->thread_count = 2;
+    if (avcodec_open2(tc.decoder, decoderCodec, nullptr) < 0) return fail("could not open the decoder");
+
+    avformat_alloc_output_context2(&tc.output, nullptr, nullptr, outputPath.c_str());
+    if (!tc.output) return fail("unknown output format for " + outputPath);
+
+    const AVCodec* encoderCodec = avcodec_find_encoder(AV_CODEC_ID_H264);
+    if (!encoderCodec) return fail("no H.264 encoder");
+    tc.encoder = avcodec_alloc_context3(encoderCodec);
+    const AVRational frameRate = av_guess_frame_rate(tc.input, inVideo, nullptr);
+    tc.encoder->width = tc.decoder->width;
+    tc.encoder->height = tc.decoder->height;
+    tc.encoder->pix_fmt = AV_PIX_FMT_YUV420P;
+    tc.encoder->time_base = av_inv_q(frameRate);
+    tc.encoder->framerate = frameRate;
+    tc.encoder->colorspace = tc.decoder->colorspace;
+    tc.encoder->color_primaries = tc.decoder->color_primaries;
+    tc.encoder->color_trc = tc.decoder->color_trc;
+    tc.encoder->color_range = AVCOL_RANGE_MPEG;
+    // Leave most of the machine to the app; this runs while the next show may be rendering.
+    tc.encoder->thread_count = std::max(1, (int)std::thread::hardware_concurrency() / 2);
+    av_opt_set(tc.encoder->priv_data, "preset", preset.c_str(), 0);
+    av_opt_set(tc.encoder->priv_data, "crf", crf.c_str(), 0);
+    if (tc.output->oformat->flags & AVFMT_GLOBALHEADER) tc.encoder->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+    if (avcodec_open2(tc.encoder, encoderCodec, nullptr) < 0) return fail("could not open the H.264 encoder");
+
+    AVStream* outVideo = avformat_new_stream(tc.output, nullptr);
+    avcodec_parameters_from_context(outVideo->codecpar, tc.encoder);
+    outVideo->time_base = tc.encoder->time_base;
+
+    // Every audio stream is copied as is.
+    std::vector<int> streamMap(tc.input->nb_streams, -1);
+    for (unsigned i = 0; i < tc.input->nb_streams; ++i) {
+        AVStream* inStream = tc.input->streams[i];
+        if (inStream->codecpar->codec_type != AVMEDIA_TYPE_AUDIO) continue;
+        AVStream* outStream = avformat_new_stream(tc.output, nullptr);
+        avcodec_parameters_copy(outStream->codecpar, inStream->codecpar);
+        outStream->codecpar->codec_tag = 0;
+        outStream->time_base = inStream->time_base;
+        streamMap[i] = outStream->index;
+    }
+
+    if (!(tc.output->oformat->flags & AVFMT_NOFILE)) {
+        if (avio_open(&tc.output->pb, outputPath.c_str(), AVIO_FLAG_WRITE) < 0) return fail("could not open " + outputPath);
+    }
+    if (avformat_write_header(tc.output, nullptr) < 0) return fail("could not write the header");
+
+    tc.decoded = av_frame_alloc();
+    tc.packet = av_packet_alloc();
+    const double duration = tc.input->duration > 0 ? (double)tc.input->duration / AV_TIME_BASE : 0.0;
+
+    auto encodeDecodedFrames = [&]() {
+        while (avcodec_receive_frame(tc.decoder, tc.decoded) >= 0) {
+            AVFrame* frame = tc.decoded;
+            if (tc.decoded->format != AV_PIX_FMT_YUV420P) {
+                if (!tc.converted) {
+                    tc.sws = sws_getContext(tc.decoder->width, tc.decoder->height, (AVPixelFormat)tc.decoded->format,
+                                            tc.encoder->width, tc.encoder->height, AV_PIX_FMT_YUV420P, SWS_BILINEAR, nullptr, nullptr, nullptr);
+                    tc.converted = av_frame_alloc();
+                    tc.converted->format = AV_PIX_FMT_YUV420P;
+                    tc.converted->width = tc.encoder->width;
+                    tc.converted->height = tc.encoder->height;
+                    av_frame_get_buffer(tc.converted, 32);
+                }
+                av_frame_make_writable(tc.converted);
+                sws_scale(tc.sws, tc.decoded->data, tc.decoded->linesize, 0, tc.decoder->height, tc.converted->data, tc.converted->linesize);
+                frame = tc.converted;
+            }
+            frame->pts = av_rescale_q(tc.decoded->best_effort_timestamp, inVideo->time_base, tc.encoder->time_base);
+            frame->pict_type = AV_PICTURE_TYPE_NONE;
+            EncodeAndWrite(tc, frame, outVideo);
+            av_frame_unref(tc.decoded);
+        }
+    };
+
+    while (av_read_frame(tc.input, tc.packet) >= 0) {
+        if (m_cancel.load(std::memory_order_relaxed)) {
+            av_packet_unref(tc.packet);
+            av_write_trailer(tc.output);
+            return false;
+        }
+        AVStream* inStream = tc.input->streams[tc.packet->stream_index];
+        if (duration > 0.0 && tc.packet->pts != AV_NOPTS_VALUE) {
+            m_progress.store(std::min(0.99f, (float)(tc.packet->pts * av_q2d(inStream->time_base) / duration)), std::memory_order_relaxed);
+        }
+        if (tc.packet->stream_index == videoIndex) {
+            if (avcodec_send_packet(tc.decoder, tc.packet) >= 0) encodeDecodedFrames();
+        } else if (streamMap[tc.packet->stream_index] >= 0) {
+            AVStream* outStream = tc.output->streams[streamMap[tc.packet->stream_index]];
+            av_packet_rescale_ts(tc.packet, inStream->time_base, outStream->time_base);
+            tc.packet->stream_index = outStream->index;
+            tc.packet->pos = -1;
+            av_interleaved_write_frame(tc.output, tc.packet);
+        }
+        av_packet_unref(tc.packet);
+    }
+
+    avcodec_send_packet(tc.decoder, nullptr);
+    encodeDecodedFrames();
+    EncodeAndWrite(tc, nullptr, outVideo);
+    return av_write_trailer(tc.output) >= 0 || fail("could not finish " + outputPath);
+}
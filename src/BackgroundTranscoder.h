@@ -0,0 +1,42 @@
+#ifndef BACKGROUND_TRANSCODER_H
+#define BACKGROUND_TRANSCODER_H
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// Re-encodes a finished capture recording to H.264 for delivery, on a background thread, once the
+// show is over. Audio is stream-copied. One job at a time; the encoder is limited to a few threads
+// so the app stays responsive while it runs.
+class BackgroundTranscoder {
+public:
+    BackgroundTranscoder();
+    ~BackgroundTranscoder();
+
+    BackgroundTranscoder(const BackgroundTranscoder&) = delete;
+    BackgroundTranscoder& operator=(const BackgroundTranscoder&) = delete;
+
+    // preset and crf are libx264 settings. Returns false if a job is still running.
+    bool Start(const std::string& inputPath, const std::string& outputPath, const std::string& preset, const std::string& crf);
+    void Cancel();
+
+    bool IsRunning() const { return m_running.load(std::memory_order_acquire); }
+    float GetProgress() const { return m_progress.load(std::memory_order_relaxed); }
+    // Result of the last job, or a description of the running one.
+    std::string GetStatus() const;
+
+private:
+    void Job(std::string inputPath, std::string outputPath, std::string preset, std::string crf);
+    bool Transcode(const std::string& inputPath, const std::string& outputPath, const std::string& preset, const std::string& crf);
+    void SetStatus(const std::string& status);
+
+    std::thread m_worker;
+    std::atomic<bool> m_running;
+    std::atomic<bool> m_cancel;
+    std::atomic<float> m_progress;
+    mutable std::mutex m_statusMutex;
+    std::string m_status;
+};
+
+#endif // BACKGROUND_TRANSCODER_H
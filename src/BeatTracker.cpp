@@ -0,0 +1,213 @@
+#include "BeatTracker.h"
+#include <cmath>
+#include <algorithm>
+
+namespace {
+    const float kMinBandHz = 40.0f;
+    const float kMaxBandHz = 16000.0f;
+    const float kHistorySeconds = 8.0f;      // Onset function history used for tempo estimation
+    const float kMinTempoHistorySeconds = 4.0f;
+    const float kThresholdWindowSeconds = 0.25f;
+    const float kMinOnsetIntervalSeconds = 0.1f;
+    const float kTempoUpdateSeconds = 0.5f;
+    const float kMinBPM = 60.0f;
+    const float kMaxBPM = 200.0f;
+    const float kBeatImpulseDecaySeconds = 0.1f;
+    const float kOdfFloor = 0.05f;           // Keeps silence and noise from producing onsets
+}
+
+BeatTracker::BeatTracker() {}
+
+void BeatTracker::Configure(float sampleRate, int fftSize, float hopSeconds) {
+    m_sampleRate = sampleRate > 0.0f ? sampleRate : 48000.0f;
+    m_fftSize = fftSize;
+    m_hopSeconds = hopSeconds;
+
+    const int numBins = fftSize / 2;
+    const float binHz = m_sampleRate / (float)fftSize;
+    const float maxHz = std::min(kMaxBandHz, m_sampleRate * 0.5f);
+
+    m_bandBegin.assign(NUM_FILTER_BANDS, 0);
+    m_bandEnd.assign(NUM_FILTER_BANDS, 0);
+    // Log-spaced bands. The lowest ones are narrower than a bin at typical FFT sizes, so every
+    // band is widened to at least one bin rather than left empty.
+    for (int b = 0; b < NUM_FILTER_BANDS; ++b) {
+        float loHz = kMinBandHz * std::pow(maxHz / kMinBandHz, (float)b / NUM_FILTER_BANDS);
+        float hiHz = kMinBandHz * std::pow(maxHz / kMinBandHz, (float)(b + 1) / NUM_FILTER_BANDS);
+        int lo = std::clamp((int)std::floor(loHz / binHz), 1, numBins - 1);
+        int hi = std::clamp((int)std::ceil(hiHz / binHz), lo + 1, numBins);
+        m_bandBegin[b] = lo;
+        m_bandEnd[b] = hi;
+    }
+
+    size_t historyLen = hopSeconds > 0.0f ? (size_t)std::ceil(kHistorySeconds / hopSeconds) : 0;
+    m_odfHistory.assign(historyLen, 0.0f);
+    Reset();
+}
+
+void BeatTracker::Reset() {
+    m_prevBandLog.assign(NUM_FILTER_BANDS, 0.0f);
+    m_havePrevSpectrum = false;
+    std::fill(m_odfHistory.begin(), m_odfHistory.end(), 0.0f);
+    m_odfWrite = 0;
+    m_odfCount = 0;
+    m_lastOdf = 0.0f;
+    m_prevOdf = 0.0f;
+    m_lastThreshold = 0.0f;
+    m_secondsSinceOnset = 1.0f;
+    m_hopsUntilTempoUpdate = 0;
+    m_bpm = 120.0f;
+    m_candidateBpm = 0.0f;
+    m_candidateVotes = 0;
+    m_tempoLocked = false;
+    m_phase = 0.0f;
+    m_beatImpulse = 0.0f;
+    m_beatThisHop = false;
+}
+
+bool BeatTracker::ProcessSpectrum(const std::vector<float>& magnitudes) {
+    m_beatThisHop = false;
+    if (!IsConfigured() || m_odfHistory.empty() || (int)magnitudes.size() < m_fftSize / 2) return false;
+
+    // Positive spectral flux of log-compressed band energies. Log compression makes the flux
+    // respond to relative change, so quiet hi-hats register alongside loud kicks.
+    float flux = 0.0f;
+    for (int b = 0; b < NUM_FILTER_BANDS; ++b) {
+        float energy = 0.0f;
+        for (int i = m_bandBegin[b]; i < m_bandEnd[b]; ++i) energy += magnitudes[i];
+        float bandLog = std::log1p(energy / (float)(m_bandEnd[b] - m_bandBegin[b]));
+        if (m_havePrevSpectrum) flux += std::max(0.0f, bandLog - m_prevBandLog[b]);
+        m_prevBandLog[b] = bandLog;
+    }
+    m_havePrevSpectrum = true;
+    float odf = flux / NUM_FILTER_BANDS;
+
+    // Adaptive threshold from the mean and deviation of the recent onset function.
+    const size_t historyLen = m_odfHistory.size();
+    size_t window = std::min(m_odfCount, std::max<size_t>(1, (size_t)(kThresholdWindowSeconds / m_hopSeconds)));
+    float mean = 0.0f, sq = 0.0f;
+    for (size_t i = 1; i <= window; ++i) {
+        float v = m_odfHistory[(m_odfWrite + historyLen - i) % historyLen];
+        mean += v;
+        sq += v * v;
+    }
+    if (window > 0) {
+        mean /= (float)window;
+        sq = std::sqrt(std::max(0.0f, sq / (float)window - mean * mean));
+    }
+    m_lastThreshold = std::max(kOdfFloor, mean + m_sensitivity * sq);
+
+    m_odfHistory[m_odfWrite] = odf;
+    m_odfWrite = (m_odfWrite + 1) % historyLen;
+    m_odfCount = std::min(m_odfCount + 1, historyLen);
+
+    // Report on the rising edge instead of waiting for the peak, which would cost another hop.
+    m_secondsSinceOnset += m_hopSeconds;
+    bool onset = odf > m_lastThreshold && odf > m_prevOdf && m_secondsSinceOnset >= kMinOnsetIntervalSeconds;
+    if (onset) m_secondsSinceOnset = 0.0f;
+    m_prevOdf = odf;
+    m_lastOdf = odf;
+
+    if (--m_hopsUntilTempoUpdate <= 0) {
+        UpdateTempo();
+        m_hopsUntilTempoUpdate = std::max(1, (int)(kTempoUpdateSeconds / m_hopSeconds));
+    }
+    AdvancePhase(onset);
+    return onset;
+}
+
+void BeatTracker::UpdateTempo() {
+    const size_t historyLen = m_odfHistory.size();
+    if ((float)m_odfCount * m_hopSeconds < kMinTempoHistorySeconds) return;
+
+    // Unroll the circular history oldest-first and remove its mean.
+    const size_t n = m_odfCount;
+    std::vector<float> odf(n);
+    float mean = 0.0f;
+    for (size_t i = 0; i < n; ++i) {
+        odf[i] = m_odfHistory[(m_odfWrite + historyLen - n + i) % historyLen];
+        mean += odf[i];
+    }
+    mean /= (float)n;
+    float energy = 0.0f;
+    for (float& v : odf) { v -= mean; energy += v * v; }
+    if (energy <= 1e-9f) return;
+
+    int minLag = std::max(1, (int)std::floor(60.0f / (kMaxBPM * m_hopSeconds)));
+    int maxLag = std::min((int)n - 1, (int)std::ceil(60.0f / (kMinBPM * m_hopSeconds)));
+    if (maxLag <= minLag + 1) return;
+
+    std::vector<float> acf(maxLag + 2, 0.0f);
+    for (int lag = minLag - 1; lag <= maxLag + 1; ++lag) {
+        if (lag < 1 || lag >= (int)n) continue;
+        float sum = 0.0f;
+        for (size_t i = lag; i < n; ++i) sum += odf[i] * odf[i - lag];
+        acf[lag] = sum / energy;
+    }
+
+    // Weight lags with a log-normal prior around 120 BPM to settle octave ambiguity.
+    int bestLag = -1;
+    float bestScore = 0.0f;
+    for (int lag = minLag; lag <= maxLag; ++lag) {
+        float bpm = 60.0f / (lag * m_hopSeconds);
+        float octaves = std::log2(bpm / 120.0f);
+        float score = acf[lag] * std::exp(-0.5f * octaves * octaves);
+        if (score > bestScore) { bestScore = score; bestLag = lag; }
+    }
+    if (bestLag < 0 || acf[bestLag] < 0.1f) {
+        m_tempoLocked = false;
+        return;
+    }
+
+    // Parabolic interpolation for a sub-hop period estimate.
+    float lag = (float)bestLag;
+    float a = acf[bestLag - 1], b = acf[bestLag], c = acf[bestLag + 1];
+    float denom = a - 2.0f * b + c;
+    if (std::fabs(denom) > 1e-6f) lag += std::clamp(0.5f * (a - c) / denom, -0.5f, 0.5f);
+    float newBpm = 60.0f / (lag * m_hopSeconds);
+
+    // Small drift is followed smoothly; a jump has to be confirmed by consecutive estimates.
+    if (!m_tempoLocked || std::fabs(newBpm - m_bpm) / m_bpm < 0.05f) {
+        m_bpm = m_tempoLocked ? m_bpm + 0.25f * (newBpm - m_bpm) : newBpm;
+        m_candidateVotes = 0;
+        m_tempoLocked = true;
+    } else if (m_candidateVotes > 0 && std::fabs(newBpm - m_candidateBpm) / m_candidateBpm < 0.05f) {
+        if (++m_candidateVotes >= 3) {
+            m_bpm = newBpm;
+            m_candidateVotes = 0;
+        }
+    } else {
+        m_candidateBpm = newBpm;
+        m_candidateVotes = 1;
+    }
+}
+
+void BeatTracker::AdvancePhase(bool onset) {
+    const float period = 60.0f / m_bpm;
+    m_beatImpulse *= std::exp(-m_hopSeconds / kBeatImpulseDecaySeconds);
+
+    if (!m_tempoLocked) {
+        // Without a tempo estimate every onset is a beat and restarts the ramp.
+        m_phase += m_hopSeconds / period;
+        if (onset) m_phase = 0.0f;
+        else if (m_phase >= 1.0f) m_phase -= std::floor(m_phase);
+        if (onset) {
+            m_beatThisHop = true;
+            m_beatImpulse = 1.0f;
+        }
+        return;
+    }
+
+    m_phase += m_hopSeconds / period;
+    if (onset) {
+        // Phase error relative to the nearest predicted beat; only onsets close to a beat pull
+        // the oscillator, so off-beat hi-hats don't drag it around.
+        float error = m_phase < 0.5f ? m_phase : m_phase - 1.0f;
+        if (std::fabs(error) < 0.2f) m_phase -= 0.3f * error;
+    }
+    if (m_phase >= 1.0f) {
+        m_phase -= std::floor(m_phase);
+        m_beatThisHop = true;
+        m_beatImpulse = 1.0f;
+    }
+}
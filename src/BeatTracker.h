@@ -0,0 +1,76 @@
+#ifndef BEATTRACKER_H
+#define BEATTRACKER_H
+
+#include <vector>
+#include <cstddef>
+
+// Incremental onset detector and tempo/phase tracker.
+// It does not run its own transform: it consumes the magnitude spectrum AudioSystem already
+// computes for every analysis hop, folds it into a log-spaced filterbank and uses the positive
+// spectral flux between hops as the onset detection function. Tempo comes from the
+// autocorrelation of that function over the last few seconds, and the beat phase is a free-running
+// oscillator that detected onsets pull into alignment.
+class BeatTracker {
+public:
+    static const int NUM_FILTER_BANDS = 24;
+
+    BeatTracker();
+
+    // Sets up the filterbank for the given spectrum layout and hop period. Clears all history.
+    void Configure(float sampleRate, int fftSize, float hopSeconds);
+    void Reset();
+
+    // Feeds the magnitude spectrum (fftSize / 2 bins) of one analysis hop.
+    // Returns true if an onset was detected in this hop.
+    bool ProcessSpectrum(const std::vector<float>& magnitudes);
+
+    bool IsConfigured() const { return m_hopSeconds > 0.0f; }
+    float GetHopSeconds() const { return m_hopSeconds; }
+    bool WasBeatThisHop() const { return m_beatThisHop; }
+    float GetBeatImpulse() const { return m_beatImpulse; }
+    float GetBeatPhase() const { return m_phase; }
+    float GetBPM() const { return m_bpm; }
+    bool IsTempoLocked() const { return m_tempoLocked; }
+    float GetOnsetStrength() const { return m_lastOdf; }
+    float GetOnsetThreshold() const { return m_lastThreshold; }
+
+    // Multiplier on the onset function's deviation above its local mean. Lower is more sensitive.
+    void SetSensitivity(float sensitivity) { m_sensitivity = sensitivity; }
+    float GetSensitivity() const { return m_sensitivity; }
+
+private:
+    void UpdateTempo();
+    void AdvancePhase(bool onset);
+
+    float m_sampleRate = 48000.0f;
+    int m_fftSize = 0;
+    float m_hopSeconds = 0.0f;
+
+    // Filterbank, as [begin, end) bin ranges per band.
+    std::vector<int> m_bandBegin;
+    std::vector<int> m_bandEnd;
+    std::vector<float> m_prevBandLog;
+    bool m_havePrevSpectrum = false;
+
+    // Onset detection function history (circular), long enough for tempo estimation.
+    std::vector<float> m_odfHistory;
+    size_t m_odfWrite = 0;
+    size_t m_odfCount = 0;
+    float m_lastOdf = 0.0f;
+    float m_prevOdf = 0.0f;
+    float m_lastThreshold = 0.0f;
+    float m_secondsSinceOnset = 1.0f;
+    float m_sensitivity = 1.5f;
+
+    // Tempo and phase state
+    int m_hopsUntilTempoUpdate = 0;
+    float m_bpm = 120.0f;
+    float m_candidateBpm = 0.0f;
+    int m_candidateVotes = 0;
+    bool m_tempoLocked = false;
+    float m_phase = 0.0f;
+    float m_beatImpulse = 0.0f;
+    bool m_beatThisHop = false;
+};
+
+#endif // BEATTRACKER_H
@@ -0,0 +1,291 @@
+#include "DecodedAudioCache.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+const char* const DecodedAudioCache::CACHE_DIRECTORY = "cache/audio";
+const uint64_t DecodedAudioCache::MAX_CACHE_BYTES = 4ull * 1024 * 1024 * 1024;
+
+namespace {
+    const char kPcmMagic[4] = { 'R', 'M', 'V', 'P' };
+    const uint32_t kPcmVersion = 1;
+    const ma_uint64 kDecodeChunkFrames = 65536;
+
+    // 32 bytes, so the samples that follow stay float-aligned in the mapping.
+    struct PcmHeader {
+        char magic[4];
+        uint32_t version;
+        uint32_t channels;
+        uint32_t sampleRate;
+        uint64_t frameCount;
+        uint64_t reserved;
+    };
+
+    // FNV-1a over the whole file. Returns false if the file can't be read or the job was cancelled.
+    bool HashFile(const std::string& path, const std::atomic<bool>& cancel, uint64_t& hash) {
+        std::ifstream in(path, std::ios::binary);
+        if (!in) return false;
+        hash = 14695981039346656037ull;
+        std::vector<char> block(1 << 20);
+        while (in) {
+            in.read(block.data(), (std::streamsize)block.size());
+            std::streamsize count = in.gcount();
+            for (std::streamsize i = 0; i < count; ++i) {
+                hash ^= (uint8_t)block[i];
+                hash *= 1099511628211ull;
+            }
+            if (cancel.load(std::memory_order_relaxed)) return false;
+        }
+        return true;
+    }
+}
+
+DecodedAudioCache::DecodedAudioCache()
+    : m_cancel(false), m_building(false), m_ready(false), m_progress(0.0f), m_waveformReady(false),
+      m_mappingBase(nullptr), m_mappingSize(0), m_fileHandle(nullptr), m_mappingHandle(nullptr),
+      m_frames(nullptr), m_frameCount(0), m_channels(0), m_sampleRate(0) {}
+
+DecodedAudioCache::~DecodedAudioCache() {
+    Close();
+}
+
+void DecodedAudioCache::Open(const std::string& sourcePath) {
+    Close();
+    m_cancel.store(false);
+    m_progress.store(0.0f);
+    m_building.store(true);
+    m_worker = std::thread(&DecodedAudioCache::BuildJob, this, sourcePath);
+}
+
+void DecodedAudioCache::Close() {
+    m_cancel.store(true);
+    if (m_worker.joinable()) m_worker.join();
+    m_ready.store(false);
+    m_waveformReady.store(false);
+    m_building.store(false);
+    m_waveform.Clear();
+    Unmap();
+}
+
+void DecodedAudioCache::BuildJob(std::string sourcePath) {
+    auto start = std::chrono::steady_clock::now();
+
+    // Only the output format is needed for the key; the decoder is reopened for the real pass.
+    ma_decoder probe;
+    ma_decoder_config decoderConfig = ma_decoder_config_init(ma_format_f32, 0, 0);
+    if (ma_decoder_init_file(sourcePath.c_str(), &decoderConfig, &probe) != MA_SUCCESS) {
+        m_building.store(false);
+        return;
+    }
+    ma_uint32 sampleRate = probe.outputSampleRate;
+    ma_decoder_uninit(&probe);
+
+    uint64_t hash = 0;
+    if (!HashFile(sourcePath, m_cancel, hash)) {
+        m_building.store(false);
+        return;
+    }
+
+    std::error_code ec;
+    std::filesystem::create_directories(CACHE_DIRECTORY, ec);
+    char name[64];
+    snprintf(name, sizeof(name), "%016llx_%u.pcm", (unsigned long long)hash, sampleRate);
+    const std::string cachePath = (std::filesystem::path(CACHE_DIRECTORY) / name).string();
+
+    bool reused = false;
+    if (std::filesystem::exists(cachePath, ec) && Map(cachePath)) {
+        // Touch the entry so size-limit eviction treats it as recently used.
+        std::filesystem::last_write_time(cachePath, std::filesystem::file_time_type::clock::now(), ec);
+        reused = true;
+    } else if (!DecodeToFile(sourcePath, cachePath) || !Map(cachePath)) {
+        if (!m_cancel.load()) std::cerr << "Audio cache: failed to build " << cachePath << std::endl;
+        m_building.store(false);
+        return;
+    }
+
+    m_progress.store(1.0f);
+    m_ready.store(true, std::memory_order_release);
+
+    float seconds = std::chrono::duration<float>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "Audio cache: " << (reused ? "mapped " : "decoded and mapped ") << cachePath << " ("
+              << m_frameCount << " frames) in " << seconds << " s" << std::endl;
+
+    const std::string peaksPath = std::filesystem::path(cachePath).replace_extension(".peaks").string();
+    if (m_waveform.Load(peaksPath, m_frameCount) ||
+        (m_waveform.Build(m_frames, m_frameCount, m_channels, m_cancel) && m_waveform.Save(peaksPath))) {
+        m_waveformReady.store(true, std::memory_order_release);
+    } else if (!m_waveform.IsEmpty()) {
+        std::cerr << "Audio cache: could not write " << peaksPath << " (kept in memory)" << std::endl;
+        m_waveformReady.store(true, std::memory_order_release);
+    }
+    m_building.store(false);
+
+    if (!reused) EnforceSizeLimit(cachePath);
+}
+
+bool DecodedAudioCache::DecodeToFile(const std::string& sourcePath, const std::string& cachePath) {
+    ma_decoder decoder;
+    ma_decoder_config decoderConfig = ma_decoder_config_init(ma_format_f32, 0, 0);
+    if (ma_decoder_init_file(sourcePath.c_str(), &decoderConfig, &decoder) != MA_SUCCESS) return false;
+
+    ma_uint64 expectedFrames = 0;
+    ma_decoder_get_length_in_pcm_frames(&decoder, &expectedFrames);
+
+    PcmHeader header{};
+    std::memcpy(header.magic, kPcmMagic, sizeof(kPcmMagic));
+    header.version = kPcmVersion;
+    header.channels = decoder.outputChannels;
+    header.sampleRate = decoder.outputSampleRate;
+
+    // Decode into a temporary file and rename at the end, so a crash or cancel never leaves a
+    // partial entry that would later be mapped as if it were complete.
+    const std::string tempPath = cachePath + ".tmp";
+    bool ok = false;
+    {
+        std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+        if (out) {
+            out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            std::vector<float> chunk((size_t)kDecodeChunkFrames * decoder.outputChannels);
+            for (;;) {
+                ma_uint64 framesRead = 0;
+                ma_decoder_read_pcm_frames(&decoder, chunk.data(), kDecodeChunkFrames, &framesRead);
+                if (framesRead > 0) {
+                    out.write(reinterpret_cast<const char*>(chunk.data()), (std::streamsize)(framesRead * decoder.outputChannels * sizeof(float)));
+                    header.frameCount += framesRead;
+                    if (expectedFrames > 0) m_progress.store(std::min(0.99f, (float)header.frameCount / (float)expectedFrames), std::memory_order_relaxed);
+                }
+                if (framesRead < kDecodeChunkFrames || m_cancel.load(std::memory_order_relaxed)) break;
+            }
+            out.seekp(0);
+            out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            ok = (bool)out && !m_cancel.load() && header.frameCount > 0;
+        }
+    }
+    ma_decoder_uninit(&decoder);
+
+    std::error_code ec;
+    if (ok) {
+        std::filesystem::rename(tempPath, cachePath, ec);
+        ok = !ec;
+    }
+    if (!ok) std::filesystem::remove(tempPath, ec);
+    return ok;
+}
+
+bool DecodedAudioCache::Map(const std::string& cachePath) {
+#ifdef _WIN32
+    HANDLE file = CreateFileA(cachePath.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) return false;
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size) || (uint64_t)size.QuadPart < sizeof(PcmHeader)) {
+        CloseHandle(file);
+        return false;
+    }
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    void* base = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+    if (!base) {
+        if (mapping) CloseHandle(mapping);
+        CloseHandle(file);
+        return false;
+    }
+    m_fileHandle = file;
+    m_mappingHandle = mapping;
+    m_mappingSize = (size_t)size.QuadPart;
+#else
+    int fd = open(cachePath.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (uint64_t)st.st_size < sizeof(PcmHeader)) {
+        close(fd);
+        return false;
+    }
+    void* base = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd); // The mapping keeps the file referenced
+    if (base == MAP_FAILED) return false;
+    // Playback reads front to back; let the kernel read ahead.
+    madvise(base, (size_t)st.st_size, MADV_SEQUENTIAL);
+    m_mappingSize = (size_t)st.st_size;
+#endif
+    m_mappingBase = base;
+
+    PcmHeader header;
+    std::memcpy(&header, base, sizeof(header));
+    const uint64_t payload = (uint64_t)header.frameCount * header.channels * sizeof(float);
+    if (std::memcmp(header.magic, kPcmMagic, sizeof(kPcmMagic)) != 0 || header.version != kPcmVersion ||
+        header.channels == 0 || header.sampleRate == 0 || payload > m_mappingSize - sizeof(PcmHeader)) {
+        Unmap();
+        return false;
+    }
+    m_frames = reinterpret_cast<const float*>(static_cast<const char*>(base) + sizeof(PcmHeader));
+    m_frameCount = header.frameCount;
+    m_channels = header.channels;
+    m_sampleRate = header.sampleRate;
+    return true;
+}
+
+void DecodedAudioCache::Unmap() {
+    if (m_mappingBase) {
+#ifdef _WIN32
+        UnmapViewOfFile(m_mappingBase);
+        CloseHandle((HANDLE)m_mappingHandle);
+        CloseHandle((HANDLE)m_fileHandle);
+#else
+        munmap(m_mappingBase, m_mappingSize);
+#endif
+    }
+    m_mappingBase = nullptr;
+    m_mappingSize = 0;
+    m_fileHandle = nullptr;
+    m_mappingHandle = nullptr;
+    m_frames = nullptr;
+    m_frameCount = 0;
+    m_channels = 0;
+    m_sampleRate = 0;
+}
+
+void DecodedAudioCache::EnforceSizeLimit(const std::string& keepPath) {
+    struct Entry {
+        std::filesystem::path path;
+        uint64_t size;
+        std::filesystem::file_time_type lastUse;
+    };
+    std::vector<Entry> entries;
+    uint64_t total = 0;
+    std::error_code ec;
+    for (const auto& item : std::filesystem::directory_iterator(CACHE_DIRECTORY, ec)) {
+        if (!item.is_regular_file(ec) || item.path().extension() != ".pcm") continue;
+        Entry entry{item.path(), (uint64_t)item.file_size(ec), item.last_write_time(ec)};
+        total += entry.size;
+        entries.push_back(entry);
+    }
+    if (total <= MAX_CACHE_BYTES) return;
+
+    std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) { return a.lastUse < b.lastUse; });
+    const std::filesystem::path keep(keepPath);
+    for (const Entry& entry : entries) {
+        if (total <= MAX_CACHE_BYTES) break;
+        if (std::filesystem::equivalent(entry.path, keep, ec)) continue;
+        if (std::filesystem::remove(entry.path, ec)) {
+            std::filesystem::remove(std::filesystem::path(entry.path).replace_extension(".peaks"), ec);
+            total -= entry.size;
+            std::cout << "Audio cache: evicted " << entry.path.string() << std::endl;
+        }
+    }
+}
@@ -0,0 +1,71 @@
+#ifndef DECODEDAUDIOCACHE_H
+#define DECODEDAUDIOCACHE_H
+
+#include "miniaudio.h"
+#include "WaveformPyramid.h"
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <thread>
+
+// Fully decoded copy of an audio file, memory-mapped from a cache file.
+// Open() starts a background job that hashes the source file, then either maps an existing cache
+// entry for it or decodes the whole file to interleaved f32 PCM first. Once IsReady(), every sample
+// of the file is addressable directly, so seeking is pointer arithmetic instead of a decoder seek.
+// Entries live in CACHE_DIRECTORY, are keyed by content hash and sample rate, and the directory is
+// trimmed to MAX_CACHE_BYTES by evicting the least recently used entries. The job also builds a
+// WaveformPyramid from the mapping and stores it next to the entry, so reloading a file is instant.
+class DecodedAudioCache {
+public:
+    static const char* const CACHE_DIRECTORY;
+    static const uint64_t MAX_CACHE_BYTES;
+
+    DecodedAudioCache();
+    ~DecodedAudioCache();
+
+    DecodedAudioCache(const DecodedAudioCache&) = delete;
+    DecodedAudioCache& operator=(const DecodedAudioCache&) = delete;
+
+    void Open(const std::string& sourcePath);
+    // Cancels a running job and unmaps. Callers must make sure nothing still reads GetFrames().
+    void Close();
+
+    bool IsBuilding() const { return m_building.load(std::memory_order_acquire); }
+    bool IsReady() const { return m_ready.load(std::memory_order_acquire); }
+    float GetProgress() const { return m_progress.load(std::memory_order_relaxed); }
+
+    // Valid once IsReady() returns true, until Close().
+    const float* GetFrames() const { return m_frames; }
+    ma_uint64 GetFrameCount() const { return m_frameCount; }
+    ma_uint32 GetChannels() const { return m_channels; }
+    ma_uint32 GetSampleRate() const { return m_sampleRate; }
+    // Null until the overview has been loaded or built.
+    const WaveformPyramid* GetWaveform() const { return m_waveformReady.load(std::memory_order_acquire) ? &m_waveform : nullptr; }
+
+private:
+    void BuildJob(std::string sourcePath);
+    bool DecodeToFile(const std::string& sourcePath, const std::string& cachePath);
+    bool Map(const std::string& cachePath);
+    void Unmap();
+    void EnforceSizeLimit(const std::string& keepPath);
+
+    std::thread m_worker;
+    std::atomic<bool> m_cancel;
+    std::atomic<bool> m_building;
+    std::atomic<bool> m_ready;
+    std::atomic<float> m_progress;
+    std::atomic<bool> m_waveformReady;
+    WaveformPyramid m_waveform;
+
+    // Mapping. Written by the job before m_ready is set, read-only afterwards.
+    void* m_mappingBase;
+    size_t m_mappingSize;
+    void* m_fileHandle;    // Win32 file and mapping handles; unused on POSIX
+    void* m_mappingHandle;
+    const float* m_frames;
+    ma_uint64 m_frameCount;
+    ma_uint32 m_channels;
+    ma_uint32 m_sampleRate;
+};
+
+#endif // DECODEDAUDIOCACHE_H
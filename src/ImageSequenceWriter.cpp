@@ -0,0 +1,302 @@
+#include "ImageSequenceWriter.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavutil/opt.h>
+}
+
+namespace {
+    struct EncoderSetup {
+        AVCodecID codecId;
+        AVPixelFormat pixelFormat;
+    };
+
+    EncoderSetup GetEncoderSetup(ImageSequenceWriter::Format format) {
+        switch (format) {
+            case ImageSequenceWriter::Format::PNG16:   return { AV_CODEC_ID_PNG, AV_PIX_FMT_RGBA64BE };
+            case ImageSequenceWriter::Format::TIFF16:  return { AV_CODEC_ID_TIFF, AV_PIX_FMT_RGBA64LE };
+            case ImageSequenceWriter::Format::EXRHalf: return { AV_CODEC_ID_EXR, AV_PIX_FMT_GBRAPF32LE };
+            case ImageSequenceWriter::Format::PNG8:
+            default:                                   return { AV_CODEC_ID_PNG, AV_PIX_FMT_RGBA };
+        }
+    }
+
+    float HalfToFloat(uint16_t half) {
+        const uint32_t sign = (uint32_t)(half & 0x8000) << 16;
+        uint32_t exponent = (half >> 10) & 0x1f;
+        uint32_t mantissa = half & 0x3ff;
+        uint32_t bits;
+        if (exponent == 0x1f) {
+            bits = sign | 0x7f800000 | (mantissa << 13); // Inf / NaN
+        } else if (exponent != 0) {
+            bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+        } else if (mantissa != 0) {
+            // Subnormal: normalise into a float exponent.
+            exponent = 113;
+            while (!(mantissa & 0x400)) {
+                mantissa <<= 1;
+                exponent--;
+            }
+            bits = sign | (exponent << 23) | ((mantissa & 0x3ff) << 13);
+        } else {
+            bits = sign;
+        }
+        float value;
+        std::memcpy(&value, &bits, sizeof(value));
+        return value;
+    }
+
+    uint16_t ToUnorm16(float value) {
+        return (uint16_t)(std::clamp(value, 0.0f, 1.0f) * 65535.0f + 0.5f);
+    }
+
+    // Reads one bottom-up source row into float RGBA.
+    void ReadRow(const uint8_t* row, int width, ImageSequenceWriter::PixelType pixelType, float* rgba) {
+        if (pixelType == ImageSequenceWriter::PixelType::RGBA16F) {
+            const uint16_t* halves = reinterpret_cast<const uint16_t*>(row);
+            for (int i = 0; i < width * 4; ++i) rgba[i] = HalfToFloat(halves[i]);
+        } else {
+            for (int i = 0; i < width * 4; ++i) rgba[i] = row[i] * (1.0f / 255.0f);
+        }
+    }
+
+    // Flips the GL readback top-down and converts it to the encoder's pixel format.
+    void FillFrame(AVFrame* frame, const uint8_t* pixels, int width, int height, ImageSequenceWriter::PixelType pixelType,
+                   std::vector<float>& rowScratch) {
+        const size_t sourceStride = (size_t)width * ImageSequenceWriter::GetPixelSize(pixelType);
+        for (int y = 0; y < height; ++y) {
+            const uint8_t* source = pixels + (size_t)(height - 1 - y) * sourceStride;
+            if (frame->format == AV_PIX_FMT_RGBA && pixelType == ImageSequenceWriter::PixelType::RGBA8) {
+                std::memcpy(frame->data[0] + (size_t)y * frame->linesize[0], source, sourceStride);
+                continue;
+            }
+            ReadRow(source, width, pixelType, rowScratch.data());
+            const float* rgba = rowScratch.data();
+            switch (frame->format) {
+                case AV_PIX_FMT_RGBA: {
+                    uint8_t* out = frame->data[0] + (size_t)y * frame->linesize[0];
+                    for (int i = 0; i < width * 4; ++i) out[i] = (uint8_t)(std::clamp(rgba[i], 0.0f, 1.0f) * 255.0f + 0.5f);
+                    break;
+                }
+                case AV_PIX_FMT_RGBA64BE:
+                case AV_PIX_FMT_RGBA64LE: {
+                    const bool bigEndian = frame->format == AV_PIX_FMT_RGBA64BE;
+                    uint8_t* out = frame->data[0] + (size_t)y * frame->linesize[0];
+                    for (int i = 0; i < width * 4; ++i) {
+                        const uint16_t value = ToUnorm16(rgba[i]);
+                        out[2 * i + (bigEndian ? 0 : 1)] = (uint8_t)(value >> 8);
+                        out[2 * i + (bigEndian ? 1 : 0)] = (uint8_t)(value & 0xff);
+                    }
+                    break;
+                }
+                case AV_PIX_FMT_GBRAPF32LE: {
+                    // Planar G, B, R, A. Values are written as rendered, without clamping.
+                    float* planes[4];
+                    for (int p = 0; p < 4; ++p) planes[p] = reinterpret_cast<float*>(frame->data[p] + (size_t)y * frame->linesize[p]);
+                    for (int x = 0; x < width; ++x) {
+                        planes[0][x] = rgba[4 * x + 1];
+                        planes[1][x] = rgba[4 * x + 2];
+                        planes[2][x] = rgba[4 * x + 0];
+                        planes[3][x] = rgba[4 * x + 3];
+                    }
+                    break;
+                }
+                default:
+                    break;
+            }
+        }
+    }
+}
+
+bool ImageSequenceWriter::ParseFormat(const std::string& name, Format& format) {
+    if (name == "png") format = Format::PNG8;
+    else if (name == "png16") format = Format::PNG16;
+    else if (name == "tiff16") format = Format::TIFF16;
+    else if (name == "exr") format = Format::EXRHalf;
+    else return false;
+    return true;
+}
+
+const char* ImageSequenceWriter::GetExtension(Format format) {
+    switch (format) {
+        case Format::TIFF16:  return ".tiff";
+        case Format::EXRHalf: return ".exr";
+        case Format::PNG8:
+        case Format::PNG16:
+        default:              return ".png";
+    }
+}
+
+bool ImageSequenceWriter::IsHighPrecision(Format format) {
+    return format != Format::PNG8;
+}
+
+ImageSequenceWriter::ImageSequenceWriter()
+    : m_active(false), m_format(Format::PNG8), m_pixelType(PixelType::RGBA8), m_width(0), m_height(0),
+      m_frameBytes(0), m_nextFrameNumber(0), m_stopping(false), m_framesWritten(0), m_writeErrors(0), m_writeTimeNs(0) {}
+
+ImageSequenceWriter::~ImageSequenceWriter() {
+    Stop();
+}
+
+bool ImageSequenceWriter::Start(const std::string& basePath, Format format, int width, int height, PixelType pixelType,
+                                int workerCount, size_t maxInFlightBytes) {
+    Stop();
+    if (!avcodec_find_encoder(GetEncoderSetup(format).codecId)) {
+        std::cerr << "ImageSequenceWriter: no encoder for " << GetExtension(format) << " in this FFmpeg build." << std::endl;
+        return false;
+    }
+    m_basePath = basePath;
+    m_format = format;
+    m_pixelType = pixelType;
+    m_width = width;
+    m_height = height;
+    m_frameBytes = (size_t)width * height * GetPixelSize(pixelType);
+    m_nextFrameNumber = 0;
+    m_framesWritten.store(0);
+    m_writeErrors.store(0);
+    m_writeTimeNs.store(0);
+
+    workerCount = std::max(1, workerCount);
+    const int bufferCount = std::max(workerCount + 1, (int)std::min<size_t>(maxInFlightBytes / m_frameBytes, 256));
+    m_buffers.assign((size_t)bufferCount, std::vector<uint8_t>(m_frameBytes));
+    m_freeBuffers.clear();
+    for (int i = 0; i < bufferCount; ++i) m_freeBuffers.push_back(i);
+    m_stopping = false;
+    for (int i = 0; i < workerCount; ++i) {
+        m_workers.emplace_back(&ImageSequenceWriter::WorkerMain, this);
+    }
+    m_active = true;
+    return true;
+}
+
+bool ImageSequenceWriter::Submit(const void* pixels, bool waitForSpace) {
+    if (!m_active) return false;
+    int buffer = -1;
+    int64_t frameNumber = 0;
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        if (waitForSpace) {
+            m_bufferFree.wait(lock, [this] { return !m_freeBuffers.empty(); });
+        }
+        // Dropped frames still take a number, so the gap shows in the sequence
+        frameNumber = m_nextFrameNumber++;
+        if (m_freeBuffers.empty()) return false;
+        buffer = m_freeBuffers.back();
+        m_freeBuffers.pop_back();
+    }
+    std::memcpy(m_buffers[buffer].data(), pixels, m_frameBytes);
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_jobs.push({buffer, frameNumber});
+    }
+    m_jobReady.notify_one();
+    return true;
+}
+
+void ImageSequenceWriter::Stop() {
+    if (!m_active) return;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_jobReady.notify_all();
+    for (std::thread& worker : m_workers) worker.join();
+    m_workers.clear();
+    m_buffers.clear();
+    m_freeBuffers.clear();
+    m_active = false;
+    std::cout << "ImageSequenceWriter: wrote " << GetFramesWritten() << " frames to " << m_basePath << "_*" << GetExtension(m_format);
+    if (GetWriteErrors() > 0) std::cout << " (" << GetWriteErrors() << " failed)";
+    std::cout << std::endl;
+}
+
+double ImageSequenceWriter::GetAverageWriteMs() const {
+    const uint64_t frames = GetFramesWritten() + GetWriteErrors();
+    return frames > 0 ? m_writeTimeNs.load(std::memory_order_relaxed) / 1.0e6 / (double)frames : 0.0;
+}
+
+int ImageSequenceWriter::GetBuffersInUse() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return (int)(m_buffers.size() - m_freeBuffers.size());
+}
+
+std::string ImageSequenceWriter::GetFramePath(int64_t frameNumber) const {
+    char suffix[32];
+    snprintf(suffix, sizeof(suffix), "_%06lld", (long long)frameNumber);
+    return m_basePath + suffix + GetExtension(m_format);
+}
+
+void ImageSequenceWriter::WorkerMain() {
+    // Each worker owns an encoder; image encoders are intra-only, so one packet is one file.
+    const EncoderSetup setup = GetEncoderSetup(m_format);
+    const AVCodec* codec = avcodec_find_encoder(setup.codecId);
+    AVCodecContext* codecCtx = avcodec_alloc_context3(codec);
+    codecCtx->width = m_width;
+    codecCtx->height = m_height;
+    codecCtx->pix_fmt = setup.pixelFormat;
+    codecCtx->time_base = {1, 25}; // Required by avcodec_open2, meaningless for stills
+    if (m_format == Format::EXRHalf) {
+        av_opt_set(codecCtx->priv_data, "format", "half", 0);
+        av_opt_set(codecCtx->priv_data, "compression", "zip16", 0);
+    } else if (m_format == Format::TIFF16) {
+        av_opt_set(codecCtx->priv_data, "compression_algo", "deflate", 0);
+    }
+    const bool opened = avcodec_open2(codecCtx, codec, nullptr) >= 0;
+    if (!opened) std::cerr << "ImageSequenceWriter: could not open the " << GetExtension(m_format) << " encoder." << std::endl;
+
+    AVFrame* frame = av_frame_alloc();
+    frame->format = setup.pixelFormat;
+    frame->width = m_width;
+    frame->height = m_height;
+    av_frame_get_buffer(frame, 32);
+    AVPacket* pkt = av_packet_alloc();
+    std::vector<float> rowScratch((size_t)m_width * 4);
+
+    for (;;) {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_jobReady.wait(lock, [this] { return !m_jobs.empty() || m_stopping; });
+            if (m_jobs.empty()) break;
+            job = m_jobs.front();
+            m_jobs.pop();
+        }
+
+        // Release the buffer as soon as it is converted, so the next frame can be copied in while
+        // this one compresses.
+        const auto writeStart = std::chrono::steady_clock::now();
+        av_frame_make_writable(frame);
+        FillFrame(frame, m_buffers[job.buffer].data(), m_width, m_height, m_pixelType, rowScratch);
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_freeBuffers.push_back(job.buffer);
+        }
+        m_bufferFree.notify_one();
+
+        bool written = false;
+        frame->pts = job.frameNumber;
+        if (opened && avcodec_send_frame(codecCtx, frame) >= 0 && avcodec_receive_packet(codecCtx, pkt) >= 0) {
+            std::ofstream out(GetFramePath(job.frameNumber), std::ios::binary | std::ios::trunc);
+            out.write(reinterpret_cast<const char*>(pkt->data), pkt->size);
+            written = (bool)out;
+            av_packet_unref(pkt);
+        }
+        m_writeTimeNs.fetch_add((uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - writeStart).count(), std::memory_order_relaxed);
+        if (written) {
+            m_framesWritten.fetch_add(1, std::memory_order_relaxed);
+        } else if (m_writeErrors.fetch_add(1, std::memory_order_relaxed) == 0) {
+            std::cerr << "ImageSequenceWriter: could not write " << GetFramePath(job.frameNumber) << std::endl;
+        }
+    }
+
+    av_packet_free(&pkt);
+    av_frame_free(&frame);
+    avcodec_free_context(&codecCtx);
+}
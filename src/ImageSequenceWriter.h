@@ -0,0 +1,92 @@
+#ifndef IMAGE_SEQUENCE_WRITER_H
+#define IMAGE_SEQUENCE_WRITER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <queue>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Writes captured frames as numbered still images (<base>_000000.png, ...) for compositing in other
+// tools. Submit() copies a frame into one of a fixed set of buffers, so memory in flight is bounded,
+// and a pool of worker threads compresses and writes them, each with its own FFmpeg image encoder.
+// When every buffer is taken, Submit() either waits for one (offline) or drops the frame (real-time).
+class ImageSequenceWriter {
+public:
+    enum class Format {
+        PNG8,    // 8-bit RGBA PNG
+        PNG16,   // 16-bit RGBA PNG
+        TIFF16,  // 16-bit RGBA TIFF, deflate
+        EXRHalf  // Half-float RGBA OpenEXR, zip
+    };
+    // Layout of the pixels handed to Submit(): bottom-up RGBA rows as read back by glReadPixels with
+    // GL_UNSIGNED_BYTE or GL_HALF_FLOAT.
+    enum class PixelType { RGBA8, RGBA16F };
+
+    // Format names accepted by ParseFormat: "png", "png16", "tiff16", "exr".
+    static bool ParseFormat(const std::string& name, Format& format);
+    static const char* GetExtension(Format format);
+    // Formats that keep more than 8 bits per channel; capture them as RGBA16F.
+    static bool IsHighPrecision(Format format);
+    static size_t GetPixelSize(PixelType pixelType) { return pixelType == PixelType::RGBA16F ? 8 : 4; }
+
+    ImageSequenceWriter();
+    ~ImageSequenceWriter();
+
+    ImageSequenceWriter(const ImageSequenceWriter&) = delete;
+    ImageSequenceWriter& operator=(const ImageSequenceWriter&) = delete;
+
+    // basePath is the output path without frame number or extension. The buffer count is
+    // maxInFlightBytes / frame size, but at least workerCount + 1.
+    bool Start(const std::string& basePath, Format format, int width, int height, PixelType pixelType,
+               int workerCount, size_t maxInFlightBytes);
+    // Copies one frame. Returns false if it was dropped; its number is skipped either way.
+    bool Submit(const void* pixels, bool waitForSpace);
+    // Writes everything already submitted, then joins the workers.
+    void Stop();
+
+    bool IsActive() const { return m_active; }
+    uint64_t GetFramesWritten() const { return m_framesWritten.load(std::memory_order_relaxed); }
+    uint64_t GetWriteErrors() const { return m_writeErrors.load(std::memory_order_relaxed); }
+    // Conversion, compression and file write, per frame.
+    double GetAverageWriteMs() const;
+    int GetBufferCount() const { return (int)m_buffers.size(); }
+    int GetBuffersInUse() const;
+    int GetWorkerCount() const { return (int)m_workers.size(); }
+    std::string GetFramePath(int64_t frameNumber) const;
+
+private:
+    struct Job {
+        int buffer;
+        int64_t frameNumber;
+    };
+
+    void WorkerMain();
+
+    bool m_active;
+    std::string m_basePath;
+    Format m_format;
+    PixelType m_pixelType;
+    int m_width;
+    int m_height;
+    size_t m_frameBytes;
+    int64_t m_nextFrameNumber;
+
+    std::vector<std::thread> m_workers;
+    std::vector<std::vector<uint8_t>> m_buffers;
+    mutable std::mutex m_mutex;         // Guards everything below
+    std::condition_variable m_jobReady;
+    std::condition_variable m_bufferFree;
+    std::vector<int> m_freeBuffers;
+    std::queue<Job> m_jobs;
+    bool m_stopping;
+
+    std::atomic<uint64_t> m_framesWritten;
+    std::atomic<uint64_t> m_writeErrors;
+    std::atomic<uint64_t> m_writeTimeNs;
+};
+
+#endif // IMAGE_SEQUENCE_WRITER_H
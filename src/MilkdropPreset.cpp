@@ -0,0 +1,492 @@
+#include "MilkdropPreset.h"
+#include "MilkdropWarpShader.h"
+#include "PresetFileParser.hpp"
+#include "Renderer.h"
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+using namespace MilkdropVars;
+
+namespace {
+    constexpr int kWavePointCount = 128;
+}
+
+MilkdropPreset::~MilkdropPreset() {
+    DestroyEquations();
+    DestroyFeedbackTargets();
+    DestroyMeshFences();
+    if (m_meshVAO != 0) glDeleteVertexArrays(1, &m_meshVAO);
+    if (m_meshVBO != 0) glDeleteBuffers(1, &m_meshVBO);
+    if (m_meshEBO != 0) glDeleteBuffers(1, &m_meshEBO);
+    if (m_waveVAO != 0) glDeleteVertexArrays(1, &m_waveVAO);
+    if (m_waveVBO != 0) glDeleteBuffers(1, &m_waveVBO);
+    if (m_pixelWarpProgram != 0) glDeleteProgram(m_pixelWarpProgram);
+}
+
+void MilkdropPreset::DestroyEquations() {
+    if (m_initCode) projectm_eval_code_destroy(m_initCode);
+    if (m_perFrameCode) projectm_eval_code_destroy(m_perFrameCode);
+    if (m_context) projectm_eval_context_destroy(m_context);
+    m_initCode = nullptr;
+    m_perFrameCode = nullptr;
+    m_context = nullptr;
+    if (m_scope) {
+        // The band contexts live in the scope too
+        std::string ignored;
+        m_warpMesh.Compile(std::string(), nullptr, m_warpMesh.GetBandCount(), ignored);
+        projectm_eval_global_scope_destroy(m_scope);
+        m_scope = nullptr;
+    }
+}
+
+bool MilkdropPreset::Compile(const std::string& presetText, int meshColumns, int meshRows, int meshThreads, std::string& error) {
+    DestroyEquations();
+    m_stage = Stage::Compiled;
+
+    libprojectM::PresetFileParser parser;
+    std::istringstream presetStream(presetText);
+    if (!parser.Read(presetStream)) {
+        error = "ERROR::MILKDROP::PARSE_FAIL - no preset values found.";
+        return false;
+    }
+
+    for (int i = 0; i < VarCount; ++i) {
+        const Info& info = GetInfo(i);
+        m_presetValues[i] = info.presetKey ? parser.GetFloat(info.presetKey, info.defaultValue) : 0.0f;
+    }
+    m_waveScale = parser.GetFloat("fWaveScale", 1.0f);
+    m_waveSmoothing = parser.GetFloat("fWaveSmoothing", 0.75f);
+    m_warpAnimSpeed = parser.GetFloat("fWarpAnimSpeed", 1.0f);
+    m_warpScale = parser.GetFloat("fWarpScale", 1.0f);
+    m_texWrap = parser.GetBool("bTexWrap", true);
+
+    // Unshared: the per-frame code and the mesh take turns, and per-pixel code that touches the
+    // globals runs as a single band, so only one thread uses the scope at a time.
+    m_scope = projectm_eval_global_scope_create(0);
+    m_context = m_scope ? projectm_eval_context_create_in_scope(m_scope) : nullptr;
+    if (!m_context) {
+        error = "ERROR::MILKDROP::CONTEXT_FAIL - could not create an expression context.";
+        return false;
+    }
+    RegisterAll(m_context, m_state);
+
+    std::string errors;
+    auto compile = [&](const char* prefix, projectm_eval_code*& code) {
+        const std::string source = parser.GetCode(prefix);
+        if (source.empty()) return;
+        code = projectm_eval_code_compile(m_context, source.c_str());
+        if (!code) {
+            int line = 0;
+            int column = 0;
+            const char* message = projectm_eval_get_error(m_context, &line, &column);
+            errors += std::string(prefix) + " (line " + std::to_string(line) + ", column " + std::to_string(column) + "): " +
+                      (message ? message : "unknown error") + "\n";
+        }
+    };
+    compile("per_frame_init_", m_initCode);
+    compile("per_frame_", m_perFrameCode);
+    m_perPixelSource = parser.GetCode("per_pixel_");
+    m_warpMesh.SetSize(meshColumns, meshRows);
+    std::string perPixelError;
+    if (!m_warpMesh.Compile(m_perPixelSource, m_scope, meshThreads, perPixelError)) {
+        errors += "per_pixel_ (" + perPixelError + ")\n";
+    }
+    if (!errors.empty()) {
+        error = "ERROR::MILKDROP::COMPILE_FAIL\n" + errors;
+        DestroyEquations();
+        return false;
+    }
+
+    // per_frame_init sees the preset values once; the q values it leaves are where every frame starts.
+    m_presetTime = 0.0f;
+    m_presetFrame = 0;
+    m_levelAverage.fill(0.0f);
+    m_levelAttack.fill(0.0f);
+    std::copy(m_presetValues.begin() + Zoom, m_presetValues.begin() + X, m_state.vars.begin() + Zoom);
+    if (m_initCode) projectm_eval_code_execute(m_initCode);
+    m_initQ = m_state.q;
+
+    // The shader sources are ready here; only linking them needs the GL context.
+    m_pixelWarpStatus.clear();
+    m_pixelWarpFragmentSource = MilkdropWarpShader::Generate(m_perPixelSource, m_pixelWarpStatus);
+    if (!m_pixelWarpFragmentSource.empty()) {
+        std::ifstream vertexFile("shaders/texture.vert");
+        std::stringstream vertexSource;
+        vertexSource << vertexFile.rdbuf();
+        m_pixelWarpVertexSource = vertexSource.str();
+    }
+    return true;
+}
+
+bool MilkdropPreset::FinalizeStep(int width, int height) {
+    switch (m_stage) {
+        case Stage::Compiled:
+            BuildMesh();
+            m_stage = Stage::MeshBuffers;
+            break;
+        case Stage::MeshBuffers:
+            BuildPixelWarp();
+            m_stage = Stage::PixelWarp;
+            break;
+        case Stage::PixelWarp:
+            CreateFeedbackTargets(width, height);
+            m_stage = Stage::Ready;
+            break;
+        case Stage::Ready:
+            break;
+    }
+    return IsReady();
+}
+
+void MilkdropPreset::FinalizeAll(int width, int height) {
+    while (!FinalizeStep(width, height)) {
+    }
+}
+
+void MilkdropPreset::ResizeFeedback(int width, int height) {
+    if (m_stage != Stage::Ready) return;
+    DestroyFeedbackTargets();
+    CreateFeedbackTargets(width, height);
+}
+
+void MilkdropPreset::CreateFeedbackTargets(int width, int height) {
+    m_feedbackWidth = width;
+    m_feedbackHeight = height;
+    if (width <= 0 || height <= 0) return;
+    for (int i = 0; i < 2; ++i) {
+        glGenTextures(1, &m_feedbackTexture[i]);
+        glBindTexture(GL_TEXTURE_2D, m_feedbackTexture[i]);
+        // Half float: at 8 bits a decay close to 1 rounds back to the same value and trails never fade.
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, width, height, 0, GL_RGBA, GL_FLOAT, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+        glGenFramebuffers(1, &m_feedbackFBO[i]);
+        glBindFramebuffer(GL_FRAMEBUFFER, m_feedbackFBO[i]);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, m_feedbackTexture[i], 0);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+            std::cerr << "ERROR::FRAMEBUFFER:: Milkdrop feedback target is not complete!" << std::endl;
+        }
+        glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+        glClear(GL_COLOR_BUFFER_BIT);
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    m_feedbackIndex = 0;
+}
+
+void MilkdropPreset::DestroyFeedbackTargets() {
+    for (int i = 0; i < 2; ++i) {
+        if (m_feedbackFBO[i] != 0) glDeleteFramebuffers(1, &m_feedbackFBO[i]);
+        if (m_feedbackTexture[i] != 0) glDeleteTextures(1, &m_feedbackTexture[i]);
+        m_feedbackFBO[i] = 0;
+        m_feedbackTexture[i] = 0;
+    }
+}
+
+void MilkdropPreset::CopyFeedbackFrom(const MilkdropPreset& other) {
+    if (m_feedbackFBO[0] == 0 || other.m_feedbackFBO[0] == 0) return;
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, other.m_feedbackFBO[other.m_feedbackIndex]);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, m_feedbackFBO[m_feedbackIndex]);
+    glBlitFramebuffer(0, 0, other.m_feedbackWidth, other.m_feedbackHeight, 0, 0, m_feedbackWidth, m_feedbackHeight,
+                      GL_COLOR_BUFFER_BIT, GL_LINEAR);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void MilkdropPreset::BuildPixelWarp() {
+    if (m_pixelWarpProgram != 0) glDeleteProgram(m_pixelWarpProgram);
+    m_pixelWarpProgram = 0;
+    if (m_pixelWarpFragmentSource.empty()) return;
+
+    m_pixelWarpProgram = Renderer::CompileProgramSource(m_pixelWarpVertexSource.c_str(), m_pixelWarpFragmentSource.c_str());
+    if (m_pixelWarpProgram == 0) {
+        m_pixelWarpStatus = "the generated shader did not compile, see the log";
+    }
+}
+
+void MilkdropPreset::SetMeshSize(int columns, int rows) {
+    m_warpMesh.SetSize(columns, rows);
+    if (m_stage != Stage::Compiled) BuildMesh();
+}
+
+void MilkdropPreset::SetMeshThreads(int threads) {
+    if (!m_context) return;
+    std::string error;
+    m_warpMesh.Compile(m_perPixelSource, m_scope, threads, error);
+}
+
+void MilkdropPreset::BuildMesh() {
+    const int columns = m_warpMesh.GetColumns();
+    const int rows = m_warpMesh.GetRows();
+    const size_t vertexCount = (size_t)m_warpMesh.GetVertexCount();
+    m_meshFallback.assign(vertexCount, MilkdropWarpMesh::Vertex{});
+    std::vector<GLuint> indices;
+    indices.reserve((size_t)columns * rows * 6);
+    for (int j = 0; j < rows; ++j) {
+        for (int i = 0; i < columns; ++i) {
+            const GLuint v0 = j * (columns + 1) + i;
+            const GLuint v1 = v0 + 1;
+            const GLuint v2 = v0 + (columns + 1);
+            const GLuint v3 = v2 + 1;
+            indices.insert(indices.end(), {v0, v1, v2, v1, v3, v2});
+        }
+    }
+    m_meshIndexCount = (int)indices.size();
+
+    if (m_meshVAO == 0) {
+        glGenVertexArrays(1, &m_meshVAO);
+        glGenBuffers(1, &m_meshVBO);
+        glGenBuffers(1, &m_meshEBO);
+    }
+    glBindVertexArray(m_meshVAO);
+    glBindBuffer(GL_ARRAY_BUFFER, m_meshVBO);
+    DestroyMeshFences();
+    m_meshRegion = 0;
+    glBufferData(GL_ARRAY_BUFFER, kMeshRingSize * vertexCount * sizeof(MilkdropWarpMesh::Vertex), nullptr, GL_STREAM_DRAW);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_meshEBO);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint), indices.data(), GL_STATIC_DRAW);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(MilkdropWarpMesh::Vertex), (void*)0);
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(MilkdropWarpMesh::Vertex), (void*)(2 * sizeof(float)));
+    glBindVertexArray(0);
+
+    if (m_waveVAO == 0) {
+        glGenVertexArrays(1, &m_waveVAO);
+        glGenBuffers(1, &m_waveVBO);
+        glBindVertexArray(m_waveVAO);
+        glBindBuffer(GL_ARRAY_BUFFER, m_waveVBO);
+        glBufferData(GL_ARRAY_BUFFER, (kWavePointCount + 1) * 2 * sizeof(float), nullptr, GL_STREAM_DRAW);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), (void*)0);
+        glBindVertexArray(0);
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void MilkdropPreset::DestroyMeshFences() {
+    for (auto& fence : m_meshFences) {
+        if (fence) glDeleteSync(fence);
+        fence = nullptr;
+    }
+}
+
+void MilkdropPreset::UpdateAudioLevels(const FrameState& frame) {
+    // Milkdrop's bass/mid/treb are each band's level over its recent average, so 1 is "normal"
+    // whatever the input gain; the _att values follow them more slowly.
+    const float dt = std::max(frame.deltaTime, 0.0001f);
+    const float averageRate = 1.0f - std::exp(-dt / 4.0f);
+    const float attackRate = 1.0f - std::exp(-dt / 0.2f);
+    const auto& bands = frame.audioBands;
+    const float levels[3] = {bands[0], 0.5f * (bands[1] + bands[2]), bands[3]};
+    for (int band = 0; band < 3; ++band) {
+        float& average = m_levelAverage[band];
+        average = (average <= 0.0f) ? levels[band] : average + (levels[band] - average) * averageRate;
+        const float relative = average > 1e-5f ? std::min(levels[band] / average, 10.0f) : 0.0f;
+        m_levelAttack[band] += (relative - m_levelAttack[band]) * attackRate;
+        m_state.vars[Bass + band] = relative;
+        m_state.vars[BassAtt + band] = m_levelAttack[band];
+    }
+}
+
+void MilkdropPreset::RunPerFrame(const FrameState& frame) {
+    if (!m_context) return;
+    const float dt = frame.deltaTime > 0.0f ? frame.deltaTime : 1.0f / 60.0f;
+    m_presetTime += dt;
+    ++m_presetFrame;
+
+    std::copy(m_presetValues.begin() + Zoom, m_presetValues.begin() + X, m_state.vars.begin() + Zoom);
+    m_state.q = m_initQ;
+
+    const float width = (float)std::max(frame.width, 1);
+    const float height = (float)std::max(frame.height, 1);
+    m_state.vars[Time] = m_presetTime;
+    m_state.vars[Fps] = 1.0f / dt;
+    m_state.vars[Frame] = (PRJM_EVAL_F)m_presetFrame;
+    m_state.vars[Progress] = frame.progress;
+    m_state.vars[MeshX] = (PRJM_EVAL_F)m_warpMesh.GetColumns();
+    m_state.vars[MeshY] = (PRJM_EVAL_F)m_warpMesh.GetRows();
+    m_state.vars[PixelsX] = width;
+    m_state.vars[PixelsY] = height;
+    m_state.vars[AspectX] = height > width ? width / height : 1.0f;
+    m_state.vars[AspectY] = width > height ? height / width : 1.0f;
+    UpdateAudioLevels(frame);
+
+    if (m_perFrameCode) projectm_eval_code_execute(m_perFrameCode);
+    // Broadcast the per-frame results; every band copies them into its own context.
+    m_frameInputs.vars = m_state.vars;
+    m_frameInputs.q = m_state.q;
+    m_frameInputs.warpTime = m_presetTime * m_warpAnimSpeed;
+    m_frameInputs.warpScale = m_warpScale;
+}
+
+void MilkdropPreset::RunPerVertex() {
+    const int region = (m_meshRegion + 1) % kMeshRingSize;
+    GLsync& fence = m_meshFences[region];
+    if (fence) {
+        // Drawn kMeshRingSize - 1 frames ago, so this almost never has to wait.
+        glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000ull);
+        glDeleteSync(fence);
+        fence = nullptr;
+    }
+
+    const size_t regionBytes = (size_t)m_warpMesh.GetVertexCount() * sizeof(MilkdropWarpMesh::Vertex);
+    glBindBuffer(GL_ARRAY_BUFFER, m_meshVBO);
+    void* mapped = glMapBufferRange(GL_ARRAY_BUFFER, (GLintptr)(region * regionBytes), (GLsizeiptr)regionBytes,
+                                    GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+    if (mapped) {
+        m_warpMesh.Evaluate(m_frameInputs, static_cast<MilkdropWarpMesh::Vertex*>(mapped));
+        glUnmapBuffer(GL_ARRAY_BUFFER);
+    } else {
+        m_warpMesh.Evaluate(m_frameInputs, m_meshFallback.data());
+        glBufferSubData(GL_ARRAY_BUFFER, (GLintptr)(region * regionBytes), (GLsizeiptr)regionBytes, m_meshFallback.data());
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    m_meshRegion = region;
+}
+
+void MilkdropPreset::SetPixelWarpUniforms() {
+    // The per-frame values, in the layout MilkdropWarpShader declares them.
+    std::array<float, X> frameVars;
+    std::array<float, kQCount> frameQ;
+    for (int i = 0; i < X; ++i) frameVars[i] = (float)m_frameInputs.vars[i];
+    for (int i = 0; i < kQCount; ++i) frameQ[i] = (float)m_frameInputs.q[i];
+    const std::array<float, 4> factors = MilkdropWarpMesh::WarpFactors(m_frameInputs.warpTime);
+
+    glUniform1fv(glGetUniformLocation(m_pixelWarpProgram, "frameVars"), X, frameVars.data());
+    glUniform1fv(glGetUniformLocation(m_pixelWarpProgram, "frameQ"), kQCount, frameQ.data());
+    glUniform2f(glGetUniformLocation(m_pixelWarpProgram, "aspect"), frameVars[AspectX], frameVars[AspectY]);
+    glUniform1f(glGetUniformLocation(m_pixelWarpProgram, "warpTime"), m_frameInputs.warpTime);
+    glUniform1f(glGetUniformLocation(m_pixelWarpProgram, "warpScaleInv"),
+                1.0f / (m_frameInputs.warpScale != 0.0f ? m_frameInputs.warpScale : 1.0f));
+    glUniform4fv(glGetUniformLocation(m_pixelWarpProgram, "warpFactors"), 1, factors.data());
+}
+
+void MilkdropPreset::DrawWave(const Programs& programs, const std::vector<float>& spectrum) {
+    const float alpha = std::clamp((float)m_state.vars[WaveA], 0.0f, 1.0f);
+    if (spectrum.empty() || alpha <= 0.001f) return;
+
+    // The lowest quarter of the spectrum holds nearly all of the musical energy.
+    const size_t bins = std::max<size_t>(spectrum.size() / 4, 1);
+    float frameMax = 0.0f;
+    for (size_t i = 0; i < bins; ++i) frameMax = std::max(frameMax, spectrum[i]);
+    m_spectrumPeak = std::max(frameMax, m_spectrumPeak * 0.995f);
+    const float normalise = m_spectrumPeak > 1e-6f ? 1.0f / m_spectrumPeak : 0.0f;
+    const float smoothing = std::clamp(m_waveSmoothing, 0.0f, 0.98f);
+
+    const int mode = (int)m_state.vars[WaveMode] % 8;
+    const bool circular = mode == 0 || mode == 1;
+    const float width = (float)std::max(m_feedbackWidth, 1);
+    const float height = (float)std::max(m_feedbackHeight, 1);
+    const float radiusX = std::min(1.0f, height / width);
+    const float radiusY = std::min(1.0f, width / height);
+    const float centerX = (float)m_state.vars[WaveX] * 2.0f - 1.0f;
+    const float centerY = (float)m_state.vars[WaveY] * 2.0f - 1.0f;
+
+    m_wavePoints.clear();
+    float level = 0.0f;
+    for (int i = 0; i < kWavePointCount; ++i) {
+        const float raw = spectrum[(size_t)i * bins / kWavePointCount] * normalise;
+        level = i == 0 ? raw : level * smoothing + raw * (1.0f - smoothing);
+        const float amplitude = level * m_waveScale * 0.25f;
+        if (circular) {
+            const float angle = (float)i / kWavePointCount * 6.28318531f;
+            const float r = 0.25f + amplitude;
+            m_wavePoints.push_back(centerX + r * radiusX * std::cos(angle));
+            m_wavePoints.push_back(centerY + r * radiusY * std::sin(angle));
+        } else {
+            m_wavePoints.push_back((float)i / (kWavePointCount - 1) * 2.0f - 1.0f);
+            m_wavePoints.push_back(centerY + amplitude);
+        }
+    }
+
+    float r = (float)m_state.vars[WaveR];
+    float g = (float)m_state.vars[WaveG];
+    float b = (float)m_state.vars[WaveB];
+    if (m_state.vars[WaveBrighten] != 0.0f) {
+        const float maxChannel = std::max({r, g, b});
+        if (maxChannel > 0.0f) {
+            r /= maxChannel;
+            g /= maxChannel;
+            b /= maxChannel;
+        }
+    }
+
+    glBindBuffer(GL_ARRAY_BUFFER, m_waveVBO);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, m_wavePoints.size() * sizeof(float), m_wavePoints.data());
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    glUseProgram(programs.wave);
+    glUniform4f(glGetUniformLocation(programs.wave, "waveColor"), r, g, b, alpha);
+    glEnable(GL_BLEND);
+    if (m_state.vars[WaveAdditive] != 0.0f) {
+        glBlendFunc(GL_SRC_ALPHA, GL_ONE);
+    } else {
+        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    }
+    glBindVertexArray(m_waveVAO);
+    const GLenum primitive = m_state.vars[WaveUseDots] != 0.0f ? GL_POINTS : (circular ? GL_LINE_LOOP : GL_LINE_STRIP);
+    glDrawArrays(primitive, 0, kWavePointCount);
+    glBindVertexArray(0);
+    glDisable(GL_BLEND);
+}
+
+void MilkdropPreset::RenderFeedback(const Programs& programs, const std::vector<float>& spectrum, bool pixelWarp) {
+    if (!IsReady() || !m_context || m_feedbackFBO[0] == 0) return;
+    const int source = m_feedbackIndex;
+    const int target = 1 - source;
+
+    // Warp: the previous frame, pulled through the mesh (or the per-pixel shader) and faded by decay
+    pixelWarp = pixelWarp && m_pixelWarpProgram != 0;
+    const GLuint warpProgram = pixelWarp ? m_pixelWarpProgram : programs.warp;
+    glBindFramebuffer(GL_FRAMEBUFFER, m_feedbackFBO[target]);
+    glViewport(0, 0, m_feedbackWidth, m_feedbackHeight);
+    glUseProgram(warpProgram);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, m_feedbackTexture[source]);
+    const GLint wrap = m_texWrap ? GL_REPEAT : GL_CLAMP_TO_EDGE;
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, wrap);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, wrap);
+    glUniform1i(glGetUniformLocation(warpProgram, "previousFrame"), 0);
+    glUniform1f(glGetUniformLocation(warpProgram, "decay"), (float)m_state.vars[Decay]);
+    glUniform1f(glGetUniformLocation(warpProgram, "darkenCenter"), m_state.vars[DarkenCenter] != 0.0f ? 1.0f : 0.0f);
+    if (pixelWarp) {
+        SetPixelWarpUniforms();
+        Renderer::RenderQuad();
+    } else {
+        glBindVertexArray(m_meshVAO);
+        glDrawElementsBaseVertex(GL_TRIANGLES, m_meshIndexCount, GL_UNSIGNED_INT, nullptr, m_meshRegion * m_warpMesh.GetVertexCount());
+        glBindVertexArray(0);
+        m_meshFences[m_meshRegion] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+
+    // Waveform, drawn into the feedback so later frames smear it
+    DrawWave(programs, spectrum);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    m_feedbackIndex = target;
+}
+
+void MilkdropPreset::Composite(const Programs& programs, float blendProgress, int blendPattern, float blendSeed) {
+    if (!IsReady() || !m_context || m_feedbackFBO[0] == 0) return;
+    // Echo, gamma and the colour filters, from the feedback just drawn
+    glUseProgram(programs.composite);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, m_feedbackTexture[m_feedbackIndex]);
+    glUniform1i(glGetUniformLocation(programs.composite, "feedbackTexture"), 0);
+    glUniform1f(glGetUniformLocation(programs.composite, "gamma"), (float)m_state.vars[Gamma]);
+    glUniform1f(glGetUniformLocation(programs.composite, "echoZoom"), (float)m_state.vars[EchoZoom]);
+    glUniform1f(glGetUniformLocation(programs.composite, "echoAlpha"), (float)m_state.vars[EchoAlpha]);
+    glUniform1i(glGetUniformLocation(programs.composite, "echoOrient"), (int)m_state.vars[EchoOrient] % 4);
+    glUniform1i(glGetUniformLocation(programs.composite, "brighten"), m_state.vars[Brighten] != 0.0f);
+    glUniform1i(glGetUniformLocation(programs.composite, "darken"), m_state.vars[Darken] != 0.0f);
+    glUniform1i(glGetUniformLocation(programs.composite, "solarize"), m_state.vars[Solarize] != 0.0f);
+    glUniform1i(glGetUniformLocation(programs.composite, "invert"), m_state.vars[Invert] != 0.0f);
+    glUniform1f(glGetUniformLocation(programs.composite, "blendProgress"), blendProgress);
+    glUniform1i(glGetUniformLocation(programs.composite, "blendPattern"), blendPattern);
+    glUniform1f(glGetUniformLocation(programs.composite, "blendSeed"), blendSeed);
+    Renderer::RenderQuad();
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
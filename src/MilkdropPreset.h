@@ -0,0 +1,145 @@
+#pragma once
+
+#include "MilkdropWarpMesh.h"
+#include <glad/glad.h>
+#include <array>
+#include <string>
+#include <vector>
+
+// One loaded Milkdrop preset and its own feedback loop: the compiled equations, the warp mesh, the
+// per-pixel warp program if the equations translate to GLSL, and the feedback textures they draw
+// into. MilkdropPresetEffect owns the current preset and, around a switch, the preloaded next one
+// and the outgoing one it blends away from.
+//
+// Loading is split so it can run off the render thread. Compile() parses the preset, compiles the
+// equations, runs per_frame_init and generates the per-pixel warp shader without touching GL, so it
+// may run on any thread. FinalizeStep() then creates the GL objects on the render thread, one stage
+// per call, so a preload never costs a frame more than one of them.
+class MilkdropPreset {
+public:
+    // Programs every preset draws with, owned by the effect.
+    struct Programs {
+        GLuint warp = 0;       // Feedback through the warp mesh
+        GLuint wave = 0;
+        GLuint composite = 0;
+    };
+
+    // What the per-frame equations read from the host.
+    struct FrameState {
+        float deltaTime = 1.0f / 60.0f;
+        float progress = 0.0f;
+        std::array<float, 4> audioBands{};
+        int width = 1;
+        int height = 1;
+    };
+
+    MilkdropPreset() = default;
+    // GL objects are deleted here, so a finalized preset must be destroyed on the render thread.
+    ~MilkdropPreset();
+
+    MilkdropPreset(const MilkdropPreset&) = delete;
+    MilkdropPreset& operator=(const MilkdropPreset&) = delete;
+
+    // CPU half of loading; no GL calls. On failure, error holds the log shown in the effect's UI.
+    bool Compile(const std::string& presetText, int meshColumns, int meshRows, int meshThreads, std::string& error);
+    // GL half of loading: creates the mesh buffers, then links the per-pixel warp program, then the
+    // feedback targets, one per call. Returns true once the preset can render.
+    bool FinalizeStep(int width, int height);
+    void FinalizeAll(int width, int height);
+    bool IsReady() const { return m_stage == Stage::Ready; }
+
+    // Runs the per-frame equations; RunPerVertex then evaluates the warp mesh from their results.
+    void RunPerFrame(const FrameState& frame);
+    void RunPerVertex();
+    // Warp and waveform into the next feedback texture. pixelWarp selects the per-pixel program.
+    void RenderFeedback(const Programs& programs, const std::vector<float>& spectrum, bool pixelWarp);
+    // Composite into the bound framebuffer. The output's alpha is where a blend with blendProgress
+    // (0..1) has reached, following blendPattern: 0 uniform, 1 radial from the centre, 2 noise.
+    void Composite(const Programs& programs, float blendProgress, int blendPattern, float blendSeed);
+    // Starts this preset's feedback from the other preset's last frame.
+    void CopyFeedbackFrom(const MilkdropPreset& other);
+
+    void ResizeFeedback(int width, int height);
+    void SetMeshSize(int columns, int rows);
+    void SetMeshThreads(int threads);
+
+    int GetVertexCount() const { return m_warpMesh.GetVertexCount(); }
+    bool PerPixelUsesGlobals() const { return m_warpMesh.UsesGlobals(); }
+    bool HasPixelWarp() const { return m_pixelWarpProgram != 0; }
+    const std::string& GetPixelWarpStatus() const { return m_pixelWarpStatus; }
+    float GetVar(MilkdropVars::Var var) const { return m_context ? (float)m_state.vars[var] : 0.0f; }
+
+private:
+    static constexpr int kMeshRingSize = 3;
+
+    enum class Stage { Compiled, MeshBuffers, PixelWarp, Ready };
+
+    void DestroyEquations();
+    void UpdateAudioLevels(const FrameState& frame);
+    void BuildMesh();
+    void DestroyMeshFences();
+    void CreateFeedbackTargets(int width, int height);
+    void DestroyFeedbackTargets();
+    void BuildPixelWarp();
+    void SetPixelWarpUniforms();
+    void DrawWave(const Programs& programs, const std::vector<float>& spectrum);
+
+    Stage m_stage = Stage::Compiled;
+
+    // Equations. m_scope holds the preset's reg00-reg99 and gmegabuf, used by m_context and the
+    // warp mesh bands and by no other preset, so presets can run side by side without the blend
+    // partner or a preload seeing their globals.
+    projectm_eval_global_scope* m_scope = nullptr;
+    projectm_eval_context* m_context = nullptr;
+    projectm_eval_code* m_initCode = nullptr;
+    projectm_eval_code* m_perFrameCode = nullptr;
+    MilkdropVars::Storage m_state;  // Bound into m_context
+    std::array<PRJM_EVAL_F, MilkdropVars::VarCount> m_presetValues{};
+    std::array<PRJM_EVAL_F, MilkdropVars::kQCount> m_initQ{};  // After per_frame_init, restored every frame
+    std::string m_perPixelSource;
+
+    // Preset values that no equation can change
+    float m_waveScale = 1.0f;
+    float m_waveSmoothing = 0.75f;
+    float m_warpAnimSpeed = 1.0f;
+    float m_warpScale = 1.0f;
+    bool m_texWrap = true;
+
+    // Audio: band levels relative to their long-term average, as Milkdrop reports them
+    std::array<float, 3> m_levelAverage{};
+    std::array<float, 3> m_levelAttack{};
+    float m_spectrumPeak = 0.0f;
+    float m_presetTime = 0.0f;
+    int m_presetFrame = 0;
+
+    // Warp mesh. The vertex buffer holds kMeshRingSize copies of the mesh; each frame the bands
+    // write straight into the next copy through an unsynchronised mapping, and a fence per copy
+    // keeps it from being rewritten while the GPU may still be reading it.
+    MilkdropWarpMesh m_warpMesh;
+    MilkdropWarpMesh::FrameInputs m_frameInputs;
+    std::vector<MilkdropWarpMesh::Vertex> m_meshFallback;  // Used if mapping fails
+    int m_meshIndexCount = 0;
+    int m_meshRegion = 0;
+    std::array<GLsync, kMeshRingSize> m_meshFences{};
+    GLuint m_meshVAO = 0;
+    GLuint m_meshVBO = 0;
+    GLuint m_meshEBO = 0;
+
+    // Waveform
+    std::vector<float> m_wavePoints;
+    GLuint m_waveVAO = 0;
+    GLuint m_waveVBO = 0;
+
+    // Feedback: the warp pass reads one texture and writes the other
+    std::array<GLuint, 2> m_feedbackFBO{};
+    std::array<GLuint, 2> m_feedbackTexture{};
+    int m_feedbackIndex = 0;
+    int m_feedbackWidth = 0;
+    int m_feedbackHeight = 0;
+
+    // Per-pixel warp, generated by Compile() and linked by FinalizeStep()
+    std::string m_pixelWarpVertexSource;
+    std::string m_pixelWarpFragmentSource;
+    GLuint m_pixelWarpProgram = 0;  // 0 if the per-pixel code needs the CPU mesh
+    std::string m_pixelWarpStatus;  // Why there is no m_pixelWarpProgram
+};
@@ -0,0 +1,395 @@
+#include "MilkdropPresetEffect.h"
+#include "Renderer.h"
+#include "WorkerPool.h"
+#include "imgui.h"
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+
+// projectm-eval locks these around gmegabuf allocations in shared scopes, including its
+// built-in globals, which every context created without a scope uses.
+static std::mutex s_evalMemoryMutex;
+extern "C" void projectm_eval_memory_host_lock_mutex() { s_evalMemoryMutex.lock(); }
+extern "C" void projectm_eval_memory_host_unlock_mutex() { s_evalMemoryMutex.unlock(); }
+
+using namespace MilkdropVars;
+
+namespace {
+    const char* const kBlendModeNames[] = {"Cut", "Crossfade", "Warp"};
+
+    double ElapsedMs(std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end) {
+        return std::chrono::duration<double, std::milli>(end - start).count();
+    }
+
+    void Smooth(double& average, double sample) {
+        average = average * 0.9 + sample * 0.1;
+    }
+}
+
+MilkdropPresetEffect::MilkdropPresetEffect(const std::string& presetPath, int initialWidth, int initialHeight)
+    : ShaderEffect(presetPath, initialWidth, initialHeight),
+      m_meshThreads(std::min(WorkerPool::Shared().GetThreadCount() + 1, 16)) {
+    // A preset draws from its own feedback only.
+    m_inputs.clear();
+}
+
+MilkdropPresetEffect::~MilkdropPresetEffect() {
+    JoinPreload();
+    m_preloadResult.reset();
+    m_next.reset();
+    m_outgoing.reset();
+    m_preset.reset();
+    if (m_gpuQueries[0] != 0) glDeleteQueries(2, m_gpuQueries.data());
+    if (m_programs.warp != 0) glDeleteProgram(m_programs.warp);
+    if (m_programs.wave != 0) glDeleteProgram(m_programs.wave);
+    if (m_programs.composite != 0) glDeleteProgram(m_programs.composite);
+}
+
+void MilkdropPresetEffect::ResizeFrameBuffer(int width, int height) {
+    ShaderEffect::ResizeFrameBuffer(width, height);
+    for (MilkdropPreset* preset : {m_preset.get(), m_outgoing.get(), m_next.get()}) {
+        if (preset) preset->ResizeFeedback(m_fboWidth, m_fboHeight);
+    }
+}
+
+bool MilkdropPresetEffect::CreatePrograms() {
+    if (m_programs.warp == 0) m_programs.warp = Renderer::CompileProgram("shaders/milkdrop_warp.vert", "shaders/milkdrop_warp.frag");
+    if (m_programs.wave == 0) m_programs.wave = Renderer::CompileProgram("shaders/milkdrop_wave.vert", "shaders/milkdrop_wave.frag");
+    if (m_programs.composite == 0) m_programs.composite = Renderer::CompileProgram("shaders/texture.vert", "shaders/milkdrop_comp.frag");
+    if (m_gpuQueries[0] == 0) glGenQueries(2, m_gpuQueries.data());
+    return m_programs.warp != 0 && m_programs.wave != 0 && m_programs.composite != 0;
+}
+
+void MilkdropPresetEffect::ApplyShaderCode(const std::string& presetText) {
+    m_shaderSourceCode = presetText;
+    m_compileErrorLog.clear();
+    if (!CreatePrograms()) {
+        m_compileErrorLog = "ERROR::MILKDROP::PROGRAM_FAIL - could not build the milkdrop_* shaders.";
+        m_shaderLoaded = false;
+        return;
+    }
+
+    auto preset = std::make_unique<MilkdropPreset>();
+    m_shaderLoaded = preset->Compile(presetText, m_meshColumns, m_meshRows, m_meshThreads, m_compileErrorLog);
+    if (!m_shaderLoaded) {
+        m_preset.reset();
+        m_outgoing.reset();
+        return;
+    }
+    preset->FinalizeAll(m_fboWidth, m_fboHeight);
+    // An edit or hot reload carries on from the current picture.
+    if (m_preset) preset->CopyFeedbackFrom(*m_preset);
+    m_preset = std::move(preset);
+    m_outgoing.reset();
+    m_compileErrorLog = "Preset applied successfully.";
+}
+
+bool MilkdropPresetEffect::PreloadNext(const std::string& presetPath) {
+    if (m_preloadThread.joinable() && !m_preloadDone.load(std::memory_order_acquire)) return false;
+    JoinPreload();
+    m_preloadResult.reset();
+    m_next.reset();
+    m_nextPath = presetPath;
+    m_nextText.clear();
+    m_nextError.clear();
+
+    // The worker only touches its arguments and the m_preload* members until it sets m_preloadDone.
+    const int columns = m_meshColumns;
+    const int rows = m_meshRows;
+    const int threads = m_meshThreads;
+    m_preloadDone.store(false, std::memory_order_relaxed);
+    m_preloadThread = std::thread([this, presetPath, columns, rows, threads]() {
+        std::string text;
+        std::string error;
+        std::unique_ptr<MilkdropPreset> preset;
+        std::ifstream file(presetPath, std::ios::binary);
+        if (file) {
+            std::stringstream contents;
+            contents << file.rdbuf();
+            text = contents.str();
+            preset = std::make_unique<MilkdropPreset>();
+            if (!preset->Compile(text, columns, rows, threads, error)) preset.reset();
+        } else {
+            error = "ERROR::MILKDROP::FILE_NOT_FOUND - could not open " + presetPath;
+        }
+        m_preloadResult = std::move(preset);
+        m_preloadText = std::move(text);
+        m_preloadError = std::move(error);
+        m_preloadDone.store(true, std::memory_order_release);
+    });
+    return true;
+}
+
+void MilkdropPresetEffect::JoinPreload() {
+    if (m_preloadThread.joinable()) m_preloadThread.join();
+}
+
+void MilkdropPresetEffect::CollectPreload() {
+    if (!m_preloadThread.joinable() || !m_preloadDone.load(std::memory_order_acquire)) return;
+    m_preloadThread.join();
+    m_next = std::move(m_preloadResult);
+    m_nextText = std::move(m_preloadText);
+    m_nextError = std::move(m_preloadError);
+}
+
+MilkdropPresetEffect::NextState MilkdropPresetEffect::GetNextState() const {
+    if (m_preloadThread.joinable()) return NextState::Compiling;
+    if (m_next) return m_next->IsReady() ? NextState::Ready : NextState::Finalizing;
+    return m_nextError.empty() ? NextState::Empty : NextState::Failed;
+}
+
+bool MilkdropPresetEffect::SwitchToNext() {
+    if (!m_next || !m_next->IsReady() || !CreatePrograms()) return false;
+
+    const bool blend = m_preset && m_shaderLoaded && m_blendMode != BlendMode::Cut && m_blendSeconds > 0.0f;
+    m_outgoing = blend ? std::move(m_preset) : nullptr;
+    m_preset = std::move(m_next);
+    m_blendTime = 0.0f;
+    m_blendPattern = 0;
+    m_blendSeed = 0.0f;
+    if (m_outgoing && m_blendMode == BlendMode::Warp) {
+        // The incoming preset's motion takes hold of the outgoing picture while its own look grows
+        // in, alternating between a radial and a noise pattern like Milkdrop's blend shapes.
+        m_preset->CopyFeedbackFrom(*m_outgoing);
+        m_blendPattern = 1 + m_switchCount % 2;
+        m_blendSeed = (float)((m_switchCount * 7919) % 1000);
+    }
+    ++m_switchCount;
+
+    // The switched-to file becomes the effect's source, so the editor and hot reload follow it.
+    m_shaderFilePath = m_nextPath;
+    m_shaderSourceCode = std::move(m_nextText);
+    std::error_code ec;
+    m_lastWriteTime = std::filesystem::last_write_time(m_shaderFilePath, ec);
+    m_shaderLoaded = true;
+    m_compileErrorLog = "Preset applied successfully.";
+    m_nextPath.clear();
+    m_nextText.clear();
+    return true;
+}
+
+void MilkdropPresetEffect::SetBlend(BlendMode mode, float seconds) {
+    m_blendMode = mode;
+    m_blendSeconds = std::clamp(seconds, 0.0f, 30.0f);
+}
+
+void MilkdropPresetEffect::SetSpectrum(const std::vector<float>& spectrum) {
+    m_spectrum = spectrum;
+}
+
+void MilkdropPresetEffect::Update(float currentTime) {
+    // The preloaded preset's GL objects are made one stage per frame, next to normal playback.
+    CollectPreload();
+    if (m_next && !m_next->IsReady()) m_next->FinalizeStep(m_fboWidth, m_fboHeight);
+
+    if (!m_shaderLoaded || !m_preset) return;
+    const auto frameStart = std::chrono::steady_clock::now();
+
+    MilkdropPreset::FrameState frame;
+    frame.deltaTime = m_deltaTime > 0.0f ? m_deltaTime : 1.0f / 60.0f;
+    frame.progress = endTime > startTime ? std::clamp((currentTime - startTime) / (endTime - startTime), 0.0f, 1.0f) : 0.0f;
+    frame.audioBands = m_audioBands;
+    frame.width = m_fboWidth;
+    frame.height = m_fboHeight;
+
+    if (m_outgoing) {
+        m_blendTime += frame.deltaTime;
+        if (m_blendTime >= m_blendSeconds) m_outgoing.reset();
+    }
+
+    // Only during a blend do two presets run.
+    m_preset->RunPerFrame(frame);
+    if (m_outgoing) m_outgoing->RunPerFrame(frame);
+    const auto perFrameEnd = std::chrono::steady_clock::now();
+    if (!UsesPixelWarp()) m_preset->RunPerVertex();
+    if (m_outgoing && (m_forceMeshWarp || !m_outgoing->HasPixelWarp())) m_outgoing->RunPerVertex();
+    const auto perVertexEnd = std::chrono::steady_clock::now();
+
+    Smooth(m_cost.perFrameMs, ElapsedMs(frameStart, perFrameEnd));
+    Smooth(m_cost.perVertexMs, ElapsedMs(perFrameEnd, perVertexEnd));
+}
+
+void MilkdropPresetEffect::SetMeshThreads(int threads) {
+    m_meshThreads = std::clamp(threads, 1, 16);
+    for (MilkdropPreset* preset : {m_preset.get(), m_outgoing.get(), m_next.get()}) {
+        if (preset) preset->SetMeshThreads(m_meshThreads);
+    }
+}
+
+void MilkdropPresetEffect::Render() {
+    if (!m_shaderLoaded || !m_preset || !m_preset->IsReady() || m_fboID == 0) {
+        return;
+    }
+    const auto renderStart = std::chrono::steady_clock::now();
+
+    // GPU time is read from the query issued two frames ago, so this never waits on the GPU.
+    const GLuint query = m_gpuQueries[m_gpuQueryIndex];
+    if (m_gpuQueryPending[m_gpuQueryIndex]) {
+        GLint available = 0;
+        glGetQueryObjectiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+        if (available) {
+            GLuint64 elapsedNs = 0;
+            glGetQueryObjectui64v(query, GL_QUERY_RESULT, &elapsedNs);
+            Smooth(m_cost.gpuMs, elapsedNs / 1.0e6);
+        }
+    }
+    glBeginQuery(GL_TIME_ELAPSED, query);
+
+    // Warp and waveform of each running preset into its own feedback
+    if (m_outgoing) m_outgoing->RenderFeedback(m_programs, m_spectrum, !m_forceMeshWarp);
+    m_preset->RenderFeedback(m_programs, m_spectrum, !m_forceMeshWarp);
+
+    // Composite into the effect's output; during a blend the incoming preset goes over the outgoing one
+    glBindFramebuffer(GL_FRAMEBUFFER, m_fboID);
+    glViewport(0, 0, m_fboWidth, m_fboHeight);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    if (m_outgoing) {
+        m_outgoing->Composite(m_programs, 1.0f, 0, 0.0f);
+        glEnable(GL_BLEND);
+        // Blend the colour only; the output stays opaque.
+        glBlendFuncSeparate(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA, GL_ZERO, GL_ONE);
+        m_preset->Composite(m_programs, GetBlendProgress(), m_blendPattern, m_blendSeed);
+        glDisable(GL_BLEND);
+    } else {
+        m_preset->Composite(m_programs, 1.0f, 0, 0.0f);
+    }
+
+    glEndQuery(GL_TIME_ELAPSED);
+    m_gpuQueryPending[m_gpuQueryIndex] = true;
+    m_gpuQueryIndex = 1 - m_gpuQueryIndex;
+
+    Smooth(m_cost.renderMs, ElapsedMs(renderStart, std::chrono::steady_clock::now()));
+}
+
+float MilkdropPresetEffect::GetBlendProgress() const {
+    if (!m_outgoing) return 1.0f;
+    return m_blendSeconds > 0.0f ? std::clamp(m_blendTime / m_blendSeconds, 0.0f, 1.0f) : 1.0f;
+}
+
+void MilkdropPresetEffect::RenderUI() {
+    if (!m_shaderLoaded && !m_compileErrorLog.empty()) {
+        ImGui::TextColored(ImVec4(1.f, 0.f, 0.f, 1.f), "Preset Error:");
+        ImGui::TextWrapped("%s", m_compileErrorLog.c_str());
+    }
+
+    ImGui::Text("Effect: %s", name.c_str());
+    ImGui::Text("Preset: %s", m_shaderFilePath.empty() ? "(edited in place)" : m_shaderFilePath.c_str());
+    ImGui::Separator();
+
+    if (ImGui::CollapsingHeader("Next Preset##MilkdropNext", ImGuiTreeNodeFlags_DefaultOpen)) {
+        switch (GetNextState()) {
+            case NextState::Empty:
+                ImGui::TextWrapped("None queued. Use \"Queue Next\" in the Preset Library.");
+                break;
+            case NextState::Compiling:
+                ImGui::Text("Compiling: %s", m_nextPath.c_str());
+                break;
+            case NextState::Finalizing:
+                ImGui::Text("Preparing: %s", m_nextPath.c_str());
+                break;
+            case NextState::Ready:
+                ImGui::Text("Ready: %s", m_nextPath.c_str());
+                if (ImGui::Button("Switch Now")) SwitchToNext();
+                break;
+            case NextState::Failed:
+                ImGui::TextColored(ImVec4(1.f, 0.4f, 0.4f, 1.f), "Could not load %s", m_nextPath.c_str());
+                ImGui::TextWrapped("%s", m_nextError.c_str());
+                break;
+        }
+        int mode = (int)m_blendMode;
+        if (ImGui::Combo("Blend", &mode, kBlendModeNames, IM_ARRAYSIZE(kBlendModeNames))) {
+            SetBlend((BlendMode)mode, m_blendSeconds);
+        }
+        if (m_blendMode != BlendMode::Cut) {
+            float seconds = m_blendSeconds;
+            if (ImGui::SliderFloat("Blend Seconds", &seconds, 0.1f, 10.0f, "%.1f")) {
+                SetBlend(m_blendMode, seconds);
+            }
+        }
+        if (IsBlending()) {
+            ImGui::ProgressBar(GetBlendProgress(), ImVec2(-1.0f, 0.0f), "Blending");
+        }
+    }
+
+    if (ImGui::CollapsingHeader("Frame Cost##MilkdropCost", ImGuiTreeNodeFlags_DefaultOpen)) {
+        ImGui::Text("Per-frame equations: %.3f ms", m_cost.perFrameMs);
+        if (UsesPixelWarp()) {
+            ImGui::Text("Per-pixel equations: on the GPU, included below");
+        } else {
+            ImGui::Text("Per-vertex equations: %.3f ms (%d vertices)", m_cost.perVertexMs, GetVertexCount());
+        }
+        ImGui::Text("Render (CPU): %.3f ms", m_cost.renderMs);
+        ImGui::Text("Render (GPU): %.3f ms", m_cost.gpuMs);
+        if (IsBlending()) ImGui::Text("Blending: both presets are included");
+    }
+
+    if (ImGui::CollapsingHeader("Warp Mesh##MilkdropMesh")) {
+        if (m_preset && m_preset->HasPixelWarp()) {
+            ImGui::Text("Per-pixel equations translate to GLSL");
+            ImGui::Checkbox("Run them on the CPU mesh instead", &m_forceMeshWarp);
+        } else if (m_preset && m_shaderLoaded) {
+            ImGui::TextWrapped("Per-pixel equations run on the CPU mesh: %s", m_preset->GetPixelWarpStatus().c_str());
+        }
+        int columns = m_meshColumns;
+        if (ImGui::SliderInt("Columns", &columns, 8, 192)) {
+            m_meshColumns = columns;
+            m_meshRows = std::max(6, columns * 3 / 4);
+            for (MilkdropPreset* preset : {m_preset.get(), m_outgoing.get(), m_next.get()}) {
+                if (preset) preset->SetMeshSize(m_meshColumns, m_meshRows);
+            }
+        }
+        ImGui::Text("Rows: %d", m_meshRows);
+        int threads = m_meshThreads;
+        if (ImGui::SliderInt("Threads", &threads, 1, std::min(WorkerPool::Shared().GetThreadCount() + 1, 16))) {
+            SetMeshThreads(threads);
+        }
+        if (m_preset && m_preset->PerPixelUsesGlobals() && m_meshThreads > 1) {
+            ImGui::TextWrapped("Runs on one thread: the per-pixel equations use reg00-reg99 or gmegabuf.");
+        }
+    }
+
+    if (m_preset && ImGui::CollapsingHeader("Equation State##MilkdropState")) {
+        ImGui::Text("bass %.2f  mid %.2f  treb %.2f", m_preset->GetVar(Bass), m_preset->GetVar(Mid), m_preset->GetVar(Treb));
+        ImGui::Text("zoom %.4f  rot %.4f  warp %.3f", m_preset->GetVar(Zoom), m_preset->GetVar(Rot), m_preset->GetVar(Warp));
+        ImGui::Text("decay %.3f  gamma %.2f", m_preset->GetVar(Decay), m_preset->GetVar(Gamma));
+    }
+}
+
+nlohmann::json MilkdropPresetEffect::Serialize() const {
+    nlohmann::json j = ShaderEffect::Serialize();
+    j["type"] = "MilkdropPresetEffect";
+    j.erase("isShadertoyMode");
+    j.erase("control_values");
+    j.erase("input_ids");
+    j["meshX"] = m_meshColumns;
+    j["meshY"] = m_meshRows;
+    j["forceMeshWarp"] = m_forceMeshWarp;
+    j["blendMode"] = (int)m_blendMode;
+    j["blendSeconds"] = m_blendSeconds;
+    return j;
+}
+
+void MilkdropPresetEffect::Deserialize(const nlohmann::json& data) {
+    ShaderEffect::Deserialize(data);
+    m_meshColumns = std::clamp(data.value("meshX", 48), 8, 192);
+    m_meshRows = std::clamp(data.value("meshY", 36), 6, 192);
+    m_forceMeshWarp = data.value("forceMeshWarp", false);
+    SetBlend((BlendMode)std::clamp(data.value("blendMode", (int)BlendMode::Warp), 0, 2), data.value("blendSeconds", 2.0f));
+}
+
+std::unique_ptr<Effect> MilkdropPresetEffect::Clone() const {
+    auto newEffect = std::make_unique<MilkdropPresetEffect>(m_shaderFilePath, m_fboWidth, m_fboHeight);
+    newEffect->name = this->name + " (Copy)";
+    if (m_shaderFilePath.empty()) {
+        newEffect->m_shaderSourceCode = this->m_shaderSourceCode;
+    }
+    newEffect->m_meshColumns = m_meshColumns;
+    newEffect->m_meshRows = m_meshRows;
+    newEffect->m_meshThreads = m_meshThreads;
+    newEffect->m_forceMeshWarp = m_forceMeshWarp;
+    newEffect->m_blendMode = m_blendMode;
+    newEffect->m_blendSeconds = m_blendSeconds;
+    return newEffect;
+}
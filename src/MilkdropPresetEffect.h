@@ -1,47 +1,119 @@
-
 #pragma once
 
 #include "ShaderEffect.h"
+#include "MilkdropPreset.h"
+#include <array>
+#include <atomic>
+#include <memory>
 #include <string>
+#include <thread>
 #include <vector>
-#include <map>
-
-// Forward declarations for projectm-eval types
-struct prjm_eval_context_;
-typedef struct prjm_eval_context_ prjm_eval_context;
-struct prjm_eval_exptreenode;
 
+// Renders a Milkdrop .milk preset. The preset's per_frame_init, per_frame and per_pixel equations
+// are compiled once with projectm-eval; every frame the per-frame code runs against the audio, the
+// per-pixel code runs at each vertex of a warp mesh (MilkdropWarpMesh, in parallel row bands), and
+// the warped mesh pulls the previous frame forward (feedback) before the waveform and composite passes. The preset text takes the place of
+// the shader source, so the editor, Apply and hot reload work as they do for GLSL effects.
+// If the per-pixel code translates to GLSL (MilkdropWarpShader), the warp runs per pixel on the GPU
+// instead of the mesh.
+//
+// The loaded state lives in a MilkdropPreset. PreloadNext() prepares a second one while the first
+// keeps playing: it is compiled on a worker thread and its GL objects are created one stage per
+// frame, so SwitchToNext() is a swap. Both presets then run until the blend window is over.
 class MilkdropPresetEffect : public ShaderEffect {
 public:
-    MilkdropPresetEffect(const std::string& presetName, const std::string& perFrameCode, const std::string& perPixelCode);
+    // Smoothed milliseconds per frame, split by stage.
+    struct FrameCost {
+        double perFrameMs = 0.0;   // per_frame equations
+        double perVertexMs = 0.0;  // per_pixel equations and warp math over the whole mesh
+        double renderMs = 0.0;     // CPU time issuing the GL passes
+        double gpuMs = 0.0;        // GPU time of the passes, one frame late
+    };
+
+    // How SwitchToNext() moves from one preset to the next.
+    enum class BlendMode {
+        Cut,        // Instant
+        Crossfade,  // Both presets run and their outputs are mixed
+        Warp,       // The incoming preset starts from the outgoing one's image and grows in through a pattern, as Milkdrop does
+    };
+
+    enum class NextState { Empty, Compiling, Finalizing, Ready, Failed };
+
+    MilkdropPresetEffect(const std::string& presetPath = "", int initialWidth = 800, int initialHeight = 600);
     ~MilkdropPresetEffect() override;
 
-    void Update(float t) override;
-    void Bind(int textureUnit);
+    void Update(float currentTime) override;
+    void Render() override;
+    void RenderUI() override;
+    void ResizeFrameBuffer(int width, int height) override;
+    // Parses presetText as a .milk file and recompiles its equations. ShaderEffect::Load,
+    // ResetParameters and hot reload all come through here; the switch is immediate.
+    void ApplyShaderCode(const std::string& presetText) override;
+
+    // Starts loading presetPath into the next-preset slot in the background, replacing whatever
+    // is there. Returns false if the previous preload is still compiling.
+    bool PreloadNext(const std::string& presetPath);
+    NextState GetNextState() const;
+    const std::string& GetNextPath() const { return m_nextPath; }
+    // Makes the next preset current and starts the blend. Returns false unless the next preset is Ready.
+    bool SwitchToNext();
+    bool IsBlending() const { return m_outgoing != nullptr; }
+    // How far the current blend has come, 0..1; 1 when not blending.
+    float GetBlendProgress() const;
+    void SetBlend(BlendMode mode, float seconds);
+
+    // Spectrum magnitudes (AudioSystem::GetFFTData()) drawn by the waveform pass.
+    void SetSpectrum(const std::vector<float>& spectrum);
+    const FrameCost& GetFrameCost() const { return m_cost; }
+    int GetVertexCount() const { return m_preset ? m_preset->GetVertexCount() : 0; }
+    // Row bands the per-vertex equations are split into, each run on its own thread.
+    void SetMeshThreads(int threads);
+    // True if the warp runs per pixel on the GPU this frame rather than on the CPU mesh.
+    bool UsesPixelWarp() const { return m_preset && m_preset->HasPixelWarp() && !m_forceMeshWarp; }
+
+    nlohmann::json Serialize() const override;
+    void Deserialize(const nlohmann::json& data) override;
+    std::unique_ptr<Effect> Clone() const override;
 
 private:
-    void CompileAndLink();
-    void ParsePerFrameCode();
-
-    std::string m_presetName;
-    std::string m_perFrameCode;
-    std::string m_perPixelCode;
-
-    // Per-frame variables
-    float m_time;
-    float m_fps;
-    float m_frame;
-    float m_progress;
-    float m_bass;
-    float m_mid;
-    float m_treb;
-    float m_bass_att;
-    float m_mid_att;
-    float m_treb_att;
-
-    std::map<std::string, float> m_q_vars;
-    std::map<std::string, float> m_t_vars;
-
-    prjm_eval_context* m_eval_context;
-    prjm_eval_exptreenode* m_per_frame_ast;
+    bool CreatePrograms();
+    void CollectPreload();
+    void JoinPreload();
+
+    // Presets: the one playing, the one being blended away from and the preloaded one
+    std::unique_ptr<MilkdropPreset> m_preset;
+    std::unique_ptr<MilkdropPreset> m_outgoing;
+    std::unique_ptr<MilkdropPreset> m_next;
+    std::string m_nextPath;
+    std::string m_nextText;
+    std::string m_nextError;
+
+    // Preload worker. m_preloadDone hands m_preloadResult and m_preloadText back to the render thread.
+    std::thread m_preloadThread;
+    std::atomic<bool> m_preloadDone{false};
+    std::unique_ptr<MilkdropPreset> m_preloadResult;
+    std::string m_preloadText;
+    std::string m_preloadError;
+
+    // Switching
+    BlendMode m_blendMode = BlendMode::Warp;
+    float m_blendSeconds = 2.0f;
+    float m_blendTime = 0.0f;
+    int m_blendPattern = 0;
+    float m_blendSeed = 0.0f;
+    int m_switchCount = 0;
+
+    std::vector<float> m_spectrum;
+    int m_meshColumns = 48;
+    int m_meshRows = 36;
+    int m_meshThreads;
+    bool m_forceMeshWarp = false;
+
+    MilkdropPreset::Programs m_programs;
+
+    // Timing
+    FrameCost m_cost;
+    std::array<GLuint, 2> m_gpuQueries{};
+    std::array<bool, 2> m_gpuQueryPending{};
+    int m_gpuQueryIndex = 0;
 };
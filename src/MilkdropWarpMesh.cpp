@@ -0,0 +1,255 @@
+#include "MilkdropWarpMesh.h"
+#include "WorkerPool.h"
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+
+namespace MilkdropVars {
+    namespace {
+        // Indexed by Var.
+        const Info kInfo[] = {
+            {"time", nullptr, 0.0f}, {"fps", nullptr, 0.0f}, {"frame", nullptr, 0.0f}, {"progress", nullptr, 0.0f},
+            {"bass", nullptr, 0.0f}, {"mid", nullptr, 0.0f}, {"treb", nullptr, 0.0f},
+            {"bass_att", nullptr, 0.0f}, {"mid_att", nullptr, 0.0f}, {"treb_att", nullptr, 0.0f},
+            {"meshx", nullptr, 0.0f}, {"meshy", nullptr, 0.0f}, {"pixelsx", nullptr, 0.0f}, {"pixelsy", nullptr, 0.0f},
+            {"aspectx", nullptr, 0.0f}, {"aspecty", nullptr, 0.0f},
+            {"zoom", "zoom", 1.0f}, {"zoomexp", "fZoomExponent", 1.0f}, {"rot", "rot", 0.0f}, {"warp", "warp", 1.0f},
+            {"cx", "cx", 0.5f}, {"cy", "cy", 0.5f}, {"dx", "dx", 0.0f}, {"dy", "dy", 0.0f}, {"sx", "sx", 1.0f}, {"sy", "sy", 1.0f},
+            {"decay", "fDecay", 0.98f}, {"gamma", "fGammaAdj", 2.0f},
+            {"echo_zoom", "fVideoEchoZoom", 1.0f}, {"echo_alpha", "fVideoEchoAlpha", 0.0f}, {"echo_orient", "nVideoEchoOrientation", 0.0f},
+            {"wave_mode", "nWaveMode", 0.0f}, {"wave_a", "fWaveAlpha", 0.8f},
+            {"wave_r", "wave_r", 1.0f}, {"wave_g", "wave_g", 1.0f}, {"wave_b", "wave_b", 1.0f},
+            {"wave_x", "wave_x", 0.5f}, {"wave_y", "wave_y", 0.5f}, {"wave_mystery", "fWaveParam", 0.0f},
+            {"wave_usedots", "bWaveDots", 0.0f}, {"wave_thick", "bWaveThick", 0.0f},
+            {"wave_additive", "bAdditiveWaves", 0.0f}, {"wave_brighten", "bMaximizeWaveColor", 1.0f},
+            {"darken_center", "bDarkenCenter", 0.0f}, {"brighten", "bBrighten", 0.0f}, {"darken", "bDarken", 0.0f},
+            {"solarize", "bSolarize", 0.0f}, {"invert", "bInvert", 0.0f},
+            {"x", nullptr, 0.0f}, {"y", nullptr, 0.0f}, {"rad", nullptr, 0.0f}, {"ang", nullptr, 0.0f},
+        };
+        static_assert(sizeof(kInfo) / sizeof(kInfo[0]) == VarCount, "kInfo must list every Var");
+    }
+
+    const Info& GetInfo(int var) {
+        return kInfo[var];
+    }
+
+    void RegisterAll(projectm_eval_context* context, Storage& storage) {
+        for (int i = 0; i < VarCount; ++i) {
+            projectm_eval_context_bind_variable(context, kInfo[i].name, &storage.vars[i]);
+        }
+        char name[8];
+        for (int i = 0; i < kQCount; ++i) {
+            std::snprintf(name, sizeof(name), "q%d", i + 1);
+            projectm_eval_context_bind_variable(context, name, &storage.q[i]);
+        }
+    }
+}
+
+using namespace MilkdropVars;
+
+MilkdropWarpMesh::~MilkdropWarpMesh() {
+    Destroy();
+}
+
+void MilkdropWarpMesh::Destroy() {
+    for (auto& band : m_bands) {
+        if (band.code) projectm_eval_code_destroy(band.code);
+        if (band.context) projectm_eval_context_destroy(band.context);
+    }
+    m_bands.clear();
+}
+
+namespace {
+    bool IsIdentifierChar(char c) {
+        return std::isalnum((unsigned char)c) || c == '_';
+    }
+
+    // Whether code names reg00-reg99, gmegabuf or gmem. Matched on whole identifiers, case-insensitive
+    // as projectm-eval is; a name inside a comment gives a false positive, which only costs the bands.
+    bool CodeUsesGlobals(const std::string& code) {
+        for (size_t i = 0; i < code.size();) {
+            if (!IsIdentifierChar(code[i])) {
+                ++i;
+                continue;
+            }
+            size_t end = i;
+            while (end < code.size() && IsIdentifierChar(code[end])) ++end;
+            std::string name = code.substr(i, end - i);
+            std::transform(name.begin(), name.end(), name.begin(), [](unsigned char c) { return (char)std::tolower(c); });
+            if (name == "gmegabuf" || name == "gmem") return true;
+            if (name.size() == 5 && name.compare(0, 3, "reg") == 0 && std::isdigit((unsigned char)name[3]) &&
+                std::isdigit((unsigned char)name[4])) {
+                return true;
+            }
+            i = end;
+        }
+        return false;
+    }
+}
+
+bool MilkdropWarpMesh::Compile(const std::string& perPixelCode, projectm_eval_global_scope* scope, int bandCount, std::string& error) {
+    Destroy();
+    // The bands would race on the shared globals
+    m_usesGlobals = CodeUsesGlobals(perPixelCode);
+    if (m_usesGlobals) bandCount = 1;
+    m_bands.resize(std::max(1, bandCount));
+    if (perPixelCode.empty()) return true;
+
+    for (auto& band : m_bands) {
+        band.context = scope ? projectm_eval_context_create_in_scope(scope) : projectm_eval_context_create(nullptr, nullptr);
+        if (!band.context) {
+            error = "could not create an expression context";
+            break;
+        }
+        RegisterAll(band.context, band.storage);
+        band.code = projectm_eval_code_compile(band.context, perPixelCode.c_str());
+        if (!band.code) {
+            int line = 0;
+            int column = 0;
+            const char* message = projectm_eval_get_error(band.context, &line, &column);
+            error = "line " + std::to_string(line) + ", column " + std::to_string(column) + ": " + (message ? message : "unknown error");
+            break;
+        }
+    }
+    if (!error.empty()) {
+        Destroy();
+        m_bands.resize(std::max(1, bandCount));
+        return false;
+    }
+    return true;
+}
+
+void MilkdropWarpMesh::SetSize(int columns, int rows) {
+    m_columns = std::max(1, columns);
+    m_rows = std::max(1, rows);
+}
+
+void MilkdropWarpMesh::Evaluate(const FrameInputs& frame, Vertex* out) {
+    const int rowCount = m_rows + 1;
+    const int bandCount = std::min((int)m_bands.size(), rowCount);
+    WorkerPool::Shared().Run(bandCount, [&](int index) {
+        const int firstRow = index * rowCount / bandCount;
+        const int endRow = (index + 1) * rowCount / bandCount;
+        EvaluateRows(m_bands[index], frame, firstRow, endRow, out);
+    });
+}
+
+std::array<float, 4> MilkdropWarpMesh::WarpFactors(float warpTime) {
+    return {11.68f + 4.0f * std::cos(warpTime * 1.413f + 10.0f),
+            8.77f + 3.0f * std::cos(warpTime * 1.113f + 7.0f),
+            10.54f + 3.0f * std::cos(warpTime * 1.233f + 3.0f),
+            11.49f + 4.0f * std::cos(warpTime * 0.933f + 5.0f)};
+}
+
+void MilkdropWarpMesh::PrepareBatch(Band& band, const FrameInputs& frame, int laneCount) const {
+    // Every vertex starts from the per-frame motion and q values, so those are passed as inputs
+    // repeating the same value in every lane; the motion values each vertex ends with are outputs.
+    constexpr int kMotionCount = Sy - Zoom + 1;
+    band.lanes.resize((size_t)BatchLaneArrays * laneCount);
+    auto lanes = [&](int array) { return band.lanes.data() + (size_t)array * laneCount; };
+    for (int k = 0; k < kMotionCount; ++k) std::fill_n(lanes(BatchMotionIn + k), laneCount, frame.vars[Zoom + k]);
+    for (int k = 0; k < kQCount; ++k) std::fill_n(lanes(BatchQ + k), laneCount, frame.q[k]);
+
+    band.batchVars.clear();
+    band.batchVars.push_back({&band.storage.vars[X], lanes(BatchX), nullptr});
+    band.batchVars.push_back({&band.storage.vars[Y], lanes(BatchY), nullptr});
+    band.batchVars.push_back({&band.storage.vars[Rad], lanes(BatchRad), nullptr});
+    band.batchVars.push_back({&band.storage.vars[Ang], lanes(BatchAng), nullptr});
+    for (int k = 0; k < kMotionCount; ++k) {
+        band.batchVars.push_back({&band.storage.vars[Zoom + k], lanes(BatchMotionIn + k), lanes(BatchMotionOut + k)});
+    }
+    for (int k = 0; k < kQCount; ++k) band.batchVars.push_back({&band.storage.q[k], lanes(BatchQ + k), nullptr});
+}
+
+void MilkdropWarpMesh::EvaluateRows(Band& band, const FrameInputs& frame, int firstRow, int endRow, Vertex* out) const {
+    // The warp, as Milkdrop computes it: zoom (bent by zoomexp towards the edges), stretch about
+    // (cx, cy), the four-term warp wobble, rotation about (cx, cy), then translation. u/v are in
+    // Milkdrop's top-down texture space until the final flip.
+    constexpr int kMotionCount = Sy - Zoom + 1;
+    const int laneCount = m_columns + 1;
+    if (band.code) {
+        band.storage.vars = frame.vars;
+        PrepareBatch(band, frame, laneCount);
+    }
+
+    const float aspectX = (float)frame.vars[AspectX];
+    const float aspectY = (float)frame.vars[AspectY];
+    const float warpTime = frame.warpTime;
+    const float warpScaleInv = 1.0f / (frame.warpScale != 0.0f ? frame.warpScale : 1.0f);
+    const std::array<float, 4> factors = WarpFactors(warpTime);
+    const float f0 = factors[0];
+    const float f1 = factors[1];
+    const float f2 = factors[2];
+    const float f3 = factors[3];
+
+    for (int j = firstRow; j < endRow; ++j) {
+        const float fy = (float)j / m_rows * 2.0f - 1.0f;
+        if (band.code) {
+            // The whole row runs as one batch, so vertices whose equations don't depend on each
+            // other are evaluated several at a time.
+            PRJM_EVAL_F* x = band.lanes.data() + (size_t)BatchX * laneCount;
+            PRJM_EVAL_F* y = band.lanes.data() + (size_t)BatchY * laneCount;
+            PRJM_EVAL_F* rad = band.lanes.data() + (size_t)BatchRad * laneCount;
+            PRJM_EVAL_F* ang = band.lanes.data() + (size_t)BatchAng * laneCount;
+            for (int i = 0; i < laneCount; ++i) {
+                const float fx = (float)i / m_columns * 2.0f - 1.0f;
+                x[i] = fx * 0.5f + 0.5f;
+                y[i] = -fy * 0.5f + 0.5f;
+                rad[i] = std::sqrt(fx * fx * aspectX * aspectX + fy * fy * aspectY * aspectY) * 0.70710678f;
+                const float angle = std::atan2(fy * aspectY, fx * aspectX);
+                ang[i] = angle < 0.0f ? angle + 6.28318531f : angle;
+            }
+            projectm_eval_code_execute_batch(band.code, laneCount, band.batchVars.data(), (int)band.batchVars.size(), nullptr);
+        }
+
+        for (int i = 0; i <= m_columns; ++i) {
+            const float fx = (float)i / m_columns * 2.0f - 1.0f;
+            const float rad = std::sqrt(fx * fx * aspectX * aspectX + fy * fy * aspectY * aspectY) * 0.70710678f;
+
+            const PRJM_EVAL_F* motion = &frame.vars[Zoom];
+            PRJM_EVAL_F vertexMotion[kMotionCount];
+            if (band.code) {
+                const PRJM_EVAL_F* results = band.lanes.data() + (size_t)BatchMotionOut * laneCount;
+                for (int k = 0; k < kMotionCount; ++k) vertexMotion[k] = results[(size_t)k * laneCount + i];
+                motion = vertexMotion;
+            }
+            auto value = [&](int var) { return (float)motion[var - Zoom]; };
+
+            const float zoom = std::pow(value(Zoom), std::pow(value(ZoomExp), rad * 2.0f - 1.0f));
+            const float zoomInv = zoom != 0.0f ? 1.0f / zoom : 1.0f;
+            const float cx = value(Cx);
+            const float cy = value(Cy);
+            float u = fx * aspectX * 0.5f * zoomInv + 0.5f;
+            float v = -fy * aspectY * 0.5f * zoomInv + 0.5f;
+
+            const float sx = value(Sx);
+            const float sy = value(Sy);
+            if (sx != 0.0f) u = (u - cx) / sx + cx;
+            if (sy != 0.0f) v = (v - cy) / sy + cy;
+
+            const float warp = value(Warp);
+            if (warp != 0.0f) {
+                u += warp * 0.0035f * std::sin(warpTime * 0.333f + warpScaleInv * (fx * f0 - fy * f3));
+                v += warp * 0.0035f * std::cos(warpTime * 0.375f - warpScaleInv * (fx * f2 + fy * f1));
+                u += warp * 0.0035f * std::cos(warpTime * 0.753f - warpScaleInv * (fx * f1 - fy * f2));
+                v += warp * 0.0035f * std::sin(warpTime * 0.825f + warpScaleInv * (fx * f0 + fy * f3));
+            }
+
+            const float rot = value(Rot);
+            const float u2 = u - cx;
+            const float v2 = v - cy;
+            const float cosRot = std::cos(rot);
+            const float sinRot = std::sin(rot);
+            u = u2 * cosRot - v2 * sinRot + cx;
+            v = u2 * sinRot + v2 * cosRot + cy;
+
+            u -= value(Dx);
+            v -= value(Dy);
+            u = (u - 0.5f) / aspectX + 0.5f;
+            v = (v - 0.5f) / aspectY + 0.5f;
+
+            out[(size_t)j * (m_columns + 1) + i] = {fx, fy, u, 1.0f - v};
+        }
+    }
+}
@@ -0,0 +1,122 @@
+#pragma once
+
+#include "projectm-eval.h"
+#include <array>
+#include <string>
+#include <vector>
+
+// Variables Milkdrop equations can read and write, bound with projectm_eval_context_bind_variable.
+namespace MilkdropVars {
+    enum Var {
+        // Set by the host before the per-frame code
+        Time, Fps, Frame, Progress, Bass, Mid, Treb, BassAtt, MidAtt, TrebAtt,
+        MeshX, MeshY, PixelsX, PixelsY, AspectX, AspectY,
+        // Preset values, reset to the file's values before the per-frame code. Zoom..Sy can also
+        // be changed per vertex.
+        Zoom, ZoomExp, Rot, Warp, Cx, Cy, Dx, Dy, Sx, Sy,
+        Decay, Gamma, EchoZoom, EchoAlpha, EchoOrient,
+        WaveMode, WaveA, WaveR, WaveG, WaveB, WaveX, WaveY, WaveMystery,
+        WaveUseDots, WaveThick, WaveAdditive, WaveBrighten,
+        DarkenCenter, Brighten, Darken, Solarize, Invert,
+        // Per-vertex inputs
+        X, Y, Rad, Ang,
+        VarCount
+    };
+    constexpr int kQCount = 32;
+
+    struct Info {
+        const char* name;       // As the equations spell it
+        const char* presetKey;  // .milk key holding the preset value, if any
+        float defaultValue;
+    };
+    const Info& GetInfo(int var);
+
+    // Every Var and q1..q32 in fixed slots, so the host sets and saves them as whole arrays.
+    struct Storage {
+        std::array<PRJM_EVAL_F, VarCount> vars{};
+        std::array<PRJM_EVAL_F, kQCount> q{};
+    };
+
+    // Binds every Var and q1..q32 in context to its slot in storage, which must not move while
+    // the context exists. Call before compiling any code into context.
+    void RegisterAll(projectm_eval_context* context, Storage& storage);
+}
+
+// The per-vertex half of a Milkdrop preset: runs the per_pixel equations at every vertex of the warp
+// mesh and turns the results into the texture coordinates the feedback is sampled at. The mesh is
+// split into row bands that run in parallel on WorkerPool::Shared(). Each band has its own
+// projectm-eval context with the code compiled into it, so each has its own copy of the preset's
+// variables; the per-frame values are passed in read-only and copied into each band before it
+// starts. reg00-reg99 and gmegabuf are not copied: they live in the preset's global scope, which
+// every band context is created in, and nothing orders the bands' reads and writes of them. Code
+// that uses them therefore runs as a single band.
+class MilkdropWarpMesh {
+public:
+    struct Vertex {
+        float x, y;  // Clip space
+        float u, v;  // Where the previous frame is sampled
+    };
+
+    // Everything the bands start from. vars and q are the values after the per-frame code.
+    struct FrameInputs {
+        std::array<PRJM_EVAL_F, MilkdropVars::VarCount> vars{};
+        std::array<PRJM_EVAL_F, MilkdropVars::kQCount> q{};
+        float warpTime = 0.0f;   // time * fWarpAnimSpeed
+        float warpScale = 1.0f;  // fWarpScale
+    };
+
+    MilkdropWarpMesh() = default;
+    ~MilkdropWarpMesh();
+
+    MilkdropWarpMesh(const MilkdropWarpMesh&) = delete;
+    MilkdropWarpMesh& operator=(const MilkdropWarpMesh&) = delete;
+
+    // Compiles perPixelCode (may be empty) into bandCount contexts in scope, which must outlive
+    // them; nullptr uses projectm-eval's built-in globals. If the code uses reg00-reg99 or
+    // gmegabuf, it gets one band whatever bandCount is. On failure, error holds the compiler
+    // message and the mesh evaluates with no per-pixel code.
+    bool Compile(const std::string& perPixelCode, projectm_eval_global_scope* scope, int bandCount, std::string& error);
+    // Columns and rows of quads; the mesh has (columns + 1) * (rows + 1) vertices.
+    void SetSize(int columns, int rows);
+
+    int GetColumns() const { return m_columns; }
+    int GetRows() const { return m_rows; }
+    int GetVertexCount() const { return (m_columns + 1) * (m_rows + 1); }
+    int GetBandCount() const { return (int)m_bands.size(); }
+    // True if the per-pixel code reads or writes reg00-reg99 or gmegabuf, and so runs as one band.
+    bool UsesGlobals() const { return m_usesGlobals; }
+
+    // Writes GetVertexCount() vertices, bottom row first.
+    void Evaluate(const FrameInputs& frame, Vertex* out);
+    // The four frequencies of the warp wobble at warpTime, shared with the per-pixel warp shader.
+    static std::array<float, 4> WarpFactors(float warpTime);
+
+private:
+    struct Band {
+        projectm_eval_context* context = nullptr;
+        projectm_eval_code* code = nullptr;
+        MilkdropVars::Storage storage;  // Bound into context; m_bands is not resized while contexts exist
+        // One row of per-vertex values for projectm_eval_code_execute_batch, BatchLaneArrays
+        // arrays of (columns + 1) values each.
+        std::vector<PRJM_EVAL_F> lanes;
+        std::vector<projectm_eval_batch_variable> batchVars;
+    };
+
+    // Index of each per-lane array in Band::lanes.
+    enum BatchArray {
+        BatchX, BatchY, BatchRad, BatchAng,
+        BatchMotionIn,
+        BatchQ = BatchMotionIn + (MilkdropVars::Sy - MilkdropVars::Zoom + 1),
+        BatchMotionOut = BatchQ + MilkdropVars::kQCount,
+        BatchLaneArrays = BatchMotionOut + (MilkdropVars::Sy - MilkdropVars::Zoom + 1)
+    };
+
+    void Destroy();
+    void PrepareBatch(Band& band, const FrameInputs& frame, int laneCount) const;
+    void EvaluateRows(Band& band, const FrameInputs& frame, int firstRow, int endRow, Vertex* out) const;
+
+    std::vector<Band> m_bands;
+    bool m_usesGlobals = false;
+    int m_columns = 48;
+    int m_rows = 36;
+};
@@ -0,0 +1,111 @@
+#include "MilkdropWarpShader.h"
+#include "MilkdropWarpMesh.h"
+#include <array>
+#include <fstream>
+#include <sstream>
+#include <vector>
+
+using namespace MilkdropVars;
+
+namespace {
+    constexpr const char* kTemplatePath = "shaders/milkdrop_warp_pixel.frag";
+
+    // Replaces the whole line holding marker with text.
+    bool ReplaceMarker(std::string& source, const char* marker, std::string text) {
+        const size_t found = source.find(marker);
+        if (found == std::string::npos) return false;
+        const size_t lineStart = source.rfind('\n', found) + 1;
+        size_t lineEnd = source.find('\n', found);
+        if (lineEnd == std::string::npos) lineEnd = source.size();
+        if (!text.empty() && text.back() == '\n') text.pop_back();
+        source.replace(lineStart, lineEnd - lineStart, text);
+        return true;
+    }
+
+    // Motion values and q start at the per-frame values and may be changed by the equations; x, y,
+    // rad and ang are set by the template. Everything else is read-only, as a write would have to
+    // carry over to the next vertex the way it does on the CPU.
+    bool IsLocal(int var) {
+        return (var >= Zoom && var <= Sy) || var >= X;
+    }
+
+    std::string Translate(const std::string& perPixelCode, std::string& reason) {
+        projectm_eval_context* context = projectm_eval_context_create(nullptr, nullptr);
+        if (!context) {
+            reason = "could not create an expression context";
+            return "";
+        }
+        Storage storage;
+        RegisterAll(context, storage);
+        projectm_eval_code* code = projectm_eval_code_compile(context, perPixelCode.c_str());
+        if (!code) {
+            reason = "the equations do not compile";
+            projectm_eval_context_destroy(context);
+            return "";
+        }
+
+        std::vector<std::string> names;
+        std::vector<projectm_eval_glsl_variable> variables;
+        names.reserve(VarCount + kQCount);
+        for (int i = 0; i < VarCount; ++i) {
+            names.push_back(IsLocal(i) ? std::string("md_") + GetInfo(i).name : "frameVars[" + std::to_string(i) + "]");
+        }
+        for (int i = 0; i < kQCount; ++i) names.push_back("md_q" + std::to_string(i + 1));
+        for (int i = 0; i < VarCount; ++i) variables.push_back({&storage.vars[i], names[i].c_str(), IsLocal(i) ? 1 : 0});
+        for (int i = 0; i < kQCount; ++i) variables.push_back({&storage.q[i], names[VarCount + i].c_str(), 1});
+
+        std::string statements;
+        const char* why = nullptr;
+        const int length = projectm_eval_code_to_glsl(code, variables.data(), (int)variables.size(), nullptr, 0, &why);
+        if (length < 0) {
+            reason = why ? why : "the equations cannot be translated";
+        } else {
+            std::vector<char> buffer((size_t)length + 1);
+            projectm_eval_code_to_glsl(code, variables.data(), (int)variables.size(), buffer.data(), length + 1, nullptr);
+            // Indented to sit inside main().
+            std::istringstream lines(buffer.data());
+            std::string line;
+            while (std::getline(lines, line)) statements += "    " + line + "\n";
+        }
+        projectm_eval_code_destroy(code);
+        projectm_eval_context_destroy(context);
+        return length < 0 ? "" : statements;
+    }
+}
+
+namespace MilkdropWarpShader {
+    std::string Generate(const std::string& perPixelCode, std::string& reason) {
+        reason.clear();
+        std::ifstream file(kTemplatePath);
+        if (!file) {
+            reason = std::string("could not read ") + kTemplatePath;
+            return "";
+        }
+        std::stringstream templateStream;
+        templateStream << file.rdbuf();
+        std::string source = templateStream.str();
+
+        std::string equations;
+        for (int i = Zoom; i <= Sy; ++i) {
+            equations += "    float md_" + std::string(GetInfo(i).name) + " = frameVars[" + std::to_string(i) + "];\n";
+        }
+        for (int i = 0; i < kQCount; ++i) {
+            equations += "    float md_q" + std::to_string(i + 1) + " = frameQ[" + std::to_string(i) + "];\n";
+        }
+        if (!perPixelCode.empty()) {
+            const std::string statements = Translate(perPixelCode, reason);
+            if (!reason.empty()) return "";
+            equations += statements;
+        }
+
+        const std::string uniforms = "uniform float frameVars[" + std::to_string((int)X) + "];\n" +
+                                     "uniform float frameQ[" + std::to_string(kQCount) + "];";
+        if (!ReplaceMarker(source, "// @uniforms", uniforms) ||
+            !ReplaceMarker(source, "// @functions", projectm_eval_glsl_functions()) ||
+            !ReplaceMarker(source, "// @equations", equations)) {
+            reason = std::string(kTemplatePath) + " is missing a // @ marker";
+            return "";
+        }
+        return source;
+    }
+}
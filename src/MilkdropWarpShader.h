@@ -0,0 +1,14 @@
+#pragma once
+
+#include <string>
+
+// Builds the per-pixel feedback shader for a preset: the per_pixel equations are translated to GLSL
+// with projectm_eval_code_to_glsl and spliced into shaders/milkdrop_warp_pixel.frag, so the warp runs
+// at every pixel instead of at the vertices of MilkdropWarpMesh. The per-frame values arrive in two
+// uniform arrays: frameVars[MilkdropVars::X], indexed by MilkdropVars::Var, and frameQ[kQCount].
+namespace MilkdropWarpShader {
+    // Returns the fragment shader source, or an empty string with reason set if the equations use
+    // something a shader cannot run (loops, megabuf, rand(), values carried from one vertex to the
+    // next) and have to stay on the CPU mesh. Empty perPixelCode always succeeds.
+    std::string Generate(const std::string& perPixelCode, std::string& reason);
+}
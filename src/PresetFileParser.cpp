@@ -1,14 +1,141 @@
 #include "PresetFileParser.hpp"
 
 #include <algorithm>
+#include <charconv>
+#include <cstring>
 #include <fstream>
-#include <sstream>
 #include <vector>
 
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 namespace libprojectM {
 
+namespace {
+
+/**
+ * @brief ASCII-only lower-casing, matching std::tolower in the C locale.
+ */
+inline auto LowerChar(char c) -> char
+{
+    return (c >= 'A' && c <= 'Z') ? static_cast<char>(c - 'A' + 'a') : c;
+}
+
+auto KeysEqual(std::string_view a, std::string_view b) -> bool
+{
+    if (a.size() != b.size())
+    {
+        return false;
+    }
+    for (size_t i = 0; i < a.size(); ++i)
+    {
+        if (LowerChar(a[i]) != LowerChar(b[i]))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+} // namespace
+
+/**
+ * @brief Read-only file contents, read into one owned buffer.
+ *
+ * The file is copied rather than memory-mapped: the parser keeps string_views into it for its whole
+ * lifetime, and a mapped preset that is truncated meanwhile (an editor saving it, hot reload) would
+ * turn the next lookup into SIGBUS. Presets are small, so the copy costs little.
+ */
+class PresetFileParser::FileContents
+{
+public:
+    FileContents() = default;
+
+    explicit FileContents(std::string buffer)
+        : m_buffer(std::move(buffer))
+    {
+    }
+
+    FileContents(const FileContents&) = delete;
+    auto operator=(const FileContents&) -> FileContents& = delete;
+
+    /**
+     * @brief Reads the whole file into the buffer with a single read where possible.
+     * @return False if the file can't be opened or read, is not a regular file, is empty or is larger than maxFileSize.
+     */
+    auto Open(const std::string& path) -> bool
+    {
+#ifdef _WIN32
+        HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE)
+        {
+            return false;
+        }
+        LARGE_INTEGER size;
+        if (!GetFileSizeEx(file, &size) || size.QuadPart == 0 || static_cast<uint64_t>(size.QuadPart) > maxFileSize)
+        {
+            CloseHandle(file);
+            return false;
+        }
+        m_buffer.resize(static_cast<size_t>(size.QuadPart));
+        DWORD bytesRead{0};
+        const bool ok = ReadFile(file, m_buffer.data(), static_cast<DWORD>(m_buffer.size()), &bytesRead, nullptr) && bytesRead == m_buffer.size();
+        CloseHandle(file);
+        return ok;
+#else
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+        {
+            return false;
+        }
+        struct stat st;
+        if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size == 0 || static_cast<uint64_t>(st.st_size) > maxFileSize)
+        {
+            close(fd);
+            return false;
+        }
+        m_buffer.resize(static_cast<size_t>(st.st_size));
+        size_t bytesRead{0};
+        while (bytesRead < m_buffer.size())
+        {
+            const ssize_t result = read(fd, m_buffer.data() + bytesRead, m_buffer.size() - bytesRead);
+            if (result <= 0)
+            {
+                break;
+            }
+            bytesRead += static_cast<size_t>(result);
+        }
+        close(fd);
+        return bytesRead == m_buffer.size();
+#endif
+    }
+
+    auto Data() const -> std::string_view
+    {
+        return m_buffer;
+    }
+
+private:
+    std::string m_buffer;
+};
+
 auto PresetFileParser::Read(const std::string& presetFile) -> bool
 {
+    auto contents = std::make_shared<FileContents>();
+    if (contents->Open(presetFile))
+    {
+        return Parse(std::move(contents));
+    }
+
+    // Not a regular file (e.g. a pipe), try reading it as a stream. Fails the same way for missing or oversized files.
     std::ifstream presetStream(presetFile.c_str(), std::ios_base::in | std::ios_base::binary);
     return Read(presetStream);
 }
@@ -29,7 +156,7 @@ auto PresetFileParser::Read(std::istream& presetStream) -> bool
         return false;
     }
 
-    std::vector<char> presetFileContents(fileSize);
+    std::string presetFileContents(static_cast<size_t>(fileSize), '\0');
     presetStream.read(presetFileContents.data(), fileSize);
 
     if (presetStream.fail() || presetStream.bad())
@@ -37,82 +164,106 @@ auto PresetFileParser::Read(std::istream& presetStream) -> bool
         return false;
     }
 
-    size_t startPos{0}; //!< Starting position of current line
-    size_t pos{0};      //!< Current read position
+    return Parse(std::make_shared<const FileContents>(std::move(presetFileContents)));
+}
+
+auto PresetFileParser::Parse(std::shared_ptr<const FileContents> contents) -> bool
+{
+    const std::string_view data = contents->Data();
+    m_contents.push_back(std::move(contents));
+    m_valueMapBuilt = false;
+
+    // Null char is not expected. Could be a random binary file.
+    if (std::memchr(data.data(), '\0', data.size()) != nullptr)
+    {
+        return false;
+    }
 
-    auto parseLineIfDataAvailable = [this, &pos, &startPos, &presetFileContents]() {
-        if (pos > startPos)
+    // Size the line index and hash table once, from the number of line breaks.
+    const size_t lineCount = m_lines.size() + static_cast<size_t>(std::count(data.begin(), data.end(), '\n')) + 1;
+    m_lines.reserve(lineCount);
+    if (lineCount * 2 > m_slots.size())
+    {
+        size_t slotCount = std::max<size_t>(m_slots.size(), 256);
+        while (lineCount * 2 > slotCount)
         {
-            auto beg = presetFileContents.begin();
-            std::string line(beg + startPos, beg + pos);
-            ParseLine(line);
+            slotCount *= 2;
         }
-    };
+        Rehash(slotCount);
+    }
 
-    while (pos < presetFileContents.size())
+    // Lines end at CR or LF; empty lines (the second half of CRLF) are skipped.
+    size_t startPos{0}; //!< Starting position of current line
+    while (startPos < data.size())
     {
-        switch (presetFileContents[pos])
-        {
-            case '\r':
-            case '\n':
-                // EOL, skip over CRLF
-                parseLineIfDataAvailable();
-                startPos = pos + 1;
-                break;
+        const char* lineEnd = static_cast<const char*>(std::memchr(data.data() + startPos, '\n', data.size() - startPos));
+        size_t endPos = lineEnd ? static_cast<size_t>(lineEnd - data.data()) : data.size();
 
-            case '\0':
-                // Null char is not expected. Could be a random binary file.
-                return false;
+        const char* carriageReturn = static_cast<const char*>(std::memchr(data.data() + startPos, '\r', endPos - startPos));
+        if (carriageReturn != nullptr)
+        {
+            endPos = static_cast<size_t>(carriageReturn - data.data());
         }
 
-        ++pos;
+        if (endPos > startPos)
+        {
+            ParseLine(data.substr(startPos, endPos - startPos));
+        }
+        startPos = endPos + 1;
     }
 
-    parseLineIfDataAvailable();
-
-    return !m_presetValues.empty();
+    return !m_lines.empty();
 }
 
 auto PresetFileParser::GetCode(const std::string& keyPrefix) const -> std::string
 {
-    auto lowerKey = ToLower(keyPrefix);
-
-    std::stringstream code;                        //!< The parsed code
-    std::string key(lowerKey.length() + 5, '\0'); //!< Allocate a string that can hold up to 5 digits.
-
-    key.replace(0, lowerKey.length(), lowerKey);
+    std::string key(keyPrefix);
+    key.reserve(keyPrefix.length() + 5); //!< Up to 5 digits.
 
+    // Collect the lines first, so the code is assembled in a single allocation.
+    std::vector<std::string_view> lines;
+    size_t codeLength{0};
     for (int index{1}; index <= 99999; ++index)
     {
-        key.replace(lowerKey.length(), 5, std::to_string(index));
-        if (m_presetValues.find(key) == m_presetValues.end())
+        char digits[8];
+        auto result = std::to_chars(digits, digits + sizeof(digits), index);
+        key.replace(keyPrefix.length(), std::string::npos, digits, result.ptr - digits);
+
+        const auto* value = Find(key);
+        if (value == nullptr)
         {
             break;
         }
 
-        auto line = m_presetValues.at(key);
+        auto line = *value;
 
         // Remove backtick char in shader code
-        if (!line.empty() && line.at(0) == '`')
+        if (!line.empty() && line.front() == '`')
         {
-            line.erase(0, 1);
+            line.remove_prefix(1);
         }
-        code << line << std::endl;
+        lines.push_back(line);
+        codeLength += line.size() + 1;
     }
 
-    auto codeStr = code.str();
+    std::string code;
+    code.reserve(codeLength);
+    for (const auto& line : lines)
+    {
+        code.append(line);
+        code.push_back('\n');
+    }
 
-    return codeStr;
+    return code;
 }
 
 auto PresetFileParser::GetInt(const std::string& key, int defaultValue) -> int
 {
-    auto lowerKey = ToLower(key);
-    if (m_presetValues.find(lowerKey) != m_presetValues.end())
+    if (const auto* value = Find(key))
     {
         try
         {
-            return std::stoi(m_presetValues.at(lowerKey));
+            return std::stoi(std::string(*value));
         }
         catch (std::logic_error&)
         {
@@ -124,12 +275,11 @@ auto PresetFileParser::GetInt(const std::string& key, int defaultValue) -> int
 
 auto PresetFileParser::GetFloat(const std::string& key, float defaultValue) -> float
 {
-    auto lowerKey = ToLower(key);
-    if (m_presetValues.find(lowerKey) != m_presetValues.end())
+    if (const auto* value = Find(key))
     {
         try
         {
-            return std::stof(m_presetValues.at(lowerKey));
+            return std::stof(std::string(*value));
         }
         catch (std::logic_error&)
         {
@@ -146,10 +296,9 @@ auto PresetFileParser::GetBool(const std::string& key, bool defaultValue) -> boo
 
 auto PresetFileParser::GetString(const std::string& key, const std::string& defaultValue) -> std::string
 {
-    auto lowerKey = ToLower(key);
-    if (m_presetValues.find(lowerKey) != m_presetValues.end())
+    if (const auto* value = Find(key))
     {
-        return m_presetValues.at(lowerKey);
+        return std::string(*value);
     }
 
     return defaultValue;
@@ -157,29 +306,106 @@ auto PresetFileParser::GetString(const std::string& key, const std::string& defa
 
 const std::map<std::string, std::string>& PresetFileParser::PresetValues() const
 {
+    if (!m_valueMapBuilt)
+    {
+        m_presetValues.clear();
+        for (const auto& line : m_lines)
+        {
+            m_presetValues.emplace(ToLower(std::string(line.key)), std::string(line.value));
+        }
+        m_valueMapBuilt = true;
+    }
     return m_presetValues;
 }
 
-void PresetFileParser::ParseLine(const std::string& line)
+void PresetFileParser::ParseLine(std::string_view line)
 {
     // Search for first delimiter, either space or equal
-    auto varNameDelimiterPos = line.find_first_of(" =");
+    size_t varNameDelimiterPos{0};
+    while (varNameDelimiterPos < line.size() && line[varNameDelimiterPos] != ' ' && line[varNameDelimiterPos] != '=')
+    {
+        ++varNameDelimiterPos;
+    }
 
-    if (varNameDelimiterPos == std::string::npos || varNameDelimiterPos == 0)
+    if (varNameDelimiterPos == line.size() || varNameDelimiterPos == 0)
     {
         // Empty line, delimiter at start of line or no delimiter found, skip.
         return;
     }
 
-    // Convert key to lower case, as INI functions are not case-sensitive.
-    std::string varName(ToLower(std::string(line.begin(), line.begin() + varNameDelimiterPos)));
-    std::string value(line.begin() + varNameDelimiterPos + 1, line.end());
+    // Keys are compared case-insensitively, as INI functions are not case-sensitive.
+    Line entry{line.substr(0, varNameDelimiterPos), line.substr(varNameDelimiterPos + 1), 0};
+    entry.hash = HashKey(entry.key);
+
+    // Keep the table at most half full.
+    if ((m_lines.size() + 1) * 2 > m_slots.size())
+    {
+        Rehash(std::max<size_t>(m_slots.size() * 2, 256));
+    }
+
+    const size_t mask = m_slots.size() - 1;
+    for (size_t slot = entry.hash & mask;; slot = (slot + 1) & mask)
+    {
+        if (m_slots[slot] == 0)
+        {
+            m_lines.push_back(entry);
+            m_slots[slot] = static_cast<uint32_t>(m_lines.size());
+            return;
+        }
+        const auto& existing = m_lines[m_slots[slot] - 1];
+        if (existing.hash == entry.hash && KeysEqual(existing.key, entry.key))
+        {
+            // Only keep first occurrence to mimic Milkdrop behaviour
+            return;
+        }
+    }
+}
+
+auto PresetFileParser::Find(std::string_view key) const -> const std::string_view*
+{
+    if (m_slots.empty())
+    {
+        return nullptr;
+    }
 
-    // Only add first occurrence to mimic Milkdrop behaviour
-    if (!varName.empty() && m_presetValues.find(varName) == m_presetValues.end())
+    const uint32_t hash = HashKey(key);
+    const size_t mask = m_slots.size() - 1;
+    for (size_t slot = hash & mask; m_slots[slot] != 0; slot = (slot + 1) & mask)
+    {
+        const auto& line = m_lines[m_slots[slot] - 1];
+        if (line.hash == hash && KeysEqual(line.key, key))
+        {
+            return &line.value;
+        }
+    }
+    return nullptr;
+}
+
+void PresetFileParser::Rehash(size_t slotCount)
+{
+    m_slots.assign(slotCount, 0);
+
+    const size_t mask = m_slots.size() - 1;
+    for (size_t index = 0; index < m_lines.size(); ++index)
+    {
+        size_t slot = m_lines[index].hash & mask;
+        while (m_slots[slot] != 0)
+        {
+            slot = (slot + 1) & mask;
+        }
+        m_slots[slot] = static_cast<uint32_t>(index + 1);
+    }
+}
+
+auto PresetFileParser::HashKey(std::string_view key) -> uint32_t
+{
+    uint32_t hash = 2166136261u;
+    for (char c : key)
     {
-        m_presetValues.emplace(std::move(varName), std::move(value));
+        hash ^= static_cast<unsigned char>(LowerChar(c));
+        hash *= 16777619u;
     }
+    return hash;
 }
 
 auto PresetFileParser::ToLower(std::string str) -> std::string
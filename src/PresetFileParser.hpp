@@ -1,7 +1,11 @@
 #pragma once
 
+#include <cstdint>
 #include <map>
+#include <memory>
 #include <string>
+#include <string_view>
+#include <vector>
 
 namespace libprojectM {
 
@@ -13,6 +17,10 @@ namespace libprojectM {
  *
  * Values and code blocks can easily be accessed via the helper functions. It is also possible to access the parsed
  * map contents directly if required.
+ *
+ * Files are read into one buffer and never copied after that: each line is stored as a pair of views into the file
+ * contents, which the parser (and any copy of it) keeps alive, and looked up through an open-addressing hash table
+ * with case-insensitive hashing, so keys don't need to be lower-cased either.
  */
 class PresetFileParser
 {
@@ -22,13 +30,13 @@ public:
     static constexpr size_t maxFileSize = 0x100000; //!< Maximum size of a preset file. Used for sanity checks.
 
     /**
-     * @brief Reads the preset file into an internal map to prepare for parsing.
+     * @brief Reads the preset file and indexes its lines to prepare for parsing.
      * @return True if the file was parsed successfully, false if an error occurred or no line could be parsed.
      */
     [[nodiscard]] auto Read(const std::string& presetFile) -> bool;
 
     /**
-     * @brief Reads the data stream into an internal map to prepare for parsing.
+     * @brief Reads the data stream into an internal buffer and indexes its lines to prepare for parsing.
      * @return True if the stream was parsed successfully, false if an error occurred or no line could be parsed.
      */
     [[nodiscard]] auto Read(std::istream& presetStream) -> bool;
@@ -100,23 +108,63 @@ public:
     [[nodiscard]] auto GetString(const std::string& key, const std::string& defaultValue) -> std::string;
 
     /**
-     * @brief Returns a reference to the internal value map.
-     * @return A reference to the internal value map.
+     * @brief Returns a map of all keys, lower-cased, and their values.
+     *
+     * The map is built from the line index on the first call, so this is not safe to call from several threads
+     * at once on the same parser.
+     *
+     * @return A reference to the value map.
      */
     auto PresetValues() const -> const ValueMap&;
 
 protected:
     /**
-     * @brief Parses a single line and stores the result in the value map.
+     * @brief Parses a single line and adds it to the line index.
      *
      * The function doesn't really care about invalid lines with random text or comments. The first "word"
-     * is added as key to the map, but will not be used afterwards.
+     * is added as key to the index, but will not be used afterwards.
      *
-     * @param line The line to parse.
+     * @param line The line to parse. Only views of it are stored, so it must point into contents the parser owns.
      */
-    void ParseLine(const std::string& line);
+    void ParseLine(std::string_view line);
 
 private:
+    class FileContents; //!< The file, read into an owned buffer.
+
+    /**
+     * @brief One key/value line, pointing into the file contents.
+     */
+    struct Line
+    {
+        std::string_view key;
+        std::string_view value;
+        uint32_t hash{};
+    };
+
+    /**
+     * @brief Indexes all lines of the given contents and keeps them alive.
+     * @return True if any line was parsed and no NUL character was found.
+     */
+    auto Parse(std::shared_ptr<const FileContents> contents) -> bool;
+
+    /**
+     * @brief Looks up a key, ignoring case.
+     * @return The value, or nullptr if the key doesn't exist.
+     */
+    auto Find(std::string_view key) const -> const std::string_view*;
+
+    /**
+     * @brief Resizes the hash table and reinserts all lines.
+     * @param slotCount The new table size, a power of two.
+     */
+    void Rehash(size_t slotCount);
+
+    /**
+     * @brief FNV-1a hash of the lower-cased key.
+     */
+    static auto HashKey(std::string_view key) -> uint32_t;
+
+
     /**
      * @brief Converts the string to lower-case.
      * Only letters A-Z are converted to a-z by default.
@@ -125,7 +173,12 @@ private:
      */
     static auto ToLower(std::string str) -> std::string;
 
-    ValueMap m_presetValues; //!< Map with preset keys and their value.
+    std::vector<std::shared_ptr<const FileContents>> m_contents; //!< Everything the line views point into.
+    std::vector<Line> m_lines;                                   //!< First occurrence of every key, in file order.
+    std::vector<uint32_t> m_slots;                               //!< Hash table of m_lines indices plus one, 0 if empty.
+
+    mutable ValueMap m_presetValues;  //!< Lower-cased copy of the lines, built by PresetValues().
+    mutable bool m_valueMapBuilt{false};
 };
 
 } // namespace libprojectM
@@ -0,0 +1,340 @@
+#include "PresetLibrary.h"
+#include "PresetFileParser.hpp"
+#include "WorkerPool.h"
+#include "projectm-eval.h"
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <unordered_map>
+
+const char* const PresetLibrary::INDEX_PATH = "cache/preset_library.rmvindex";
+
+namespace {
+    const char kIndexMagic[4] = { 'R', 'M', 'V', 'L' };
+    const uint32_t kIndexVersion = 1;
+    const uint32_t kMaxStringLength = 1 << 16;
+    const int kCustomSlots = 4;  // Custom waves and shapes per preset
+
+    struct IndexHeader {
+        char magic[4];
+        uint32_t version;
+        uint32_t infoSize;
+        uint32_t entryCount;
+    };
+
+    std::string ToLower(std::string text) {
+        std::transform(text.begin(), text.end(), text.begin(), [](unsigned char c) { return (char)std::tolower(c); });
+        return text;
+    }
+
+    bool GetSourceStamp(const std::string& path, uint64_t& size, int64_t& mtime) {
+        std::error_code ec;
+        size = std::filesystem::file_size(path, ec);
+        if (ec) return false;
+        auto time = std::filesystem::last_write_time(path, ec);
+        if (ec) return false;
+        mtime = (int64_t)time.time_since_epoch().count();
+        return true;
+    }
+
+    void WriteString(std::ostream& out, const std::string& text) {
+        const uint32_t length = (uint32_t)std::min<size_t>(text.size(), kMaxStringLength);
+        out.write(reinterpret_cast<const char*>(&length), sizeof(length));
+        out.write(text.data(), length);
+    }
+
+    bool ReadString(std::istream& in, std::string& text) {
+        uint32_t length = 0;
+        if (!in.read(reinterpret_cast<char*>(&length), sizeof(length)) || length > kMaxStringLength) return false;
+        text.resize(length);
+        return length == 0 || (bool)in.read(&text[0], length);
+    }
+}
+
+PresetLibrary::PresetLibrary() : m_scanning(false), m_cancel(false), m_progress(0.0f) {}
+
+PresetLibrary::~PresetLibrary() {
+    Cancel();
+}
+
+bool PresetLibrary::Scan(const std::string& directory) {
+    if (IsScanning()) return false;
+    if (m_worker.joinable()) m_worker.join();
+    m_cancel.store(false);
+    m_progress.store(0.0f);
+    m_scanning.store(true, std::memory_order_release);
+    SetStatus("Scanning " + directory + "...");
+    m_worker = std::thread(&PresetLibrary::ScanJob, this, directory);
+    return true;
+}
+
+void PresetLibrary::Cancel() {
+    m_cancel.store(true);
+    if (m_worker.joinable()) m_worker.join();
+}
+
+std::string PresetLibrary::GetStatus() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_status;
+}
+
+void PresetLibrary::SetStatus(const std::string& status) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_status = status;
+}
+
+size_t PresetLibrary::GetCount() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_entries.size();
+}
+
+std::vector<PresetLibrary::Entry> PresetLibrary::Search(const std::string& query, uint32_t requiredFeatures, uint32_t excludedFeatures) const {
+    std::vector<std::string> words;
+    std::istringstream stream(ToLower(query));
+    std::string word;
+    while (stream >> word) words.push_back(word);
+
+    std::vector<Entry> results;
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (const Entry& entry : m_entries) {
+        const uint32_t features = entry.info.features;
+        if ((features & requiredFeatures) != requiredFeatures || (features & excludedFeatures) != 0) continue;
+        const std::string name = ToLower(entry.name);
+        const bool matches = std::all_of(words.begin(), words.end(), [&](const std::string& w) { return name.find(w) != std::string::npos; });
+        if (matches) results.push_back(entry);
+    }
+    return results;
+}
+
+bool PresetLibrary::ReadEntry(const std::string& path, Entry& entry) {
+    entry.path = path;
+    entry.name = std::filesystem::path(path).stem().string();
+    const size_t separator = entry.name.find(" - ");
+    entry.author = separator == std::string::npos ? std::string() : entry.name.substr(0, separator);
+    entry.compileError.clear();
+    entry.info = Info{};
+    Info& info = entry.info;
+    GetSourceStamp(path, info.fileSize, info.mtime);
+
+    libprojectM::PresetFileParser parser;
+    if (!parser.Read(path)) {
+        info.features = CompileFailed;
+        entry.compileError = "not a readable preset file";
+        return false;
+    }
+    info.presetVersion = parser.GetInt("MILKDROP_PRESET_VERSION", 0);
+    const int shaderVersion = parser.GetInt("PSVERSION", 0);
+    info.warpShaderVersion = parser.GetInt("PSVERSION_WARP", shaderVersion);
+    info.compShaderVersion = parser.GetInt("PSVERSION_COMP", shaderVersion);
+
+    // Every equation block, in the order Milkdrop runs them, to be compiled below.
+    std::vector<std::pair<std::string, std::string>> blocks;
+    auto addBlock = [&](const std::string& prefix) {
+        std::string code = parser.GetCode(prefix);
+        const uint32_t size = (uint32_t)code.size();
+        if (!code.empty()) blocks.emplace_back(prefix, std::move(code));
+        return size;
+    };
+    info.perFrameInitBytes = addBlock("per_frame_init_");
+    info.perFrameBytes = addBlock("per_frame_");
+    info.perPixelBytes = addBlock("per_pixel_");
+    for (int i = 0; i < kCustomSlots; ++i) {
+        const std::string index = std::to_string(i);
+        if (parser.GetInt("wavecode_" + index + "_enabled", 0) != 0) {
+            ++info.waveCount;
+            const std::string wave = "wave_" + index + "_";
+            info.customCodeBytes += addBlock(wave + "init") + addBlock(wave + "per_frame") + addBlock(wave + "per_point");
+        }
+        if (parser.GetInt("shapecode_" + index + "_enabled", 0) != 0) {
+            ++info.shapeCount;
+            const std::string shape = "shape_" + index + "_";
+            info.customCodeBytes += addBlock(shape + "init") + addBlock(shape + "per_frame");
+        }
+    }
+    info.warpShaderBytes = (uint32_t)parser.GetCode("warp_").size();
+    info.compShaderBytes = (uint32_t)parser.GetCode("comp_").size();
+
+    if (info.waveCount > 0) info.features |= CustomWaves;
+    if (info.shapeCount > 0) info.features |= CustomShapes;
+    if (info.warpShaderBytes > 0) info.features |= WarpShader;
+    if (info.compShaderBytes > 0) info.features |= CompShader;
+
+    // Each preset gets its own context in its own scope, so workers share nothing (not even
+    // gmegabuf) and need no lock.
+    projectm_eval_global_scope* scope = projectm_eval_global_scope_create(0);
+    projectm_eval_context* context = scope ? projectm_eval_context_create_in_scope(scope) : nullptr;
+    for (const auto& [prefix, code] : blocks) {
+        if (ToLower(code).find("megabuf") != std::string::npos) info.features |= UsesMegabuf;
+        if (!context || (info.features & CompileFailed)) continue;
+        projectm_eval_code* compiled = projectm_eval_code_compile(context, code.c_str());
+        if (compiled) {
+            projectm_eval_code_destroy(compiled);
+            continue;
+        }
+        int line = 0;
+        int column = 0;
+        const char* error = projectm_eval_get_error(context, &line, &column);
+        info.features |= CompileFailed;
+        entry.compileError = prefix + " (line " + std::to_string(line) + ", column " + std::to_string(column) + "): " +
+                             (error ? error : "unknown error");
+    }
+    if (context) projectm_eval_context_destroy(context);
+    if (scope) projectm_eval_global_scope_destroy(scope);
+    return true;
+}
+
+void PresetLibrary::ScanJob(std::string directory) {
+    const auto start = std::chrono::steady_clock::now();
+
+    // The first scan starts from the index on disk, which is searchable right away.
+    std::vector<Entry> previous;
+    bool indexLoaded;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        indexLoaded = m_indexLoaded;
+        if (indexLoaded) previous = m_entries;
+    }
+    if (!indexLoaded && LoadIndex(previous)) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_entries = previous;
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_indexLoaded = true;
+    }
+
+    std::unordered_map<std::string, const Entry*> known;
+    for (const Entry& entry : previous) known[entry.path] = &entry;
+
+    // Files whose size and modification time match the index keep their entry; the rest are parsed.
+    std::vector<Entry> entries;
+    std::vector<size_t> stale;
+    std::error_code ec;
+    auto it = std::filesystem::recursive_directory_iterator(directory, std::filesystem::directory_options::skip_permission_denied, ec);
+    for (; !ec && it != std::filesystem::recursive_directory_iterator(); it.increment(ec)) {
+        if (!it->is_regular_file(ec) || it->path().extension() != ".milk") continue;
+        const std::string path = it->path().string();
+        uint64_t size = 0;
+        int64_t mtime = 0;
+        if (!GetSourceStamp(path, size, mtime)) continue;
+        auto found = known.find(path);
+        if (found != known.end() && found->second->info.fileSize == size && found->second->info.mtime == mtime) {
+            entries.push_back(*found->second);
+        } else {
+            stale.push_back(entries.size());
+            entries.emplace_back();
+            entries.back().path = path;
+        }
+    }
+    if (ec && entries.empty()) {
+        SetStatus("Could not read " + directory + ": " + ec.message());
+        m_scanning.store(false, std::memory_order_release);
+        return;
+    }
+
+    // Half of the hardware threads (the scan thread being one of them), so rendering keeps going.
+    if (!stale.empty()) {
+        WorkerPool pool(std::max(1, (int)std::thread::hardware_concurrency() / 2 - 1));
+        std::atomic<int> done{0};
+        pool.Run((int)stale.size(), [&](int index) {
+            if (m_cancel.load(std::memory_order_relaxed)) return;
+            Entry& entry = entries[stale[index]];
+            ReadEntry(entry.path, entry);
+            m_progress.store((float)(++done) / stale.size(), std::memory_order_relaxed);
+        });
+    }
+    if (m_cancel.load()) {
+        SetStatus("Scan cancelled.");
+        m_scanning.store(false, std::memory_order_release);
+        return;
+    }
+
+    std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) {
+        const std::string nameA = ToLower(a.name);
+        const std::string nameB = ToLower(b.name);
+        return nameA != nameB ? nameA < nameB : a.path < b.path;
+    });
+    const bool changed = !stale.empty() || entries.size() != previous.size();
+    const bool saved = !changed || SaveIndex(entries);
+    const size_t count = entries.size();
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_entries = std::move(entries);
+    }
+
+    const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    char status[160];
+    std::snprintf(status, sizeof(status), "%zu presets: %zu parsed, %zu from the index (%.0f ms).", count, stale.size(),
+                  count - stale.size(), ms);
+    SetStatus(std::string(status) + (saved ? "" : " The index could not be written."));
+    m_progress.store(1.0f);
+    m_scanning.store(false, std::memory_order_release);
+}
+
+bool PresetLibrary::LoadIndex(std::vector<Entry>& entries) const {
+    std::ifstream in(INDEX_PATH, std::ios::binary);
+    if (!in) return false;
+
+    IndexHeader header;
+    if (!in.read(reinterpret_cast<char*>(&header), sizeof(header))) return false;
+    if (std::memcmp(header.magic, kIndexMagic, sizeof(kIndexMagic)) != 0 || header.version != kIndexVersion ||
+        header.infoSize != sizeof(Info)) {
+        return false;
+    }
+
+    // The count comes from disk, so only reserve what the file could actually hold: every entry
+    // takes at least four string lengths and an Info.
+    std::error_code ec;
+    const uintmax_t fileSize = std::filesystem::file_size(INDEX_PATH, ec);
+    if (ec) return false;
+    const uintmax_t minEntrySize = 4 * sizeof(uint32_t) + sizeof(Info);
+    std::vector<Entry> loaded;
+    loaded.reserve((size_t)std::min<uintmax_t>(header.entryCount, fileSize / minEntrySize));
+    for (uint32_t i = 0; i < header.entryCount; ++i) {
+        Entry entry;
+        if (!ReadString(in, entry.path) || !ReadString(in, entry.name) || !ReadString(in, entry.author) ||
+            !ReadString(in, entry.compileError) || !in.read(reinterpret_cast<char*>(&entry.info), sizeof(Info))) {
+            return false;
+        }
+        loaded.push_back(std::move(entry));
+    }
+    entries = std::move(loaded);
+    return true;
+}
+
+bool PresetLibrary::SaveIndex(const std::vector<Entry>& entries) const {
+    IndexHeader header{};
+    std::memcpy(header.magic, kIndexMagic, sizeof(kIndexMagic));
+    header.version = kIndexVersion;
+    header.infoSize = sizeof(Info);
+    header.entryCount = (uint32_t)entries.size();
+
+    std::error_code ec;
+    std::filesystem::create_directories(std::filesystem::path(INDEX_PATH).parent_path(), ec);
+    // Write to a temporary name first so an interrupted write never leaves a truncated index behind.
+    const std::string tempPath = std::string(INDEX_PATH) + ".tmp";
+    {
+        std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+        if (!out) return false;
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        for (const Entry& entry : entries) {
+            WriteString(out, entry.path);
+            WriteString(out, entry.name);
+            WriteString(out, entry.author);
+            WriteString(out, entry.compileError);
+            out.write(reinterpret_cast<const char*>(&entry.info), sizeof(Info));
+        }
+        if (!out) return false;
+    }
+    std::filesystem::rename(tempPath, INDEX_PATH, ec);
+    if (ec) {
+        std::filesystem::remove(tempPath, ec);
+        return false;
+    }
+    return true;
+}
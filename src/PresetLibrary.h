@@ -0,0 +1,95 @@
+#ifndef PRESET_LIBRARY_H
+#define PRESET_LIBRARY_H
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Searchable metadata for every Milkdrop preset under a directory, so presets can be browsed without
+// opening each file. Scan() walks the directory on a background thread and parses the presets on a
+// pool of workers: name and author, the size of each code block, which features they use, and whether
+// the equations compile with projectm-eval. The results are kept in a binary index (INDEX_PATH) keyed
+// by path, size and modification time, so a restart loads the index and re-parses only changed files.
+class PresetLibrary {
+public:
+    static const char* const INDEX_PATH;
+
+    enum Feature : uint32_t {
+        UsesMegabuf = 1u << 0,    // megabuf or gmegabuf in any equation
+        CustomWaves = 1u << 1,    // At least one enabled custom wave
+        CustomShapes = 1u << 2,   // At least one enabled custom shape
+        WarpShader = 1u << 3,     // Milkdrop 2 HLSL warp shader
+        CompShader = 1u << 4,     // Milkdrop 2 HLSL composite shader
+        CompileFailed = 1u << 5,  // An equation block doesn't compile, or the file can't be read
+    };
+
+    // Plain data, stored verbatim in the index.
+    struct Info {
+        uint64_t fileSize = 0;
+        int64_t mtime = 0;
+        uint32_t features = 0;
+        int32_t presetVersion = 0;      // MILKDROP_PRESET_VERSION
+        int32_t warpShaderVersion = 0;  // PSVERSION_WARP
+        int32_t compShaderVersion = 0;  // PSVERSION_COMP
+        uint32_t perFrameInitBytes = 0;
+        uint32_t perFrameBytes = 0;
+        uint32_t perPixelBytes = 0;
+        uint32_t customCodeBytes = 0;   // Equations of all custom waves and shapes
+        uint32_t warpShaderBytes = 0;
+        uint32_t compShaderBytes = 0;
+        uint32_t waveCount = 0;         // Enabled custom waves
+        uint32_t shapeCount = 0;        // Enabled custom shapes
+    };
+
+    struct Entry {
+        std::string path;
+        std::string name;          // File name without the extension
+        std::string author;        // Name up to the first " - ", as presets are usually named
+        std::string compileError;  // First block that failed, if CompileFailed
+        Info info;
+    };
+
+    PresetLibrary();
+    ~PresetLibrary();
+
+    PresetLibrary(const PresetLibrary&) = delete;
+    PresetLibrary& operator=(const PresetLibrary&) = delete;
+
+    // Starts indexing directory and its subdirectories in the background. Returns false if a scan is
+    // still running. Entries of the previous scan stay searchable until this one finishes.
+    bool Scan(const std::string& directory);
+    void Cancel();
+
+    bool IsScanning() const { return m_scanning.load(std::memory_order_acquire); }
+    float GetProgress() const { return m_progress.load(std::memory_order_relaxed); }
+    // Result of the last scan, or a description of the running one.
+    std::string GetStatus() const;
+    size_t GetCount() const;
+
+    // Entries whose name contains every word of query (case-insensitive), that have all of
+    // requiredFeatures and none of excludedFeatures, sorted by name.
+    std::vector<Entry> Search(const std::string& query, uint32_t requiredFeatures = 0, uint32_t excludedFeatures = 0) const;
+
+    // Parses one preset. Returns false if the file isn't a readable preset; entry is then marked CompileFailed.
+    static bool ReadEntry(const std::string& path, Entry& entry);
+
+private:
+    void ScanJob(std::string directory);
+    bool LoadIndex(std::vector<Entry>& entries) const;
+    bool SaveIndex(const std::vector<Entry>& entries) const;
+    void SetStatus(const std::string& status);
+
+    std::thread m_worker;
+    std::atomic<bool> m_scanning;
+    std::atomic<bool> m_cancel;
+    std::atomic<float> m_progress;
+    mutable std::mutex m_mutex;  // Guards m_entries, m_status and m_indexLoaded
+    std::vector<Entry> m_entries;
+    std::string m_status;
+    bool m_indexLoaded = false;
+};
+
+#endif // PRESET_LIBRARY_H
@@ -26,22 +26,9 @@ static std::string LoadShaderSource(const char* filePath, std::string& errorMsg)
     return shaderStream.str();
 }
 
-// Helper function to compile and link shader program
-static GLuint CompileAndLinkShaderProgram(const char* vertexPath, const char* fragmentPath) {
-    std::string errorMsg;
-    std::string vertSource = LoadShaderSource(vertexPath, errorMsg);
-    if (vertSource.empty()) {
-        // Error already printed by LoadShaderSource
-        return 0;
-    }
-    std::string fragSource = LoadShaderSource(fragmentPath, errorMsg);
-    if (fragSource.empty()) {
-        // Error already printed by LoadShaderSource
-        return 0;
-    }
-
+// Helper function to compile and link shader program from source strings
+static GLuint CompileAndLinkShaderSources(const char* vSrc, const char* fSrc) {
     GLuint vertexShader = glCreateShader(GL_VERTEX_SHADER);
-    const char* vSrc = vertSource.c_str();
     glShaderSource(vertexShader, 1, &vSrc, NULL);
     glCompileShader(vertexShader);
     GLint success;
@@ -55,7 +42,6 @@ static GLuint CompileAndLinkShaderProgram(const char* vertexPath, const char* fr
     }
 
     GLuint fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
-    const char* fSrc = fragSource.c_str();
     glShaderSource(fragmentShader, 1, &fSrc, NULL);
     glCompileShader(fragmentShader);
     glGetShaderiv(fragmentShader, GL_COMPILE_STATUS, &success);
@@ -88,6 +74,22 @@ static GLuint CompileAndLinkShaderProgram(const char* vertexPath, const char* fr
     return shaderProgram;
 }
 
+// Helper function to compile and link shader program
+static GLuint CompileAndLinkShaderProgram(const char* vertexPath, const char* fragmentPath) {
+    std::string errorMsg;
+    std::string vertSource = LoadShaderSource(vertexPath, errorMsg);
+    if (vertSource.empty()) {
+        // Error already printed by LoadShaderSource
+        return 0;
+    }
+    std::string fragSource = LoadShaderSource(fragmentPath, errorMsg);
+    if (fragSource.empty()) {
+        // Error already printed by LoadShaderSource
+        return 0;
+    }
+    return CompileAndLinkShaderSources(vertSource.c_str(), fragSource.c_str());
+}
+
 void Renderer::setupQuad() {
     // Fullscreen quad vertices: Pos (x,y), TexCoords (s,t)
     // TexCoords are flipped on Y for standard OpenGL texture coordinate system (0,0 at bottom-left)
@@ -152,6 +154,14 @@ void Renderer::RenderFullscreenTexture(GLuint textureID) {
     glBindTexture(GL_TEXTURE_2D, 0); // Unbind texture
 }
 
+GLuint Renderer::CompileProgram(const char* vertexPath, const char* fragmentPath) {
+    return CompileAndLinkShaderProgram(vertexPath, fragmentPath);
+}
+
+GLuint Renderer::CompileProgramSource(const char* vertexSource, const char* fragmentSource) {
+    return CompileAndLinkShaderSources(vertexSource, fragmentSource);
+}
+
 // Change RenderQuad to be a static method and use the static VAO
 void Renderer::RenderQuad() {
     glBindVertexArray(s_quadVAO);
@@ -85,7 +85,8 @@ void ShaderEffect::ResizeFrameBuffer(int width, int height) {
 
     glGenTextures(1, &m_fboTextureID);
     glBindTexture(GL_TEXTURE_2D, m_fboTextureID);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, m_fboWidth, m_fboHeight, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    const bool floatTarget = s_framebufferFormat == GL_RGBA16F || s_framebufferFormat == GL_RGBA32F;
+    glTexImage2D(GL_TEXTURE_2D, 0, s_framebufferFormat, m_fboWidth, m_fboHeight, 0, GL_RGBA, floatTarget ? GL_FLOAT : GL_UNSIGNED_BYTE, NULL);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
     glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, m_fboTextureID, 0);
@@ -321,6 +322,9 @@ void ShaderEffect::Render() {
     if (m_iAudioBandsAttLoc != -1) {
         glUniform4fv(m_iAudioBandsAttLoc, 1, m_audioBands.data());
     }
+    if (m_iBeatLocation != -1) glUniform1f(m_iBeatLocation, m_beat);
+    if (m_iBeatPhaseLocation != -1) glUniform1f(m_iBeatPhaseLocation, m_beatPhase);
+    if (m_iBPMLocation != -1) glUniform1f(m_iBPMLocation, m_bpm);
 
     if (m_iCameraPositionLocation != -1) {
         glUniform3fv(m_iCameraPositionLocation, 1, glm::value_ptr(m_cameraPosition));
@@ -344,6 +348,12 @@ void ShaderEffect::SetAudioBands(const std::array<float, 4>& bands) {
     m_audioBands = bands;
 }
 
+void ShaderEffect::SetBeatState(float beat, float beatPhase, float bpm) {
+    m_beat = beat;
+    m_beatPhase = beatPhase;
+    m_bpm = bpm;
+}
+
 void ShaderEffect::SetCameraState(const glm::vec3& pos, const glm::mat4& viewMatrix) {
     m_cameraPosition = pos;
     m_cameraMatrix = viewMatrix;
@@ -1028,6 +1038,9 @@ void ShaderEffect::FetchUniformLocations() {
     m_iCameraPositionLocation = glGetUniformLocation(m_shaderProgram, "iCameraPosition");
     m_iCameraMatrixLocation = glGetUniformLocation(m_shaderProgram, "iCameraMatrix");
     m_iLightPositionLocation = glGetUniformLocation(m_shaderProgram, "iLightPos");
+    m_iBeatLocation = glGetUniformLocation(m_shaderProgram, "iBeat");
+    m_iBeatPhaseLocation = glGetUniformLocation(m_shaderProgram, "iBeatPhase");
+    m_iBPMLocation = glGetUniformLocation(m_shaderProgram, "iBPM");
 
     // This now runs for ALL effects
     for (auto& control : m_shadertoyUniformControls) {
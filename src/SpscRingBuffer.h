@@ -0,0 +1,85 @@
+#ifndef SPSC_RING_BUFFER_H
+#define SPSC_RING_BUFFER_H
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+#include <algorithm>
+
+// Lock-free single-producer/single-consumer ring buffer.
+// Exactly one thread may call the Write* functions and exactly one (other) thread may call the
+// Read*/Discard functions. Neither side allocates or blocks, which makes it safe to use from
+// real-time audio callbacks. Capacity is rounded up to a power of two.
+template <typename T>
+class SpscRingBuffer {
+public:
+    explicit SpscRingBuffer(size_t capacity = 0) { Reset(capacity); }
+
+    SpscRingBuffer(const SpscRingBuffer&) = delete;
+    SpscRingBuffer& operator=(const SpscRingBuffer&) = delete;
+
+    // Not thread-safe: only call while neither producer nor consumer is active.
+    void Reset(size_t capacity) {
+        size_t size = 1;
+        while (size < capacity) size <<= 1;
+        m_buffer.assign(capacity > 0 ? size : 0, T());
+        m_mask = m_buffer.empty() ? 0 : m_buffer.size() - 1;
+        m_writeIndex.store(0, std::memory_order_relaxed);
+        m_readIndex.store(0, std::memory_order_relaxed);
+    }
+
+    size_t Capacity() const { return m_buffer.size(); }
+
+    // Number of elements that can be read. Safe to call from any thread. The read index is loaded
+    // first: it never passes the write index, so a third thread cannot see read > write and wrap.
+    // The read may be stale by then, hence the clamp.
+    size_t AvailableToRead() const {
+        const size_t read = m_readIndex.load(std::memory_order_acquire);
+        return std::min(m_writeIndex.load(std::memory_order_acquire) - read, Capacity());
+    }
+
+    size_t AvailableToWrite() const { return Capacity() - AvailableToRead(); }
+
+    // Producer side. Writes as many elements as fit and returns how many were written.
+    size_t Write(const T* data, size_t count) {
+        const size_t write = m_writeIndex.load(std::memory_order_relaxed);
+        const size_t read = m_readIndex.load(std::memory_order_acquire);
+        const size_t toWrite = std::min(count, Capacity() - (write - read));
+        for (size_t i = 0; i < toWrite; ++i) {
+            m_buffer[(write + i) & m_mask] = data[i];
+        }
+        m_writeIndex.store(write + toWrite, std::memory_order_release);
+        return toWrite;
+    }
+
+    // Consumer side. Reads up to count elements and returns how many were read.
+    size_t Read(T* data, size_t count) {
+        const size_t read = m_readIndex.load(std::memory_order_relaxed);
+        const size_t write = m_writeIndex.load(std::memory_order_acquire);
+        const size_t toRead = std::min(count, write - read);
+        for (size_t i = 0; i < toRead; ++i) {
+            data[i] = m_buffer[(read + i) & m_mask];
+        }
+        m_readIndex.store(read + toRead, std::memory_order_release);
+        return toRead;
+    }
+
+    // Consumer side. Drops up to count of the oldest elements without copying them.
+    size_t Discard(size_t count) {
+        const size_t read = m_readIndex.load(std::memory_order_relaxed);
+        const size_t write = m_writeIndex.load(std::memory_order_acquire);
+        const size_t toDiscard = std::min(count, write - read);
+        m_readIndex.store(read + toDiscard, std::memory_order_release);
+        return toDiscard;
+    }
+
+private:
+    std::vector<T> m_buffer;
+    size_t m_mask = 0;
+    // Monotonic counters; the difference is the fill level. Kept on separate cache lines so the
+    // producer and consumer don't false-share.
+    alignas(64) std::atomic<size_t> m_writeIndex{0};
+    alignas(64) std::atomic<size_t> m_readIndex{0};
+};
+
+#endif // SPSC_RING_BUFFER_H
@@ -1,12 +1,63 @@
 #include "VideoRecorder.h"
+#include "Renderer.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
 #include <iostream>
+#include <sstream>
 #include <vector>
 #include <chrono> // Required for time-based PTS
 
-VideoRecorder::VideoRecorder() : recording(false), pbo_index(0) {}
+namespace {
+    // Parallel export keeps encoded packets in plain record files until they are joined, which
+    // avoids muxing every segment into a container only to demux it again.
+    struct PacketRecord {
+        int64_t pts;
+        int64_t dts;
+        int64_t duration;
+        int32_t flags;
+        int32_t size;
+    };
+
+    void write_packet_record(std::ofstream& out, const AVPacket& pkt) {
+        PacketRecord record{pkt.pts, pkt.dts, pkt.duration, pkt.flags, pkt.size};
+        out.write(reinterpret_cast<const char*>(&record), sizeof(record));
+        out.write(reinterpret_cast<const char*>(pkt.data), pkt.size);
+    }
+
+    bool read_packet_record(std::ifstream& in, AVPacket* pkt) {
+        PacketRecord record;
+        if (!in.read(reinterpret_cast<char*>(&record), sizeof(record)) || record.size < 0) return false;
+        av_packet_unref(pkt);
+        if (av_new_packet(pkt, record.size) < 0) return false;
+        if (!in.read(reinterpret_cast<char*>(pkt->data), record.size)) return false;
+        pkt->pts = record.pts;
+        pkt->dts = record.dts;
+        pkt->duration = record.duration;
+        pkt->flags = record.flags;
+        return true;
+    }
+
+    // Sends frame (nullptr flushes) and logs every packet the encoder returns, in codec time base.
+    void encode_to_log(AVCodecContext* codec_ctx, AVFrame* frame, std::ofstream& out) {
+        AVPacket pkt;
+        av_new_packet(&pkt, 0);
+        int ret = avcodec_send_frame(codec_ctx, frame);
+        while (ret >= 0) {
+            ret = avcodec_receive_packet(codec_ctx, &pkt);
+            if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) break;
+            write_packet_record(out, pkt);
+            av_packet_unref(&pkt);
+        }
+        av_packet_unref(&pkt);
+    }
+}
+
+VideoRecorder::VideoRecorder() : recording(false) {}
 
 VideoRecorder::~VideoRecorder() {
     stop_recording();
+    if (finalize_thread.joinable()) finalize_thread.join();
 }
 
 bool VideoRecorder::is_recording() const {
@@ -14,15 +65,263 @@ bool VideoRecorder::is_recording() const {
 }
 
 void VideoRecorder::init_pbos() {
-    glGenBuffers(PBO_COUNT, pbos);
-    for (int i = 0; i < PBO_COUNT; ++i) {
-        glBindBuffer(GL_PIXEL_PACK_BUFFER, pbos[i]);
-        glBufferData(GL_PIXEL_PACK_BUFFER, frame_width * frame_height * 4, 0, GL_STREAM_READ);
+    pbos.assign(std::clamp(pbo_count_setting, MIN_PBO_COUNT, MAX_PBO_COUNT), PboSlot());
+    for (PboSlot& slot : pbos) {
+        glGenBuffers(1, &slot.buffer);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+        glBufferData(GL_PIXEL_PACK_BUFFER, (GLsizeiptr)readback_bytes, 0, GL_STREAM_READ);
     }
     glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    pbo_oldest = 0;
+    pbos_in_flight = 0;
+}
+
+void VideoRecorder::release_pbos() {
+    for (PboSlot& slot : pbos) {
+        if (slot.fence) glDeleteSync(slot.fence);
+        glDeleteBuffers(1, &slot.buffer);
+    }
+    pbos.clear();
+    pbos_in_flight = 0;
+}
+
+bool VideoRecorder::init_yuv_target() {
+    if (yuv_program == 0) {
+        yuv_program = Renderer::CompileProgram("shaders/texture.vert", "shaders/rgb_to_yuv420.frag");
+        if (yuv_program == 0) return false;
+    }
+    const int chroma_width = (frame_width + 1) / 2;
+    const int chroma_height = (frame_height + 1) / 2;
+    yuv_target_width = 2 * chroma_width;
+    yuv_target_height = frame_height + chroma_height;
+
+    glGenTextures(1, &yuv_texture);
+    glBindTexture(GL_TEXTURE_2D, yuv_texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, yuv_target_width, yuv_target_height, 0, GL_RED, GL_UNSIGNED_BYTE, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    GLint previous_fbo = 0;
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &previous_fbo);
+    glGenFramebuffers(1, &yuv_fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, yuv_fbo);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, yuv_texture, 0);
+    const bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+    glBindFramebuffer(GL_FRAMEBUFFER, (GLuint)previous_fbo);
+    if (!complete) {
+        std::cerr << "VideoRecorder: YUV conversion framebuffer is incomplete." << std::endl;
+        release_yuv_target();
+        return false;
+    }
+    return true;
+}
+
+void VideoRecorder::release_yuv_target() {
+    if (yuv_fbo) glDeleteFramebuffers(1, &yuv_fbo);
+    if (yuv_texture) glDeleteTextures(1, &yuv_texture);
+    yuv_fbo = 0;
+    yuv_texture = 0;
+}
+
+void VideoRecorder::render_yuv_planes(GLuint source_texture) {
+    GLint previous_fbo = 0, previous_program = 0, previous_viewport[4];
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &previous_fbo);
+    glGetIntegerv(GL_CURRENT_PROGRAM, &previous_program);
+    glGetIntegerv(GL_VIEWPORT, previous_viewport);
+    const GLboolean blend = glIsEnabled(GL_BLEND);
+    const GLboolean depth_test = glIsEnabled(GL_DEPTH_TEST);
+    const GLboolean scissor_test = glIsEnabled(GL_SCISSOR_TEST);
+    glDisable(GL_BLEND);
+    glDisable(GL_DEPTH_TEST);
+    glDisable(GL_SCISSOR_TEST);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, yuv_fbo);
+    glViewport(0, 0, yuv_target_width, yuv_target_height);
+    glUseProgram(yuv_program);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, source_texture);
+    GLint source_width = frame_width, source_height = frame_height;
+    if (source_texture != 0) {
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &source_width);
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &source_height);
+    }
+    glUniform1i(glGetUniformLocation(yuv_program, "sourceTexture"), 0);
+    glUniform2i(glGetUniformLocation(yuv_program, "frameSize"), frame_width, frame_height);
+    glUniform2i(glGetUniformLocation(yuv_program, "sourceSize"), source_width, source_height);
+    Renderer::RenderQuad();
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    // Left bound as the read framebuffer for the readback; the caller restores it.
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, (GLuint)previous_fbo);
+    glUseProgram((GLuint)previous_program);
+    glViewport(previous_viewport[0], previous_viewport[1], previous_viewport[2], previous_viewport[3]);
+    if (blend) glEnable(GL_BLEND);
+    if (depth_test) glEnable(GL_DEPTH_TEST);
+    if (scissor_test) glEnable(GL_SCISSOR_TEST);
+}
+
+bool VideoRecorder::init_capture_target() {
+    glGenTextures(1, &capture_texture);
+    glBindTexture(GL_TEXTURE_2D, capture_texture);
+    if (capture_half_float) {
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, frame_width, frame_height, 0, GL_RGBA, GL_HALF_FLOAT, nullptr);
+    } else {
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, frame_width, frame_height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    GLint previous_fbo = 0;
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &previous_fbo);
+    glGenFramebuffers(1, &capture_fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, capture_fbo);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, capture_texture, 0);
+    const bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+    glGenFramebuffers(1, &capture_read_fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, (GLuint)previous_fbo);
+    if (!complete) {
+        std::cerr << "VideoRecorder: capture framebuffer is incomplete." << std::endl;
+        release_capture_target();
+        return false;
+    }
+    return true;
+}
+
+void VideoRecorder::release_capture_target() {
+    if (capture_fbo) glDeleteFramebuffers(1, &capture_fbo);
+    if (capture_read_fbo) glDeleteFramebuffers(1, &capture_read_fbo);
+    if (capture_texture) glDeleteTextures(1, &capture_texture);
+    capture_fbo = 0;
+    capture_read_fbo = 0;
+    capture_texture = 0;
+}
+
+void VideoRecorder::copy_to_capture_target(GLuint source_texture) {
+    GLint previous_read_fbo = 0, previous_draw_fbo = 0;
+    glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &previous_read_fbo);
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &previous_draw_fbo);
+    const GLboolean scissor_test = glIsEnabled(GL_SCISSOR_TEST);
+    glDisable(GL_SCISSOR_TEST);
+
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, capture_fbo);
+    if (source_texture != 0) {
+        GLint source_width = 0, source_height = 0;
+        glBindTexture(GL_TEXTURE_2D, source_texture);
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &source_width);
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &source_height);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, capture_read_fbo);
+        glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, source_texture, 0);
+        glBlitFramebuffer(0, 0, source_width, source_height, 0, 0, frame_width, frame_height, GL_COLOR_BUFFER_BIT, GL_LINEAR);
+    } else {
+        const GLfloat black[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
+        glClearBufferfv(GL_COLOR, 0, black);
+    }
+
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, (GLuint)previous_read_fbo);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, (GLuint)previous_draw_fbo);
+    if (scissor_test) glEnable(GL_SCISSOR_TEST);
+}
+
+void VideoRecorder::set_gpu_color_conversion(bool enabled) {
+    gpu_yuv_setting = enabled;
+}
+
+void VideoRecorder::set_parallel_export(int workers, int segment_frames) {
+    export_workers_setting = workers;
+    export_segment_frames_setting = std::max(1, segment_frames);
+}
+
+std::vector<VideoRecorder::SegmentProgress> VideoRecorder::get_segment_progress() const {
+    std::lock_guard<std::mutex> lock(queue_mutex);
+    return segment_progress;
+}
+
+void VideoRecorder::set_image_sequence_workers(int workers) {
+    image_sequence_workers_setting = std::max(0, workers);
+}
+
+void VideoRecorder::set_pbo_count(int count) {
+    pbo_count_setting = std::clamp(count, MIN_PBO_COUNT, MAX_PBO_COUNT);
+}
+
+void VideoRecorder::set_frame_pool_size(int count) {
+    frame_pool_size_setting = std::max(2, count);
+}
+
+VideoRecorder::CaptureStats VideoRecorder::get_capture_stats() const {
+    CaptureStats stats;
+    stats.pbo_count = (int)pbos.size();
+    stats.pbos_in_flight = pbos_in_flight;
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex);
+        stats.frame_pool_size = (int)frame_pool.size();
+        stats.frame_pool_in_use = (int)(frame_pool.size() - free_frames.size());
+    }
+    if (image_sequence_active) {
+        stats.frame_pool_size = image_sequence.GetBufferCount();
+        stats.frame_pool_in_use = image_sequence.GetBuffersInUse();
+    }
+    stats.frames_captured = frames_captured;
+    stats.frames_encoded = image_sequence_active ? image_sequence.GetFramesWritten() : frames_encoded.load(std::memory_order_relaxed);
+    stats.fence_stalls = fence_stalls;
+    stats.fence_stall_ms = fence_stall_ms;
+    stats.dropped_frames = dropped_frames;
+    stats.audio_overflow_frames = audio_overflow_frames.load(std::memory_order_relaxed);
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex);
+        stats.frame_pool_high_water = frame_pool_high_water;
+    }
+    if (image_sequence_active) {
+        stats.avg_encode_ms = image_sequence.GetAverageWriteMs();
+    } else if (const uint64_t calls = encode_calls.load(std::memory_order_relaxed)) {
+        stats.avg_encode_ms = encode_time_ns.load(std::memory_order_relaxed) / 1.0e6 / (double)calls;
+    }
+    if (m_recordAudio) {
+        stats.av_drift_ms = (audio_written_us.load(std::memory_order_relaxed) - video_written_us.load(std::memory_order_relaxed)) / 1000.0;
+    }
+
+    const auto now = std::chrono::steady_clock::now();
+    const double elapsed = std::chrono::duration<double>(now - fps_sample_time).count();
+    if (elapsed >= 0.5) {
+        encoder_fps = (double)(stats.frames_encoded - fps_sample_frames) / elapsed;
+        fps_sample_time = now;
+        fps_sample_frames = stats.frames_encoded;
+    }
+    stats.encoder_fps = encoder_fps;
+    return stats;
 }
 
-void VideoRecorder::add_video_frame_from_pbo(float deltaTime) {
+void VideoRecorder::note_encode_time(std::chrono::steady_clock::time_point start) {
+    encode_time_ns.fetch_add((uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count(), std::memory_order_relaxed);
+    encode_calls.fetch_add(1, std::memory_order_relaxed);
+}
+
+void VideoRecorder::write_summary() {
+    const CaptureStats stats = get_capture_stats();
+    const double wall_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - recording_start_time).count();
+    std::ostringstream summary;
+    summary << "Output: " << output_description << "\n";
+    if (encoder_failed) summary << "Encoder failed to start; no video was written\n";
+    summary << "Wall time: " << wall_seconds << " s\n"
+            << "Frames captured: " << stats.frames_captured << "\n"
+            << "Frames encoded: " << stats.frames_encoded << "\n"
+            << "Frames dropped: " << stats.dropped_frames << "\n"
+            << "Average encoder throughput: " << (wall_seconds > 0.0 ? stats.frames_encoded / wall_seconds : 0.0) << " fps\n"
+            << "Average encode time: " << stats.avg_encode_ms << " ms/frame\n"
+            << "Frame buffer high-water: " << stats.frame_pool_high_water << " / " << stats.frame_pool_size << "\n"
+            << "GPU readback stalls: " << stats.fence_stalls << " (" << stats.fence_stall_ms << " ms)\n";
+    if (m_recordAudio) {
+        summary << "Audio frames replaced by silence: " << stats.audio_overflow_frames << "\n"
+                << "Final A/V drift: " << stats.av_drift_ms << " ms\n";
+    }
+    std::cout << "VideoRecorder summary\n" << summary.str() << std::flush;
+    std::ofstream out(summary_path, std::ios::trunc);
+    out << summary.str();
+    if (!out) std::cerr << "VideoRecorder: could not write " << summary_path << std::endl;
+}
+
+void VideoRecorder::add_video_frame_from_pbo(float deltaTime, GLuint source_texture) {
     if (!recording) return;
 
     frame_accumulator += deltaTime;
@@ -36,112 +335,365 @@ void VideoRecorder::add_video_frame_from_pbo(float deltaTime) {
         frame_accumulator = 0.0f; // Reset accumulator in offline mode to be safe
     }
 
-    auto capture_time = std::chrono::steady_clock::now();
-    int next_pbo_index = (pbo_index + 1) % PBO_COUNT;
-    glBindBuffer(GL_PIXEL_PACK_BUFFER, pbos[pbo_index]);
-    // Ensure viewport is set correctly for glReadPixels
-    glViewport(0, 0, frame_width, frame_height);
-    glReadPixels(0, 0, frame_width, frame_height, GL_RGBA, GL_UNSIGNED_BYTE, 0);
-    glBindBuffer(GL_PIXEL_PACK_BUFFER, pbos[next_pbo_index]);
-    GLubyte* ptr = (GLubyte*)glMapBuffer(GL_PIXEL_PACK_BUFFER, GL_READ_ONLY);
-    if (ptr) {
-        std::unique_lock<std::mutex> lock(queue_mutex);
+    // Every PBO still has a readback in flight: the oldest must finish before its buffer is reused.
+    const int count = (int)pbos.size();
+    if (pbos_in_flight == count) {
+        retire_pbo(pbo_oldest);
+    }
 
-        if (m_offlineMode) {
-            // In offline mode, wait for space to prevent frame drops
-            queue_cv.wait(lock, [this] { return video_queue.size() < MAX_QUEUE_SIZE || !recording; });
-        } else if (video_queue.size() >= MAX_QUEUE_SIZE) {
-            // In real-time mode, drop the frame if the queue is full
+    PboSlot& slot = pbos[(pbo_oldest + pbos_in_flight) % count];
+    GLint previous_read_fbo = 0;
+    glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &previous_read_fbo);
+    if (yuv_active) {
+        render_yuv_planes(source_texture);
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, yuv_fbo);
+        glPixelStorei(GL_PACK_ALIGNMENT, 1); // Rows are tightly packed bytes
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+        glReadPixels(0, 0, yuv_target_width, yuv_target_height, GL_RED, GL_UNSIGNED_BYTE, 0);
+        glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    } else {
+        copy_to_capture_target(source_texture);
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, capture_fbo);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+        glReadPixels(0, 0, frame_width, frame_height, GL_RGBA, capture_half_float ? GL_HALF_FLOAT : GL_UNSIGNED_BYTE, 0);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, (GLuint)previous_read_fbo);
+    slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    slot.capture_time = std::chrono::steady_clock::now();
+    pbos_in_flight++;
+    frames_captured++;
+
+    // Hand over, oldest first, every readback the GPU has already finished. Never waits.
+    while (pbos_in_flight > 0) {
+        GLenum status = glClientWaitSync(pbos[pbo_oldest].fence, 0, 0);
+        if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) break;
+        retire_pbo(pbo_oldest);
+    }
+}
+
+bool VideoRecorder::wait_for_pbo(int index) {
+    PboSlot& slot = pbos[index];
+    GLenum status = glClientWaitSync(slot.fence, 0, 0);
+    if (status == GL_TIMEOUT_EXPIRED) {
+        auto wait_start = std::chrono::steady_clock::now();
+        // Flushing guarantees the fence eventually signals.
+        do {
+            status = glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000ull);
+        } while (status == GL_TIMEOUT_EXPIRED);
+        fence_stalls++;
+        fence_stall_ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - wait_start).count();
+    }
+    glDeleteSync(slot.fence);
+    slot.fence = nullptr;
+    pbo_oldest = (pbo_oldest + 1) % (int)pbos.size();
+    pbos_in_flight--;
+    if (status == GL_WAIT_FAILED) {
+        std::cerr << "VideoRecorder: waiting for a readback fence failed, frame skipped." << std::endl;
+        return false;
+    }
+    return true;
+}
+
+void VideoRecorder::retire_pbo(int index) {
+    const PboSlot& slot = pbos[index];
+    if (!wait_for_pbo(index)) return;
+
+    if (image_sequence_active) {
+        // The writer copies out of the mapping into its own buffers, waiting or dropping as the encoder would.
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+        const void* ptr = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, (GLsizeiptr)readback_bytes, GL_MAP_READ_BIT);
+        if (ptr) {
+            if (!image_sequence.Submit(ptr, m_offlineMode)) dropped_frames++;
             glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
-            glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
-            pbo_index = next_pbo_index;
-            return;
+            std::lock_guard<std::mutex> lock(queue_mutex);
+            frame_pool_high_water = std::max(frame_pool_high_water, image_sequence.GetBuffersInUse());
         }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        return;
+    }
 
-        if (recording) {
-            video_queue.push({std::vector<uint8_t>(ptr, ptr + frame_width * frame_height * 4), capture_time});
-            cv.notify_one();
+    int buffer = -1;
+    {
+        std::unique_lock<std::mutex> lock(queue_mutex);
+        if (m_offlineMode) {
+            // In offline mode, wait for a free buffer to prevent frame drops
+            queue_cv.wait(lock, [this] { return !free_frames.empty() || !recording || encoder_failed; });
         }
+        if (!free_frames.empty()) {
+            buffer = free_frames.back();
+            free_frames.pop_back();
+            frame_pool_high_water = std::max(frame_pool_high_water, (int)(frame_pool.size() - free_frames.size()));
+        }
+    }
+    if (buffer < 0 || encoder_failed) {
+        // In real-time mode, drop the frame if the encoder still holds every buffer
+        if (buffer >= 0) {
+            std::lock_guard<std::mutex> lock(queue_mutex);
+            free_frames.push_back(buffer);
+        }
+        dropped_frames++;
+        return;
+    }
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+    const void* ptr = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, (GLsizeiptr)readback_bytes, GL_MAP_READ_BIT);
+    if (ptr) {
+        std::memcpy(frame_pool[buffer].data(), ptr, readback_bytes);
         glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
     }
     glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
-    pbo_index = next_pbo_index;
+
+    std::lock_guard<std::mutex> lock(queue_mutex);
+    if (ptr) {
+        video_queue.push({buffer, slot.capture_time});
+        cv.notify_one();
+    } else {
+        free_frames.push_back(buffer);
+    }
 }
 
 void VideoRecorder::add_audio_frame(const float* samples, int num_samples) {
-    if (!recording) return;
-    std::lock_guard<std::mutex> lock(queue_mutex);
-    audio_queue.push(std::vector<float>(samples, samples + num_samples * input_audio_channels));
-    cv.notify_one();
+    if (!recording || !m_recordAudio || num_samples <= 0) return;
+    push_audio(samples, (uint32_t)num_samples, m_offlineMode);
 }
 
 void VideoRecorder::onAudioData(const float* samples, uint32_t frameCount, int channels, int sampleRate) {
-    if (!m_recordAudio) return;
+    // In offline mode the render loop feeds each frame's audio through add_audio_frame, and the ring
+    // only allows one producer.
+    if (!m_recordAudio || m_offlineMode) return;
     if (recording) {
-        add_audio_frame(samples, frameCount);
+        push_audio(samples, frameCount, false);
+    }
+}
+
+void VideoRecorder::push_audio(const float* samples, uint32_t frame_count, bool wait_for_space) {
+    const size_t channels = (size_t)input_audio_channels;
+    const size_t total = (size_t)frame_count * channels;
+    // Whole frames only, so the consumer never sees a frame split across two reads.
+    size_t written = audio_ring.Write(samples, std::min(total, audio_ring.AvailableToWrite() / channels * channels));
+    while (written < total && wait_for_space && recording && !encoder_failed) {
+        std::unique_lock<std::mutex> lock(queue_mutex);
+        queue_cv.wait_for(lock, AUDIO_POLL_INTERVAL);
+        lock.unlock();
+        written += audio_ring.Write(samples + written, std::min(total - written, audio_ring.AvailableToWrite() / channels * channels));
+    }
+    if (written < total) {
+        audio_overflow_frames.fetch_add((total - written) / channels, std::memory_order_relaxed);
     }
 }
 
-bool VideoRecorder::start_recording(const std::string& filename, int width, int height, int fps, const std::string& format, bool record_audio, int input_audio_sample_rate, int input_audio_channels, bool offline_mode, VideoQuality video_quality, AudioBitrate audio_bitrate) {
+uint64_t VideoRecorder::get_audio_overflow_frames() const {
+    return audio_overflow_frames.load(std::memory_order_relaxed);
+}
+
+bool VideoRecorder::start_recording(const std::string& filename, int width, int height, int fps_num, int fps_den, const std::string& format, bool record_audio, int input_audio_sample_rate, int input_audio_channels, bool offline_mode, VideoQuality video_quality, AudioBitrate audio_bitrate) {
     if (recording) {
         std::cerr << "VideoRecorder::start_recording called while already recording." << std::endl;
         return false;
     }
+    if (finalizing) {
+        std::cerr << "VideoRecorder::start_recording called while the previous recording is still being finished." << std::endl;
+        return false;
+    }
+    if (finalize_thread.joinable()) finalize_thread.join();
     frame_width = width;
     frame_height = height;
-    frame_rate = fps;
-    frame_duration = 1.0 / static_cast<double>(frame_rate);
+    frame_rate_num = fps_num;
+    frame_rate_den = fps_den;
+    frame_duration = static_cast<double>(frame_rate_den) / static_cast<double>(frame_rate_num);
     frame_accumulator = 0.0;
-    m_recordAudio = record_audio;
+    ImageSequenceWriter::Format sequence_format = ImageSequenceWriter::Format::PNG8;
+    image_sequence_active = ImageSequenceWriter::ParseFormat(format, sequence_format);
+    capture_half_float = image_sequence_active && ImageSequenceWriter::IsHighPrecision(sequence_format);
+    m_recordAudio = record_audio && !image_sequence_active;
     m_offlineMode = offline_mode;
     m_videoQuality = video_quality;
+    capture_codec = capture_codec_setting;
+    if (m_videoQuality == VideoQuality::Capture && !image_sequence_active && !capture_codec_fits_format(capture_codec, format)) {
+        std::cerr << "VideoRecorder: the " << format << " container cannot hold this capture codec." << std::endl;
+        return false;
+    }
     m_audioBitrate = audio_bitrate;
+    fragmented_output = fragmented_setting && !image_sequence_active && supports_fragmented_output(format);
+    fragment_ms = fragment_ms_setting;
     if (m_recordAudio) {
         this->input_audio_sample_rate = input_audio_sample_rate;
         this->input_audio_channels = input_audio_channels;
+        // Allocated here, before recording is set, so the audio thread only ever copies.
+        audio_ring.Reset((size_t)(AUDIO_RING_SECONDS * input_audio_sample_rate) * input_audio_channels);
+        audio_staging.assign((size_t)AUDIO_STAGING_FRAMES * input_audio_channels, 0.0f);
+    }
+    audio_overflow_frames.store(0);
+    audio_frames_padded = 0;
+    encoder_failed = false;
+    // Image sequences keep RGBA.
+    yuv_active = gpu_yuv_setting && !image_sequence_active && init_yuv_target();
+    if (gpu_yuv_setting && !image_sequence_active && !yuv_active) {
+        std::cerr << "VideoRecorder: GPU colour conversion unavailable, converting on the CPU." << std::endl;
     }
+    if (!yuv_active && !init_capture_target()) {
+        return false;
+    }
+    readback_bytes = yuv_active ? (size_t)yuv_target_width * yuv_target_height : (size_t)frame_width * frame_height * (capture_half_float ? 8 : 4);
     init_pbos();
+    if (image_sequence_active) {
+        std::string base_path = filename;
+        const size_t dot = base_path.find_last_of('.');
+        const size_t slash = base_path.find_last_of("/\\");
+        if (dot != std::string::npos && (slash == std::string::npos || dot > slash)) base_path.erase(dot);
+        int workers = image_sequence_workers_setting;
+        if (workers == 0) workers = std::max(1, (int)std::thread::hardware_concurrency() - 1);
+        const ImageSequenceWriter::PixelType pixel_type = capture_half_float ? ImageSequenceWriter::PixelType::RGBA16F : ImageSequenceWriter::PixelType::RGBA8;
+        if (!image_sequence.Start(base_path, sequence_format, frame_width, frame_height, pixel_type, workers, IMAGE_SEQUENCE_POOL_BYTES)) {
+            release_pbos();
+            release_capture_target();
+            image_sequence_active = false;
+            return false;
+        }
+    }
+    parallel_export = m_offlineMode && !image_sequence_active && export_workers_setting >= 2;
+    export_workers = parallel_export ? export_workers_setting : 0;
+    export_segment_frames = export_segment_frames_setting;
+    export_base_path = filename;
+    segment_queues.assign((size_t)export_workers, {});
+    segments_closing = false;
+    next_dispatch_frame = 0;
+    segment_progress.clear();
+    export_video_params.reset();
+    int pool_size = image_sequence_active ? 0 : frame_pool_size_setting;
+    if (parallel_export) {
+        // Every worker needs a segment's worth of frames queued to stay busy; the cap keeps 4K+ sane.
+        const int min_pool = export_workers * 2;
+        const int max_pool = std::max(min_pool, (int)std::min<size_t>(PARALLEL_EXPORT_POOL_BYTES / readback_bytes, 4096));
+        pool_size = std::clamp(export_workers * export_segment_frames, min_pool, max_pool);
+    }
+    frame_pool.assign((size_t)pool_size, std::vector<uint8_t>(readback_bytes));
+    free_frames.clear();
+    for (int i = 0; i < pool_size; ++i) free_frames.push_back(i);
+    frames_captured = 0;
+    fence_stalls = 0;
+    fence_stall_ms = 0.0;
+    dropped_frames = 0;
+    frames_encoded.store(0);
+    frame_pool_high_water = 0;
+    encode_time_ns.store(0);
+    encode_calls.store(0);
+    video_written_us.store(0);
+    audio_written_us.store(0);
+    fps_sample_time = std::chrono::steady_clock::now();
+    fps_sample_frames = 0;
+    encoder_fps = 0.0;
+    {
+        std::ostringstream description;
+        description << filename << " (" << format << ", " << frame_width << "x" << frame_height << " at "
+                    << frame_rate_num << "/" << frame_rate_den << " fps, " << (m_offlineMode ? "offline" : "real-time");
+        if (parallel_export) description << ", parallel export on " << export_workers << " encoders";
+        if (m_videoQuality == VideoQuality::Capture && !image_sequence_active) description << ", capture codec";
+        if (fragmented_output) description << ", fragmented every " << fragment_ms << " ms";
+        description << ")";
+        output_description = description.str();
+    }
+    summary_path = filename + ".summary.txt";
+    input_closed = false;
     recording = true;
     next_video_pts = 0;
     next_audio_pts = 0;
     last_video_pts = -1;
     recording_start_time = std::chrono::steady_clock::now();
     first_audio_frame_ready = false;
-    encoding_thread = std::thread(&VideoRecorder::encoding_thread_main, this, filename, format);
+    if (!image_sequence_active) {
+        encoding_thread = std::thread(&VideoRecorder::encoding_thread_main, this, filename, format);
+    }
     return true;
 }
 
 void VideoRecorder::stop_recording() {
     if (!recording) return;
+    // Copy out the readbacks still in flight. This only waits for the GPU, never for the encoder,
+    // which may be seconds behind; finalize_main queues them once there is room.
+    tail_frames.clear();
+    while (pbos_in_flight > 0) {
+        const PboSlot& slot = pbos[pbo_oldest];
+        if (!wait_for_pbo(pbo_oldest)) continue;
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+        const uint8_t* ptr = static_cast<const uint8_t*>(glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, (GLsizeiptr)readback_bytes, GL_MAP_READ_BIT));
+        if (ptr) {
+            tail_frames.push_back({std::vector<uint8_t>(ptr, ptr + readback_bytes), slot.capture_time});
+            glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    }
+    finalizing = true;
     recording = false;
+    queue_cv.notify_all(); // Wakes an offline audio producer waiting for ring space
+    release_pbos();
+    release_yuv_target();
+    release_capture_target();
+    finalize_thread = std::thread(&VideoRecorder::finalize_main, this);
+}
+
+void VideoRecorder::finalize_main() {
+    for (TailFrame& tail : tail_frames) {
+        if (image_sequence_active) {
+            if (!image_sequence.Submit(tail.pixels.data(), m_offlineMode)) dropped_frames++;
+            continue;
+        }
+        int buffer = -1;
+        {
+            std::unique_lock<std::mutex> lock(queue_mutex);
+            if (m_offlineMode) {
+                queue_cv.wait(lock, [this] { return !free_frames.empty() || encoder_failed; });
+            }
+            if (!free_frames.empty() && !encoder_failed) {
+                buffer = free_frames.back();
+                free_frames.pop_back();
+                frame_pool_high_water = std::max(frame_pool_high_water, (int)(frame_pool.size() - free_frames.size()));
+            }
+        }
+        if (buffer < 0) {
+            dropped_frames++;
+            continue;
+        }
+        std::memcpy(frame_pool[buffer].data(), tail.pixels.data(), readback_bytes);
+        std::lock_guard<std::mutex> lock(queue_mutex);
+        video_queue.push({buffer, tail.capture_time});
+        cv.notify_one();
+    }
+    tail_frames.clear();
+
+    input_closed = true;
     cv.notify_one();
     if (encoding_thread.joinable()) {
         encoding_thread.join();
     }
-    glDeleteBuffers(PBO_COUNT, pbos);
+    if (image_sequence_active) image_sequence.Stop();
+    write_summary();
+    image_sequence_active = false;
+    frame_pool.clear();
+    free_frames.clear();
+    std::queue<PendingFrame>().swap(video_queue); // Left over if the encoder failed
+    finalizing = false;
 }
 
-void VideoRecorder::encoding_thread_main(const std::string& filename, const std::string& format) {
-    AVFormatContext* raw_format_ctx = nullptr;
-    avformat_alloc_output_context2(&raw_format_ctx, nullptr, format.c_str(), filename.c_str());
-    format_ctx.reset(raw_format_ctx);
-    if (!format_ctx) { std::cerr << "Could not create output context" << std::endl; return; }
-
-    // Video Stream Setup
-    const AVCodec* video_codec = avcodec_find_encoder(AV_CODEC_ID_H264);
-    video_stream = avformat_new_stream(format_ctx.get(), video_codec);
-    video_codec_ctx.reset(avcodec_alloc_context3(video_codec));
-    video_codec_ctx->width = frame_width;
-    video_codec_ctx->height = frame_height;
-    video_codec_ctx->time_base = {1, frame_rate};
-    video_codec_ctx->framerate = {frame_rate, 1};
-    video_codec_ctx->pix_fmt = AV_PIX_FMT_YUV420P;
-    video_codec_ctx->pix_fmt = AV_PIX_FMT_YUV420P;
-    
-    const char* preset = "medium";
-    const char* crf = "18";
+void VideoRecorder::set_capture_codec(CaptureCodec codec) {
+    capture_codec_setting = codec;
+}
+
+bool VideoRecorder::capture_codec_fits_format(CaptureCodec codec, const std::string& format) {
+    switch (codec) {
+        case CaptureCodec::FFV1:  return format == "mov" || format == "matroska";
+        case CaptureCodec::MJPEG: return format != "mpg";
+        case CaptureCodec::X264IntraRefresh:
+        default:                  return true;
+    }
+}
+
+void VideoRecorder::get_x264_settings(VideoQuality quality, const char*& preset, const char*& crf) {
+    preset = "medium";
+    crf = "18";
 
-    switch (m_videoQuality) {
+    switch (quality) {
         case VideoQuality::Low:
             preset = "veryfast";
             crf = "28";
@@ -158,14 +710,146 @@ void VideoRecorder::encoding_thread_main(const std::string& filename, const std:
             preset = "veryslow";
             crf = "14";
             break;
+        case VideoQuality::Capture:
+            preset = "ultrafast";
+            crf = "16";
+            break;
     }
+}
 
-    av_opt_set(video_codec_ctx->priv_data, "preset", preset, 0);
-    av_opt_set(video_codec_ctx->priv_data, "crf", crf, 0);
-    if (format_ctx->oformat->flags & AVFMT_GLOBALHEADER) video_codec_ctx->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
-    if (avcodec_open2(video_codec_ctx.get(), video_codec, nullptr) < 0) { std::cerr << "Could not open video codec" << std::endl; return; }
-    avcodec_parameters_from_context(video_stream->codecpar, video_codec_ctx.get());
-    video_stream->time_base = {1, 90000};
+bool VideoRecorder::open_video_encoder(std::unique_ptr<AVCodecContext, AVCodecContextDeleter>& ctx, bool global_header) {
+    const bool capture = m_videoQuality == VideoQuality::Capture;
+    AVCodecID codec_id = AV_CODEC_ID_H264;
+    if (capture && capture_codec == CaptureCodec::MJPEG) codec_id = AV_CODEC_ID_MJPEG;
+    if (capture && capture_codec == CaptureCodec::FFV1) codec_id = AV_CODEC_ID_FFV1;
+    const AVCodec* video_codec = avcodec_find_encoder(codec_id);
+    if (!video_codec) return false;
+    ctx.reset(avcodec_alloc_context3(video_codec));
+    ctx->width = frame_width;
+    ctx->height = frame_height;
+    ctx->time_base = {frame_rate_den, frame_rate_num};
+    ctx->framerate = {frame_rate_num, frame_rate_den};
+    ctx->pix_fmt = AV_PIX_FMT_YUV420P;
+    if (yuv_active) {
+        // Matches shaders/rgb_to_yuv420.frag
+        ctx->colorspace = AVCOL_SPC_BT709;
+        ctx->color_primaries = AVCOL_PRI_BT709;
+        ctx->color_trc = AVCOL_TRC_BT709;
+        ctx->color_range = AVCOL_RANGE_MPEG;
+    }
+
+    const char* preset;
+    const char* crf;
+    get_x264_settings(m_videoQuality, preset, crf);
+
+    if (!capture) {
+        av_opt_set(ctx->priv_data, "preset", preset, 0);
+        av_opt_set(ctx->priv_data, "crf", crf, 0);
+    } else {
+        // Slice threads split each frame instead of pipelining frames, so the encoder adds no latency
+        // and never holds a queue of frames of its own.
+        ctx->thread_type = FF_THREAD_SLICE;
+        ctx->thread_count = 0;
+        switch (capture_codec) {
+            case CaptureCodec::X264IntraRefresh:
+                av_opt_set(ctx->priv_data, "preset", preset, 0);
+                av_opt_set(ctx->priv_data, "tune", "zerolatency", 0);
+                av_opt_set(ctx->priv_data, "crf", crf, 0);
+                av_opt_set(ctx->priv_data, "intra-refresh", "1", 0);
+                break;
+            case CaptureCodec::MJPEG:
+                // Limited-range 4:2:0 is what the GPU conversion produces; the decoder reads the tag.
+                ctx->strict_std_compliance = FF_COMPLIANCE_UNOFFICIAL;
+                ctx->qmin = 2;
+                ctx->qmax = 3;
+                ctx->bit_rate = (int64_t)frame_width * frame_height * 3 * frame_rate_num / frame_rate_den;
+                break;
+            case CaptureCodec::FFV1:
+                ctx->gop_size = 1;
+                ctx->level = 3; // Required for slices
+                av_opt_set(ctx->priv_data, "slices", "16", 0);
+                av_opt_set(ctx->priv_data, "slicecrc", "1", 0);
+                break;
+        }
+    }
+    if (fragmented_output && codec_id == AV_CODEC_ID_H264 && !capture) {
+        // A keyframe at least once per fragment, so fragments are cut on time and each one decodes
+        // on its own.
+        ctx->gop_size = std::max(1, (int)((int64_t)fragment_ms * frame_rate_num / (1000 * (int64_t)frame_rate_den)));
+    }
+    if (global_header) ctx->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+    return avcodec_open2(ctx.get(), video_codec, nullptr) >= 0;
+}
+
+int VideoRecorder::write_output_header() {
+    AVDictionary* options = nullptr;
+    if (fragmented_output) {
+        // An empty moov up front, then self-contained moof+mdat fragments. Each is cut at the first
+        // keyframe after fragment_ms, or at twice that regardless (intra refresh has no keyframes).
+        av_dict_set(&options, "movflags", "frag_keyframe+empty_moov+default_base_moof", 0);
+        av_dict_set_int(&options, "min_frag_duration", (int64_t)fragment_ms * 1000, 0);
+        av_dict_set_int(&options, "frag_duration", (int64_t)fragment_ms * 2000, 0);
+        // Push each finished fragment to the file at once instead of leaving it in the I/O buffer.
+        format_ctx->flags |= AVFMT_FLAG_FLUSH_PACKETS;
+    }
+    const int ret = avformat_write_header(format_ctx.get(), &options);
+    av_dict_free(&options);
+    return ret;
+}
+
+void VideoRecorder::set_fragmented_output(bool enabled, int fragment_ms) {
+    fragmented_setting = enabled;
+    fragment_ms_setting = std::clamp(fragment_ms, MIN_FRAGMENT_MS, MAX_FRAGMENT_MS);
+}
+
+bool VideoRecorder::supports_fragmented_output(const std::string& format) {
+    return format == "mp4" || format == "mov";
+}
+
+std::unique_ptr<AVFrame, AVFrameDeleter> VideoRecorder::alloc_video_frame() const {
+    std::unique_ptr<AVFrame, AVFrameDeleter> frame(av_frame_alloc());
+    frame->format = AV_PIX_FMT_YUV420P;
+    frame->width = frame_width;
+    frame->height = frame_height;
+    av_frame_get_buffer(frame.get(), 32);
+    return frame;
+}
+
+void VideoRecorder::convert_video_frame(const std::vector<uint8_t>& pixels, AVFrame* frame, SwsContext* sws) {
+    if (yuv_active) {
+        // Already YUV and top-down; only the plane strides differ from the AVFrame's.
+        const int chroma_width = yuv_target_width / 2;
+        const int chroma_height = yuv_target_height - frame_height;
+        const uint8_t* chroma_rows = pixels.data() + (size_t)yuv_target_width * frame_height;
+        av_frame_make_writable(frame);
+        av_image_copy_plane(frame->data[0], frame->linesize[0], pixels.data(), yuv_target_width, frame_width, frame_height);
+        av_image_copy_plane(frame->data[1], frame->linesize[1], chroma_rows, yuv_target_width, chroma_width, chroma_height);
+        av_image_copy_plane(frame->data[2], frame->linesize[2], chroma_rows + chroma_width, yuv_target_width, chroma_width, chroma_height);
+    } else {
+        const int src_stride[1] = { -frame_width * 4 };
+        const uint8_t* src_slices[1] = { pixels.data() + (frame_height - 1) * frame_width * 4 };
+        av_frame_make_writable(frame);
+        sws_scale(sws, src_slices, src_stride, 0, frame_height, frame->data, frame->linesize);
+    }
+}
+
+void VideoRecorder::encoding_thread_main(const std::string& filename, const std::string& format) {
+    AVFormatContext* raw_format_ctx = nullptr;
+    avformat_alloc_output_context2(&raw_format_ctx, nullptr, format.c_str(), filename.c_str());
+    format_ctx.reset(raw_format_ctx);
+    if (!format_ctx) { abort_encoding("Could not create output context"); return; }
+    output_global_header = (format_ctx->oformat->flags & AVFMT_GLOBALHEADER) != 0;
+
+    // Video Stream Setup. With parallel export the segment encoders are opened by the workers and
+    // the stream parameters are filled in from the first one when the segments are joined.
+    if (parallel_export) {
+        video_stream = avformat_new_stream(format_ctx.get(), nullptr);
+    } else {
+        if (!open_video_encoder(video_codec_ctx, output_global_header)) { abort_encoding("Could not open video codec"); return; }
+        video_stream = avformat_new_stream(format_ctx.get(), nullptr);
+        avcodec_parameters_from_context(video_stream->codecpar, video_codec_ctx.get());
+        video_stream->time_base = {1, 90000};
+    }
 
     // Audio Stream Setup (Conditional)
     if (m_recordAudio) {
@@ -203,23 +887,24 @@ void VideoRecorder::encoding_thread_main(const std::string& filename, const std:
         audio_codec_ctx->sample_rate = 44100;
         av_channel_layout_from_string(&audio_codec_ctx->ch_layout, "stereo");
         audio_codec_ctx->time_base = {1, audio_codec_ctx->sample_rate};
-        if (format_ctx->oformat->flags & AVFMT_GLOBALHEADER) audio_codec_ctx->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
-        if (avcodec_open2(audio_codec_ctx.get(), audio_codec, nullptr) < 0) { std::cerr << "Could not open audio codec" << std::endl; return; }
+        if (output_global_header) audio_codec_ctx->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+        if (avcodec_open2(audio_codec_ctx.get(), audio_codec, nullptr) < 0) { abort_encoding("Could not open audio codec"); return; }
         avcodec_parameters_from_context(audio_stream->codecpar, audio_codec_ctx.get());
         audio_stream->time_base = {1, 90000};
     }
 
-    if (!(format_ctx->oformat->flags & AVFMT_NOFILE)) {
-        if (avio_open(&format_ctx->pb, filename.c_str(), AVIO_FLAG_WRITE) < 0) { std::cerr << "Could not open output file" << std::endl; return; }
-    }
-    if (avformat_write_header(format_ctx.get(), nullptr) < 0) { std::cerr << "Could not write header" << std::endl; return; }
+    if (parallel_export) {
+        // The output is written when the segments are joined; until then audio goes to a packet log.
+        if (m_recordAudio) audio_log.open(export_base_path + ".audio.seg", std::ios::binary | std::ios::trunc);
+    } else {
+        if (!(format_ctx->oformat->flags & AVFMT_NOFILE)) {
+            if (avio_open(&format_ctx->pb, filename.c_str(), AVIO_FLAG_WRITE) < 0) { abort_encoding("Could not open output file"); return; }
+        }
+        if (write_output_header() < 0) { abort_encoding("Could not write header"); return; }
 
-    // Video Frame Setup
-    video_frame.reset(av_frame_alloc());
-    video_frame->format = video_codec_ctx->pix_fmt;
-    video_frame->width = frame_width;
-    video_frame->height = frame_height;
-    av_frame_get_buffer(video_frame.get(), 32);
+        // Video Frame Setup
+        video_frame = alloc_video_frame();
+    }
 
     // Audio Frame and Resampler Setup (Conditional)
     if (m_recordAudio) {
@@ -240,36 +925,67 @@ void VideoRecorder::encoding_thread_main(const std::string& filename, const std:
         swr_alloc_set_opts2(&swr_ptr, &audio_codec_ctx->ch_layout, audio_codec_ctx->sample_fmt, audio_codec_ctx->sample_rate, &in_ch_layout, AV_SAMPLE_FMT_FLT, input_audio_sample_rate, 0, nullptr);
         swr_ctx.reset(swr_ptr);
         swr_init(swr_ctx.get());
+
+        audio_convert_frame.reset(av_frame_alloc());
+        audio_convert_frame->format = audio_codec_ctx->sample_fmt;
+        audio_convert_frame->ch_layout = audio_codec_ctx->ch_layout;
+        audio_convert_frame->sample_rate = audio_codec_ctx->sample_rate;
+        audio_convert_frame->nb_samples = swr_get_out_samples(swr_ctx.get(), AUDIO_STAGING_FRAMES);
+        av_frame_get_buffer(audio_convert_frame.get(), 0);
+        audio_fifo.reset(av_audio_fifo_alloc(audio_codec_ctx->sample_fmt, audio_codec_ctx->ch_layout.nb_channels, audio_frame->nb_samples * 4));
     }
 
-    sws_ctx.reset(sws_getContext(frame_width, frame_height, AV_PIX_FMT_RGBA, frame_width, frame_height, AV_PIX_FMT_YUV420P, SWS_BILINEAR, nullptr, nullptr, nullptr));
+    if (!yuv_active && !parallel_export) {
+        sws_ctx.reset(sws_getContext(frame_width, frame_height, AV_PIX_FMT_RGBA, frame_width, frame_height, AV_PIX_FMT_YUV420P, SWS_BILINEAR, nullptr, nullptr, nullptr));
+    }
+    for (int i = 0; i < export_workers; ++i) {
+        segment_workers.emplace_back(&VideoRecorder::segment_worker_main, this, i);
+    }
     
-    std::vector<float> audio_input_buffer;
-    while (recording || !video_queue.empty() || (m_recordAudio && !audio_queue.empty())) {
+    for (;;) {
         std::unique_lock<std::mutex> lock(queue_mutex);
-        cv.wait(lock, [this] { return !recording || !video_queue.empty() || (m_recordAudio && !audio_queue.empty()); });
+        cv.wait_for(lock, AUDIO_POLL_INTERVAL, [this] { return input_closed || !video_queue.empty(); });
+        const bool stopping = input_closed;
 
         // Video Encoding Loop
         while (!video_queue.empty()) {
+            PendingFrame frame_data = video_queue.front();
+            video_queue.pop();
+            if (parallel_export) {
+                // Deal whole segments out round-robin; frame numbers are exact, so no audio gating.
+                const int64_t frame_number = next_dispatch_frame++;
+                const int64_t segment = frame_number / export_segment_frames;
+                if (segment == (int64_t)segment_progress.size()) {
+                    SegmentProgress progress;
+                    progress.worker = (int)(segment % export_workers);
+                    segment_progress.push_back(progress);
+                }
+                segment_queues[segment % export_workers].push({frame_number, frame_data});
+                video_written_us.store(next_dispatch_frame * 1000000 * frame_rate_den / frame_rate_num, std::memory_order_relaxed);
+                segment_cv.notify_all();
+                continue;
+            }
             if (m_recordAudio && !first_audio_frame_ready) {
                 // Drop video frames until the first audio frame is ready
-                video_queue.pop();
+                free_frames.push_back(frame_data.buffer);
+                queue_cv.notify_all();
                 continue;
             }
-            auto frame_data = video_queue.front();
-            video_queue.pop();
-            queue_cv.notify_one(); // Signal that space is available
             lock.unlock();
 
-            const std::vector<uint8_t>& pixels = frame_data.first;
-            const auto& capture_time = frame_data.second;
+            convert_video_frame(frame_pool[frame_data.buffer], video_frame.get(), sws_ctx.get());
 
-            const int src_stride[1] = { -frame_width * 4 };
-            const uint8_t* src_slices[1] = { pixels.data() + (frame_height - 1) * frame_width * 4 };
-            sws_scale(sws_ctx.get(), src_slices, src_stride, 0, frame_height, video_frame->data, video_frame->linesize);
+            // The pixels are converted, so the buffer can go back to the pool before encoding.
+            lock.lock();
+            free_frames.push_back(frame_data.buffer);
+            queue_cv.notify_all(); // Signal that space is available
+            lock.unlock();
             
             video_frame->pts = next_video_pts++;
+            frames_encoded.fetch_add(1, std::memory_order_relaxed);
+            video_written_us.store(next_video_pts * 1000000 * frame_rate_den / frame_rate_num, std::memory_order_relaxed);
 
+            const auto encode_start = std::chrono::steady_clock::now();
             AVPacket pkt;
             av_new_packet(&pkt, 0);
             int ret = avcodec_send_frame(video_codec_ctx.get(), video_frame.get());
@@ -282,48 +998,43 @@ void VideoRecorder::encoding_thread_main(const std::string& filename, const std:
                 av_interleaved_write_frame(format_ctx.get(), &pkt);
                 av_packet_unref(&pkt);
             }
+            note_encode_time(encode_start);
             lock.lock();
         }
+        lock.unlock();
 
-        // Audio Encoding Loop (Conditional)
+        // Audio Encoding (Conditional)
         if (m_recordAudio) {
-            while (!audio_queue.empty()) {
-                std::vector<float> samples = audio_queue.front();
-                audio_queue.pop();
-                lock.unlock();
-
-                audio_input_buffer.insert(audio_input_buffer.end(), samples.begin(), samples.end());
-                const int output_samples_per_frame = audio_frame->nb_samples;
-                const int input_samples_needed = av_rescale_rnd(output_samples_per_frame, input_audio_sample_rate, audio_codec_ctx->sample_rate, AV_ROUND_UP);
-                const int total_input_samples_needed = input_samples_needed * input_audio_channels;
-
-                while (audio_input_buffer.size() >= total_input_samples_needed) {
-                    if (!first_audio_frame_ready) {
-                        first_audio_frame_ready = true;
-                    }
-                    const uint8_t* in_data = (const uint8_t*)audio_input_buffer.data();
-                    int out_samples = swr_convert(swr_ctx.get(), audio_frame->data, output_samples_per_frame, &in_data, input_samples_needed);
-                    if (out_samples > 0) {
-                        audio_frame->pts = next_audio_pts;
-                        next_audio_pts += out_samples;
-                        AVPacket pkt;
-                        av_new_packet(&pkt, 0);
-                        int ret = avcodec_send_frame(audio_codec_ctx.get(), audio_frame.get());
-                        if (ret < 0) { break; }
-                        while (ret >= 0) {
-                            ret = avcodec_receive_packet(audio_codec_ctx.get(), &pkt);
-                            if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) break;
-                            av_packet_rescale_ts(&pkt, audio_codec_ctx->time_base, audio_stream->time_base);
-                            pkt.stream_index = audio_stream->index;
-                            av_interleaved_write_frame(format_ctx.get(), &pkt);
-                            av_packet_unref(&pkt);
-                        }
-                    }
-                    audio_input_buffer.erase(audio_input_buffer.begin(), audio_input_buffer.begin() + total_input_samples_needed);
-                }
-                lock.lock();
-            }
+            encode_pending_audio(false);
+            queue_cv.notify_all(); // An offline producer may be waiting for ring space
+        }
+
+        if (stopping) {
+            lock.lock();
+            if (video_queue.empty()) break;
+        }
+    }
+
+    if (m_recordAudio) {
+        encode_pending_audio(true);
+    }
+
+    if (parallel_export) {
+        if (m_recordAudio) {
+            encode_audio_frame(nullptr);
+            audio_log.close();
+        }
+        {
+            std::lock_guard<std::mutex> lock(queue_mutex);
+            segments_closing = true;
+        }
+        segment_cv.notify_all();
+        for (std::thread& worker : segment_workers) worker.join();
+        segment_workers.clear();
+        if (!concat_segments((int64_t)segment_progress.size())) {
+            std::cerr << "VideoRecorder: could not join the exported segments; they were left next to " << export_base_path << std::endl;
         }
+        return;
     }
 
     // Flushing encoders
@@ -340,17 +1051,239 @@ void VideoRecorder::encoding_thread_main(const std::string& filename, const std:
     }
 
     if (m_recordAudio) {
-        av_new_packet(&pkt, 0);
-        ret = avcodec_send_frame(audio_codec_ctx.get(), nullptr);
-        while (ret >= 0) {
-            ret = avcodec_receive_packet(audio_codec_ctx.get(), &pkt);
-            if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) break;
-            av_packet_rescale_ts(&pkt, audio_codec_ctx->time_base, audio_stream->time_base);
-            pkt.stream_index = audio_stream->index;
-            av_interleaved_write_frame(format_ctx.get(), &pkt);
-            av_packet_unref(&pkt);
+        encode_audio_frame(nullptr);
+    }
+
+    av_write_trailer(format_ctx.get());
+}
+
+void VideoRecorder::abort_encoding(const char* reason) {
+    std::cerr << "VideoRecorder: " << reason << " for " << export_base_path << "; this output stops here." << std::endl;
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex);
+        encoder_failed = true;
+    }
+    queue_cv.notify_all();
+}
+
+void VideoRecorder::encode_pending_audio(bool flush) {
+    const int channels = input_audio_channels;
+    const int capacity = audio_convert_frame->nb_samples;
+
+    // Silence for input the producer had to drop. It lands a little later than the gap did, but
+    // the output timestamps are a pure sample count, so the track must not come up short.
+    const uint64_t dropped = audio_overflow_frames.load(std::memory_order_relaxed);
+    while (audio_frames_padded < dropped) {
+        const int frames = (int)std::min<uint64_t>(dropped - audio_frames_padded, AUDIO_STAGING_FRAMES);
+        std::fill(audio_staging.begin(), audio_staging.begin() + (size_t)frames * channels, 0.0f);
+        const uint8_t* in_data = (const uint8_t*)audio_staging.data();
+        int converted = swr_convert(swr_ctx.get(), audio_convert_frame->data, capacity, &in_data, frames);
+        if (converted > 0) av_audio_fifo_write(audio_fifo.get(), (void**)audio_convert_frame->data, converted);
+        audio_frames_padded += frames;
+    }
+
+    for (;;) {
+        const int frames = (int)(audio_ring.Read(audio_staging.data(), audio_staging.size()) / channels);
+        const uint8_t* in_data = (const uint8_t*)audio_staging.data();
+        int converted = 0;
+        if (frames > 0) {
+            converted = swr_convert(swr_ctx.get(), audio_convert_frame->data, capacity, &in_data, frames);
+        } else if (flush) {
+            converted = swr_convert(swr_ctx.get(), audio_convert_frame->data, capacity, nullptr, 0);
+        }
+        if (converted > 0) av_audio_fifo_write(audio_fifo.get(), (void**)audio_convert_frame->data, converted);
+
+        const int frame_size = audio_frame->nb_samples;
+        while (av_audio_fifo_size(audio_fifo.get()) >= frame_size) {
+            av_frame_make_writable(audio_frame.get());
+            av_audio_fifo_read(audio_fifo.get(), (void**)audio_frame->data, frame_size);
+            audio_frame->pts = next_audio_pts;
+            next_audio_pts += frame_size;
+            encode_audio_frame(audio_frame.get());
+            first_audio_frame_ready = true;
+        }
+        if (frames == 0 && converted <= 0) break;
+    }
+
+    audio_written_us.store(next_audio_pts * 1000000 / audio_codec_ctx->sample_rate, std::memory_order_relaxed);
+
+    // The codec accepts a shorter last frame.
+    const int remaining = av_audio_fifo_size(audio_fifo.get());
+    if (flush && remaining > 0) {
+        const int frame_size = audio_frame->nb_samples;
+        av_frame_make_writable(audio_frame.get());
+        audio_frame->nb_samples = remaining;
+        av_audio_fifo_read(audio_fifo.get(), (void**)audio_frame->data, remaining);
+        audio_frame->pts = next_audio_pts;
+        next_audio_pts += remaining;
+        encode_audio_frame(audio_frame.get());
+        audio_frame->nb_samples = frame_size;
+    }
+}
+
+void VideoRecorder::encode_audio_frame(AVFrame* frame) {
+    if (parallel_export) {
+        encode_to_log(audio_codec_ctx.get(), frame, audio_log);
+        return;
+    }
+    AVPacket pkt;
+    av_new_packet(&pkt, 0);
+    int ret = avcodec_send_frame(audio_codec_ctx.get(), frame);
+    while (ret >= 0) {
+        ret = avcodec_receive_packet(audio_codec_ctx.get(), &pkt);
+        if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) break;
+        av_packet_rescale_ts(&pkt, audio_codec_ctx->time_base, audio_stream->time_base);
+        pkt.stream_index = audio_stream->index;
+        av_interleaved_write_frame(format_ctx.get(), &pkt);
+        av_packet_unref(&pkt);
+    }
+    av_packet_unref(&pkt);
+}
+
+std::string VideoRecorder::segment_path(int64_t segment) const {
+    char suffix[32];
+    snprintf(suffix, sizeof(suffix), ".part%04lld.seg", (long long)segment);
+    return export_base_path + suffix;
+}
+
+void VideoRecorder::segment_worker_main(int worker) {
+    std::unique_ptr<AVCodecContext, AVCodecContextDeleter> encoder;
+    std::unique_ptr<AVFrame, AVFrameDeleter> frame = alloc_video_frame();
+    std::unique_ptr<SwsContext, SwsContextDeleter> sws;
+    if (!yuv_active) {
+        sws.reset(sws_getContext(frame_width, frame_height, AV_PIX_FMT_RGBA, frame_width, frame_height, AV_PIX_FMT_YUV420P, SWS_BILINEAR, nullptr, nullptr, nullptr));
+    }
+    std::ofstream log;
+    int64_t segment = -1;
+
+    auto finish_segment = [&]() {
+        if (segment < 0) return;
+        if (encoder) encode_to_log(encoder.get(), nullptr, log);
+        encoder.reset();
+        log.close();
+        std::lock_guard<std::mutex> lock(queue_mutex);
+        segment_progress[segment].finished = true;
+    };
+
+    for (;;) {
+        std::pair<int64_t, PendingFrame> item;
+        {
+            std::unique_lock<std::mutex> lock(queue_mutex);
+            segment_cv.wait(lock, [&] { return !segment_queues[worker].empty() || segments_closing; });
+            if (segment_queues[worker].empty()) break;
+            item = segment_queues[worker].front();
+            segment_queues[worker].pop();
+        }
+
+        const int64_t frame_segment = item.first / export_segment_frames;
+        if (frame_segment != segment) {
+            finish_segment();
+            segment = frame_segment;
+            // A fresh encoder per segment, so every segment opens on an IDR frame.
+            log.open(segment_path(segment), std::ios::binary | std::ios::trunc);
+            if (!log || !open_video_encoder(encoder, output_global_header)) {
+                std::cerr << "VideoRecorder: could not start segment " << segment << std::endl;
+                encoder.reset();
+                std::lock_guard<std::mutex> lock(queue_mutex);
+                segment_progress[segment].failed = true;
+            } else {
+                std::lock_guard<std::mutex> lock(queue_mutex);
+                if (!export_video_params) {
+                    export_video_params.reset(avcodec_parameters_alloc());
+                    avcodec_parameters_from_context(export_video_params.get(), encoder.get());
+                }
+            }
+        }
+
+        convert_video_frame(frame_pool[item.second.buffer], frame.get(), sws.get());
+        {
+            std::lock_guard<std::mutex> lock(queue_mutex);
+            free_frames.push_back(item.second.buffer);
         }
+        queue_cv.notify_all(); // The render loop may be waiting for a buffer
+
+        if (!encoder) continue;  // Failed segment; its frames are dropped
+        frame->pts = item.first - segment * export_segment_frames;
+        const auto encode_start = std::chrono::steady_clock::now();
+        encode_to_log(encoder.get(), frame.get(), log);
+        note_encode_time(encode_start);
+        frames_encoded++;
+        std::lock_guard<std::mutex> lock(queue_mutex);
+        segment_progress[segment].frames_encoded++;
     }
+    finish_segment();
+}
 
+bool VideoRecorder::concat_segments(int64_t segment_count) {
+    if (!export_video_params) return false;
+    avcodec_parameters_copy(video_stream->codecpar, export_video_params.get());
+    video_stream->codecpar->codec_tag = 0;
+    video_stream->time_base = {1, 90000};
+    if (!(format_ctx->oformat->flags & AVFMT_NOFILE)) {
+        if (avio_open(&format_ctx->pb, format_ctx->url, AVIO_FLAG_WRITE) < 0) { std::cerr << "Could not open output file" << std::endl; return false; }
+    }
+    if (write_output_header() < 0) { std::cerr << "Could not write header" << std::endl; return false; }
+
+    const AVRational video_time_base = {frame_rate_den, frame_rate_num};
+    const std::string audio_path = export_base_path + ".audio.seg";
+    std::ifstream audio_in;
+    AVPacket audio_pkt;
+    av_new_packet(&audio_pkt, 0);
+    bool audio_pending = false;
+    if (m_recordAudio) {
+        audio_in.open(audio_path, std::ios::binary);
+        audio_pending = read_packet_record(audio_in, &audio_pkt);
+    }
+    auto write_audio_packet = [&]() {
+        av_packet_rescale_ts(&audio_pkt, audio_codec_ctx->time_base, audio_stream->time_base);
+        audio_pkt.stream_index = audio_stream->index;
+        av_interleaved_write_frame(format_ctx.get(), &audio_pkt);
+        audio_pending = read_packet_record(audio_in, &audio_pkt);
+    };
+
+    bool complete = true;
+    AVPacket pkt;
+    av_new_packet(&pkt, 0);
+    for (int64_t segment = 0; segment < segment_count; ++segment) {
+        bool failed;
+        {
+            std::lock_guard<std::mutex> lock(queue_mutex);
+            failed = segment_progress[segment].failed;
+        }
+        // A failed segment leaves an empty file; joining past it would leave a silent hole in the output.
+        if (failed) {
+            std::cerr << "VideoRecorder: segment " << segment << " failed to encode" << std::endl;
+            complete = false;
+            continue;
+        }
+        std::ifstream in(segment_path(segment), std::ios::binary);
+        if (!in) {
+            std::cerr << "VideoRecorder: missing segment " << segment_path(segment) << std::endl;
+            complete = false;
+            continue;
+        }
+        const int64_t offset = segment * export_segment_frames;
+        while (read_packet_record(in, &pkt)) {
+            if (pkt.pts != AV_NOPTS_VALUE) pkt.pts += offset;
+            if (pkt.dts != AV_NOPTS_VALUE) pkt.dts += offset;
+            // Interleave by hand so the muxer never has to buffer a whole segment of one stream.
+            while (audio_pending && av_compare_ts(audio_pkt.dts, audio_codec_ctx->time_base, pkt.dts, video_time_base) <= 0) {
+                write_audio_packet();
+            }
+            av_packet_rescale_ts(&pkt, video_time_base, video_stream->time_base);
+            pkt.stream_index = video_stream->index;
+            av_interleaved_write_frame(format_ctx.get(), &pkt);
+        }
+    }
+    while (audio_pending) write_audio_packet();
+    av_packet_unref(&pkt);
+    av_packet_unref(&audio_pkt);
     av_write_trailer(format_ctx.get());
-}
\ No newline at end of file
+
+    if (complete) {
+        audio_in.close();
+        for (int64_t segment = 0; segment < segment_count; ++segment) std::remove(segment_path(segment).c_str());
+        if (m_recordAudio) std::remove(audio_path.c_str());
+    }
+    return complete;
+}
@@ -12,8 +12,11 @@
 #include <queue>
 #include <chrono>
 #include <memory>
+#include <fstream>
 
 #include "IAudioListener.h"
+#include "SpscRingBuffer.h"
+#include "ImageSequenceWriter.h"
 
 extern "C" {
 #include <libavcodec/avcodec.h>
@@ -22,6 +25,7 @@ extern "C" {
 #include <libavutil/imgutils.h>
 #include <libswscale/swscale.h>
 #include <libswresample/swresample.h>
+#include <libavutil/audio_fifo.h>
 }
 
 // Custom deleters for FFmpeg types
@@ -52,13 +56,30 @@ struct SwrContextDeleter {
     void operator()(SwrContext* ctx) const { if (ctx) swr_free(&ctx); }
 };
 
+struct AVCodecParametersDeleter {
+    void operator()(AVCodecParameters* params) const { if (params) avcodec_parameters_free(&params); }
+};
+
+struct AVAudioFifoDeleter {
+    void operator()(AVAudioFifo* fifo) const { if (fifo) av_audio_fifo_free(fifo); }
+};
+
 class VideoRecorder : public IAudioListener {
 public:
     enum class VideoQuality {
         Low,
         Medium,
         High,
-        Ultra
+        Ultra,
+        Capture // Cheap intra codec for live recording, see CaptureCodec
+    };
+
+    // Codec of the Capture tier. Each costs a fraction of x264 "slow" and encodes with slice threads,
+    // so a frame is finished as soon as it is submitted.
+    enum class CaptureCodec {
+        X264IntraRefresh, // x264 ultrafast / zerolatency, periodic intra refresh instead of keyframes
+        MJPEG,            // Every frame a JPEG
+        FFV1              // Lossless, large files; mov or matroska only
     };
 
     enum class AudioBitrate {
@@ -68,20 +89,141 @@ public:
         Lossless
     };
 
+    struct CaptureStats {
+        int pbo_count = 0;
+        int pbos_in_flight = 0;
+        int frame_pool_size = 0;
+        int frame_pool_in_use = 0;      // Buffers queued for or being read by the encoder
+        uint64_t frames_captured = 0;
+        uint64_t frames_encoded = 0;
+        uint64_t fence_stalls = 0;      // Readbacks that had to wait for the GPU
+        double fence_stall_ms = 0.0;
+        uint64_t dropped_frames = 0;    // Real-time mode only: no free pool buffer
+        int frame_pool_high_water = 0;  // Most buffers in use at once during this recording
+        double encoder_fps = 0.0;       // Over the time since the previous get_capture_stats call (at least 0.5 s)
+        double avg_encode_ms = 0.0;     // Per frame: avcodec_send_frame plus draining its packets
+        double av_drift_ms = 0.0;       // Audio written minus video written; grows when video drops
+        uint64_t audio_overflow_frames = 0;
+    };
+
+    struct SegmentProgress {
+        int worker = 0;
+        int frames_encoded = 0;
+        bool finished = false;
+        bool failed = false;  // Its encoder could not start, so its frames were dropped
+    };
+
+    static const int MIN_PBO_COUNT = 3;
+    static const int MAX_PBO_COUNT = 6;
+    static const int MIN_FRAGMENT_MS = 500;
+    static const int MAX_FRAGMENT_MS = 10000;
+
     VideoRecorder();
     ~VideoRecorder();
 
-    bool start_recording(const std::string& filename, int width, int height, int fps, const std::string& format, bool record_audio, int input_audio_sample_rate, int input_audio_channels, bool offline_mode = false, VideoQuality video_quality = VideoQuality::High, AudioBitrate audio_bitrate = AudioBitrate::Kbps192);
+    // width x height is the output size, independent of the window; frames are scaled to it from the
+    // source texture. The frame rate is fps_num / fps_den (e.g. 24000 / 1001).
+    // A format of "png", "png16", "tiff16" or "exr" writes an image sequence instead of a video:
+    // filename minus its extension becomes the base of the numbered files, and no audio is recorded.
+    bool start_recording(const std::string& filename, int width, int height, int fps_num, int fps_den, const std::string& format, bool record_audio, int input_audio_sample_rate, int input_audio_channels, bool offline_mode = false, VideoQuality video_quality = VideoQuality::High, AudioBitrate audio_bitrate = AudioBitrate::Kbps192);
+    // Render thread. Copies out the readbacks still in flight and releases the GL objects, then
+    // returns; the encoder is drained, flushed and the file finished on a background thread (see
+    // is_finalizing). Does nothing if not recording.
     void stop_recording();
-    void add_video_frame_from_pbo(float deltaTime);
+    // Render thread. Captures source_texture (0 records black) at the output size, starts an
+    // asynchronous readback into the PBO ring, and hands every readback whose fence has signalled to
+    // the encoder. Never reads or changes the window's framebuffer.
+    void add_video_frame_from_pbo(float deltaTime, GLuint source_texture);
+    // Render loop only, for offline mode. Waits for the encoder instead of dropping audio.
     void add_audio_frame(const float* samples, int num_samples);
     bool is_recording() const;
+    // Between stop_recording and the output being complete: the last frames are still being encoded
+    // and the trailer and summary written. is_recording() is already false, and start_recording fails.
+    bool is_finalizing() const { return finalizing; }
+    // Input frames the audio thread had to drop because the encoder fell behind. Replaced by
+    // silence in the output so the audio track stays as long as the capture.
+    uint64_t get_audio_overflow_frames() const;
     void init_pbos();
+    // Take effect on the next start_recording. The PBO count is clamped to MIN/MAX_PBO_COUNT.
+    void set_pbo_count(int count);
+    void set_frame_pool_size(int count);
+    void set_gpu_color_conversion(bool enabled);
+    // Offline only. Cuts the video into segments of segment_frames, each starting on a keyframe, and
+    // encodes them round-robin on `workers` independent encoders into temporary files that are
+    // stream-copied into the output when recording stops. Audio is still encoded once. Rendering stays
+    // in order, so effects that carry state between frames are unaffected. workers < 2 turns it off.
+    // Takes effect on the next start_recording.
+    void set_parallel_export(int workers, int segment_frames);
+    // mp4 and mov only. Writes an empty moov and then a moof+mdat fragment about every fragment_ms
+    // (clamped to MIN/MAX_FRAGMENT_MS), so the muxer's index never grows, a crash leaves every
+    // finished fragment playable, and stopping writes no index. Takes effect on the next start_recording.
+    void set_fragmented_output(bool enabled, int fragment_ms);
+    static bool supports_fragmented_output(const std::string& format);
+    bool is_fragmented_output_active() const { return fragmented_output; }
+    // Codec used when recording at VideoQuality::Capture. Takes effect on the next start_recording.
+    void set_capture_codec(CaptureCodec codec);
+    // Whether the container given as start_recording's format can carry the capture codec.
+    static bool capture_codec_fits_format(CaptureCodec codec, const std::string& format);
+    // libx264 preset and CRF of the delivery tiers (Low to Ultra).
+    static void get_x264_settings(VideoQuality quality, const char*& preset, const char*& crf);
+    bool is_parallel_export_active() const { return parallel_export; }
+    int get_export_segment_frames() const { return export_segment_frames; }
+    // One entry per segment started so far, in output order.
+    std::vector<SegmentProgress> get_segment_progress() const;
+    // Compression threads for image sequences; 0 uses all but one hardware thread.
+    void set_image_sequence_workers(int workers);
+    bool is_image_sequence_active() const { return image_sequence_active; }
+    // The encoding thread could not set up its output (codec, file or header) and has exited. The
+    // recording keeps going but drops every frame, so the render loop and other recorders never wait
+    // on it; stop_recording still cleans up.
+    bool has_encoder_failed() const { return encoder_failed; }
+    // True while a recording converts on the GPU (it falls back to sws_scale if the shader fails).
+    bool is_gpu_color_conversion_active() const { return yuv_active; }
+    // Render thread. Also samples the encoder frame rate, hence the mutable members behind it.
+    CaptureStats get_capture_stats() const;
+    // Written next to the output when a recording stops (<output>.summary.txt); empty before the first.
+    const std::string& get_summary_path() const { return summary_path; }
 
+    // Audio thread, real-time mode only. No locks or allocation: copies into the audio ring.
     void onAudioData(const float* samples, uint32_t frameCount, int channels, int sampleRate) override;
 
 private:
     void encoding_thread_main(const std::string& filename, const std::string& format);
+    void push_audio(const float* samples, uint32_t frame_count, bool wait_for_space);
+    // Encoder thread. Resamples everything queued in the audio ring and encodes whole codec frames;
+    // with flush, also drains the resampler and encodes the final partial frame.
+    void encode_pending_audio(bool flush);
+    void encode_audio_frame(AVFrame* frame);
+    // avformat_write_header with the fragmentation options, if any.
+    int write_output_header();
+    // Encoding thread setup failed: flags it and wakes anything waiting for a free buffer.
+    void abort_encoding(const char* reason);
+    // Creates and opens an H.264 encoder with the recording's size, rate, colour tags and quality.
+    bool open_video_encoder(std::unique_ptr<AVCodecContext, AVCodecContextDeleter>& ctx, bool global_header);
+    std::unique_ptr<AVFrame, AVFrameDeleter> alloc_video_frame() const;
+    // Pool buffer to YUV 4:2:0. sws is only used on the RGBA path.
+    void convert_video_frame(const std::vector<uint8_t>& pixels, AVFrame* frame, SwsContext* sws);
+    void segment_worker_main(int worker);
+    std::string segment_path(int64_t segment) const;
+    // Stream-copies the segment packet logs and the audio log into format_ctx, then removes them.
+    bool concat_segments(int64_t segment_count);
+    // Render thread. Maps the PBO slot and copies it into a pool buffer for the encoder.
+    void retire_pbo(int slot);
+    // Render thread. Waits for the slot's readback and frees the slot; false if the wait failed.
+    bool wait_for_pbo(int slot);
+    // Background thread started by stop_recording: queues the tail frames, then joins the encoder
+    // and writes the summary.
+    void finalize_main();
+    void release_pbos();
+    bool init_yuv_target();
+    void release_yuv_target();
+    void render_yuv_planes(GLuint source_texture);
+    bool init_capture_target();
+    void release_capture_target();
+    // Scales source_texture into capture_fbo, for the RGBA path.
+    void copy_to_capture_target(GLuint source_texture);
+    void note_encode_time(std::chrono::steady_clock::time_point start);
+    void write_summary();
 
     // FFmpeg components using RAII
     std::unique_ptr<AVFormatContext, AVFormatContextDeleter> format_ctx;
@@ -94,17 +236,26 @@ private:
     AVStream* audio_stream = nullptr; // Managed by format_ctx
     std::unique_ptr<AVFrame, AVFrameDeleter> audio_frame;
     std::unique_ptr<SwrContext, SwrContextDeleter> swr_ctx;
+    std::unique_ptr<AVFrame, AVFrameDeleter> audio_convert_frame; // Resampler output, before the FIFO
+    std::unique_ptr<AVAudioFifo, AVAudioFifoDeleter> audio_fifo;   // Cuts resampled audio into codec frames
 
     // Recording settings
     bool m_recordAudio;
     bool m_offlineMode;
     VideoQuality m_videoQuality;
+    CaptureCodec capture_codec_setting = CaptureCodec::X264IntraRefresh;
+    CaptureCodec capture_codec = CaptureCodec::X264IntraRefresh;
     AudioBitrate m_audioBitrate;
+    bool fragmented_setting = false;
+    int fragment_ms_setting = 2000;
+    bool fragmented_output = false;
+    int fragment_ms = 2000;
 
     // Frame properties
     int frame_width;
     int frame_height;
-    int frame_rate;
+    int frame_rate_num;
+    int frame_rate_den;
     double frame_duration;
     double frame_accumulator = 0.0;
     int input_audio_sample_rate;
@@ -116,24 +267,120 @@ private:
     // Timing
     std::chrono::steady_clock::time_point recording_start_time;
 
-    // PBO members
-    static const int PBO_COUNT = 2;
-    GLuint pbos[PBO_COUNT];
-    int pbo_index = 0;
+    // PBO ring. Slots are filled in order; pbo_oldest is the next one to retire.
+    struct PboSlot {
+        GLuint buffer = 0;
+        GLsync fence = nullptr;
+        std::chrono::steady_clock::time_point capture_time;
+    };
+    std::vector<PboSlot> pbos;
+    int pbo_count_setting = MIN_PBO_COUNT;
+    size_t readback_bytes = 0; // Per frame: RGBA, or the packed planes with GPU conversion
+    int pbo_oldest = 0;
+    int pbos_in_flight = 0;
 
     // Threading and state
     std::thread encoding_thread;
+    std::thread finalize_thread;
     std::atomic<bool> recording;
-    std::mutex queue_mutex;
+    std::atomic<bool> finalizing{false};
+    std::atomic<bool> input_closed{false}; // Set by finalize_main once the encoder has every frame
+    std::atomic<bool> encoder_failed{false};
+    mutable std::mutex queue_mutex;
     std::condition_variable cv;
 
     // Frame queues
-    std::queue<std::pair<std::vector<uint8_t>, std::chrono::steady_clock::time_point>> video_queue;
+    // GPU colour conversion (shaders/rgb_to_yuv420.frag). The R8 target holds the Y plane followed by
+    // rows of U|V, so yuv_target_width is twice the chroma width and may exceed frame_width by one.
+    bool gpu_yuv_setting = true;
+    bool yuv_active = false;
+    GLuint yuv_program = 0;
+    GLuint yuv_fbo = 0;
+    GLuint yuv_texture = 0;
+    int yuv_target_width = 0;
+    int yuv_target_height = 0;
+
+    // RGBA path: the source texture is blitted into this output-sized target and read back from it.
+    // RGBA16F, read back as half floats, for high-precision image sequences.
+    bool capture_half_float = false;
+    GLuint capture_fbo = 0;
+    GLuint capture_texture = 0;
+    GLuint capture_read_fbo = 0; // Wraps the source texture for the blit
+
+    // Frame pool: buffers are allocated once in start_recording and cycle between free_frames (render
+    // thread takes) and video_queue (encoder takes, then returns to free_frames). Both guarded by
+    // queue_mutex.
+    struct PendingFrame {
+        int buffer;
+        std::chrono::steady_clock::time_point capture_time;
+    };
+    std::vector<std::vector<uint8_t>> frame_pool;
+    std::vector<int> free_frames;
+    std::queue<PendingFrame> video_queue;
+    int frame_pool_size_setting = 8;
+    // Readbacks still in flight at stop_recording, copied out so the PBOs can go with the GL context
+    // thread. finalize_main hands them to the encoder.
+    struct TailFrame {
+        std::vector<uint8_t> pixels;
+        std::chrono::steady_clock::time_point capture_time;
+    };
+    std::vector<TailFrame> tail_frames;
+
+    // Capture stats. The render thread owns all but frames_encoded.
+    uint64_t frames_captured = 0;
+    uint64_t fence_stalls = 0;
+    double fence_stall_ms = 0.0;
+    uint64_t dropped_frames = 0;
+    std::atomic<uint64_t> frames_encoded{0};
+    int frame_pool_high_water = 0;             // Guarded by queue_mutex
+    std::atomic<uint64_t> encode_time_ns{0};   // Summed over encode_calls, by every encoding thread
+    std::atomic<uint64_t> encode_calls{0};
+    std::atomic<int64_t> video_written_us{0};  // Stream time handed to the video encoder(s)
+    std::atomic<int64_t> audio_written_us{0};  // Stream time handed to the audio encoder
+    mutable std::chrono::steady_clock::time_point fps_sample_time;
+    mutable uint64_t fps_sample_frames = 0;
+    mutable double encoder_fps = 0.0;
+    std::string output_description;            // For the summary: what was recorded and how
+    std::string summary_path;
     std::atomic<bool> first_audio_frame_ready;
-    std::queue<std::vector<float>> audio_queue;
-    
-    static const size_t MAX_QUEUE_SIZE = 60; // Limit queue to ~1 second of frames to prevent OOM
+
+    // Interleaved input samples. One producer (the audio thread in real-time mode, the render loop in
+    // offline mode) and one consumer (the encoder thread). Sized in start_recording, never grown.
+    SpscRingBuffer<float> audio_ring;
+    std::atomic<uint64_t> audio_overflow_frames{0};
+    uint64_t audio_frames_padded = 0; // Encoder side: dropped frames already replaced by silence
+    std::vector<float> audio_staging; // Encoder side: one read's worth of ring samples
+    static constexpr double AUDIO_RING_SECONDS = 2.0;
+    static constexpr int AUDIO_STAGING_FRAMES = 4096;
+    // The audio thread never signals the encoder, so the encoder polls the ring at this interval.
+    static constexpr std::chrono::milliseconds AUDIO_POLL_INTERVAL{10};
     std::condition_variable queue_cv; // To signal when space is available
+
+    // Parallel export. The encoding thread deals frames out to segment_queues (guarded by
+    // queue_mutex); each worker owns one encoder at a time and writes raw packets to a segment file.
+    static constexpr size_t PARALLEL_EXPORT_POOL_BYTES = size_t(2) << 30; // Caps the deeper frame pool it needs
+    int export_workers_setting = 0;
+    int export_segment_frames_setting = 120;
+    bool parallel_export = false;
+    int export_workers = 0;
+    int export_segment_frames = 0;
+    bool output_global_header = false;
+    std::string export_base_path;
+    std::vector<std::thread> segment_workers;
+    std::vector<std::queue<std::pair<int64_t, PendingFrame>>> segment_queues;
+    std::condition_variable segment_cv;
+    bool segments_closing = false;
+    int64_t next_dispatch_frame = 0;                // Encoding thread only
+    std::vector<SegmentProgress> segment_progress;  // Guarded by queue_mutex
+    std::unique_ptr<AVCodecParameters, AVCodecParametersDeleter> export_video_params; // Guarded by queue_mutex
+    std::ofstream audio_log;                        // Encoding thread only
+
+    // Image sequence export. Replaces the encoding thread: readbacks go straight to the writer, which
+    // has its own bounded buffers and worker pool.
+    static constexpr size_t IMAGE_SEQUENCE_POOL_BYTES = size_t(1) << 30;
+    ImageSequenceWriter image_sequence;
+    bool image_sequence_active = false;
+    int image_sequence_workers_setting = 0;
 };
 
 #endif // VIDEO_RECORDER_H
\ No newline at end of file
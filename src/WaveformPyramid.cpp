@@ -0,0 +1,151 @@
+#include "WaveformPyramid.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+
+namespace {
+    const char kPeaksMagic[4] = { 'R', 'M', 'V', 'W' };
+    const uint32_t kPeaksVersion = 1;
+
+    struct PeaksHeader {
+        char magic[4];
+        uint32_t version;
+        uint32_t baseBinFrames;
+        uint32_t levelCount;
+        uint64_t frameCount;
+    };
+}
+
+void WaveformPyramid::Clear() {
+    m_levels.clear();
+    m_frameCount = 0;
+}
+
+bool WaveformPyramid::Build(const float* frames, uint64_t frameCount, uint32_t channels, const std::atomic<bool>& cancel) {
+    Clear();
+    if (!frames || frameCount == 0 || channels == 0) return false;
+
+    // Level 0 straight from the samples, across all channels.
+    std::vector<Bin> base((size_t)((frameCount + BASE_BIN_FRAMES - 1) / BASE_BIN_FRAMES));
+    for (size_t b = 0; b < base.size(); ++b) {
+        uint64_t first = (uint64_t)b * BASE_BIN_FRAMES;
+        uint64_t count = std::min<uint64_t>(BASE_BIN_FRAMES, frameCount - first);
+        const float* samples = frames + first * channels;
+        const size_t sampleCount = (size_t)(count * channels);
+        float lo = samples[0], hi = samples[0], sumSquares = 0.0f;
+        for (size_t i = 0; i < sampleCount; ++i) {
+            lo = std::min(lo, samples[i]);
+            hi = std::max(hi, samples[i]);
+            sumSquares += samples[i] * samples[i];
+        }
+        base[b] = { lo, hi, std::sqrt(sumSquares / (float)sampleCount) };
+        if ((b & 4095) == 0 && cancel.load(std::memory_order_relaxed)) return false;
+    }
+    m_levels.push_back(std::move(base));
+
+    // Halve until a single bin covers the whole file.
+    while (m_levels.back().size() > 1) {
+        const std::vector<Bin>& below = m_levels.back();
+        std::vector<Bin> level((below.size() + 1) / 2);
+        for (size_t b = 0; b < level.size(); ++b) {
+            const Bin& a = below[2 * b];
+            if (2 * b + 1 < below.size()) {
+                const Bin& c = below[2 * b + 1];
+                level[b] = { std::min(a.min, c.min), std::max(a.max, c.max), std::sqrt(0.5f * (a.rms * a.rms + c.rms * c.rms)) };
+            } else {
+                level[b] = a;
+            }
+        }
+        m_levels.push_back(std::move(level));
+    }
+    m_frameCount = frameCount;
+    return true;
+}
+
+void WaveformPyramid::Query(double startFrame, double framesPerPixel, int pixelCount, std::vector<Bin>& out) const {
+    out.assign(std::max(0, pixelCount), Bin());
+    if (m_levels.empty() || framesPerPixel <= 0.0) return;
+
+    size_t level = 0;
+    double binFrames = BASE_BIN_FRAMES;
+    while (level + 1 < m_levels.size() && binFrames * 2.0 <= framesPerPixel) {
+        ++level;
+        binFrames *= 2.0;
+    }
+    const std::vector<Bin>& bins = m_levels[level];
+    const int64_t lastBin = (int64_t)bins.size() - 1;
+
+    for (int p = 0; p < pixelCount; ++p) {
+        double begin = startFrame + p * framesPerPixel;
+        double end = begin + framesPerPixel;
+        if (end <= 0.0 || begin >= (double)m_frameCount) continue;
+
+        int64_t first = std::clamp((int64_t)std::floor(begin / binFrames), (int64_t)0, lastBin);
+        int64_t last = std::clamp((int64_t)std::ceil(end / binFrames) - 1, first, lastBin);
+        Bin merged = bins[first];
+        float sumSquares = merged.rms * merged.rms;
+        for (int64_t b = first + 1; b <= last; ++b) {
+            merged.min = std::min(merged.min, bins[b].min);
+            merged.max = std::max(merged.max, bins[b].max);
+            sumSquares += bins[b].rms * bins[b].rms;
+        }
+        merged.rms = std::sqrt(sumSquares / (float)(last - first + 1));
+        out[p] = merged;
+    }
+}
+
+bool WaveformPyramid::Load(const std::string& path, uint64_t frameCount) {
+    Clear();
+    std::ifstream in(path, std::ios::binary);
+    if (!in) return false;
+
+    PeaksHeader header;
+    if (!in.read(reinterpret_cast<char*>(&header), sizeof(header))) return false;
+    if (std::memcmp(header.magic, kPeaksMagic, sizeof(kPeaksMagic)) != 0 || header.version != kPeaksVersion ||
+        header.baseBinFrames != (uint32_t)BASE_BIN_FRAMES || header.frameCount != frameCount || header.levelCount == 0 || header.levelCount > 64) {
+        return false;
+    }
+
+    std::vector<uint64_t> sizes(header.levelCount);
+    if (!in.read(reinterpret_cast<char*>(sizes.data()), sizes.size() * sizeof(uint64_t))) return false;
+    // Level sizes follow from the frame count; anything else is a corrupt file.
+    uint64_t expected = (frameCount + BASE_BIN_FRAMES - 1) / BASE_BIN_FRAMES;
+    for (uint64_t size : sizes) {
+        if (size != expected) return false;
+        expected = (expected + 1) / 2;
+    }
+
+    m_levels.resize(header.levelCount);
+    for (uint32_t l = 0; l < header.levelCount; ++l) {
+        m_levels[l].resize((size_t)sizes[l]);
+        if (!in.read(reinterpret_cast<char*>(m_levels[l].data()), m_levels[l].size() * sizeof(Bin))) {
+            Clear();
+            return false;
+        }
+    }
+    m_frameCount = frameCount;
+    return true;
+}
+
+bool WaveformPyramid::Save(const std::string& path) const {
+    if (m_levels.empty()) return false;
+    PeaksHeader header{};
+    std::memcpy(header.magic, kPeaksMagic, sizeof(kPeaksMagic));
+    header.version = kPeaksVersion;
+    header.baseBinFrames = BASE_BIN_FRAMES;
+    header.levelCount = (uint32_t)m_levels.size();
+    header.frameCount = m_frameCount;
+
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out) return false;
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    for (const auto& level : m_levels) {
+        uint64_t size = level.size();
+        out.write(reinterpret_cast<const char*>(&size), sizeof(size));
+    }
+    for (const auto& level : m_levels) {
+        out.write(reinterpret_cast<const char*>(level.data()), level.size() * sizeof(Bin));
+    }
+    return (bool)out;
+}
@@ -0,0 +1,43 @@
+#ifndef WAVEFORMPYRAMID_H
+#define WAVEFORMPYRAMID_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Min/max/RMS overview of a whole audio file at successively halved resolutions.
+// Level 0 summarises BASE_BIN_FRAMES frames per bin and every level above merges pairs of bins from
+// the one below, so drawing any zoom level touches at most a few bins per pixel no matter how long
+// the file is.
+class WaveformPyramid {
+public:
+    static const int BASE_BIN_FRAMES = 256;
+
+    struct Bin {
+        float min = 0.0f;
+        float max = 0.0f;
+        float rms = 0.0f;
+    };
+
+    // Builds from interleaved f32 frames. Returns false if cancelled.
+    bool Build(const float* frames, uint64_t frameCount, uint32_t channels, const std::atomic<bool>& cancel);
+    // Loads a pyramid saved for a file with frameCount frames. Fails on any mismatch.
+    bool Load(const std::string& path, uint64_t frameCount);
+    bool Save(const std::string& path) const;
+    void Clear();
+
+    bool IsEmpty() const { return m_levels.empty(); }
+    int GetLevelCount() const { return (int)m_levels.size(); }
+    uint64_t GetFrameCount() const { return m_frameCount; }
+
+    // Fills one bin per pixel, pixel p covering frames [startFrame + p * framesPerPixel, +framesPerPixel).
+    // Picks the coarsest level whose bins are no wider than a pixel, so the cost is O(pixelCount).
+    void Query(double startFrame, double framesPerPixel, int pixelCount, std::vector<Bin>& out) const;
+
+private:
+    std::vector<std::vector<Bin>> m_levels;
+    uint64_t m_frameCount = 0;
+};
+
+#endif // WAVEFORMPYRAMID_H
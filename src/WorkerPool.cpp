@@ -0,0 +1,77 @@
+#include "WorkerPool.h"
+#include <algorithm>
+
+WorkerPool::WorkerPool(int threadCount) {
+    for (int i = 0; i < threadCount; ++i) {
+        m_threads.emplace_back(&WorkerPool::WorkerMain, this);
+    }
+}
+
+WorkerPool::~WorkerPool() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_wake.notify_all();
+    for (auto& thread : m_threads) thread.join();
+}
+
+WorkerPool& WorkerPool::Shared() {
+    static WorkerPool pool(std::max(1, (int)std::thread::hardware_concurrency()) - 1);
+    return pool;
+}
+
+void WorkerPool::Run(int count, const std::function<void(int)>& task) {
+    if (count <= 0) return;
+    std::lock_guard<std::mutex> runLock(m_runMutex);
+    if (m_threads.empty() || count == 1) {
+        for (int i = 0; i < count; ++i) task(i);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_task = &task;
+        m_count = count;
+        m_remaining = count;
+        m_next.store(0, std::memory_order_relaxed);
+        ++m_generation;
+    }
+    m_wake.notify_all();
+    RunTasks(task, count);
+
+    // Workers that picked this loop up must have left it before task goes out of scope.
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_done.wait(lock, [this] { return m_remaining == 0 && m_activeWorkers == 0; });
+    m_task = nullptr;
+}
+
+void WorkerPool::RunTasks(const std::function<void(int)>& task, int count) {
+    int index;
+    while ((index = m_next.fetch_add(1, std::memory_order_relaxed)) < count) {
+        task(index);
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (--m_remaining == 0) m_done.notify_all();
+    }
+}
+
+void WorkerPool::WorkerMain() {
+    uint64_t seenGeneration = 0;
+    for (;;) {
+        const std::function<void(int)>* task;
+        int count;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_wake.wait(lock, [&] { return m_stopping || m_generation != seenGeneration; });
+            if (m_stopping) return;
+            seenGeneration = m_generation;
+            if (!m_task) continue;  // Woke after that loop had already finished
+            task = m_task;
+            count = m_count;
+            ++m_activeWorkers;
+        }
+        RunTasks(*task, count);
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (--m_activeWorkers == 0) m_done.notify_all();
+    }
+}
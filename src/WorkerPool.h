@@ -0,0 +1,48 @@
+#ifndef WORKER_POOL_H
+#define WORKER_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A fixed set of threads for data-parallel loops. Run() hands out the indices 0..count-1 to the
+// workers and the calling thread, and returns once every index has been processed. Which thread
+// runs which index is not fixed, but each index runs exactly once. One Run() at a time.
+class WorkerPool {
+public:
+    explicit WorkerPool(int threadCount);
+    ~WorkerPool();
+
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    // Shared pool with one thread per hardware thread, less the caller's.
+    static WorkerPool& Shared();
+
+    // Worker threads, not counting the caller.
+    int GetThreadCount() const { return (int)m_threads.size(); }
+    void Run(int count, const std::function<void(int)>& task);
+
+private:
+    void WorkerMain();
+    void RunTasks(const std::function<void(int)>& task, int count);
+
+    std::vector<std::thread> m_threads;
+    std::mutex m_runMutex;             // Serialises Run()
+    std::mutex m_mutex;                // Guards everything below except m_next
+    std::condition_variable m_wake;
+    std::condition_variable m_done;
+    const std::function<void(int)>* m_task = nullptr;
+    int m_count = 0;
+    int m_remaining = 0;
+    int m_activeWorkers = 0;
+    uint64_t m_generation = 0;
+    bool m_stopping = false;
+    std::atomic<int> m_next{0};
+};
+
+#endif // WORKER_POOL_H
@@ -27,6 +27,7 @@
 // --- Core App Headers ---
 #include "Effect.h"
 #include "ShaderEffect.h"
+#include "MilkdropPresetEffect.h"
 #include "Renderer.h"
 #include "ShadertoyIntegration.h"
 
@@ -45,6 +46,8 @@
 #include "OutputNode.h" // For the Scene Output node
 #include "Bess/Config/Themes.h" // Added Themes header
 #include "VideoRecorder.h"
+#include "BackgroundTranscoder.h"
+#include "PresetLibrary.h"
 #define GLM_ENABLE_EXPERIMENTAL
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
@@ -81,6 +84,9 @@ void RenderConsoleWindow();
 void RenderAudioReactivityWindow();
 void RenderShadertoyWindow();
 void RenderFpsMeter();
+void RenderRecorderTelemetryWindow();
+void RenderPresetLibraryWindow();
+void LoadMilkdropPreset(const std::string& filePathName);
 void RenderCameraHelpText();
 
 std::vector<Effect*> GetRenderOrder(const std::vector<Effect*>& activeEffects);
@@ -159,6 +165,8 @@ static Renderer g_renderer;
 static TextEditor g_editor;
 static AudioSystem g_audioSystem;
 VideoRecorder g_videoRecorder;
+BackgroundTranscoder g_transcoder;
+static PresetLibrary g_presetLibrary;
 static Bess::Config::Themes g_themes; // Global Themes object
 static bool g_showGui = true;
 static bool g_verboseLogging = false; // Verbose terminal logging flag (set via CLI -verbose=ON)
@@ -182,8 +190,73 @@ static double g_lastMouseX = 0.0, g_lastMouseY = 0.0;
 static std::chrono::steady_clock::time_point g_recordingStartTime;
 static bool g_offlineRendering = false;
 static float g_offlineTime = 0.0f;
+static uint64_t g_offlineFrameIndex = 0; // Absolute frame number; iTime and audio are derived from it
+
+// Output format, independent of the window. A 0x0 resolution preset means "match the window".
+struct RecordingResolution { const char* label; int width; int height; };
+static const RecordingResolution g_recordResolutions[] = {
+    { "Window", 0, 0 }, { "1280x720", 1280, 720 }, { "1920x1080", 1920, 1080 }, { "2560x1440", 2560, 1440 },
+    { "3840x2160 (4K)", 3840, 2160 }, { "7680x4320 (8K)", 7680, 4320 }, { "Custom", -1, -1 },
+};
+struct RecordingFrameRate { const char* label; ma_uint32 num; ma_uint32 den; };
+static const RecordingFrameRate g_recordFrameRates[] = {
+    { "23.976", 24000, 1001 }, { "24", 24, 1 }, { "25", 25, 1 }, { "30", 30, 1 }, { "50", 50, 1 }, { "60", 60, 1 }, { "120", 120, 1 },
+};
+static const int g_maxRecordWidth = 7680;
+static const int g_maxRecordHeight = 4320;
+static int g_recordResolutionIndex = 0;
+static int g_recordCustomSize[2] = { 1920, 1080 };
+static int g_recordFrameRateIndex = 5; // 60 fps
+// Latched when a recording starts
+static ma_uint32 g_recordingFpsNum = 60;
+static ma_uint32 g_recordingFpsDen = 1;
 static int g_videoQuality = 2; // Default to High
 static int g_audioBitrate = 1; // Default to 192k
+static int g_recordPboCount = VideoRecorder::MIN_PBO_COUNT;
+static int g_recordFramePoolSize = 8;
+static bool g_recordGpuColorConversion = true;
+static bool g_recordParallelExport = false;
+static bool g_recordFloatChain = false;
+static int g_recordSequenceWorkers = 0; // 0 = all but one hardware thread
+static int g_recordCaptureCodec = 0;    // VideoRecorder::CaptureCodec
+static bool g_transcodeAfterCapture = false;
+static int g_deliveryQuality = 2;       // Quality of the transcode, Low to Ultra
+// Latched when a recording starts, for the transcode after it stops
+static std::string g_recordingFilename;
+static bool g_recordingIsCapture = false;
+// Stopped, with a recorder still finishing its file; reported and transcoded once all are done
+static bool g_recordingFinishing = false;
+static std::vector<std::string> g_finishingSummaryPaths;
+// Requested offline render, started once the audio analysis is ready
+struct PendingOfflineRender {
+    std::string filename;
+    std::string format;
+    bool recordAudio = false;
+    int frameRateIndex = 0;
+};
+static PendingOfflineRender g_pendingOfflineRender;
+static bool g_offlineRenderPending = false;
+static int g_recordExportWorkers = 4;
+static int g_recordSegmentFrames = 120;
+static bool g_recordFragmented = false;
+static int g_recordFragmentMs = 2000;
+static const char* g_recordFormats[] = { "mp4", "mov", "mpg", "matroska", "png", "png16", "tiff16", "exr" };
+static const char* g_recordFormatLabels[] = { "mp4", "mov", "mpg", "mkv", "PNG sequence (8-bit)", "PNG sequence (16-bit)", "TIFF sequence (16-bit)", "EXR sequence (half float)" };
+static const char* g_recordFormatExtensions[] = { ".mp4", ".mov", ".mpg", ".mkv", ".png", ".png", ".tif", ".exr" };
+
+// Additional outputs encoded from the same render, e.g. a 1080p cut next to a 4K master. Each has
+// its own recorder, so its own GPU downscale, readback ring and encoder thread; a slow or failed
+// encoder only costs its own file frames. They share the main output's frame rate and audio.
+struct RecordingOutputProfile {
+    bool enabled = false;
+    int resolutionIndex = 2; // 1920x1080
+    int customSize[2] = { 1280, 720 };
+    int formatIndex = 0;
+    int quality = 2;
+};
+static const int g_maxExtraOutputs = 3;
+static RecordingOutputProfile g_extraOutputProfiles[g_maxExtraOutputs];
+static VideoRecorder g_extraRecorders[g_maxExtraOutputs];
 
 // Window visibility flags
 static bool g_showShaderEditorWindow = true;
@@ -195,6 +268,8 @@ static bool g_showNodeEditorWindow = false;
 static bool g_showAudioWindow = false;
 static bool g_showShadertoyWindow = false;
 static bool g_showFpsMeter = false;
+static bool g_showRecorderTelemetry = false;
+static bool g_showPresetLibrary = false;
 
 static char g_shadertoyApiKeyBuffer[256] = ""; // For user's API key
 
@@ -298,6 +373,48 @@ static void HelpMarker(const char* desc) {
     }
 }
 
+// Draws the loaded audio file's waveform between startSeconds and endSeconds across the available
+// width, reading one pyramid bin per pixel. Returns true while the strip is clicked or dragged, with
+// the time under the mouse in seekSeconds.
+static bool DrawWaveformStrip(const char* id, const WaveformPyramid& waveform, float sampleRate, double startSeconds, double endSeconds,
+                              float height, float playheadSeconds, float* seekSeconds) {
+    static std::vector<WaveformPyramid::Bin> bins;
+    const ImVec2 pos = ImGui::GetCursorScreenPos();
+    const float width = ImGui::GetContentRegionAvail().x;
+    if (width < 1.0f || sampleRate <= 0.0f || endSeconds <= startSeconds) return false;
+
+    ImGui::InvisibleButton(id, ImVec2(width, height));
+    const bool seeking = ImGui::IsItemActive();
+    ImDrawList* drawList = ImGui::GetWindowDrawList();
+    drawList->AddRectFilled(pos, ImVec2(pos.x + width, pos.y + height), IM_COL32(30, 30, 34, 255), 2.0f);
+
+    const int pixels = (int)width;
+    const double secondsPerPixel = (endSeconds - startSeconds) / width;
+    waveform.Query(startSeconds * sampleRate, secondsPerPixel * sampleRate, pixels, bins);
+    const float mid = pos.y + height * 0.5f;
+    const float half = height * 0.5f - 1.0f;
+    for (int p = 0; p < pixels; ++p) {
+        const WaveformPyramid::Bin& bin = bins[p];
+        float x = pos.x + p + 0.5f;
+        float top = mid - std::clamp(bin.max, -1.0f, 1.0f) * half;
+        float bottom = mid - std::clamp(bin.min, -1.0f, 1.0f) * half;
+        drawList->AddLine(ImVec2(x, top), ImVec2(x, bottom + 1.0f), IM_COL32(80, 140, 200, 255));
+        float rms = std::min(bin.rms, 1.0f) * half;
+        drawList->AddLine(ImVec2(x, mid - rms), ImVec2(x, mid + rms + 1.0f), IM_COL32(150, 200, 250, 255));
+    }
+
+    if (playheadSeconds >= startSeconds && playheadSeconds <= endSeconds) {
+        float x = pos.x + (float)((playheadSeconds - startSeconds) / secondsPerPixel);
+        drawList->AddLine(ImVec2(x, pos.y), ImVec2(x, pos.y + height), IM_COL32(255, 80, 80, 255), 1.5f);
+    }
+
+    if (seeking && seekSeconds) {
+        float mouseX = std::clamp(ImGui::GetIO().MousePos.x - pos.x, 0.0f, width);
+        *seekSeconds = (float)(startSeconds + mouseX * secondsPerPixel);
+    }
+    return seeking;
+}
+
 static Effect* FindEffectById(int effect_id) {
     for (const auto& effect_ptr : g_scene) {
         if (effect_ptr && effect_ptr->id == effect_id) {
@@ -476,6 +593,204 @@ static void ParseCommandLineArgs(int argc, char** argv) {
 
 // --- UI Window Implementations ---
 
+// Snaps the offline render start to a frame boundary, so every rendered frame maps to one fixed
+// slice of audio.
+static void BeginOfflineRender() {
+    double startSeconds = std::max(0.0, (double)g_timelineState.currentTime_seconds);
+    g_offlineFrameIndex = (uint64_t)std::llround(startSeconds * g_recordingFpsNum / g_recordingFpsDen);
+    g_offlineTime = (float)((double)g_offlineFrameIndex * g_recordingFpsDen / g_recordingFpsNum);
+}
+
+static void ResizeSceneFramebuffers(int width, int height) {
+    for (const auto& effect_ptr : g_scene) {
+        if (auto* se = dynamic_cast<ShaderEffect*>(effect_ptr.get())) {
+            se->ResizeFrameBuffer(width, height);
+        }
+    }
+}
+
+// "Window" resolves to windowWidth x windowHeight. Sizes are kept even for 4:2:0 video.
+static void ResolveRecordingSize(int resolutionIndex, const int customSize[2], int windowWidth, int windowHeight, int& width, int& height) {
+    width = g_recordResolutions[resolutionIndex].width;
+    height = g_recordResolutions[resolutionIndex].height;
+    if (width == 0) {
+        width = windowWidth;
+        height = windowHeight;
+    } else if (width < 0) {
+        width = customSize[0];
+        height = customSize[1];
+    }
+    width = std::clamp(width, 16, g_maxRecordWidth) & ~1;
+    height = std::clamp(height, 16, g_maxRecordHeight) & ~1;
+}
+
+// Starts every enabled extra output as <stem>_out<N>_<w>x<h>.<ext> next to the main file. Their
+// "Window" size means the main output's size. One that cannot start is reported and skipped.
+static void StartExtraOutputs(const std::string& filename, int mainWidth, int mainHeight, const RecordingFrameRate& rate, bool recordAudio) {
+    const std::filesystem::path mainPath(filename);
+    for (int i = 0; i < g_maxExtraOutputs; ++i) {
+        const RecordingOutputProfile& profile = g_extraOutputProfiles[i];
+        if (!profile.enabled) continue;
+        int width, height;
+        ResolveRecordingSize(profile.resolutionIndex, profile.customSize, mainWidth, mainHeight, width, height);
+        std::filesystem::path path = mainPath;
+        path.replace_filename(mainPath.stem().string() + "_out" + std::to_string(i + 2) + "_" + std::to_string(width) + "x" +
+                              std::to_string(height) + g_recordFormatExtensions[profile.formatIndex]);
+
+        VideoRecorder& recorder = g_extraRecorders[i];
+        recorder.set_pbo_count(g_recordPboCount);
+        recorder.set_frame_pool_size(g_recordFramePoolSize);
+        recorder.set_gpu_color_conversion(g_recordGpuColorConversion);
+        recorder.set_parallel_export(g_recordParallelExport ? g_recordExportWorkers : 0, g_recordSegmentFrames);
+        recorder.set_image_sequence_workers(g_recordSequenceWorkers);
+        recorder.set_capture_codec(static_cast<VideoRecorder::CaptureCodec>(g_recordCaptureCodec));
+        recorder.set_fragmented_output(g_recordFragmented, g_recordFragmentMs);
+        if (!recorder.start_recording(path.string(), width, height, (int)rate.num, (int)rate.den, g_recordFormats[profile.formatIndex], recordAudio,
+                                      g_audioSystem.GetCurrentInputSampleRate(),
+                                      g_audioSystem.GetCurrentInputChannels(),
+                                      g_offlineRendering,
+                                      static_cast<VideoRecorder::VideoQuality>(profile.quality),
+                                      static_cast<VideoRecorder::AudioBitrate>(g_audioBitrate))) {
+            g_consoleLog += "\nCould not start output " + std::to_string(i + 2) + " (" + path.string() + ")";
+            continue;
+        }
+        g_consoleLog += "\nAlso recording " + std::to_string(width) + "x" + std::to_string(height) + " to " + path.string();
+    }
+}
+
+// Renders the scene at the chosen output size for the length of the recording; the window only
+// shows it scaled. Extra outputs are scaled from that render on the GPU.
+static bool StartRecordingNow(const std::string& filename, const std::string& format, bool recordAudio, int frameRateIndex) {
+    // Ensure the audio device is started if we are recording with mic input
+    if (recordAudio && g_audioSystem.GetCurrentAudioSource() == AudioSystem::AudioSource::Microphone && !g_audioSystem.IsCaptureDeviceInitialized()) {
+        g_audioSystem.InitializeAndStartSelectedCaptureDevice();
+    }
+
+    int windowWidth, windowHeight;
+    glfwGetFramebufferSize(glfwGetCurrentContext(), &windowWidth, &windowHeight);
+    int width, height;
+    ResolveRecordingSize(g_recordResolutionIndex, g_recordCustomSize, windowWidth, windowHeight, width, height);
+
+    const RecordingFrameRate& rate = g_recordFrameRates[frameRateIndex];
+    g_recordingFpsNum = rate.num;
+    g_recordingFpsDen = rate.den;
+
+    // High-precision image sequences can render the whole chain in half floats.
+    ImageSequenceWriter::Format sequenceFormat;
+    if (g_recordFloatChain && ImageSequenceWriter::ParseFormat(format, sequenceFormat) && ImageSequenceWriter::IsHighPrecision(sequenceFormat)) {
+        ShaderEffect::SetFramebufferFormat(GL_RGBA16F);
+    }
+    ResizeSceneFramebuffers(width, height);
+    if (!g_videoRecorder.start_recording(filename, width, height, (int)rate.num, (int)rate.den, format, recordAudio,
+                                         g_audioSystem.GetCurrentInputSampleRate(),
+                                         g_audioSystem.GetCurrentInputChannels(),
+                                         g_offlineRendering,
+                                         static_cast<VideoRecorder::VideoQuality>(g_videoQuality),
+                                         static_cast<VideoRecorder::AudioBitrate>(g_audioBitrate))) {
+        ShaderEffect::SetFramebufferFormat(GL_RGBA8);
+        ResizeSceneFramebuffers(windowWidth, windowHeight);
+        g_consoleLog += "\nCould not start recording to " + filename;
+        return false;
+    }
+    if (g_offlineRendering) {
+        BeginOfflineRender(); // Start from current timeline time
+    }
+    g_recordingStartTime = std::chrono::steady_clock::now();
+    g_recordingFilename = filename;
+    g_recordingIsCapture = g_videoQuality == (int)VideoRecorder::VideoQuality::Capture && !g_videoRecorder.is_image_sequence_active();
+    g_consoleLog += "\nRecording " + std::to_string(width) + "x" + std::to_string(height) + " at " + rate.label + " fps to " + filename;
+    StartExtraOutputs(filename, width, height, rate, recordAudio);
+    return true;
+}
+
+// An offline render from an audio file first waits for the file's analysis track, which
+// AudioSystem builds on a worker; StartPendingOfflineRender starts it once the track is ready.
+static bool UsesOfflineAudioAnalysis() {
+    return g_offlineRendering && g_audioSystem.GetCurrentAudioSource() == AudioSystem::AudioSource::AudioFile &&
+           g_audioSystem.IsAudioFileLoaded();
+}
+
+static bool StartRecording(const std::string& filename, const std::string& format, bool recordAudio) {
+    if (!UsesOfflineAudioAnalysis()) return StartRecordingNow(filename, format, recordAudio, g_recordFrameRateIndex);
+    const RecordingFrameRate& rate = g_recordFrameRates[g_recordFrameRateIndex];
+    g_audioSystem.PrepareOfflineAnalysis(rate.num, rate.den);
+    g_pendingOfflineRender = {filename, format, recordAudio, g_recordFrameRateIndex};
+    g_offlineRenderPending = true;
+    g_consoleLog += "\nAnalysing the audio file before rendering " + filename + "...";
+    return true;
+}
+
+static void CancelPendingOfflineRender() {
+    if (!g_offlineRenderPending) return;
+    g_audioSystem.CancelOfflineAnalysis();
+    g_offlineRenderPending = false;
+    g_consoleLog += "\nOffline render cancelled.";
+}
+
+// Every frame.
+static void StartPendingOfflineRender() {
+    if (!g_offlineRenderPending || g_audioSystem.IsOfflineAnalysisPending()) return;
+    g_offlineRenderPending = false;
+    if (!g_audioSystem.FinishOfflineAnalysis()) {
+        g_consoleLog += "\nOffline audio pre-analysis unavailable, analysing live instead.\n" + g_audioSystem.GetLastError();
+    }
+    const PendingOfflineRender& pending = g_pendingOfflineRender;
+    StartRecordingNow(pending.filename, pending.format, pending.recordAudio, pending.frameRateIndex);
+}
+
+static bool IsRecordingFinalizing() {
+    if (g_videoRecorder.is_finalizing()) return true;
+    for (const VideoRecorder& recorder : g_extraRecorders) {
+        if (recorder.is_finalizing()) return true;
+    }
+    return false;
+}
+
+// Returns once the readbacks are copied out; the recorders finish their files in the background
+// and FinishStoppedRecording reports them.
+static void StopRecording() {
+    g_finishingSummaryPaths.clear();
+    if (g_videoRecorder.is_recording()) {
+        g_videoRecorder.stop_recording();
+        g_finishingSummaryPaths.push_back(g_videoRecorder.get_summary_path());
+    }
+    for (VideoRecorder& recorder : g_extraRecorders) {
+        if (!recorder.is_recording()) continue;
+        recorder.stop_recording();
+        g_finishingSummaryPaths.push_back(recorder.get_summary_path());
+    }
+    g_recordingFinishing = true;
+    g_consoleLog += "\nRecording stopped; finishing " + g_recordingFilename + " in the background.";
+    int windowWidth, windowHeight;
+    glfwGetFramebufferSize(glfwGetCurrentContext(), &windowWidth, &windowHeight);
+    ShaderEffect::SetFramebufferFormat(GL_RGBA8);
+    ResizeSceneFramebuffers(windowWidth, windowHeight);
+}
+
+// Every frame. Once the stopped recorders have written their files, reports the summaries and
+// queues the delivery transcode, which must not read the capture before its trailer is written.
+static void FinishStoppedRecording() {
+    if (!g_recordingFinishing || IsRecordingFinalizing()) return;
+    g_recordingFinishing = false;
+    for (const std::string& path : g_finishingSummaryPaths) {
+        g_consoleLog += "\nRecording finished; summary written to " + path;
+    }
+    g_finishingSummaryPaths.clear();
+
+    if (g_recordingIsCapture && g_transcodeAfterCapture) {
+        const std::string deliveryPath = (std::filesystem::path(g_recordingFilename).parent_path() /
+            (std::filesystem::path(g_recordingFilename).stem().string() + "_delivery.mp4")).string();
+        const char* preset;
+        const char* crf;
+        VideoRecorder::get_x264_settings(static_cast<VideoRecorder::VideoQuality>(g_deliveryQuality), preset, crf);
+        if (g_transcoder.Start(g_recordingFilename, deliveryPath, preset, crf)) {
+            g_consoleLog += "\nTranscoding " + g_recordingFilename + " to " + deliveryPath + " in the background.";
+        } else {
+            g_consoleLog += "\nA transcode is still running; " + g_recordingFilename + " was not queued.";
+        }
+    }
+}
+
 void RenderMenuBar() {
     if (ImGui::BeginMainMenuBar()) {
         if (ImGui::BeginMenu("File")) {
@@ -483,6 +798,9 @@ void RenderMenuBar() {
                 // Args: key, title, filters, path, fileName, count, flags, userDatas
                 ImGuiFileDialog::Instance()->OpenDialog("LoadShaderDlgKey", "Choose Shader File", ".frag,.fs,.glsl,.*", IGFD::FileDialogConfig{".", "", "", 1, nullptr, ImGuiFileDialogFlags_None, {}, 250.0f, {}});
             }
+            if (ImGui::MenuItem("Load Milkdrop Preset...")) {
+                ImGuiFileDialog::Instance()->OpenDialog("LoadMilkdropPresetDlgKey", "Choose Milkdrop Preset", ".milk", IGFD::FileDialogConfig{"shaders/presets", "", "", 1, nullptr, ImGuiFileDialogFlags_None, {}, 250.0f, {}});
+            }
             bool canSave = (g_selectedEffect && dynamic_cast<ShaderEffect*>(g_selectedEffect));
             if (ImGui::MenuItem("Save Shader", nullptr, false, canSave)) {
                 if (auto* se = dynamic_cast<ShaderEffect*>(g_selectedEffect)) {
@@ -565,7 +883,7 @@ void RenderMenuBar() {
             if (ImGui::Button("Browse")) {
                 IGFD::FileDialogConfig config;
                 config.path = ".";
-                ImGuiFileDialog::Instance()->OpenDialog("SaveRecordingDlgKey", "Choose Output File", ".mp4,.mov,.mpg", config);
+                ImGuiFileDialog::Instance()->OpenDialog("SaveRecordingDlgKey", "Choose Output File", ".mp4,.mov,.mpg,.mkv", config);
             }
 
             ImGui::SetNextWindowSize(ImVec2(600, 400), ImGuiCond_FirstUseEver);
@@ -578,35 +896,162 @@ void RenderMenuBar() {
             }
 
             static int format_idx = 0;
-            const char* formats[] = { "mp4", "mov", "mpg" };
-            if (ImGui::BeginCombo("Format", formats[format_idx])) {
-                for (int i = 0; i < IM_ARRAYSIZE(formats); i++) {
+            if (ImGui::BeginCombo("Format", g_recordFormatLabels[format_idx])) {
+                for (int i = 0; i < IM_ARRAYSIZE(g_recordFormats); i++) {
                     const bool is_selected = (format_idx == i);
-                    if (ImGui::Selectable(formats[i], is_selected))
+                    if (ImGui::Selectable(g_recordFormatLabels[i], is_selected))
                         format_idx = i;
                     if (is_selected) ImGui::SetItemDefaultFocus();
                 }
                 ImGui::EndCombo();
             }
+            ImGui::SameLine(); HelpMarker("Image sequences are written as <filename>_000000.png and so on, next to the chosen file name, by a pool of compression threads. They have no audio.");
+            ImageSequenceWriter::Format sequenceFormat;
+            if (ImageSequenceWriter::ParseFormat(g_recordFormats[format_idx], sequenceFormat)) {
+                ImGui::BeginDisabled(g_videoRecorder.is_recording());
+                if (ImGui::SliderInt("Compression Threads", &g_recordSequenceWorkers, 0, 32, g_recordSequenceWorkers == 0 ? "Auto" : "%d")) {
+                    g_videoRecorder.set_image_sequence_workers(g_recordSequenceWorkers);
+                }
+                if (ImageSequenceWriter::IsHighPrecision(sequenceFormat)) {
+                    ImGui::Checkbox("Float Render Chain", &g_recordFloatChain);
+                    ImGui::SameLine(); HelpMarker("Renders every effect into RGBA16F framebuffers while recording, so the sequence keeps more than 8 bits per channel and values above 1.0 for grading. Without it the 16-bit files hold 8-bit data.");
+                }
+                ImGui::EndDisabled();
+            }
+            if (VideoRecorder::supports_fragmented_output(g_recordFormats[format_idx])) {
+                ImGui::BeginDisabled(g_videoRecorder.is_recording());
+                bool fragmentChanged = ImGui::Checkbox("Fragmented Output", &g_recordFragmented);
+                ImGui::SameLine(); HelpMarker("For long recordings. Writes the file as a series of short self-contained fragments instead of one index at the end: memory stays flat, stopping writes no index, and a crash only loses the last fragment. Some older players and editors cannot seek in fragmented files.");
+                if (g_recordFragmented) {
+                    fragmentChanged |= ImGui::SliderInt("Fragment Length (ms)", &g_recordFragmentMs, VideoRecorder::MIN_FRAGMENT_MS, VideoRecorder::MAX_FRAGMENT_MS);
+                }
+                if (fragmentChanged) {
+                    g_videoRecorder.set_fragmented_output(g_recordFragmented, g_recordFragmentMs);
+                }
+                ImGui::EndDisabled();
+            }
 
             static bool g_recordAudio = true;
             ImGui::Checkbox("Record Audio", &g_recordAudio);
             ImGui::Checkbox("Offline Rendering (Smooth Video)", &g_offlineRendering);
-            ImGui::SameLine(); HelpMarker("Decouples rendering from real-time. Ensures smooth 60 FPS video even if the app runs slowly. Audio sync only works with Audio File source.");
+            ImGui::SameLine(); HelpMarker("Decouples rendering from real-time. Every frame advances time by exactly one frame at the chosen frame rate, so video is smooth even if the app runs slowly. Audio sync only works with Audio File source.");
 
-            const char* quality_items[] = { "Low", "Medium", "High", "Ultra" };
+            const char* quality_items[] = { "Low", "Medium", "High", "Ultra", "Capture (fast intra)" };
+            ImGui::BeginDisabled(g_videoRecorder.is_recording());
             ImGui::Combo("Video Quality", &g_videoQuality, quality_items, IM_ARRAYSIZE(quality_items));
+            ImGui::EndDisabled();
+            if (g_videoQuality == (int)VideoRecorder::VideoQuality::Capture) {
+                ImGui::SameLine(); HelpMarker("For live shows. A cheap codec that leaves the CPU to rendering, at the cost of much larger files. Transcode to a delivery quality afterwards.");
+                const char* capture_codec_items[] = { "x264 ultrafast (intra refresh)", "MJPEG", "FFV1 (lossless)" };
+                ImGui::BeginDisabled(g_videoRecorder.is_recording());
+                if (ImGui::Combo("Capture Codec", &g_recordCaptureCodec, capture_codec_items, IM_ARRAYSIZE(capture_codec_items))) {
+                    g_videoRecorder.set_capture_codec(static_cast<VideoRecorder::CaptureCodec>(g_recordCaptureCodec));
+                }
+                ImGui::EndDisabled();
+                if (!VideoRecorder::capture_codec_fits_format(static_cast<VideoRecorder::CaptureCodec>(g_recordCaptureCodec), g_recordFormats[format_idx])) {
+                    ImGui::TextColored(ImVec4(1.0f, 0.6f, 0.2f, 1.0f), "This codec needs a different format (FFV1: mov or mkv; MJPEG: not mpg).");
+                }
+                ImGui::Checkbox("Transcode After Stop", &g_transcodeAfterCapture);
+                ImGui::SameLine(); HelpMarker("When the recording stops, re-encode it in the background to H.264 at the delivery quality, as <name>_delivery.mp4. Audio is copied.");
+                if (g_transcodeAfterCapture) {
+                    ImGui::Combo("Delivery Quality", &g_deliveryQuality, quality_items, 4);
+                }
+            }
+            if (g_transcoder.IsRunning()) {
+                ImGui::ProgressBar(g_transcoder.GetProgress(), ImVec2(-80.0f, 0.0f), "Transcoding");
+                ImGui::SameLine();
+                if (ImGui::Button("Cancel")) g_transcoder.Cancel();
+            } else if (!g_transcoder.GetStatus().empty()) {
+                ImGui::TextWrapped("%s", g_transcoder.GetStatus().c_str());
+            }
 
             const char* bitrate_items[] = { "128 kbps", "192 kbps", "320 kbps", "Lossless (ALAC)" };
             ImGui::Combo("Audio Bitrate", &g_audioBitrate, bitrate_items, IM_ARRAYSIZE(bitrate_items));
 
+            ImGui::BeginDisabled(g_videoRecorder.is_recording());
+            if (ImGui::BeginCombo("Resolution", g_recordResolutions[g_recordResolutionIndex].label)) {
+                for (int i = 0; i < IM_ARRAYSIZE(g_recordResolutions); i++) {
+                    if (ImGui::Selectable(g_recordResolutions[i].label, g_recordResolutionIndex == i)) g_recordResolutionIndex = i;
+                }
+                ImGui::EndCombo();
+            }
+            if (g_recordResolutions[g_recordResolutionIndex].width < 0) {
+                if (ImGui::InputInt2("Size", g_recordCustomSize)) {
+                    g_recordCustomSize[0] = std::clamp(g_recordCustomSize[0], 16, g_maxRecordWidth);
+                    g_recordCustomSize[1] = std::clamp(g_recordCustomSize[1], 16, g_maxRecordHeight);
+                }
+            }
+            ImGui::SameLine(); HelpMarker("Output size of the video. The scene is rendered at this size while recording, independent of the window, and the window shows it scaled.");
+            if (ImGui::BeginCombo("Frame Rate", g_recordFrameRates[g_recordFrameRateIndex].label)) {
+                for (int i = 0; i < IM_ARRAYSIZE(g_recordFrameRates); i++) {
+                    if (ImGui::Selectable(g_recordFrameRates[i].label, g_recordFrameRateIndex == i)) g_recordFrameRateIndex = i;
+                }
+                ImGui::EndCombo();
+            }
+            if (ImGui::SliderInt("Readback Depth", &g_recordPboCount, VideoRecorder::MIN_PBO_COUNT, VideoRecorder::MAX_PBO_COUNT)) {
+                g_videoRecorder.set_pbo_count(g_recordPboCount);
+            }
+            ImGui::SameLine(); HelpMarker("Number of frames the GPU may still be copying back before the recorder waits for it. Raise it if the stall count keeps growing.");
+            if (ImGui::SliderInt("Frame Buffers", &g_recordFramePoolSize, 2, 32)) {
+                g_videoRecorder.set_frame_pool_size(g_recordFramePoolSize);
+            }
+            ImGui::SameLine(); HelpMarker("Frames that can wait for the encoder. Each holds one full frame, allocated when recording starts.");
+            if (ImGui::Checkbox("GPU Color Conversion", &g_recordGpuColorConversion)) {
+                g_videoRecorder.set_gpu_color_conversion(g_recordGpuColorConversion);
+            }
+            ImGui::SameLine(); HelpMarker("Converts frames to YUV 4:2:0 (BT.709) on the GPU before reading them back. Reads back 62% less data and takes the color conversion off the encoder thread.");
+            ImGui::BeginDisabled(!g_offlineRendering);
+            bool parallelChanged = ImGui::Checkbox("Parallel Export", &g_recordParallelExport);
+            ImGui::SameLine(); HelpMarker("Offline only. Encodes the video as keyframe-aligned segments on several encoders at once and joins them losslessly when the export ends, which stops at the end of the timeline. Uses more memory for queued frames.");
+            if (g_recordParallelExport) {
+                parallelChanged |= ImGui::SliderInt("Workers", &g_recordExportWorkers, 2, 16);
+                if (ImGui::InputInt("Segment Frames", &g_recordSegmentFrames, 30, 120)) {
+                    g_recordSegmentFrames = std::clamp(g_recordSegmentFrames, 30, 3600);
+                    parallelChanged = true;
+                }
+            }
+            if (parallelChanged) {
+                g_videoRecorder.set_parallel_export(g_recordParallelExport ? g_recordExportWorkers : 0, g_recordSegmentFrames);
+            }
+            ImGui::EndDisabled();
+
+            if (ImGui::TreeNode("Additional Outputs")) {
+                ImGui::SameLine(); HelpMarker("Encode the same render to more files at once, e.g. a 1080p social cut next to a 4K master. Each is scaled from the main output on the GPU and has its own readback and encoder, so one falling behind drops only its own frames. Frame rate, audio and the settings above are shared. Files are named <name>_out2_<size> and so on.");
+                for (int i = 0; i < g_maxExtraOutputs; ++i) {
+                    RecordingOutputProfile& profile = g_extraOutputProfiles[i];
+                    ImGui::PushID(i);
+                    ImGui::Checkbox(("Output " + std::to_string(i + 2)).c_str(), &profile.enabled);
+                    if (profile.enabled) {
+                        ImGui::Indent();
+                        if (ImGui::BeginCombo("Resolution", g_recordResolutions[profile.resolutionIndex].label)) {
+                            for (int r = 0; r < IM_ARRAYSIZE(g_recordResolutions); r++) {
+                                if (ImGui::Selectable(g_recordResolutions[r].label, profile.resolutionIndex == r)) profile.resolutionIndex = r;
+                            }
+                            ImGui::EndCombo();
+                        }
+                        if (g_recordResolutions[profile.resolutionIndex].width < 0) {
+                            if (ImGui::InputInt2("Size", profile.customSize)) {
+                                profile.customSize[0] = std::clamp(profile.customSize[0], 16, g_maxRecordWidth);
+                                profile.customSize[1] = std::clamp(profile.customSize[1], 16, g_maxRecordHeight);
+                            }
+                        }
+                        ImGui::Combo("Format", &profile.formatIndex, g_recordFormatLabels, IM_ARRAYSIZE(g_recordFormatLabels));
+                        ImGui::Combo("Video Quality", &profile.quality, quality_items, IM_ARRAYSIZE(quality_items));
+                        ImGui::Unindent();
+                    }
+                    ImGui::PopID();
+                }
+                ImGui::TreePop();
+            }
+            ImGui::EndDisabled();
+
             if (g_videoRecorder.is_recording()) {
                 ImGui::PushStyleColor(ImGuiCol_Button, ImVec4(0.8f, 0.2f, 0.2f, 1.0f));
                 ImGui::PushStyleColor(ImGuiCol_ButtonHovered, ImVec4(0.9f, 0.3f, 0.3f, 1.0f));
                 ImGui::PushStyleColor(ImGuiCol_ButtonActive, ImVec4(0.7f, 0.2f, 0.2f, 1.0f));
                 ImGui::PushStyleColor(ImGuiCol_Text, ImVec4(1.0f, 1.0f, 1.0f, 1.0f));
                 if (ImGui::Button("Stop Recording")) {
-                    g_videoRecorder.stop_recording();
+                    StopRecording();
                 }
                 ImGui::PopStyleColor(4);
                 ImGui::SameLine();
@@ -618,43 +1063,87 @@ void RenderMenuBar() {
                 duration -= minutes;
                 auto seconds = std::chrono::duration_cast<std::chrono::seconds>(duration);
                 ImGui::Text("Status: Recording... %02d:%02d:%02d", (int)hours.count(), (int)minutes.count(), (int)seconds.count());
+                VideoRecorder::CaptureStats captureStats = g_videoRecorder.get_capture_stats();
+                ImGui::Text("Frames: %llu captured, %llu encoded, %llu dropped", (unsigned long long)captureStats.frames_captured,
+                            (unsigned long long)captureStats.frames_encoded, (unsigned long long)captureStats.dropped_frames);
+                ImGui::Text("Readbacks in flight: %d/%d, GPU stalls: %llu (%.1f ms)", captureStats.pbos_in_flight, captureStats.pbo_count,
+                            (unsigned long long)captureStats.fence_stalls, captureStats.fence_stall_ms);
+                ImGui::Text("Frame buffers in use: %d/%d", captureStats.frame_pool_in_use, captureStats.frame_pool_size);
+                if (uint64_t droppedAudio = g_videoRecorder.get_audio_overflow_frames()) {
+                    ImGui::TextColored(ImVec4(1.0f, 0.4f, 0.4f, 1.0f), "Audio overflow: %llu frames replaced by silence", (unsigned long long)droppedAudio);
+                    ImGui::SameLine(); HelpMarker("The encoder fell behind the audio input. Try a lower video quality.");
+                }
+                for (int i = 0; i < g_maxExtraOutputs; ++i) {
+                    VideoRecorder& recorder = g_extraRecorders[i];
+                    if (!recorder.is_recording()) continue;
+                    if (recorder.has_encoder_failed()) {
+                        ImGui::TextColored(ImVec4(1.0f, 0.4f, 0.4f, 1.0f), "Output %d: encoder failed to start", i + 2);
+                        continue;
+                    }
+                    VideoRecorder::CaptureStats outputStats = recorder.get_capture_stats();
+                    ImGui::Text("Output %d: %llu encoded, %llu dropped", i + 2, (unsigned long long)outputStats.frames_encoded,
+                                (unsigned long long)outputStats.dropped_frames);
+                }
+                if (g_videoRecorder.is_parallel_export_active()) {
+                    // One cell per segment, filled as its worker encodes it.
+                    std::vector<VideoRecorder::SegmentProgress> segments = g_videoRecorder.get_segment_progress();
+                    int finishedSegments = 0;
+                    int failedSegments = 0;
+                    for (const auto& segment : segments) {
+                        finishedSegments += segment.finished && !segment.failed ? 1 : 0;
+                        failedSegments += segment.failed ? 1 : 0;
+                    }
+                    ImGui::Text("Segments: %d started, %d finished", (int)segments.size(), finishedSegments);
+                    if (failedSegments > 0) {
+                        ImGui::SameLine();
+                        ImGui::TextColored(ImVec4(1.0f, 0.3f, 0.3f, 1.0f), "%d failed", failedSegments);
+                    }
+                    const float cellWidth = 8.0f, cellHeight = 14.0f, spacing = 2.0f;
+                    const float availableWidth = std::max(ImGui::GetContentRegionAvail().x, cellWidth);
+                    const int perRow = std::max(1, (int)((availableWidth + spacing) / (cellWidth + spacing)));
+                    const int rows = ((int)segments.size() + perRow - 1) / perRow;
+                    ImVec2 origin = ImGui::GetCursorScreenPos();
+                    ImDrawList* drawList = ImGui::GetWindowDrawList();
+                    const float segmentFrames = (float)g_videoRecorder.get_export_segment_frames();
+                    for (int i = 0; i < (int)segments.size(); ++i) {
+                        ImVec2 cellMin(origin.x + (i % perRow) * (cellWidth + spacing), origin.y + (i / perRow) * (cellHeight + spacing));
+                        ImVec2 cellMax(cellMin.x + cellWidth, cellMin.y + cellHeight);
+                        float fill = segments[i].finished || segments[i].failed ? 1.0f : std::min(1.0f, segments[i].frames_encoded / segmentFrames);
+                        ImU32 color = segments[i].failed     ? IM_COL32(210, 60, 60, 255)
+                                      : segments[i].finished ? IM_COL32(80, 200, 80, 255)
+                                                             : IM_COL32(220, 170, 60, 255);
+                        drawList->AddRectFilled(cellMin, cellMax, IM_COL32(60, 60, 60, 255));
+                        drawList->AddRectFilled(ImVec2(cellMin.x, cellMax.y - cellHeight * fill), cellMax, color);
+                        if (ImGui::IsMouseHoveringRect(cellMin, cellMax)) {
+                            ImGui::SetTooltip("Segment %d: worker %d, %d frames%s", i, segments[i].worker, segments[i].frames_encoded,
+                                              segments[i].failed ? " (encoder failed to start)" : "");
+                        }
+                    }
+                    ImGui::Dummy(ImVec2(availableWidth, rows * (cellHeight + spacing)));
+                }
 
+            } else if (g_offlineRenderPending) {
+                ImGui::ProgressBar(g_audioSystem.GetOfflineAnalysisProgress(), ImVec2(-80.0f, 0.0f), "Analysing audio");
+                ImGui::SameLine();
+                if (ImGui::Button("Cancel")) CancelPendingOfflineRender();
+                ImGui::Text("Status: Preparing the offline render");
             } else {
                 ImGui::PushStyleColor(ImGuiCol_Button, ImVec4(0.2f, 0.7f, 0.2f, 1.0f));
                 ImGui::PushStyleColor(ImGuiCol_ButtonHovered, ImVec4(0.3f, 0.8f, 0.3f, 1.0f));
                 ImGui::PushStyleColor(ImGuiCol_ButtonActive, ImVec4(0.2f, 0.6f, 0.2f, 1.0f));
                 ImGui::PushStyleColor(ImGuiCol_Text, ImVec4(0.0f, 0.0f, 0.0f, 1.0f));
+                const bool finishing = IsRecordingFinalizing();
+                ImGui::BeginDisabled(finishing);
                 if (ImGui::Button("Start Recording")) {
-                    // Ensure the audio device is started if we are recording with mic input
-                    if (g_recordAudio && g_audioSystem.GetCurrentAudioSource() == AudioSystem::AudioSource::Microphone && !g_audioSystem.IsCaptureDeviceInitialized()) {
-                        g_audioSystem.InitializeAndStartSelectedCaptureDevice();
-                    }
-
                     if (std::filesystem::exists(filename)) {
                         ImGui::OpenPopup("Overwrite File?");
                     } else {
-                        int fb_width, fb_height;
-                        glfwGetFramebufferSize(glfwGetCurrentContext(), &fb_width, &fb_height);
-                        fb_width &= ~1;
-                        fb_height &= ~1;
-                        g_videoRecorder.start_recording(filename, fb_width, fb_height, 60, formats[format_idx], g_recordAudio,
-                                                    g_audioSystem.GetCurrentInputSampleRate(),
-                                                    g_audioSystem.GetCurrentInputChannels(),
-                                                    g_offlineRendering,
-                                                    static_cast<VideoRecorder::VideoQuality>(g_videoQuality),
-                                                    static_cast<VideoRecorder::AudioBitrate>(g_audioBitrate));
-                        if (g_offlineRendering) {
-                            g_offlineTime = g_timelineState.currentTime_seconds; // Start from current timeline time
-                            if (g_audioSystem.GetCurrentAudioSource() == AudioSystem::AudioSource::AudioFile) {
-                                g_audioSystem.Pause(); // Pause audio playback to manually step it
-                                g_audioSystem.SetPlaybackProgress(g_offlineTime / g_audioSystem.GetPlaybackDuration());
-                            }
-                        }
-                        g_recordingStartTime = std::chrono::steady_clock::now();
+                        StartRecording(filename, g_recordFormats[format_idx], g_recordAudio);
                     }
                 }
+                ImGui::EndDisabled();
                 ImGui::PopStyleColor(4);
-                ImGui::Text("Status: Idle");
+                ImGui::Text(finishing ? "Status: Finishing the last recording..." : "Status: Idle");
             }
 
             // Overwrite confirmation popup
@@ -662,28 +1151,7 @@ void RenderMenuBar() {
                 ImGui::Text("File '%s' already exists.\nDo you want to overwrite it?", filename);
                 ImGui::Separator();
                 if (ImGui::Button("Overwrite", ImVec2(120, 0))) {
-                    // Ensure the audio device is started if we are recording with mic input
-                    if (g_recordAudio && g_audioSystem.GetCurrentAudioSource() == AudioSystem::AudioSource::Microphone && !g_audioSystem.IsCaptureDeviceInitialized()) {
-                        g_audioSystem.InitializeAndStartSelectedCaptureDevice();
-                    }
-                    int fb_width, fb_height;
-                    glfwGetFramebufferSize(glfwGetCurrentContext(), &fb_width, &fb_height);
-                    fb_width &= ~1;
-                    fb_height &= ~1;
-                    g_videoRecorder.start_recording(filename, fb_width, fb_height, 60, formats[format_idx], g_recordAudio,
-                                                g_audioSystem.GetCurrentInputSampleRate(),
-                                                g_audioSystem.GetCurrentInputChannels(),
-                                                g_offlineRendering,
-                                                static_cast<VideoRecorder::VideoQuality>(g_videoQuality),
-                                                static_cast<VideoRecorder::AudioBitrate>(g_audioBitrate));
-                    if (g_offlineRendering) {
-                        g_offlineTime = g_timelineState.currentTime_seconds;
-                        if (g_audioSystem.GetCurrentAudioSource() == AudioSystem::AudioSource::AudioFile) {
-                            g_audioSystem.Pause();
-                            g_audioSystem.SetPlaybackProgress(g_offlineTime / g_audioSystem.GetPlaybackDuration());
-                        }
-                    }
-                    g_recordingStartTime = std::chrono::steady_clock::now();
+                    StartRecording(filename, g_recordFormats[format_idx], g_recordAudio);
                     ImGui::CloseCurrentPopup();
                 }
                 ImGui::SameLine();
@@ -698,6 +1166,8 @@ void RenderMenuBar() {
         ImGui::MenuItem("Node Editor (F2)", "F2", &g_showNodeEditorWindow);
         ImGui::MenuItem("Audio Reactivity (F3)", "F3", &g_showAudioWindow);
         ImGui::MenuItem("FPS Meter (F4)", "F4", &g_showFpsMeter);
+        ImGui::MenuItem("Recorder Telemetry", nullptr, &g_showRecorderTelemetry);
+        ImGui::MenuItem("Preset Library", nullptr, &g_showPresetLibrary);
 
         ImGui::EndMainMenuBar();
     }
@@ -725,6 +1195,14 @@ void RenderMenuBar() {
         ImGuiFileDialog::Instance()->Close();
     }
 
+    ImGui::SetNextWindowSize(ImVec2(600, 400), ImGuiCond_FirstUseEver);
+    if (ImGuiFileDialog::Instance()->Display("LoadMilkdropPresetDlgKey")) {
+        if (ImGuiFileDialog::Instance()->IsOk()) {
+            LoadMilkdropPreset(ImGuiFileDialog::Instance()->GetFilePathName());
+        }
+        ImGuiFileDialog::Instance()->Close();
+    }
+
     ImGui::SetNextWindowSize(ImVec2(600, 400), ImGuiCond_FirstUseEver);
     if (ImGuiFileDialog::Instance()->Display("SaveShaderAsDlgKey")) {
         if (ImGuiFileDialog::Instance()->IsOk()) {
@@ -952,6 +1430,18 @@ void RenderTimelineWindow() {
                                g_timelineState.zoomLevel                 // Pass zoom
                                );
 
+    // Waveform of the loaded audio file under the tracks, using the timeline's time mapping.
+    const DecodedAudioCache& pcmCache = g_audioSystem.GetDecodedAudioCache();
+    if (const WaveformPyramid* waveform = pcmCache.GetWaveform()) {
+        double viewStart = g_timelineState.horizontalScroll_seconds;
+        double viewEnd = viewStart + g_timelineState.totalDuration_seconds / std::max(0.01f, g_timelineState.zoomLevel);
+        float seekTo = 0.0f;
+        if (DrawWaveformStrip("##TimelineWaveform", *waveform, (float)pcmCache.GetSampleRate(), viewStart, viewEnd, 48.0f,
+                              g_timelineState.currentTime_seconds, &seekTo)) {
+            g_timelineState.currentTime_seconds = seekTo;
+        }
+    }
+
     if (timeline_event) {
         if (g_selectedTimelineItem >= 0 && static_cast<size_t>(g_selectedTimelineItem) < g_scene.size()) {
             if (g_scene[g_selectedTimelineItem]) {
@@ -1405,6 +1895,224 @@ void RenderFpsMeter() {
     ImGui::End();
 }
 
+void RenderRecorderTelemetryWindow() {
+    ImGui::SetNextWindowSize(ImVec2(420, 320), ImGuiCond_FirstUseEver);
+    if (!ImGui::Begin("Recorder Telemetry", &g_showRecorderTelemetry)) {
+        ImGui::End();
+        return;
+    }
+    static float fpsHistory[120] = {};
+    static int fpsHistoryOffset = 0;
+    static double lastSampleTime = 0.0;
+    if (!g_videoRecorder.is_recording()) {
+        ImGui::TextDisabled("Not recording.");
+        if (!g_videoRecorder.get_summary_path().empty()) {
+            ImGui::TextWrapped("Last summary: %s", g_videoRecorder.get_summary_path().c_str());
+        }
+        ImGui::End();
+        return;
+    }
+
+    VideoRecorder::CaptureStats stats = g_videoRecorder.get_capture_stats();
+    if (ImGui::GetTime() - lastSampleTime >= 0.5) {
+        lastSampleTime = ImGui::GetTime();
+        fpsHistory[fpsHistoryOffset] = (float)stats.encoder_fps;
+        fpsHistoryOffset = (fpsHistoryOffset + 1) % IM_ARRAYSIZE(fpsHistory);
+    }
+    const float targetFps = (float)g_recordingFpsNum / (float)g_recordingFpsDen;
+    const ImVec4 warning(1.0f, 0.4f, 0.4f, 1.0f);
+
+    ImGui::Text("Frames captured: %llu", (unsigned long long)stats.frames_captured);
+    ImGui::Text("Frames encoded:  %llu", (unsigned long long)stats.frames_encoded);
+    if (stats.dropped_frames > 0) {
+        ImGui::TextColored(warning, "Frames dropped:  %llu", (unsigned long long)stats.dropped_frames);
+    } else {
+        ImGui::Text("Frames dropped:  0");
+    }
+    ImGui::Separator();
+    ImGui::Text("Encoder: %.1f fps (target %.2f), %.2f ms/frame", stats.encoder_fps, targetFps, stats.avg_encode_ms);
+    char overlay[32];
+    snprintf(overlay, sizeof(overlay), "%.1f fps", stats.encoder_fps);
+    ImGui::PlotLines("##EncoderFps", fpsHistory, IM_ARRAYSIZE(fpsHistory), fpsHistoryOffset, overlay, 0.0f, targetFps * 1.5f, ImVec2(-1.0f, 60.0f));
+    ImGui::Text("Frame buffers: %d in use, high-water %d / %d", stats.frame_pool_in_use, stats.frame_pool_high_water, stats.frame_pool_size);
+    ImGui::Text("Readbacks in flight: %d/%d, GPU stalls: %llu (%.1f ms)", stats.pbos_in_flight, stats.pbo_count,
+                (unsigned long long)stats.fence_stalls, stats.fence_stall_ms);
+    ImGui::Separator();
+    ImGui::Text("A/V drift: %+.1f ms", stats.av_drift_ms);
+    ImGui::SameLine(); HelpMarker("Audio written minus video written. It grows in real-time mode when video frames are dropped.");
+    if (stats.audio_overflow_frames > 0) {
+        ImGui::TextColored(warning, "Audio overflow: %llu frames replaced by silence", (unsigned long long)stats.audio_overflow_frames);
+    }
+    for (int i = 0; i < g_maxExtraOutputs; ++i) {
+        VideoRecorder& recorder = g_extraRecorders[i];
+        if (!recorder.is_recording()) continue;
+        ImGui::Separator();
+        if (recorder.has_encoder_failed()) {
+            ImGui::TextColored(warning, "Output %d: encoder failed to start", i + 2);
+            continue;
+        }
+        VideoRecorder::CaptureStats outputStats = recorder.get_capture_stats();
+        ImGui::Text("Output %d: %llu encoded, %llu dropped, %.1f fps, %.2f ms/frame, buffers %d/%d", i + 2,
+                    (unsigned long long)outputStats.frames_encoded, (unsigned long long)outputStats.dropped_frames,
+                    outputStats.encoder_fps, outputStats.avg_encode_ms, outputStats.frame_pool_high_water, outputStats.frame_pool_size);
+    }
+    ImGui::End();
+}
+
+// Reports new drops to the console while recording, at most once per interval, so falling behind
+// is visible without opening the telemetry window.
+static void LogRecorderTelemetry() {
+    static uint64_t loggedDropped = 0, loggedOverflow = 0;
+    static auto lastLog = std::chrono::steady_clock::now();
+    if (!g_videoRecorder.is_recording()) {
+        loggedDropped = 0;
+        loggedOverflow = 0;
+        return;
+    }
+    const auto now = std::chrono::steady_clock::now();
+    if (now - lastLog < std::chrono::seconds(5)) return;
+    lastLog = now;
+
+    VideoRecorder::CaptureStats stats = g_videoRecorder.get_capture_stats();
+    if (stats.dropped_frames == loggedDropped && stats.audio_overflow_frames == loggedOverflow) return;
+    char line[256];
+    snprintf(line, sizeof(line), "Recorder falling behind: %llu frames dropped, %llu audio frames lost, encoder %.1f fps, buffers high-water %d/%d",
+             (unsigned long long)stats.dropped_frames, (unsigned long long)stats.audio_overflow_frames, stats.encoder_fps,
+             stats.frame_pool_high_water, stats.frame_pool_size);
+    g_consoleLog += std::string("\n") + line;
+    std::cout << line << std::endl;
+    loggedDropped = stats.dropped_frames;
+    loggedOverflow = stats.audio_overflow_frames;
+}
+
+void LoadMilkdropPreset(const std::string& filePathName) {
+    std::string justFileName = std::filesystem::path(filePathName).stem().string();
+
+    auto newEffect = std::make_unique<MilkdropPresetEffect>(filePathName, SCR_WIDTH, SCR_HEIGHT);
+    newEffect->name = justFileName.empty() ? "Milkdrop Preset" : justFileName;
+    newEffect->Load();
+    if (newEffect->GetCompileErrorLog().find("applied successfully") == std::string::npos) {
+        g_consoleLog = "Error loading preset " + justFileName + ". Log: " + newEffect->GetCompileErrorLog();
+    } else {
+        g_editor.SetText(newEffect->GetShaderSource());
+        ClearErrorMarkers();
+        g_scene.push_back(std::move(newEffect));
+        g_selectedEffect = g_scene.back().get();
+        g_consoleLog = "Loaded Milkdrop preset '" + justFileName + "' into a new effect.";
+    }
+}
+
+void RenderPresetLibraryWindow() {
+    ImGui::SetNextWindowSize(ImVec2(640, 480), ImGuiCond_FirstUseEver);
+    if (!ImGui::Begin("Preset Library", &g_showPresetLibrary)) {
+        ImGui::End();
+        return;
+    }
+    static char query[128] = "";
+    static bool hideFailed = true;
+    static bool hideMegabuf = false;
+    static bool hideShaders = false;
+    static bool onlyCustom = false;
+    static std::vector<PresetLibrary::Entry> results;
+    static std::string lastQuery;
+    static uint32_t lastRequired = 0, lastExcluded = 0;
+    static size_t lastCount = (size_t)-1;
+    static int selected = -1;
+
+    if (g_presetLibrary.IsScanning()) {
+        ImGui::ProgressBar(g_presetLibrary.GetProgress(), ImVec2(-80.0f, 0.0f), "Indexing");
+        ImGui::SameLine();
+        if (ImGui::Button("Cancel")) g_presetLibrary.Cancel();
+    } else {
+        if (ImGui::Button("Rescan")) g_presetLibrary.Scan("shaders/presets");
+        ImGui::SameLine();
+        ImGui::TextWrapped("%s", g_presetLibrary.GetStatus().c_str());
+    }
+
+    ImGui::SetNextItemWidth(-1.0f);
+    ImGui::InputTextWithHint("##PresetSearch", "Search by name or author", query, sizeof(query));
+    ImGui::Checkbox("Hide failing", &hideFailed);
+    ImGui::SameLine();
+    ImGui::Checkbox("Hide megabuf", &hideMegabuf);
+    ImGui::SameLine();
+    ImGui::Checkbox("Hide HLSL shaders", &hideShaders);
+    ImGui::SameLine();
+    ImGui::Checkbox("Custom waves only", &onlyCustom);
+
+    uint32_t required = onlyCustom ? PresetLibrary::CustomWaves : 0;
+    uint32_t excluded = 0;
+    if (hideFailed) excluded |= PresetLibrary::CompileFailed;
+    if (hideMegabuf) excluded |= PresetLibrary::UsesMegabuf;
+    if (hideShaders) excluded |= PresetLibrary::WarpShader | PresetLibrary::CompShader;
+
+    // Only search again when the filters or the index change.
+    const size_t count = g_presetLibrary.GetCount();
+    if (lastQuery != query || required != lastRequired || excluded != lastExcluded || count != lastCount || g_presetLibrary.IsScanning()) {
+        results = g_presetLibrary.Search(query, required, excluded);
+        lastQuery = query;
+        lastRequired = required;
+        lastExcluded = excluded;
+        lastCount = count;
+        selected = -1;
+    }
+    ImGui::Text("%zu of %zu presets", results.size(), count);
+
+    // The selected preset loads in the background and the Milkdrop effect blends into it on Switch.
+    auto* milkdrop = dynamic_cast<MilkdropPresetEffect*>(g_selectedEffect);
+    ImGui::SameLine();
+    ImGui::BeginDisabled(!milkdrop || selected < 0 || selected >= (int)results.size());
+    if (ImGui::Button("Queue Next") && milkdrop->PreloadNext(results[selected].path)) {
+        g_consoleLog += "Preloading " + results[selected].path + "\n";
+    }
+    ImGui::EndDisabled();
+    ImGui::SameLine();
+    ImGui::BeginDisabled(!milkdrop || milkdrop->GetNextState() != MilkdropPresetEffect::NextState::Ready);
+    if (ImGui::Button("Switch")) milkdrop->SwitchToNext();
+    ImGui::EndDisabled();
+
+    const ImGuiTableFlags tableFlags = ImGuiTableFlags_RowBg | ImGuiTableFlags_BordersInnerV | ImGuiTableFlags_ScrollY | ImGuiTableFlags_Resizable;
+    if (ImGui::BeginTable("##PresetTable", 4, tableFlags, ImVec2(0.0f, 0.0f))) {
+        ImGui::TableSetupScrollFreeze(0, 1);
+        ImGui::TableSetupColumn("Name", ImGuiTableColumnFlags_WidthStretch);
+        ImGui::TableSetupColumn("Author", ImGuiTableColumnFlags_WidthFixed, 140.0f);
+        ImGui::TableSetupColumn("Equations", ImGuiTableColumnFlags_WidthFixed, 70.0f);
+        ImGui::TableSetupColumn("Features", ImGuiTableColumnFlags_WidthFixed, 110.0f);
+        ImGui::TableHeadersRow();
+
+        ImGuiListClipper clipper;
+        clipper.Begin((int)results.size());
+        while (clipper.Step()) {
+            for (int i = clipper.DisplayStart; i < clipper.DisplayEnd; ++i) {
+                const PresetLibrary::Entry& entry = results[i];
+                const PresetLibrary::Info& info = entry.info;
+                ImGui::TableNextRow();
+                ImGui::TableNextColumn();
+                ImGui::PushID(i);
+                if (ImGui::Selectable(entry.name.c_str(), selected == i, ImGuiSelectableFlags_SpanAllColumns | ImGuiSelectableFlags_AllowDoubleClick)) {
+                    selected = i;
+                    if (ImGui::IsMouseDoubleClicked(ImGuiMouseButton_Left)) LoadMilkdropPreset(entry.path);
+                }
+                if (!entry.compileError.empty()) ImGui::SetItemTooltip("%s", entry.compileError.c_str());
+                ImGui::PopID();
+                ImGui::TableNextColumn();
+                ImGui::TextUnformatted(entry.author.c_str());
+                ImGui::TableNextColumn();
+                ImGui::Text("%.1f KB", (info.perFrameInitBytes + info.perFrameBytes + info.perPixelBytes + info.customCodeBytes) / 1024.0f);
+                ImGui::TableNextColumn();
+                if (info.features & PresetLibrary::CompileFailed) {
+                    ImGui::TextColored(ImVec4(1.0f, 0.4f, 0.4f, 1.0f), "fails");
+                } else {
+                    ImGui::Text("%s%s%s%s", info.waveCount ? "W" : "", info.shapeCount ? "S" : "",
+                                (info.features & (PresetLibrary::WarpShader | PresetLibrary::CompShader)) ? " HLSL" : "",
+                                (info.features & PresetLibrary::UsesMegabuf) ? " mem" : "");
+                }
+            }
+        }
+        ImGui::EndTable();
+    }
+    ImGui::End();
+}
+
 void RenderCameraHelpText() {
     if (!g_cameraControlsEnabled) return;
 
@@ -1530,7 +2238,40 @@ void RenderAudioReactivityWindow() {
                 }
                 ImGui::SameLine();
                 ImGui::Text("%s", timer.getFormattedTime(timer.duration).c_str());
+
+                AudioFileStreamer::Stats streamStats = g_audioSystem.GetFileStreamStats();
+                const DecodedAudioCache& pcmCache = g_audioSystem.GetDecodedAudioCache();
+                if (const WaveformPyramid* waveform = pcmCache.GetWaveform()) {
+                    float duration = g_audioSystem.GetPlaybackDuration();
+                    float seekTo = 0.0f;
+                    if (DrawWaveformStrip("##AudioFileWaveform", *waveform, (float)pcmCache.GetSampleRate(), 0.0, duration, 64.0f,
+                                          timer.progress * duration, &seekTo) && duration > 0.0f) {
+                        g_audioSystem.SetPlaybackProgress(seekTo / duration);
+                    }
+                }
+                if (streamStats.decodedFramesAttached) {
+                    ImGui::TextColored(ImVec4(0.4f, 0.9f, 0.4f, 1.0f), "Playing from decoded cache (instant seeking)");
+                } else {
+                    if (pcmCache.IsBuilding()) {
+                        char progressText[64];
+                        snprintf(progressText, sizeof(progressText), "Decoding to cache... %.0f%%", 100.0f * pcmCache.GetProgress());
+                        ImGui::ProgressBar(pcmCache.GetProgress(), ImVec2(-1.0f, 0.0f), progressText);
+                    }
+                    float sampleRate = (float)g_audioSystem.GetCurrentInputSampleRate();
+                    float fill = streamStats.capacityFrames > 0 ? (float)streamStats.bufferedFrames / (float)streamStats.capacityFrames : 0.0f;
+                    char fillText[64];
+                    snprintf(fillText, sizeof(fillText), "%.0f / %.0f ms", 1000.0f * streamStats.bufferedFrames / sampleRate, 1000.0f * streamStats.capacityFrames / sampleRate);
+                    ImGui::ProgressBar(fill, ImVec2(-1.0f, 0.0f), fillText);
+                }
+                ImGui::Text("Decode buffer underruns: %llu, seeks: %llu", (unsigned long long)streamStats.underruns, (unsigned long long)streamStats.seeks);
+                ImGui::SameLine(); HelpMarker("The file is decoded ahead of playback on a background thread. Underruns mean the decoder fell behind and the playback device had to insert silence.");
+            }
+
+            bool useDecodedCache = g_audioSystem.IsDecodedAudioCacheEnabled();
+            if (ImGui::Checkbox("Decode to cache for instant seeking", &useDecodedCache)) {
+                g_audioSystem.SetDecodedAudioCacheEnabled(useDecodedCache);
             }
+            ImGui::SameLine(); HelpMarker("Decodes the whole file once in the background to cache/audio and memory-maps it, so seeking and scrubbing are instant. Cached files are reused across sessions. Takes effect on the next load.");
         }
     }
 
@@ -1550,6 +2291,30 @@ void RenderAudioReactivityWindow() {
     if (!fftData.empty()) {
         ImGui::PlotLines("##FFT", fftData.data(), fftData.size(), 0, NULL, 0.0f, 1.0f, ImVec2(0, 80));
     }
+
+    if (ImGui::CollapsingHeader("Beat Tracking (iBeat, iBeatPhase, iBPM)", ImGuiTreeNodeFlags_DefaultOpen)) {
+        float beatImpulse = g_audioSystem.GetBeatImpulse();
+        ImGui::PushStyleColor(ImGuiCol_PlotHistogram, ImVec4(0.9f, 0.4f, 0.2f, 1.0f));
+        ImGui::ProgressBar(beatImpulse, ImVec2(60.0f, 0.0f), "Beat");
+        ImGui::PopStyleColor();
+        ImGui::SameLine();
+        ImGui::ProgressBar(g_audioSystem.GetBeatPhase(), ImVec2(-1.0f, 0.0f), "Phase");
+        ImGui::Text("Tempo: %.1f BPM %s", g_audioSystem.GetBPM(), g_audioSystem.IsTempoLocked() ? "(locked)" : "(searching)");
+
+        float sensitivity = g_audioSystem.GetBeatSensitivity();
+        if (ImGui::SliderFloat("Onset Threshold", &sensitivity, 0.5f, 4.0f, "%.2f")) {
+            g_audioSystem.SetBeatSensitivity(sensitivity);
+        }
+        ImGui::SameLine(); HelpMarker("How far the spectral flux must rise above its recent average to count as an onset. Lower values detect more onsets.");
+
+        const auto& latency = g_audioSystem.GetOnsetLatencyStats();
+        if (latency.onsetCount > 0) {
+            ImGui::Text("Detection latency: avg %.1f ms, max %.1f ms (%.1f ms hops, %u onsets)",
+                        latency.averageMs, latency.maxMs, latency.hopMs, latency.onsetCount);
+        } else {
+            ImGui::TextDisabled("Detection latency: no onsets yet");
+        }
+    }
     ImGui::End();
 }
 
@@ -1620,6 +2385,7 @@ int main(int argc, char** argv) {
     g_editor.SetLanguageDefinition(TextEditor::LanguageDefinition::GLSL());
     g_audioSystem.Initialize();
     g_audioSystem.RegisterListener(&g_videoRecorder); // Connect audio system to video recorder
+    for (VideoRecorder& recorder : g_extraRecorders) g_audioSystem.RegisterListener(&recorder);
 
     // Load initial shader (default or CLI-provided)
     auto defaultEffect = std::make_unique<ShaderEffect>(g_initialShaderPath, SCR_WIDTH, SCR_HEIGHT);
@@ -1655,6 +2421,9 @@ int main(int argc, char** argv) {
         }
     }
 
+    // Index the bundled presets in the background; unchanged files come from the cached index.
+    g_presetLibrary.Scan("shaders/presets");
+
     // No auto-linking needed for a single node setup
 
     float deltaTime = 0.0f, lastFrameTime = 0.0f;
@@ -1673,7 +2442,12 @@ int main(int argc, char** argv) {
 
         for (const auto& file_info : files_to_process) {
             g_consoleLog += "Dropped shader file: " + file_info.path + "\n";
-            auto newEffect = std::make_unique<ShaderEffect>(file_info.path, SCR_WIDTH, SCR_HEIGHT);
+            std::unique_ptr<ShaderEffect> newEffect;
+            if (std::filesystem::path(file_info.path).extension() == ".milk") {
+                newEffect = std::make_unique<MilkdropPresetEffect>(file_info.path, SCR_WIDTH, SCR_HEIGHT);
+            } else {
+                newEffect = std::make_unique<ShaderEffect>(file_info.path, SCR_WIDTH, SCR_HEIGHT);
+            }
             newEffect->name = std::filesystem::path(file_info.path).filename().string();
             
             // CreateAndPlaceNode will load the shader and set g_selectedEffect to it
@@ -1745,33 +2519,30 @@ int main(int argc, char** argv) {
         lastFrameTime = currentFrameTime;
 
         // --- Offline Rendering Logic ---
+        // A parallel export renders the timeline once, so it ends at the end instead of looping.
+        if (g_videoRecorder.is_recording() && g_offlineRendering && g_videoRecorder.is_parallel_export_active() &&
+            (double)g_offlineFrameIndex * g_recordingFpsDen / g_recordingFpsNum >= g_timelineState.totalDuration_seconds) {
+            StopRecording();
+            g_consoleLog += "\nParallel export finished at the end of the timeline.";
+        }
         if (g_videoRecorder.is_recording() && g_offlineRendering) {
-            deltaTime = 1.0f / 60.0f; // Fixed 60 FPS time step
-            g_offlineTime += deltaTime;
-            
-            // Sync audio file playback position and extract audio for recording
-            if (g_audioSystem.GetCurrentAudioSource() == AudioSystem::AudioSource::AudioFile && g_audioSystem.IsAudioFileLoaded()) {
-                // Ensure real-time playback is stopped to prevent conflict
-                g_audioSystem.StopActiveDevice(); 
+            deltaTime = (float)((double)g_recordingFpsDen / g_recordingFpsNum); // Fixed time step
+            // Derived from the frame number rather than accumulated, so long renders don't drift.
+            g_offlineTime = (float)((double)g_offlineFrameIndex * g_recordingFpsDen / g_recordingFpsNum);
 
-                float duration = g_audioSystem.GetPlaybackDuration();
-                if (duration > 0.0f) {
-                    g_audioSystem.SetPlaybackProgress(g_offlineTime / duration);
-                }
-
-                // Manually extract audio samples for this frame
-                int sampleRate = g_audioSystem.GetCurrentInputSampleRate();
-                int channels = g_audioSystem.GetCurrentInputChannels();
-                int samplesNeeded = (int)((float)sampleRate * deltaTime);
-                
-                // Buffer to hold interleaved samples
-                std::vector<float> audioBuffer(samplesNeeded * channels);
-                ma_uint64 framesRead = g_audioSystem.ReadOfflineAudio(audioBuffer.data(), samplesNeeded);
-                
+            // Extract exactly this frame's audio for recording; the frame's analysis comes from the
+            // pre-analysed track, and the decoder is read sequentially without seeking.
+            if (g_audioSystem.GetCurrentAudioSource() == AudioSystem::AudioSource::AudioFile && g_audioSystem.IsAudioFileLoaded()) {
+                static std::vector<float> audioBuffer;
+                ma_uint64 framesRead = g_audioSystem.ReadOfflineFrame(g_offlineFrameIndex, audioBuffer);
                 if (framesRead > 0) {
                     g_videoRecorder.add_audio_frame(audioBuffer.data(), framesRead);
+                    for (VideoRecorder& recorder : g_extraRecorders) recorder.add_audio_frame(audioBuffer.data(), framesRead);
                 }
             }
+            g_offlineFrameIndex++;
+        } else if (g_audioSystem.IsOfflineAnalysisActive()) {
+            g_audioSystem.EndOfflineAnalysis();
         }
 
         // --- Hot-reloading Check (every second) ---
@@ -1853,6 +2624,9 @@ int main(int argc, char** argv) {
         std::vector<Effect*> renderQueue = GetRenderOrder(activeEffects);
         float audioAmp = g_enableAudioLink ? g_audioSystem.GetCurrentAmplitude() : 0.0f;
         const auto& audioBands = g_audioSystem.GetAudioBands();
+        float beat = g_enableAudioLink ? g_audioSystem.GetBeatImpulse() : 0.0f;
+        float beatPhase = g_enableAudioLink ? g_audioSystem.GetBeatPhase() : 0.0f;
+        float bpm = g_enableAudioLink ? g_audioSystem.GetBPM() : 0.0f;
 
         // Spherical to Cartesian conversion for camera position
         glm::vec3 cameraPos;
@@ -1880,9 +2654,13 @@ int main(int argc, char** argv) {
                 se->IncrementFrameCount();
                 se->SetAudioAmplitude(audioAmp);
                 se->SetAudioBands(audioBands);
+                se->SetBeatState(beat, beatPhase, bpm);
                 se->SetCameraState(cameraPos, cameraMatrix);
                 se->SetLightPosition(lightPos);
             }
+            if (auto* preset = dynamic_cast<MilkdropPresetEffect*>(effect_ptr)) {
+                preset->SetSpectrum(g_audioSystem.GetFFTData());
+            }
             effect_ptr->Update(currentTimeForEffects); 
             effect_ptr->Render();
         }
@@ -1906,6 +2684,8 @@ int main(int argc, char** argv) {
             if (g_showAudioWindow) RenderAudioReactivityWindow();
             if (g_showShadertoyWindow) RenderShadertoyWindow();
             if (g_showFpsMeter) RenderFpsMeter();
+            if (g_showRecorderTelemetry) RenderRecorderTelemetryWindow();
+            if (g_showPresetLibrary) RenderPresetLibraryWindow();
             RenderCameraHelpText();
         }
 
@@ -1938,9 +2718,10 @@ int main(int argc, char** argv) {
             }
         }
 
+        GLuint finalTextureID = 0;
         if (finalOutputEffect) {
             checkGLError("Before Final RenderFullscreenTexture");
-            GLuint finalTextureID = finalOutputEffect->GetOutputTexture();
+            finalTextureID = finalOutputEffect->GetOutputTexture();
             
             g_renderer.RenderFullscreenTexture(finalTextureID);
             checkGLError("After Final RenderFullscreenTexture");
@@ -1952,8 +2733,14 @@ int main(int argc, char** argv) {
         }
 
         if (g_videoRecorder.is_recording()) {
-            g_videoRecorder.add_video_frame_from_pbo(deltaTime);
+            g_videoRecorder.add_video_frame_from_pbo(deltaTime, finalTextureID);
+            for (VideoRecorder& recorder : g_extraRecorders) {
+                if (recorder.is_recording()) recorder.add_video_frame_from_pbo(deltaTime, finalTextureID);
+            }
         }
+        LogRecorderTelemetry();
+        FinishStoppedRecording();
+        StartPendingOfflineRender();
 
         glDisable(GL_BLEND);
         checkGLError("After Disabling Blend, Before ImGui Render");
@@ -1964,6 +2751,7 @@ int main(int argc, char** argv) {
     }
 
     g_scene.clear();
+    g_presetLibrary.Cancel();
     g_audioSystem.Shutdown();
     ImGui_ImplOpenGL3_Shutdown();
     ImGui_ImplGlfw_Shutdown();
@@ -1987,21 +2775,11 @@ void processInput(GLFWwindow *window) {
     if (glfwGetKey(window, GLFW_KEY_F1) == GLFW_PRESS) {
         if (!f1_pressed) {
             if (g_videoRecorder.is_recording()) {
-                g_videoRecorder.stop_recording();
-            } else {
-                int fb_width, fb_height;
-                glfwGetFramebufferSize(window, &fb_width, &fb_height);
-                fb_width &= ~1;
-                fb_height &= ~1;
-                g_videoRecorder.start_recording("output.mp4", fb_width, fb_height, 60, "mp4", true, g_audioSystem.GetCurrentInputSampleRate(), g_audioSystem.GetCurrentInputChannels(), g_offlineRendering, static_cast<VideoRecorder::VideoQuality>(g_videoQuality), static_cast<VideoRecorder::AudioBitrate>(g_audioBitrate));
-                if (g_offlineRendering) {
-                    g_offlineTime = g_timelineState.currentTime_seconds;
-                     if (g_audioSystem.GetCurrentAudioSource() == AudioSystem::AudioSource::AudioFile) {
-                        g_audioSystem.Pause();
-                        g_audioSystem.SetPlaybackProgress(g_offlineTime / g_audioSystem.GetPlaybackDuration());
-                    }
-                }
-                g_recordingStartTime = std::chrono::steady_clock::now();
+                StopRecording();
+            } else if (g_offlineRenderPending) {
+                CancelPendingOfflineRender();
+            } else if (!IsRecordingFinalizing()) {
+                StartRecording("output.mp4", "mp4", true);
             }
             f1_pressed = true;
         }
@@ -2025,10 +2803,9 @@ void processInput(GLFWwindow *window) {
 void framebuffer_size_callback(GLFWwindow* window, int width, int height) {
     (void)window;
     glViewport(0, 0, width, height);
-    for (const auto& effect_ptr : g_scene) {
-        if (auto* se = dynamic_cast<ShaderEffect*>(effect_ptr.get())) {
-            se->ResizeFrameBuffer(width, height);
-        }
+    // While recording, the scene stays at the output size; StopRecording picks up the new size.
+    if (!g_videoRecorder.is_recording()) {
+        ResizeSceneFramebuffers(width, height);
     }
 }
 void mouse_cursor_position_callback(GLFWwindow* window, double xpos, double ypos) {
@@ -2228,7 +3005,7 @@ std::vector<Effect*> GetRenderOrder(const std::vector<Effect*>& activeEffects) {
 
         for (int i = 0; i < count; i++) {
             std::filesystem::path p = paths[i];
-            if (p.extension() == ".frag") {
+            if (p.extension() == ".frag" || p.extension() == ".milk") {
                 try {
                     // Validate file exists
                     if (!std::filesystem::exists(p)) {
@@ -2328,6 +3105,8 @@ void LoadScene(const std::string& filePath) {
 
             if (type == "ShaderEffect") {
                 newEffect = std::make_unique<ShaderEffect>("", SCR_WIDTH, SCR_HEIGHT);
+            } else if (type == "MilkdropPresetEffect") {
+                newEffect = std::make_unique<MilkdropPresetEffect>("", SCR_WIDTH, SCR_HEIGHT);
             } else if (type == "OutputNode") {
                 newEffect = std::make_unique<OutputNode>();
             }